@@ -0,0 +1,606 @@
+#include "array.h"
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ARRAY_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#define ARRAY_X86 0
+#endif
+
+// GCC and Clang only emit SSE/AVX instructions in functions that ask for them,
+// so the rest of the program keeps the baseline instruction set
+#if defined(__GNUC__) || defined(__clang__)
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define SSE2_TARGET
+#define AVX2_TARGET
+#endif
+
+// One implementation of every kernel; levels without a dedicated kernel reuse a slower one
+typedef struct ArrayKernels {
+	int (*sum_int)(const int* data, int count);
+	float (*sum_float)(const float* data, int count);
+	int (*min_int)(const int* data, int count);
+	int (*max_int)(const int* data, int count);
+	float (*min_float)(const float* data, int count);
+	float (*max_float)(const float* data, int count);
+	int (*dot_int)(const int* left, const int* right, int count);
+	float (*dot_float)(const float* left, const float* right, int count);
+	void (*scale_int)(int* data, int count, int factor);
+	void (*scale_float)(float* data, int count, float factor);
+	void (*fill_int)(int* data, int count, int value);
+	void (*fill_float)(float* data, int count, float value);
+} ArrayKernels;
+
+static const char* builtin_names[] = { "", "len", "resize", "sum", "min", "max", "scale", "dot", "fill", "copy", "contains", "remove",
+	"compare", "concat", "substring", "find", "lower", "upper" };
+static const int builtin_parameter_counts[] = { 0, 1, 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1 };
+
+BuiltinFunction find_builtin(const char* name) {
+	for (int i = BUILTIN_LEN; i <= BUILTIN_UPPER; i++) {
+		if (strcmp(builtin_names[i], name) == 0) {
+			return (BuiltinFunction)i;
+		}
+	}
+	return BUILTIN_NONE;
+}
+
+int builtin_parameter_count(BuiltinFunction builtin) {
+	return builtin_parameter_counts[builtin];
+}
+
+// ints and floats are both 4 bytes, so one allocator serves both element types
+static void* allocate_elements(int count) {
+	return memory_alloc_aligned(MEMORY_ARRAYS, sizeof(int) * (size_t)(count > 0 ? count : 1), ARRAY_ALIGNMENT);
+}
+
+static void free_elements(void* data) {
+	memory_free(data);
+}
+
+Array* array_create(ValueType element_type, int length, int fixed) {
+	if (length < 0) {
+		script_error("Negative array length %d", length);
+	}
+	Array* array = (Array*)memory_alloc(MEMORY_ARRAYS, sizeof(Array));
+	if (!array) {
+		printf("Error: Memory allocation failed for array.\n");
+		exit(1);
+	}
+	array->element_type = element_type;
+	array->length = length;
+	array->capacity = length;
+	array->fixed = fixed;
+	array->data = allocate_elements(length);
+	array->borrowed = 0;
+	memset(array->data, 0, sizeof(int) * (size_t)length);  // All-zero bits are 0 and 0.0f
+	return array;
+}
+
+Array* array_wrap(ValueType element_type, int length, void* data) {
+	Array* array = (Array*)memory_alloc(MEMORY_ARRAYS, sizeof(Array));
+	if (!array) {
+		printf("Error: Memory allocation failed for array.\n");
+		exit(1);
+	}
+	array->element_type = element_type;
+	array->length = length;
+	array->capacity = length;
+	array->fixed = 1;
+	array->data = data;
+	array->borrowed = 1;
+	return array;
+}
+
+void array_free(Array* array) {
+	if (array == NULL) return;
+	if (!array->borrowed) free_elements(array->data);
+	memory_free(array);
+}
+
+void array_resize(Array* array, int length) {
+	if (array->fixed) {
+		script_error("Cannot resize a fixed-length array");
+	}
+	if (length < 0) {
+		script_error("Negative array length %d", length);
+	}
+	if (length > array->capacity) {
+		// Grow geometrically so repeated resizes stay amortized O(1)
+		int capacity = array->capacity > 0 ? array->capacity : 8;
+		while (capacity < length) capacity *= 2;
+		void* data = allocate_elements(capacity);
+		memcpy(data, array->data, sizeof(int) * (size_t)array->length);
+		free_elements(array->data);
+		array->data = data;
+		array->capacity = capacity;
+	}
+	if (length > array->length) {
+		memset((int*)array->data + array->length, 0, sizeof(int) * (size_t)(length - array->length));
+	}
+	array->length = length;
+}
+
+void array_reset(Array* array) {
+	if (array->fixed) {
+		memset(array->data, 0, sizeof(int) * (size_t)array->length);
+	}
+	else {
+		array->length = 0;  // Keeps the capacity for the next iteration
+	}
+}
+
+// ---- Scalar kernels ----------------------------------------------------------
+// Reductions keep eight partial results, exactly like one AVX register (or two
+// SSE registers), and combine them in the same order as the vector kernels.
+
+static float reduce_lanes_float(const float* lanes) {
+	return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+static int sum_int_scalar(const int* data, int count) {
+	unsigned total = 0;  // Unsigned arithmetic wraps like the vector adds
+	for (int i = 0; i < count; i++) total += (unsigned)data[i];
+	return (int)total;
+}
+
+static float sum_float_scalar(const float* data, int count) {
+	float lanes[8] = { 0 };
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		for (int lane = 0; lane < 8; lane++) lanes[lane] += data[i + lane];
+	}
+	float total = reduce_lanes_float(lanes);
+	for (; i < count; i++) total += data[i];
+	return total;
+}
+
+static int min_int_scalar(const int* data, int count) {
+	int result = data[0];
+	for (int i = 1; i < count; i++) if (data[i] < result) result = data[i];
+	return result;
+}
+
+static int max_int_scalar(const int* data, int count) {
+	int result = data[0];
+	for (int i = 1; i < count; i++) if (data[i] > result) result = data[i];
+	return result;
+}
+
+static float min_float_scalar(const float* data, int count) {
+	float result = data[0];
+	for (int i = 1; i < count; i++) if (data[i] < result) result = data[i];
+	return result;
+}
+
+static float max_float_scalar(const float* data, int count) {
+	float result = data[0];
+	for (int i = 1; i < count; i++) if (data[i] > result) result = data[i];
+	return result;
+}
+
+static int dot_int_scalar(const int* left, const int* right, int count) {
+	unsigned total = 0;
+	for (int i = 0; i < count; i++) total += (unsigned)left[i] * (unsigned)right[i];
+	return (int)total;
+}
+
+static float dot_float_scalar(const float* left, const float* right, int count) {
+	float lanes[8] = { 0 };
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		for (int lane = 0; lane < 8; lane++) {
+			float product = left[i + lane] * right[i + lane];
+			lanes[lane] += product;
+		}
+	}
+	float total = reduce_lanes_float(lanes);
+	for (; i < count; i++) {
+		float product = left[i] * right[i];
+		total += product;
+	}
+	return total;
+}
+
+static void scale_int_scalar(int* data, int count, int factor) {
+	for (int i = 0; i < count; i++) data[i] = (int)((unsigned)data[i] * (unsigned)factor);
+}
+
+static void scale_float_scalar(float* data, int count, float factor) {
+	for (int i = 0; i < count; i++) data[i] *= factor;
+}
+
+static void fill_int_scalar(int* data, int count, int value) {
+	for (int i = 0; i < count; i++) data[i] = value;
+}
+
+static void fill_float_scalar(float* data, int count, float value) {
+	for (int i = 0; i < count; i++) data[i] = value;
+}
+
+static const ArrayKernels scalar_kernels = {
+	sum_int_scalar, sum_float_scalar,
+	min_int_scalar, max_int_scalar, min_float_scalar, max_float_scalar,
+	dot_int_scalar, dot_float_scalar,
+	scale_int_scalar, scale_float_scalar,
+	fill_int_scalar, fill_float_scalar,
+};
+
+#if ARRAY_X86
+
+// ---- SSE2 kernels ------------------------------------------------------------
+// SSE2 has no 32-bit integer min/max or multiply, those stay scalar
+
+SSE2_TARGET static int sum_int_sse2(const int* data, int count) {
+	__m128i low = _mm_setzero_si128();
+	__m128i high = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		low = _mm_add_epi32(low, _mm_loadu_si128((const __m128i*)(data + i)));
+		high = _mm_add_epi32(high, _mm_loadu_si128((const __m128i*)(data + i + 4)));
+	}
+	int lanes[8];
+	_mm_storeu_si128((__m128i*)lanes, low);
+	_mm_storeu_si128((__m128i*)(lanes + 4), high);
+	return (int)((unsigned)sum_int_scalar(lanes, 8) + (unsigned)sum_int_scalar(data + i, count - i));
+}
+
+SSE2_TARGET static float sum_float_sse2(const float* data, int count) {
+	__m128 low = _mm_setzero_ps();
+	__m128 high = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		low = _mm_add_ps(low, _mm_loadu_ps(data + i));
+		high = _mm_add_ps(high, _mm_loadu_ps(data + i + 4));
+	}
+	float lanes[8];
+	_mm_storeu_ps(lanes, low);
+	_mm_storeu_ps(lanes + 4, high);
+	float total = reduce_lanes_float(lanes);
+	for (; i < count; i++) total += data[i];
+	return total;
+}
+
+SSE2_TARGET static float min_float_sse2(const float* data, int count) {
+	if (count < 4) return min_float_scalar(data, count);
+	__m128 result = _mm_loadu_ps(data);
+	int i = 4;
+	for (; i + 4 <= count; i += 4) result = _mm_min_ps(result, _mm_loadu_ps(data + i));
+	float lanes[4];
+	_mm_storeu_ps(lanes, result);
+	float minimum = min_float_scalar(lanes, 4);
+	for (; i < count; i++) if (data[i] < minimum) minimum = data[i];
+	return minimum;
+}
+
+SSE2_TARGET static float max_float_sse2(const float* data, int count) {
+	if (count < 4) return max_float_scalar(data, count);
+	__m128 result = _mm_loadu_ps(data);
+	int i = 4;
+	for (; i + 4 <= count; i += 4) result = _mm_max_ps(result, _mm_loadu_ps(data + i));
+	float lanes[4];
+	_mm_storeu_ps(lanes, result);
+	float maximum = max_float_scalar(lanes, 4);
+	for (; i < count; i++) if (data[i] > maximum) maximum = data[i];
+	return maximum;
+}
+
+SSE2_TARGET static float dot_float_sse2(const float* left, const float* right, int count) {
+	__m128 low = _mm_setzero_ps();
+	__m128 high = _mm_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(left + i), _mm_loadu_ps(right + i)));
+		high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(left + i + 4), _mm_loadu_ps(right + i + 4)));
+	}
+	float lanes[8];
+	_mm_storeu_ps(lanes, low);
+	_mm_storeu_ps(lanes + 4, high);
+	float total = reduce_lanes_float(lanes);
+	for (; i < count; i++) {
+		float product = left[i] * right[i];
+		total += product;
+	}
+	return total;
+}
+
+SSE2_TARGET static void scale_float_sse2(float* data, int count, float factor) {
+	__m128 scale = _mm_set1_ps(factor);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), scale));
+	for (; i < count; i++) data[i] *= factor;
+}
+
+SSE2_TARGET static void fill_int_sse2(int* data, int count, int value) {
+	__m128i fill = _mm_set1_epi32(value);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm_storeu_si128((__m128i*)(data + i), fill);
+	for (; i < count; i++) data[i] = value;
+}
+
+SSE2_TARGET static void fill_float_sse2(float* data, int count, float value) {
+	__m128 fill = _mm_set1_ps(value);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(data + i, fill);
+	for (; i < count; i++) data[i] = value;
+}
+
+static const ArrayKernels sse2_kernels = {
+	sum_int_sse2, sum_float_sse2,
+	min_int_scalar, max_int_scalar, min_float_sse2, max_float_sse2,
+	dot_int_scalar, dot_float_sse2,
+	scale_int_scalar, scale_float_sse2,
+	fill_int_sse2, fill_float_sse2,
+};
+
+// ---- AVX2 kernels ------------------------------------------------------------
+
+AVX2_TARGET static int sum_int_avx2(const int* data, int count) {
+	__m256i total = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) total = _mm256_add_epi32(total, _mm256_loadu_si256((const __m256i*)(data + i)));
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, total);
+	return (int)((unsigned)sum_int_scalar(lanes, 8) + (unsigned)sum_int_scalar(data + i, count - i));
+}
+
+AVX2_TARGET static float sum_float_avx2(const float* data, int count) {
+	__m256 total = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) total = _mm256_add_ps(total, _mm256_loadu_ps(data + i));
+	float lanes[8];
+	_mm256_storeu_ps(lanes, total);
+	float result = reduce_lanes_float(lanes);
+	for (; i < count; i++) result += data[i];
+	return result;
+}
+
+AVX2_TARGET static int min_int_avx2(const int* data, int count) {
+	if (count < 8) return min_int_scalar(data, count);
+	__m256i result = _mm256_loadu_si256((const __m256i*)data);
+	int i = 8;
+	for (; i + 8 <= count; i += 8) result = _mm256_min_epi32(result, _mm256_loadu_si256((const __m256i*)(data + i)));
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, result);
+	int minimum = min_int_scalar(lanes, 8);
+	for (; i < count; i++) if (data[i] < minimum) minimum = data[i];
+	return minimum;
+}
+
+AVX2_TARGET static int max_int_avx2(const int* data, int count) {
+	if (count < 8) return max_int_scalar(data, count);
+	__m256i result = _mm256_loadu_si256((const __m256i*)data);
+	int i = 8;
+	for (; i + 8 <= count; i += 8) result = _mm256_max_epi32(result, _mm256_loadu_si256((const __m256i*)(data + i)));
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, result);
+	int maximum = max_int_scalar(lanes, 8);
+	for (; i < count; i++) if (data[i] > maximum) maximum = data[i];
+	return maximum;
+}
+
+AVX2_TARGET static float min_float_avx2(const float* data, int count) {
+	if (count < 8) return min_float_scalar(data, count);
+	__m256 result = _mm256_loadu_ps(data);
+	int i = 8;
+	for (; i + 8 <= count; i += 8) result = _mm256_min_ps(result, _mm256_loadu_ps(data + i));
+	float lanes[8];
+	_mm256_storeu_ps(lanes, result);
+	float minimum = min_float_scalar(lanes, 8);
+	for (; i < count; i++) if (data[i] < minimum) minimum = data[i];
+	return minimum;
+}
+
+AVX2_TARGET static float max_float_avx2(const float* data, int count) {
+	if (count < 8) return max_float_scalar(data, count);
+	__m256 result = _mm256_loadu_ps(data);
+	int i = 8;
+	for (; i + 8 <= count; i += 8) result = _mm256_max_ps(result, _mm256_loadu_ps(data + i));
+	float lanes[8];
+	_mm256_storeu_ps(lanes, result);
+	float maximum = max_float_scalar(lanes, 8);
+	for (; i < count; i++) if (data[i] > maximum) maximum = data[i];
+	return maximum;
+}
+
+AVX2_TARGET static int dot_int_avx2(const int* left, const int* right, int count) {
+	__m256i total = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i product = _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i*)(left + i)), _mm256_loadu_si256((const __m256i*)(right + i)));
+		total = _mm256_add_epi32(total, product);
+	}
+	int lanes[8];
+	_mm256_storeu_si256((__m256i*)lanes, total);
+	return (int)((unsigned)sum_int_scalar(lanes, 8) + (unsigned)dot_int_scalar(left + i, right + i, count - i));
+}
+
+AVX2_TARGET static float dot_float_avx2(const float* left, const float* right, int count) {
+	__m256 total = _mm256_setzero_ps();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		total = _mm256_add_ps(total, _mm256_mul_ps(_mm256_loadu_ps(left + i), _mm256_loadu_ps(right + i)));
+	}
+	float lanes[8];
+	_mm256_storeu_ps(lanes, total);
+	float result = reduce_lanes_float(lanes);
+	for (; i < count; i++) {
+		float product = left[i] * right[i];
+		result += product;
+	}
+	return result;
+}
+
+AVX2_TARGET static void scale_int_avx2(int* data, int count, int factor) {
+	__m256i scale = _mm256_set1_epi32(factor);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i* chunk = (__m256i*)(data + i);
+		_mm256_storeu_si256(chunk, _mm256_mullo_epi32(_mm256_loadu_si256(chunk), scale));
+	}
+	scale_int_scalar(data + i, count - i, factor);
+}
+
+AVX2_TARGET static void scale_float_avx2(float* data, int count, float factor) {
+	__m256 scale = _mm256_set1_ps(factor);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), scale));
+	for (; i < count; i++) data[i] *= factor;
+}
+
+AVX2_TARGET static void fill_int_avx2(int* data, int count, int value) {
+	__m256i fill = _mm256_set1_epi32(value);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) _mm256_storeu_si256((__m256i*)(data + i), fill);
+	for (; i < count; i++) data[i] = value;
+}
+
+AVX2_TARGET static void fill_float_avx2(float* data, int count, float value) {
+	__m256 fill = _mm256_set1_ps(value);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) _mm256_storeu_ps(data + i, fill);
+	for (; i < count; i++) data[i] = value;
+}
+
+static const ArrayKernels avx2_kernels = {
+	sum_int_avx2, sum_float_avx2,
+	min_int_avx2, max_int_avx2, min_float_avx2, max_float_avx2,
+	dot_int_avx2, dot_float_avx2,
+	scale_int_avx2, scale_float_avx2,
+	fill_int_avx2, fill_float_avx2,
+};
+
+static SimdLevel detect_simd_level() {
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuid(registers, 0);
+	int max_leaf = registers[0];
+	__cpuid(registers, 1);
+	int has_sse2 = (registers[3] >> 26) & 1;
+	int has_avx = ((registers[2] >> 28) & 1) && ((registers[2] >> 27) & 1);  // AVX and OSXSAVE
+	if (has_avx && max_leaf >= 7 && (_xgetbv(0) & 6) == 6) {
+		__cpuidex(registers, 7, 0);
+		if ((registers[1] >> 5) & 1) return SIMD_AVX2;
+	}
+	return has_sse2 ? SIMD_SSE2 : SIMD_SCALAR;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+	if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+	return SIMD_SCALAR;
+#endif
+}
+
+#else
+
+static SimdLevel detect_simd_level() {
+	return SIMD_SCALAR;
+}
+
+#endif
+
+// Detected once; racing threads all store the same answer
+static int simd_level = -1;
+
+SimdLevel array_simd_level() {
+	if (simd_level < 0) {
+		SimdLevel level = detect_simd_level();
+		const char* requested = getenv("VFSCRIPT_SIMD");
+		if (requested != NULL) {
+			if (strcmp(requested, "scalar") == 0) level = SIMD_SCALAR;
+			else if (strcmp(requested, "sse2") == 0 && level > SIMD_SSE2) level = SIMD_SSE2;
+		}
+		simd_level = (int)level;
+	}
+	return (SimdLevel)simd_level;
+}
+
+static const ArrayKernels* kernels() {
+#if ARRAY_X86
+	switch (array_simd_level()) {
+	case SIMD_AVX2: return &avx2_kernels;
+	case SIMD_SSE2: return &sse2_kernels;
+	default: break;
+	}
+#endif
+	return &scalar_kernels;
+}
+
+// ---- Builtins ----------------------------------------------------------------
+
+Value array_sum(const Array* array) {
+	if (array->element_type == VALUE_FLOAT) {
+		return make_float(kernels()->sum_float((const float*)array->data, array->length));
+	}
+	return make_int(kernels()->sum_int((const int*)array->data, array->length));
+}
+
+static void require_elements(const Array* array, const char* builtin) {
+	if (array->length == 0) {
+		script_error("%s() of an empty array", builtin);
+	}
+}
+
+Value array_min(const Array* array) {
+	require_elements(array, "min");
+	if (array->element_type == VALUE_FLOAT) {
+		return make_float(kernels()->min_float((const float*)array->data, array->length));
+	}
+	return make_int(kernels()->min_int((const int*)array->data, array->length));
+}
+
+Value array_max(const Array* array) {
+	require_elements(array, "max");
+	if (array->element_type == VALUE_FLOAT) {
+		return make_float(kernels()->max_float((const float*)array->data, array->length));
+	}
+	return make_int(kernels()->max_int((const int*)array->data, array->length));
+}
+
+Value array_dot(const Array* left, const Array* right) {
+	if (left->length != right->length) {
+		script_error("dot() of arrays of length %d and %d", left->length, right->length);
+	}
+	if (left->element_type == VALUE_FLOAT) {
+		return make_float(kernels()->dot_float((const float*)left->data, (const float*)right->data, left->length));
+	}
+	return make_int(kernels()->dot_int((const int*)left->data, (const int*)right->data, left->length));
+}
+
+void array_scale(Array* array, Value factor) {
+	if (array->element_type == VALUE_FLOAT) {
+		kernels()->scale_float((float*)array->data, array->length, value_to_float(factor));
+	}
+	else {
+		kernels()->scale_int((int*)array->data, array->length, value_to_int(factor));
+	}
+}
+
+void array_fill(Array* array, Value value) {
+	if (array->element_type == VALUE_FLOAT) {
+		kernels()->fill_float((float*)array->data, array->length, value_to_float(value));
+	}
+	else {
+		kernels()->fill_int((int*)array->data, array->length, value_to_int(value));
+	}
+}
+
+void array_copy(Array* destination, const Array* source) {
+	if (destination == source) return;
+	if (destination->fixed && destination->length != source->length) {
+		script_error("copy() of %d elements into a fixed array of length %d", source->length, destination->length);
+	}
+	if (!destination->fixed) {
+		array_resize(destination, source->length);
+	}
+	memcpy(destination->data, source->data, sizeof(int) * (size_t)source->length);
+}
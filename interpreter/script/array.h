@@ -0,0 +1,76 @@
+#pragma once
+#include "value.h"  // Include value.h for ValueType and Value
+
+// Element storage is aligned to one AVX register
+#define ARRAY_ALIGNMENT 32
+
+// Contiguous, unboxed storage behind an int[] or float[] field or local.
+// Fixed-length arrays (int[16]) are allocated once with their length;
+// variable-length arrays (float[]) start empty and grow with resize()/copy().
+typedef struct Array {
+	ValueType element_type;  // VALUE_INT or VALUE_FLOAT
+	int length;              // Number of elements in use
+	int capacity;            // Number of elements allocated
+	int fixed;               // Non-zero when declared with a length: can't be resized
+	void* data;              // ARRAY_ALIGNMENT-aligned elements
+	int borrowed;            // Non-zero when data belongs to someone else (see array_wrap): never freed or moved
+} Array;
+
+// Builtin functions of the language, callable like methods (a method of the
+// same name takes precedence). Most work on arrays, then come the ones on maps (see map.h)
+// and on strings (see text.h).
+typedef enum {
+	BUILTIN_NONE,
+	BUILTIN_LEN,     // len(a): number of elements
+	BUILTIN_RESIZE,  // resize(a, n): variable-length arrays only, new elements are zero
+	BUILTIN_SUM,     // sum(a)
+	BUILTIN_MIN,     // min(a): the array must not be empty
+	BUILTIN_MAX,     // max(a): the array must not be empty
+	BUILTIN_SCALE,   // scale(a, k): a[i] = a[i] * k
+	BUILTIN_DOT,     // dot(a, b): arrays of the same type and length
+	BUILTIN_FILL,    // fill(a, v): a[i] = v
+	BUILTIN_COPY,    // copy(dst, src): a variable-length dst takes src's length, a fixed one must match it
+	BUILTIN_CONTAINS,  // contains(m, key): whether a map has the key (len(m) counts its entries)
+	BUILTIN_REMOVE,    // remove(m, key): remove the key from a map, returning whether it was there
+	BUILTIN_COMPARE,   // compare(s, t): -1, 0 or 1 as s sorts before, equal to or after t (len(s) is its length)
+	BUILTIN_CONCAT,    // concat(s, t): same as s + t
+	BUILTIN_SUBSTRING, // substring(s, start, length): clamped to the string
+	BUILTIN_FIND,      // find(s, t): index of the first t in s, -1 if there is none
+	BUILTIN_LOWER,     // lower(s): ASCII letters in lower case
+	BUILTIN_UPPER,     // upper(s): ASCII letters in upper case
+} BuiltinFunction;
+
+// Kernel implementations, from slowest to fastest
+typedef enum {
+	SIMD_SCALAR,  // Portable C
+	SIMD_SSE2,    // 128-bit (x86 baseline on x64)
+	SIMD_AVX2,    // 256-bit, picked when the CPU and OS support it
+} SimdLevel;
+
+// Array functions
+Array* array_create(ValueType element_type, int length, int fixed);
+// Fixed-length array over storage the caller keeps alive (e.g. a mapped snapshot);
+// array_free leaves the storage alone
+Array* array_wrap(ValueType element_type, int length, void* data);
+void array_free(Array* array);
+void array_resize(Array* array, int length);
+// Reset an array for a re-executed declaration: zero a fixed array, empty a variable one
+void array_reset(Array* array);
+
+// Builtin functions
+BuiltinFunction find_builtin(const char* name);
+int builtin_parameter_count(BuiltinFunction builtin);
+
+// Vectorized kernels. Reductions use eight partial sums combined in a fixed
+// order, so every SimdLevel gives bit-identical results.
+Value array_sum(const Array* array);
+Value array_min(const Array* array);
+Value array_max(const Array* array);
+Value array_dot(const Array* left, const Array* right);
+void array_scale(Array* array, Value factor);
+void array_fill(Array* array, Value value);
+void array_copy(Array* destination, const Array* source);
+
+// Kernel level in use: the best one the CPU supports, capped by the
+// VFSCRIPT_SIMD environment variable ("scalar", "sse2" or "avx2")
+SimdLevel array_simd_level();
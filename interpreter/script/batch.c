@@ -0,0 +1,516 @@
+#include "batch.h"
+#include "context.h"
+#include "reload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lane-wise execution state of one chunk of instances. Every local slot owns
+// BATCH_LANES payloads (int or float by its declared type), so a statement
+// runs as a loop over the instances of the chunk.
+typedef struct BatchFrame {
+	Batch* batch;
+	Method* method;
+	int first;              // Instance in lane 0
+	int lanes;              // Instances in this chunk (the last one may be short)
+	int* locals;            // local_count * BATCH_LANES payloads
+	unsigned char* alive;   // Lanes that haven't returned yet
+	int* result;            // Return value payload of every lane
+} BatchFrame;
+
+Batch* batch_create(ClassNode* class_node, int count) {
+	// Columns are arrays of the class's context
+	Interpreter* previous = interpreter_enter(class_node->context);
+	Batch* batch = (Batch*)memory_alloc(MEMORY_RUNTIME, sizeof(Batch));
+	if (!batch) {
+		printf("Error: Memory allocation failed for Batch.\n");
+		exit(1);
+	}
+	batch->class_type = class_node;
+	batch->count = count;
+	batch->columns = (Array**)memory_alloc(MEMORY_ARRAYS, sizeof(Array*) * (class_node->field_count > 0 ? class_node->field_count : 1));
+	if (!batch->columns) {
+		printf("Error: Memory allocation failed for batch columns.\n");
+		exit(1);
+	}
+
+	int index = 0;
+	for (Field* field = class_node->fields; field != NULL; field = field->next) {
+		if (is_array_type(field->value.type)) {
+			printf("Error: Field %s of class %s is an array, batches store scalar fields only.\n", field->name, class_node->class_name);
+			exit(1);
+		}
+		if (is_map_type(field->value.type)) {
+			printf("Error: Field %s of class %s is a map, batches store scalar fields only.\n", field->name, class_node->class_name);
+			exit(1);
+		}
+		if (field->value.type == VALUE_OBJECT) {
+			printf("Error: Field %s of class %s is a reference, batches store scalar fields only.\n", field->name, class_node->class_name);
+			exit(1);
+		}
+		if (field->value.type == VALUE_STRING) {
+			printf("Error: Field %s of class %s is a string, batches store scalar fields only.\n", field->name, class_node->class_name);
+			exit(1);
+		}
+		batch->columns[index++] = array_create(field->value.type, count, 1);
+	}
+	class_retain(class_node);  // The batch's instances keep their version
+	interpreter_enter(previous);
+	return batch;
+}
+
+void batch_free(Batch* batch) {
+	if (batch == NULL) return;
+	for (int i = 0; i < batch->class_type->field_count; i++) {
+		array_free(batch->columns[i]);
+	}
+	ClassNode* class_node = batch->class_type;
+	memory_free(batch->columns);
+	memory_free(batch);
+	class_release(class_node);
+}
+
+Array* batch_column(Batch* batch, const char* field_name) {
+	int index = find_field(batch->class_type, field_name);
+	if (index < 0) {
+		printf("Error: Field %s not found in class %s\n", field_name, batch->class_type->class_name);
+		exit(1);
+	}
+	return batch->columns[index];
+}
+
+// Lane-wise execution only covers scalar assignments, ifs, loops and returns
+static int batch_expression_supported(ExpressionNode* expr) {
+	if (expr == NULL) return 1;
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+	case EXPR_VARIABLE:
+		return !is_array_type(expr->type) && !is_map_type(expr->type) && expr->type != VALUE_STRING;
+	case EXPR_BINARY_INT:
+	case EXPR_BINARY_FLOAT:
+		return batch_expression_supported(expr_child(expr, expr->left)) && batch_expression_supported(expr_child(expr, expr->right));
+	case EXPR_CONVERT:
+		return batch_expression_supported(expr_child(expr, expr->left));
+	case EXPR_ASSIGN:
+		return expr->left == EXPR_NONE && batch_expression_supported(expr_child(expr, expr->assigned));
+	default:
+		return 0;  // Calls, builtins and array elements
+	}
+}
+
+static int batch_block_supported(BlockNode* block) {
+	for (; block != NULL; block = block->next) {
+		switch (block->node_type) {
+		case NODE_IF:
+			if (!batch_expression_supported(block->ifNode->condition) ||
+				!batch_block_supported(block->ifNode->trueBlock) ||
+				!batch_block_supported(block->ifNode->falseBlock)) return 0;
+			break;
+		case NODE_FOR:
+			if (!batch_expression_supported(block->forNode->initializer) ||
+				!batch_expression_supported(block->forNode->condition) ||
+				!batch_block_supported(block->forNode->body)) return 0;
+			break;
+		case NODE_ASSIGNMENT:
+		case NODE_EXPRESSION:
+		case NODE_RETURN:
+			if (!batch_expression_supported(block->expression)) return 0;
+			break;
+		case NODE_DECLARATION: {
+			ExpressionNode* declaration = block->expression;
+			if (is_array_type(declaration->type) || is_map_type(declaration->type) || !batch_expression_supported(expr_child(declaration, declaration->assigned))) return 0;
+			break;
+		}
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int any_lane(const unsigned char* mask, int lanes) {
+	for (int k = 0; k < lanes; k++) {
+		if (mask[k]) return 1;
+	}
+	return 0;
+}
+
+// Payloads of a variable: its local slot, or its column from the chunk's first instance
+static void* lane_address(ExpressionNode* variable, BatchFrame* frame) {
+	if (variable->slot >= 0) {
+		return frame->locals + variable->slot * BATCH_LANES;
+	}
+	return (int*)frame->batch->columns[variable->field]->data + frame->first;
+}
+
+static ValueType variable_type(ExpressionNode* variable, BatchFrame* frame) {
+	if (variable->slot >= 0) {
+		return frame->method->local_types[variable->slot];
+	}
+	return frame->batch->columns[variable->field]->element_type;
+}
+
+static const float* batch_float(ExpressionNode* expr, BatchFrame* frame, const unsigned char* mask, float* out);
+
+// Evaluate an int expression for every lane. Variables are returned in place;
+// anything else is computed into `out`. Only the division by zero check looks at
+// the mask: inactive lanes compute values nobody stores.
+static const int* batch_int(ExpressionNode* expr, BatchFrame* frame, const unsigned char* mask, int* out) {
+	int lanes = frame->lanes;
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+		for (int k = 0; k < lanes; k++) out[k] = expr->value.as.i;
+		return out;
+
+	case EXPR_VARIABLE:
+		return (const int*)lane_address(expr, frame);
+
+	case EXPR_BINARY_INT: {
+		int left_buffer[BATCH_LANES];
+		int right_buffer[BATCH_LANES];
+		const int* l = batch_int(expr_child(expr, expr->left), frame, mask, left_buffer);
+		const int* r = batch_int(expr_child(expr, expr->right), frame, mask, right_buffer);
+		switch (expr->op) {
+		case OP_ADD: for (int k = 0; k < lanes; k++) out[k] = l[k] + r[k]; break;
+		case OP_SUBTRACT: for (int k = 0; k < lanes; k++) out[k] = l[k] - r[k]; break;
+		case OP_MULTIPLY: for (int k = 0; k < lanes; k++) out[k] = l[k] * r[k]; break;
+		case OP_DIVIDE:
+			for (int k = 0; k < lanes; k++) {
+				if (mask[k] && r[k] == 0) {
+					script_error("Division by zero.");
+				}
+			}
+			for (int k = 0; k < lanes; k++) out[k] = l[k] / (mask[k] ? r[k] : 1);
+			break;
+		case OP_LESS: for (int k = 0; k < lanes; k++) out[k] = l[k] < r[k]; break;
+		case OP_GREATER: for (int k = 0; k < lanes; k++) out[k] = l[k] > r[k]; break;
+		case OP_LESS_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] <= r[k]; break;
+		case OP_GREATER_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] >= r[k]; break;
+		case OP_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] == r[k]; break;
+		case OP_NOT_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] != r[k]; break;
+		}
+		return out;
+	}
+
+	case EXPR_BINARY_FLOAT: {
+		// Only comparisons of floats produce an int
+		float left_buffer[BATCH_LANES];
+		float right_buffer[BATCH_LANES];
+		const float* l = batch_float(expr_child(expr, expr->left), frame, mask, left_buffer);
+		const float* r = batch_float(expr_child(expr, expr->right), frame, mask, right_buffer);
+		switch (expr->op) {
+		case OP_LESS: for (int k = 0; k < lanes; k++) out[k] = l[k] < r[k]; break;
+		case OP_GREATER: for (int k = 0; k < lanes; k++) out[k] = l[k] > r[k]; break;
+		case OP_LESS_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] <= r[k]; break;
+		case OP_GREATER_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] >= r[k]; break;
+		case OP_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] == r[k]; break;
+		case OP_NOT_EQUAL: for (int k = 0; k < lanes; k++) out[k] = l[k] != r[k]; break;
+		default:
+			printf("Error: Unsupported int expression.\n");
+			exit(1);
+		}
+		return out;
+	}
+
+	case EXPR_CONVERT: {
+		// Float to int truncates, as in C
+		float buffer[BATCH_LANES];
+		const float* operand = batch_float(expr_child(expr, expr->left), frame, mask, buffer);
+		for (int k = 0; k < lanes; k++) out[k] = (int)operand[k];
+		return out;
+	}
+
+	default:
+		break;
+	}
+
+	printf("Error: Unsupported int expression.\n");
+	exit(1);
+}
+
+static const float* batch_float(ExpressionNode* expr, BatchFrame* frame, const unsigned char* mask, float* out) {
+	int lanes = frame->lanes;
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+		for (int k = 0; k < lanes; k++) out[k] = expr->value.as.f;
+		return out;
+
+	case EXPR_VARIABLE:
+		return (const float*)lane_address(expr, frame);
+
+	case EXPR_BINARY_FLOAT: {
+		float left_buffer[BATCH_LANES];
+		float right_buffer[BATCH_LANES];
+		const float* l = batch_float(expr_child(expr, expr->left), frame, mask, left_buffer);
+		const float* r = batch_float(expr_child(expr, expr->right), frame, mask, right_buffer);
+		switch (expr->op) {
+		case OP_ADD: for (int k = 0; k < lanes; k++) out[k] = l[k] + r[k]; break;
+		case OP_SUBTRACT: for (int k = 0; k < lanes; k++) out[k] = l[k] - r[k]; break;
+		case OP_MULTIPLY: for (int k = 0; k < lanes; k++) out[k] = l[k] * r[k]; break;
+		case OP_DIVIDE: for (int k = 0; k < lanes; k++) out[k] = l[k] / r[k]; break;
+		default:
+			printf("Error: Unsupported float expression.\n");
+			exit(1);
+		}
+		return out;
+	}
+
+	case EXPR_CONVERT: {
+		int buffer[BATCH_LANES];
+		const int* operand = batch_int(expr_child(expr, expr->left), frame, mask, buffer);
+		for (int k = 0; k < lanes; k++) out[k] = (float)operand[k];
+		return out;
+	}
+
+	default:
+		break;
+	}
+
+	printf("Error: Unsupported float expression.\n");
+	exit(1);
+}
+
+// Evaluate `value` and store it into `destination` in the lanes of the mask
+static void batch_store(void* destination, ValueType type, ExpressionNode* value, BatchFrame* frame, const unsigned char* mask) {
+	int lanes = frame->lanes;
+	if (type == VALUE_FLOAT) {
+		float buffer[BATCH_LANES];
+		const float* source = batch_float(value, frame, mask, buffer);
+		float* target = (float*)destination;
+		for (int k = 0; k < lanes; k++) target[k] = mask[k] ? source[k] : target[k];
+	}
+	else {
+		int buffer[BATCH_LANES];
+		const int* source = batch_int(value, frame, mask, buffer);
+		int* target = (int*)destination;
+		for (int k = 0; k < lanes; k++) target[k] = mask[k] ? source[k] : target[k];
+	}
+}
+
+static void batch_expression(ExpressionNode* expr, BatchFrame* frame, const unsigned char* mask) {
+	if (expr->kind == EXPR_ASSIGN) {
+		batch_store(lane_address(expr, frame), variable_type(expr, frame), expr_child(expr, expr->assigned), frame, mask);
+	}
+	else if (expr->type == VALUE_FLOAT) {
+		float buffer[BATCH_LANES];
+		batch_float(expr, frame, mask, buffer);  // Evaluated for its errors only
+	}
+	else {
+		int buffer[BATCH_LANES];
+		batch_int(expr, frame, mask, buffer);
+	}
+}
+
+// Lanes that returned inside a statement drop out of the enclosing mask
+static void retire_returned_lanes(BatchFrame* frame, unsigned char* mask) {
+	for (int k = 0; k < frame->lanes; k++) mask[k] &= frame->alive[k];
+}
+
+static void batch_block(BlockNode* block, BatchFrame* frame, unsigned char* mask);
+
+static void batch_if(IfNode* if_node, BatchFrame* frame, unsigned char* mask) {
+	int lanes = frame->lanes;
+	int buffer[BATCH_LANES];
+	const int* condition = batch_int(if_node->condition, frame, mask, buffer);
+
+	// Each branch runs on the lanes that take it
+	unsigned char branch_mask[BATCH_LANES];
+	for (int k = 0; k < lanes; k++) branch_mask[k] = mask[k] && condition[k];
+	if (any_lane(branch_mask, lanes)) {
+		batch_block(if_node->trueBlock, frame, branch_mask);
+	}
+	if (if_node->falseBlock) {
+		for (int k = 0; k < lanes; k++) branch_mask[k] = mask[k] && !condition[k];
+		if (any_lane(branch_mask, lanes)) {
+			batch_block(if_node->falseBlock, frame, branch_mask);
+		}
+	}
+	retire_returned_lanes(frame, mask);
+}
+
+// The loop keeps running while any lane's condition holds; the others sit it out
+static void batch_for(ForNode* for_node, BatchFrame* frame, unsigned char* mask) {
+	int lanes = frame->lanes;
+	ExpressionNode* initializer = for_node->initializer;
+	batch_store(lane_address(initializer, frame), frame->method->local_types[initializer->slot], expr_child(initializer, initializer->assigned), frame, mask);
+
+	ExpressionNode* update = for_node->update;
+	void* counter = lane_address(update, frame);
+	unsigned char loop_mask[BATCH_LANES];
+	unsigned char body_mask[BATCH_LANES];
+	memcpy(loop_mask, mask, lanes);
+	while (1) {
+		int buffer[BATCH_LANES];
+		const int* condition = batch_int(for_node->condition, frame, loop_mask, buffer);
+		for (int k = 0; k < lanes; k++) loop_mask[k] = loop_mask[k] && condition[k];
+		if (!any_lane(loop_mask, lanes)) break;
+
+		memcpy(body_mask, loop_mask, lanes);
+		batch_block(for_node->body, frame, body_mask);
+		retire_returned_lanes(frame, loop_mask);
+
+		// The step keeps the variable's type
+		if (update->type == VALUE_INT) {
+			int* target = (int*)counter;
+			for (int k = 0; k < lanes; k++) target[k] += loop_mask[k] ? update->value.as.i : 0;
+		}
+		else {
+			float* target = (float*)counter;
+			for (int k = 0; k < lanes; k++) target[k] += loop_mask[k] ? (float)update->value.as.i : 0.0f;
+		}
+	}
+	retire_returned_lanes(frame, mask);
+}
+
+// Execute a block on the lanes of `mask`, narrowing it as lanes return
+static void batch_block(BlockNode* block, BatchFrame* frame, unsigned char* mask) {
+	int lanes = frame->lanes;
+	for (BlockNode* current = block; current != NULL && any_lane(mask, lanes); current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			batch_if(current->ifNode, frame, mask);
+			break;
+		case NODE_FOR:
+			batch_for(current->forNode, frame, mask);
+			break;
+		case NODE_ASSIGNMENT:
+		case NODE_EXPRESSION:
+			batch_expression(current->expression, frame, mask);
+			break;
+		case NODE_DECLARATION: {
+			ExpressionNode* declaration = current->expression;
+			void* slot = lane_address(declaration, frame);
+			if (declaration->assigned != EXPR_NONE) {
+				batch_store(slot, declaration->type, expr_child(declaration, declaration->assigned), frame, mask);
+			}
+			else {
+				// Without an initializer the variable starts at zero of its type (all bits clear for int and float)
+				int* target = (int*)slot;
+				for (int k = 0; k < lanes; k++) target[k] = mask[k] ? 0 : target[k];
+			}
+			break;
+		}
+		case NODE_RETURN:
+			if (current->expression) {
+				batch_store(frame->result, frame->method->result_type, current->expression, frame, mask);
+			}
+			for (int k = 0; k < lanes; k++) frame->alive[k] &= !mask[k];
+			memset(mask, 0, lanes);
+			break;
+		default:
+			printf("Error: Unsupported node type in block.\n");
+			exit(1);
+		}
+	}
+}
+
+// Run the method on instances [first, first + lanes) with the lane-wise executor
+static void batch_chunk(BatchFrame* frame, const Value* args, int argument_count) {
+	Method* method = frame->method;
+	memset(frame->locals, 0, sizeof(int) * BATCH_LANES * (method->local_count > 0 ? method->local_count : 1));
+	memset(frame->result, 0, sizeof(int) * BATCH_LANES);
+	memset(frame->alive, 1, BATCH_LANES);
+
+	// The shared arguments are broadcast to every lane of their slots
+	for (int i = 0; i < argument_count; i++) {
+		Value argument = value_convert(args[i], method->local_types[i]);
+		int* slot = frame->locals + i * BATCH_LANES;
+		for (int k = 0; k < frame->lanes; k++) {
+			if (argument.type == VALUE_FLOAT) ((float*)slot)[k] = argument.as.f;
+			else slot[k] = argument.as.i;
+		}
+	}
+
+	unsigned char mask[BATCH_LANES];
+	memset(mask, 1, BATCH_LANES);
+	batch_block(method->body, frame, mask);
+}
+
+// Fallback: copy every instance into a scratch object, call the method and copy the fields back
+static void batch_call_each(Batch* batch, Method* method, const Value* args, int argument_count, void* results) {
+	ClassNode* class_node = batch->class_type;
+	int field_count = class_node->field_count;
+	Object* obj = create_object(class_node);
+	Field* fields = obj->field_values;  // In class order, like the columns
+
+	for (int instance = 0; instance < batch->count; instance++) {
+		for (int i = 0; i < field_count; i++) {
+			fields[i].value.as.i = ((int*)batch->columns[i]->data)[instance];  // Same payload size for int and float
+		}
+		Value result = call_method(obj, method->name, args, argument_count);
+		for (int i = 0; i < field_count; i++) {
+			((int*)batch->columns[i]->data)[instance] = fields[i].value.as.i;
+		}
+		if (results != NULL) {
+			if (method->result_type == VALUE_FLOAT) ((float*)results)[instance] = result.as.f;
+			else ((int*)results)[instance] = result.as.i;
+		}
+	}
+
+	free_object(obj);
+}
+
+void batch_call(Batch* batch, const char* method_name, const Value* args, int argument_count, void* results) {
+	// The method is looked up once for the whole batch
+	Method* method = find_method(batch->class_type, method_name);
+	if (method == NULL) {
+		printf("Error: Method %s not found in class %s\n", method_name, batch->class_type->class_name);
+		exit(1);
+	}
+	if (argument_count != method->parameter_count) {
+		printf("Error: Method %s expects %d arguments but got %d\n", method_name, method->parameter_count, argument_count);
+		exit(1);
+	}
+	if (method->result_type == VALUE_OBJECT || method->result_type == VALUE_STRING) {
+		printf("Error: Method %s returns %s, batch results are numbers.\n", method_name, value_kind_name(method->result_type));
+		exit(1);
+	}
+
+	// Scratch buffers are charged to the context of the batch's class
+	Interpreter* previous = interpreter_enter(batch->class_type->context);
+	int supported = batch_block_supported(method->body);
+	for (int i = 0; i < method->local_count; i++) {
+		if (is_array_type(method->local_types[i]) || is_map_type(method->local_types[i]) || method->local_types[i] == VALUE_OBJECT || method->local_types[i] == VALUE_STRING) supported = 0;
+	}
+	if (!supported) {
+		batch_call_each(batch, method, args, argument_count, results);
+		interpreter_enter(previous);
+		return;
+	}
+
+	BatchFrame frame;
+	frame.batch = batch;
+	frame.method = method;
+	frame.locals = (int*)memory_alloc(MEMORY_RUNTIME, sizeof(int) * BATCH_LANES * (method->local_count > 0 ? method->local_count : 1));
+	frame.alive = (unsigned char*)memory_alloc(MEMORY_RUNTIME, BATCH_LANES);
+	frame.result = (int*)memory_alloc(MEMORY_RUNTIME, sizeof(int) * BATCH_LANES);
+	if (!frame.locals || !frame.alive || !frame.result) {
+		printf("Error: Memory allocation failed for batch frame.\n");
+		exit(1);
+	}
+
+	// A division by zero in some lane mustn't leak the scratch buffers: free them, then pass the error on
+	ErrorTrap trap;
+	ErrorTrap* caller_trap = interpreter_trap_errors(&trap);
+	if (setjmp(trap.jump) != 0) {
+		interpreter_trap_errors(caller_trap);
+		memory_free(frame.locals);
+		memory_free(frame.alive);
+		memory_free(frame.result);
+		interpreter_enter(previous);
+		script_error("%s", trap.message);
+	}
+	for (frame.first = 0; frame.first < batch->count; frame.first += BATCH_LANES) {
+		frame.lanes = batch->count - frame.first < BATCH_LANES ? batch->count - frame.first : BATCH_LANES;
+		batch_chunk(&frame, args, argument_count);
+		if (results != NULL) {
+			memcpy((int*)results + frame.first, frame.result, sizeof(int) * frame.lanes);
+		}
+	}
+
+	interpreter_trap_errors(caller_trap);
+	memory_free(frame.locals);
+	memory_free(frame.alive);
+	memory_free(frame.result);
+	interpreter_enter(previous);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "parse.h"  // Include parse.h for ClassNode and Method
+
+// Number of instances a batch executes at once: every expression is evaluated
+// for this many instances before moving on to the next one
+#define BATCH_LANES 256
+
+// Many instances of one class stored column-wise (struct of arrays): field i of
+// instance k is element k of columns[i], so a field reads and writes contiguous memory.
+typedef struct Batch {
+	ClassNode* class_type;  // Class of every instance
+	int count;              // Number of instances
+	Array** columns;        // One fixed-length int or float column per field, in ClassNode::fields order
+} Batch;
+
+// Batch functions
+// Columns start at zero; array fields can't be stored column-wise and are rejected
+Batch* batch_create(ClassNode* class_node, int count);
+void batch_free(Batch* batch);
+// Column of a field, for the host to fill or read in bulk (element k belongs to instance k)
+Array* batch_column(Batch* batch, const char* field_name);
+
+// Run a method on every instance. The arguments are shared by all instances and
+// converted to the parameter types; `results` (int or float per instance, by the
+// method's result type) receives the return values and may be NULL.
+// Bodies made of assignments, ifs, loops and returns on scalars run BATCH_LANES
+// instances per statement with the instance loop innermost; anything else (calls,
+// arrays) falls back to executing the instances one by one.
+void batch_call(Batch* batch, const char* method_name, const Value* args, int argument_count, void* results);
@@ -0,0 +1,219 @@
+#include "cache.h"
+#include "context.h"
+#include "native.h"
+#include "reload.h"
+#include "table.h"
+#include "threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct CacheEntry {
+	unsigned int hash;         // Of the source and the options
+	int options;
+	char* source;              // Copy of the source, compared on lookup
+	ClassNode* class_node;     // NULL while the first lookup compiles it
+	int failed;                // That compile raised an error: the entry is unlinked and goes with its last waiter
+	int waiters;               // Lookups waiting for that compile (the entry can't be evicted under them)
+	struct CacheEntry* chain;  // Next entry of the bucket
+	struct CacheEntry* newer;  // Recency list, most recently used first
+	struct CacheEntry* older;
+} CacheEntry;
+
+struct ClassCache {
+	Mutex lock;             // Guards everything below
+	Condition compiled;     // Signaled whenever a compile finishes
+	Interpreter* context;   // Where the classes are parsed
+	CacheEntry** buckets;
+	int bucket_mask;        // Bucket count - 1 (a power of two)
+	CacheEntry* newest;
+	CacheEntry* oldest;
+	int capacity;
+	ClassCacheStats stats;
+};
+
+ClassCache* class_cache_create(int capacity) {
+	ClassCache* cache = (ClassCache*)calloc(1, sizeof(ClassCache));
+	if (!cache) {
+		printf("Error: Memory allocation failed for ClassCache.\n");
+		exit(1);
+	}
+	mutex_init(&cache->lock);
+	condition_init(&cache->compiled);
+	cache->context = interpreter_create(0);
+	cache->capacity = capacity > 0 ? capacity : 1;
+
+	// About two buckets per entry keeps the chains short
+	int bucket_count = 4;
+	while (bucket_count < cache->capacity * 2) bucket_count *= 2;
+	cache->buckets = (CacheEntry**)calloc(bucket_count, sizeof(CacheEntry*));
+	if (!cache->buckets) {
+		printf("Error: Memory allocation failed for ClassCache buckets.\n");
+		exit(1);
+	}
+	cache->bucket_mask = bucket_count - 1;
+	return cache;
+}
+
+static unsigned int hash_key(const char* source_text, int options) {
+	unsigned int hash = hash_name(source_text);
+	hash ^= (unsigned int)options;
+	hash *= 16777619u;  // FNV prime, as in hash_name
+	return hash;
+}
+
+static void unlink_recent(ClassCache* cache, CacheEntry* entry) {
+	if (entry->newer != NULL) entry->newer->older = entry->older;
+	else cache->newest = entry->older;
+	if (entry->older != NULL) entry->older->newer = entry->newer;
+	else cache->oldest = entry->newer;
+}
+
+static void push_recent(ClassCache* cache, CacheEntry* entry) {
+	entry->newer = NULL;
+	entry->older = cache->newest;
+	if (cache->newest != NULL) cache->newest->newer = entry;
+	else cache->oldest = entry;
+	cache->newest = entry;
+}
+
+static void unlink_entry(ClassCache* cache, CacheEntry* entry) {
+	CacheEntry** link = &cache->buckets[entry->hash & cache->bucket_mask];
+	while (*link != entry) link = &(*link)->chain;
+	*link = entry->chain;
+	unlink_recent(cache, entry);
+}
+
+// Drop an entry; the class itself goes once nothing holds it any more
+static void free_entry(ClassCache* cache, CacheEntry* entry) {
+	unlink_entry(cache, entry);
+	class_release(entry->class_node);
+	free(entry->source);
+	free(entry);
+	cache->stats.entries--;
+}
+
+// Evict least recently used classes until there is room (compiles in progress and
+// the entries lookups are waiting for stay)
+static void make_room(ClassCache* cache) {
+	CacheEntry* entry = cache->oldest;
+	while (cache->stats.entries >= cache->capacity && entry != NULL) {
+		CacheEntry* newer = entry->newer;
+		if (entry->class_node != NULL && entry->waiters == 0) {
+			free_entry(cache, entry);
+			cache->stats.evictions++;
+		}
+		entry = newer;
+	}
+}
+
+ClassNode* class_cache_get(ClassCache* cache, const char* source_text, int options) {
+	unsigned int hash = hash_key(source_text, options);
+	mutex_lock(&cache->lock);
+	CacheEntry* entry = cache->buckets[hash & cache->bucket_mask];
+	while (entry != NULL && (entry->hash != hash || entry->options != options || strcmp(entry->source, source_text) != 0)) {
+		entry = entry->chain;
+	}
+
+	if (entry != NULL) {
+		cache->stats.hits++;
+		if (entry->class_node == NULL) {
+			cache->stats.waits++;
+			entry->waiters++;
+			while (entry->class_node == NULL && !entry->failed) {
+				condition_wait(&cache->compiled, &cache->lock);
+			}
+			entry->waiters--;
+			if (entry->failed) {
+				// Compile it again, which reports the error to this caller too
+				if (entry->waiters == 0) {
+					free(entry->source);
+					free(entry);
+				}
+				mutex_unlock(&cache->lock);
+				return class_cache_get(cache, source_text, options);
+			}
+		}
+		unlink_recent(cache, entry);
+		push_recent(cache, entry);
+		ClassNode* class_node = entry->class_node;
+		class_retain(class_node);  // The caller's reference
+		mutex_unlock(&cache->lock);
+		return class_node;
+	}
+
+	// Miss: publish a placeholder so the same source isn't compiled twice
+	cache->stats.misses++;
+	make_room(cache);
+	entry = (CacheEntry*)calloc(1, sizeof(CacheEntry));
+	char* source = (char*)malloc(strlen(source_text) + 1);
+	if (!entry || !source) {
+		printf("Error: Memory allocation failed for a cache entry.\n");
+		exit(1);
+	}
+	strcpy(source, source_text);
+	entry->hash = hash;
+	entry->options = options;
+	entry->source = source;
+	entry->chain = cache->buckets[hash & cache->bucket_mask];
+	cache->buckets[hash & cache->bucket_mask] = entry;
+	push_recent(cache, entry);
+	cache->stats.entries++;
+	mutex_unlock(&cache->lock);
+
+	// A source that doesn't compile mustn't leave its placeholder behind: drop it,
+	// wake the lookups waiting for it, then pass the error on
+	ErrorTrap trap;
+	ErrorTrap* caller_trap = interpreter_trap_errors(&trap);
+	if (setjmp(trap.jump) != 0) {
+		interpreter_trap_errors(caller_trap);
+		mutex_lock(&cache->lock);
+		unlink_entry(cache, entry);
+		cache->stats.entries--;
+		entry->failed = 1;
+		if (entry->waiters == 0) {
+			free(entry->source);
+			free(entry);
+		}
+		condition_broadcast(&cache->compiled);
+		mutex_unlock(&cache->lock);
+		script_error("%s", trap.message);
+	}
+
+	// Compile outside the lock; the parse holds the cache's reference
+	ClassNode* class_node = interpreter_parse_class(cache->context, source);
+	if (options & COMPILE_NATIVE) {
+		compile_class_native(class_node, source);
+	}
+	interpreter_trap_errors(caller_trap);
+
+	mutex_lock(&cache->lock);
+	entry->class_node = class_node;
+	class_retain(class_node);  // The caller's reference
+	condition_broadcast(&cache->compiled);
+	mutex_unlock(&cache->lock);
+	return class_node;
+}
+
+void class_cache_release(ClassNode* class_node) {
+	class_release(class_node);
+}
+
+void class_cache_stats(ClassCache* cache, ClassCacheStats* stats) {
+	mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	mutex_unlock(&cache->lock);
+}
+
+void class_cache_destroy(ClassCache* cache) {
+	if (cache == NULL) return;
+	while (cache->oldest != NULL) {
+		free_entry(cache, cache->oldest);
+	}
+	reclaim_classes();
+	interpreter_destroy(cache->context);
+	free(cache->buckets);
+	condition_destroy(&cache->compiled);
+	mutex_destroy(&cache->lock);
+	free(cache);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "parse.h"  // Include parse.h for ClassNode
+
+// Compile options, part of the cache key
+#define COMPILE_INTERPRETED 0
+#define COMPILE_NATIVE 1  // Also run compile_class_native on the class
+
+// Compiled classes by source text, for hosts that submit the same scripts over and
+// over. The cache parses into a context of its own and keeps at most `capacity`
+// classes, evicting the least recently used one. A class is immutable once compiled,
+// so every thread and context may share it; its objects live in the cache's context.
+// Lookups are thread-safe, and concurrent lookups of a source being compiled wait
+// for that compile instead of starting their own.
+typedef struct ClassCache ClassCache;
+
+typedef struct ClassCacheStats {
+	size_t hits;       // Lookups answered from the cache
+	size_t waits;      // Hits that waited for another thread's compile of the same source
+	size_t misses;     // Lookups that compiled
+	size_t evictions;
+	int entries;       // Classes cached now
+} ClassCacheStats;
+
+// Cache functions
+ClassCache* class_cache_create(int capacity);
+// Every class handed out must be released and its objects freed first
+void class_cache_destroy(ClassCache* cache);
+// The class declared by the source (one class, without a base class), compiled with
+// `options` on a miss. The class stays valid until class_cache_release, even if it
+// is evicted meanwhile. A source that doesn't compile isn't cached: every lookup of
+// it raises the compile's script error.
+ClassNode* class_cache_get(ClassCache* cache, const char* source_text, int options);
+void class_cache_release(ClassNode* class_node);
+void class_cache_stats(ClassCache* cache, ClassCacheStats* stats);
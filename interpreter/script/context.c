@@ -0,0 +1,522 @@
+#include "context.h"
+#include "table.h"
+#include "reload.h"
+#include "threads.h"
+#include "gc.h"
+#include "text.h"
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Header in front of every block: links it into its context so the context can
+// release whatever is left, and remembers what to uncharge when it is freed
+typedef struct Allocation {
+	struct Allocation* prev;
+	struct Allocation* next;
+	Interpreter* owner;
+	size_t size;              // Bytes charged: header, padding and block
+	size_t offset;            // From the start of the malloc'd memory to the block
+	MemoryCategory category;
+} Allocation;
+
+// Rounded up so blocks keep malloc's alignment
+#define HEADER_SIZE ((sizeof(Allocation) + 15) & ~(size_t)15)
+
+struct Interpreter {
+	Mutex lock;                        // Guards the allocation list and the usage (calls may run on pool workers)
+	Allocation* allocations;           // Every live block
+	MemoryUsage usage;
+	MemoryLimitHandler limit_handler;
+	void* limit_data;
+	Mutex class_lock;                  // Guards the class registry (loads and lookups may run on any thread)
+	ClassNode** classes;               // Registered classes
+	int class_count;
+	int class_capacity;
+	NameTable class_names;             // Class name -> index in classes
+	Mutex name_lock;                   // Guards the interned names
+	NameTable names;                   // Interned identifiers, type and method names
+	NameTable literals;                // Text of string literals -> index in literal_strings
+	String** literal_strings;          // Permanent strings of the interned literals
+	int literal_capacity;
+	SymbolTable* symbols;              // Variables set with update_variable
+	Mutex heap_lock;                   // Guards the creation of the heap
+	GcHeap* volatile heap;             // Objects made by `new` (see gc.h), created on first use
+};
+
+// Context of everything not created in an explicit one; it is never destroyed
+static Interpreter default_interpreter = {
+	.lock = MUTEX_INITIALIZER,
+	.class_lock = MUTEX_INITIALIZER,
+	.class_names = { .category = MEMORY_RUNTIME },
+	.name_lock = MUTEX_INITIALIZER,
+	.names = { .category = MEMORY_STRINGS },
+	.literals = { .category = MEMORY_STRINGS },
+	.heap_lock = MUTEX_INITIALIZER,
+};
+
+// Context entered on this thread, NULL for the default one
+static THREAD_LOCAL Interpreter* entered_interpreter = NULL;
+// Where script errors on this thread go, NULL to exit
+static THREAD_LOCAL ErrorTrap* error_trap = NULL;
+// The first problem reported while the trap was set, appended to the error
+static THREAD_LOCAL char reported[256];
+
+Interpreter* interpreter_create(size_t memory_limit) {
+	Interpreter* interpreter = (Interpreter*)calloc(1, sizeof(Interpreter));
+	if (!interpreter) {
+		printf("Error: Memory allocation failed for Interpreter.\n");
+		exit(1);
+	}
+	mutex_init(&interpreter->lock);
+	interpreter->usage.limit = memory_limit;
+	mutex_init(&interpreter->class_lock);
+	name_table_init(&interpreter->class_names, MEMORY_RUNTIME);
+	mutex_init(&interpreter->name_lock);
+	name_table_init(&interpreter->names, MEMORY_STRINGS);
+	name_table_init(&interpreter->literals, MEMORY_STRINGS);
+	mutex_init(&interpreter->heap_lock);
+	return interpreter;
+}
+
+void interpreter_destroy(Interpreter* interpreter) {
+	if (interpreter == NULL) return;
+	if (interpreter == &default_interpreter) {
+		printf("Error: The default interpreter context cannot be destroyed.\n");
+		exit(1);
+	}
+	if (entered_interpreter == interpreter) {
+		entered_interpreter = NULL;
+	}
+	forget_retired_classes(interpreter);
+	if (interpreter->heap != NULL) {
+		gc_destroy(interpreter->heap);
+	}
+	Allocation* allocation = interpreter->allocations;
+	while (allocation != NULL) {
+		Allocation* next = allocation->next;
+		free((char*)allocation + HEADER_SIZE - allocation->offset);
+		allocation = next;
+	}
+	mutex_destroy(&interpreter->heap_lock);
+	mutex_destroy(&interpreter->name_lock);
+	mutex_destroy(&interpreter->class_lock);
+	mutex_destroy(&interpreter->lock);
+	free(interpreter);
+}
+
+Interpreter* interpreter_enter(Interpreter* interpreter) {
+	Interpreter* previous = entered_interpreter;
+	entered_interpreter = interpreter;
+	return previous;
+}
+
+Interpreter* interpreter_current() {
+	return entered_interpreter != NULL ? entered_interpreter : &default_interpreter;
+}
+
+void interpreter_recover() {
+	entered_interpreter = NULL;
+	reset_frame_stack();
+}
+
+ErrorTrap* interpreter_trap_errors(ErrorTrap* trap) {
+	ErrorTrap* previous = error_trap;
+	error_trap = trap;
+	if (trap != NULL) {
+		trap->context = entered_interpreter;
+		mark_thread(&trap->mark);
+	}
+	return previous;
+}
+
+void script_error(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	if (error_trap == NULL) {
+		fprintf(stderr, "Error: ");
+		vfprintf(stderr, format, args);
+		fprintf(stderr, "\n");
+		exit(1);
+	}
+	ErrorTrap* trap = error_trap;
+	int length = vsnprintf(trap->message, sizeof(trap->message), format, args);
+	va_end(args);
+	if (reported[0] != '\0' && length >= 0 && (size_t)length < sizeof(trap->message)) {
+		snprintf(trap->message + length, sizeof(trap->message) - length, ": %s", reported);
+	}
+	reported[0] = '\0';
+	unwind_thread(&trap->mark);
+	entered_interpreter = trap->context;
+	longjmp(trap->jump, 1);
+}
+
+void script_report(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	if (error_trap == NULL) {
+		fprintf(stderr, "Error: ");
+		vfprintf(stderr, format, args);
+		fprintf(stderr, "\n");
+	}
+	else if (reported[0] == '\0') {
+		vsnprintf(reported, sizeof(reported), format, args);
+	}
+	va_end(args);
+}
+
+void interpreter_set_limit_handler(Interpreter* interpreter, MemoryLimitHandler handler, void* data) {
+	mutex_lock(&interpreter->lock);
+	interpreter->limit_handler = handler;
+	interpreter->limit_data = data;
+	mutex_unlock(&interpreter->lock);
+}
+
+void interpreter_usage(Interpreter* interpreter, MemoryUsage* usage) {
+	mutex_lock(&interpreter->lock);
+	*usage = interpreter->usage;
+	mutex_unlock(&interpreter->lock);
+}
+
+GcHeap* interpreter_heap(Interpreter* interpreter) {
+	GcHeap* heap = (GcHeap*)atomic_read_pointer((void* volatile*)&interpreter->heap);
+	if (heap != NULL) return heap;
+
+	mutex_lock(&interpreter->heap_lock);
+	heap = interpreter->heap;
+	if (heap == NULL) {
+		heap = gc_create(interpreter);
+		atomic_write_pointer((void* volatile*)&interpreter->heap, heap);
+	}
+	mutex_unlock(&interpreter->heap_lock);
+	return heap;
+}
+
+// ---- Class registry ----------------------------------------------------------
+
+// What load_classes does with the classes it parses
+typedef enum {
+	REGISTER_ADD,      // Register them; a name already loaded is an error
+	REGISTER_REPLACE,  // Register them, replacing classes of the same name (hot reload)
+	REGISTER_NONE,     // Leave them to the caller
+} Registration;
+
+// Add a parsed class to the registry of the current context. When reloading,
+// a class of the same name is replaced: the new version is published to the
+// objects of the old one and takes its index.
+static void register_class(Interpreter* interpreter, ClassNode* class_node, Registration registration) {
+	mutex_lock(&interpreter->class_lock);
+	int index = registration == REGISTER_REPLACE ? name_table_find(&interpreter->class_names, class_node->class_name) : -1;
+	if (index >= 0) {
+		ClassNode* old = interpreter->classes[index];
+		class_retain(class_node);  // Held by the old version until it is freed
+		atomic_write_pointer((void* volatile*)&old->replacement, class_node);
+		atomic_write_pointer((void* volatile*)&interpreter->classes[index], class_node);
+		mutex_unlock(&interpreter->class_lock);
+		class_release(old);  // The registry's reference
+		return;
+	}
+	if (!name_table_insert(&interpreter->class_names, class_node->class_name, interpreter->class_count)) {
+		mutex_unlock(&interpreter->class_lock);
+		const char* class_name = class_node->class_name;  // Interned: outlives the class
+		free_class_node(class_node);
+		script_error("Class %s is already loaded.", class_name);
+	}
+	if (interpreter->class_count == interpreter->class_capacity) {
+		interpreter->class_capacity = interpreter->class_capacity ? interpreter->class_capacity * 2 : 4;
+		interpreter->classes = (ClassNode**)memory_realloc(MEMORY_RUNTIME, interpreter->classes, sizeof(ClassNode*) * interpreter->class_capacity);
+	}
+	interpreter->classes[interpreter->class_count++] = class_node;
+	mutex_unlock(&interpreter->class_lock);
+}
+
+// Parse classes from source text into the context, all of them or just the first
+static int load_classes(Interpreter* interpreter, const char* source_text, int all, Registration registration, ClassNode** first) {
+	Interpreter* previous = interpreter_enter(interpreter);
+
+	// Keep the caller's parse state: the host may be in the middle of its own parse
+	const char** saved_source = source;
+	Token saved_token = current_token;
+	const char* code = source_text;
+	source = &code;
+	next_token_wrapper();
+	int count = 0;
+	do {
+		ClassNode* class_node = parse_class();
+		if (count++ == 0 && first != NULL) {
+			*first = class_node;
+			if (registration != REGISTER_NONE) {
+				class_retain(class_node);  // The caller's; the registry holds the first reference
+			}
+		}
+		if (registration != REGISTER_NONE) {
+			register_class(interpreter, class_node, registration);
+		}
+	} while (all && current_token.type == TOKEN_CLASS);
+	if (all && current_token.type != TOKEN_END) {
+		script_error("Expected a class declaration but found '%s'", current_token.value);
+	}
+	source = saved_source;
+	current_token = saved_token;
+
+	interpreter_enter(previous);
+	if (registration == REGISTER_REPLACE) {
+		reclaim_classes();  // Versions without objects can go right away
+	}
+	return count;
+}
+
+ClassNode* interpreter_load_class(Interpreter* interpreter, const char* source_text) {
+	ClassNode* class_node = NULL;
+	load_classes(interpreter, source_text, 0, REGISTER_ADD, &class_node);
+	return class_node;
+}
+
+int interpreter_load_source(Interpreter* interpreter, const char* source_text) {
+	return load_classes(interpreter, source_text, 1, REGISTER_ADD, NULL);
+}
+
+ClassNode* interpreter_parse_class(Interpreter* interpreter, const char* source_text) {
+	ClassNode* class_node = NULL;
+	load_classes(interpreter, source_text, 0, REGISTER_NONE, &class_node);
+	return class_node;
+}
+
+ClassNode* interpreter_reload_class(Interpreter* interpreter, const char* source_text) {
+	ClassNode* class_node = NULL;
+	load_classes(interpreter, source_text, 0, REGISTER_REPLACE, &class_node);
+	return class_node;
+}
+
+int interpreter_reload_source(Interpreter* interpreter, const char* source_text) {
+	return load_classes(interpreter, source_text, 1, REGISTER_REPLACE, NULL);
+}
+
+void interpreter_reclaim() {
+	reclaim_classes();
+}
+
+ClassNode* interpreter_find_class(Interpreter* interpreter, const char* class_name) {
+	mutex_lock(&interpreter->class_lock);
+	int index = name_table_find(&interpreter->class_names, class_name);
+	ClassNode* class_node = index >= 0 ? interpreter->classes[index] : NULL;
+	if (class_node != NULL) {
+		class_retain(class_node);  // Before a reload can drop the registry's reference
+	}
+	mutex_unlock(&interpreter->class_lock);
+	return class_node;
+}
+
+void interpreter_forget_class(ClassNode* class_node) {
+	Interpreter* interpreter = class_node->context;
+	mutex_lock(&interpreter->class_lock);
+	int index = name_table_find(&interpreter->class_names, class_node->class_name);
+	if (index < 0 || interpreter->classes[index] != class_node) {
+		mutex_unlock(&interpreter->class_lock);
+		return;  // Parsed but never registered
+	}
+
+	// The last class takes the freed index
+	name_table_remove(&interpreter->class_names, class_node->class_name);
+	ClassNode* last = interpreter->classes[--interpreter->class_count];
+	if (last != class_node) {
+		interpreter->classes[index] = last;
+		name_table_update(&interpreter->class_names, last->class_name, index);
+	}
+	mutex_unlock(&interpreter->class_lock);
+}
+
+SymbolTable** interpreter_symbols(Interpreter* interpreter) {
+	return &interpreter->symbols;
+}
+
+// ---- Interned names ----------------------------------------------------------
+
+const char* intern_span(const char* text, size_t length) {
+	Interpreter* interpreter = interpreter_current();
+	mutex_lock(&interpreter->name_lock);
+	const char* name = name_table_intern(&interpreter->names, text, length);
+	mutex_unlock(&interpreter->name_lock);
+	return name;
+}
+
+const char* intern_name(const char* name) {
+	return intern_span(name, strlen(name));
+}
+
+String* intern_string(const char* text, size_t length) {
+	Interpreter* interpreter = interpreter_current();
+	mutex_lock(&interpreter->name_lock);
+	const char* chars = name_table_intern(&interpreter->literals, text, length);
+	int index = name_table_find(&interpreter->literals, chars);
+	if (index >= interpreter->literal_capacity) {
+		int capacity = interpreter->literal_capacity > 0 ? interpreter->literal_capacity * 2 : 16;
+		String** strings = (String**)memory_realloc(MEMORY_STRINGS, interpreter->literal_strings, sizeof(String*) * (size_t)capacity);
+		memset(strings + interpreter->literal_capacity, 0, sizeof(String*) * (size_t)(capacity - interpreter->literal_capacity));
+		interpreter->literal_strings = strings;
+		interpreter->literal_capacity = capacity;
+	}
+	String* string = interpreter->literal_strings[index];
+	if (string == NULL) {
+		string = (String*)memory_alloc(MEMORY_STRINGS, sizeof(String));
+		string->references = 1;
+		string->permanent = 1;
+		string->length = (int)length;
+		string->capacity = 0;
+		string->chars = chars;
+		string->base = NULL;
+		interpreter->literal_strings[index] = string;
+	}
+	mutex_unlock(&interpreter->name_lock);
+	return string;
+}
+
+// ---- Allocation --------------------------------------------------------------
+
+// Report a context going past its limit; the host's handler gets the first chance
+static void limit_exceeded(Interpreter* interpreter, size_t requested) {
+	size_t current = interpreter->usage.current;
+	size_t limit = interpreter->usage.limit;
+	MemoryLimitHandler handler = interpreter->limit_handler;
+	void* data = interpreter->limit_data;
+	mutex_unlock(&interpreter->lock);
+	if (handler != NULL) {
+		handler(interpreter, requested, data);
+	}
+	printf("Error: Memory limit of %zu bytes exceeded (%zu in use, %zu requested).\n", limit, current, requested);
+	exit(1);
+}
+
+static void charge(Interpreter* interpreter, Allocation* allocation) {
+	MemoryUsage* usage = &interpreter->usage;
+	usage->current += allocation->size;
+	usage->by_category[allocation->category] += allocation->size;
+	usage->allocations++;
+	if (usage->current > usage->peak) {
+		usage->peak = usage->current;
+	}
+	allocation->owner = interpreter;
+	allocation->prev = NULL;
+	allocation->next = interpreter->allocations;
+	if (interpreter->allocations != NULL) {
+		interpreter->allocations->prev = allocation;
+	}
+	interpreter->allocations = allocation;
+}
+
+static void uncharge(Interpreter* interpreter, Allocation* allocation) {
+	MemoryUsage* usage = &interpreter->usage;
+	usage->current -= allocation->size;
+	usage->by_category[allocation->category] -= allocation->size;
+	usage->allocations--;
+	if (allocation->prev != NULL) allocation->prev->next = allocation->next;
+	else interpreter->allocations = allocation->next;
+	if (allocation->next != NULL) allocation->next->prev = allocation->prev;
+}
+
+static Allocation* header_of(void* block) {
+	return (Allocation*)((char*)block - HEADER_SIZE);
+}
+
+static void* allocate_block(MemoryCategory category, size_t size, size_t alignment, int zero) {
+	Interpreter* interpreter = interpreter_current();
+	size_t padding = alignment > 16 ? alignment : 0;  // Room to move the block up to the alignment
+	if (size > SIZE_MAX - HEADER_SIZE - padding) {
+		printf("Error: Memory allocation of %zu bytes is too large.\n", size);
+		exit(1);
+	}
+	size_t total = HEADER_SIZE + padding + size;
+
+	char* memory = (char*)(zero ? calloc(1, total) : malloc(total));
+	if (!memory) {
+		printf("Error: Memory allocation failed (%zu bytes).\n", total);
+		exit(1);
+	}
+	char* block = memory + HEADER_SIZE;
+	if (padding > 0) {
+		block = (char*)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	}
+	Allocation* allocation = header_of(block);
+	allocation->size = total;
+	allocation->offset = (size_t)(block - memory);
+	allocation->category = category;
+
+	mutex_lock(&interpreter->lock);
+	if (interpreter->usage.limit != 0 && total > interpreter->usage.limit - interpreter->usage.current) {
+		free(memory);
+		limit_exceeded(interpreter, total);
+	}
+	charge(interpreter, allocation);
+	mutex_unlock(&interpreter->lock);
+	return block;
+}
+
+void* memory_alloc(MemoryCategory category, size_t size) {
+	return allocate_block(category, size, 0, 0);
+}
+
+void* memory_calloc(MemoryCategory category, size_t count, size_t size) {
+	if (size != 0 && count > SIZE_MAX / size) {
+		printf("Error: Memory allocation of %zu x %zu bytes is too large.\n", count, size);
+		exit(1);
+	}
+	return allocate_block(category, count * size, 0, 1);
+}
+
+void* memory_alloc_aligned(MemoryCategory category, size_t size, size_t alignment) {
+	return allocate_block(category, size, alignment, 0);
+}
+
+void* memory_realloc(MemoryCategory category, void* block, size_t size) {
+	if (block == NULL) {
+		return memory_alloc(category, size);
+	}
+	Allocation* allocation = header_of(block);
+	if (allocation->offset != HEADER_SIZE) {
+		printf("Error: Aligned memory cannot be reallocated.\n");
+		exit(1);
+	}
+	if (size > SIZE_MAX - HEADER_SIZE) {
+		printf("Error: Memory allocation of %zu bytes is too large.\n", size);
+		exit(1);
+	}
+	size_t total = HEADER_SIZE + size;
+
+	// The block stays in the context that owns it; the header moves with it
+	Interpreter* interpreter = allocation->owner;
+	mutex_lock(&interpreter->lock);
+	if (interpreter->usage.limit != 0 && total > allocation->size &&
+		total - allocation->size > interpreter->usage.limit - interpreter->usage.current) {
+		limit_exceeded(interpreter, total - allocation->size);
+	}
+	uncharge(interpreter, allocation);
+	Allocation* moved = (Allocation*)realloc(allocation, total);
+	if (!moved) {
+		mutex_unlock(&interpreter->lock);
+		printf("Error: Memory allocation failed (%zu bytes).\n", total);
+		exit(1);
+	}
+	moved->size = total;
+	moved->category = category;
+	charge(interpreter, moved);
+	mutex_unlock(&interpreter->lock);
+	return (char*)moved + HEADER_SIZE;
+}
+
+char* memory_strdup(MemoryCategory category, const char* text) {
+	size_t length = strlen(text) + 1;
+	char* copy = (char*)memory_alloc(category, length);
+	memcpy(copy, text, length);
+	return copy;
+}
+
+void memory_free(void* block) {
+	if (block == NULL) return;
+	Allocation* allocation = header_of(block);
+	Interpreter* interpreter = allocation->owner;
+	mutex_lock(&interpreter->lock);
+	uncharge(interpreter, allocation);
+	mutex_unlock(&interpreter->lock);
+	free((char*)block - allocation->offset);
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "parse.h"  // Include parse.h for ClassNode and SymbolTable
+#include <stddef.h>
+#include <setjmp.h>
+
+#ifdef _MSC_VER
+#define NORETURN __declspec(noreturn)
+#else
+#define NORETURN __attribute__((noreturn))
+#endif
+
+// What an allocation is used for, reported separately by interpreter_usage
+typedef enum {
+	MEMORY_AST,       // Classes, methods, statements and expression trees
+	MEMORY_STRINGS,   // Names, type names and token text
+	MEMORY_OBJECTS,   // Objects and their fields
+	MEMORY_ARRAYS,    // Array and map headers, element storage and map tables
+	MEMORY_RUNTIME,   // Coroutines, batches, parallel loop chunks and other execution state
+	MEMORY_CATEGORY_COUNT
+} MemoryCategory;
+
+// Memory of one context, in bytes (including the small header every allocation carries)
+typedef struct MemoryUsage {
+	size_t current;                               // In use now
+	size_t peak;                                  // Highest `current` so far
+	size_t limit;                                 // Cap on `current`, 0 for none
+	size_t allocations;                           // Live allocations
+	size_t by_category[MEMORY_CATEGORY_COUNT];    // `current` split by category
+} MemoryUsage;
+
+// An isolated interpreter: every class parsed, object created and array or
+// runtime buffer allocated while it is the thread's current context draws on
+// its allocator, which tracks each block so the whole context can be released
+// at once. Calls run in the context of the object's class, on any thread.
+// Frame stacks, the worker pool and compiled modules are shared by all contexts.
+typedef struct Interpreter Interpreter;
+
+// Called when an allocation would take the context past its limit, with the bytes
+// requested. The handler may longjmp back into the host, which then calls
+// interpreter_recover and should destroy the context; if it returns, the error is
+// reported and the process exits.
+typedef void (*MemoryLimitHandler)(Interpreter* interpreter, size_t requested, void* data);
+
+// Script errors (a class that doesn't parse, an index out of bounds, a division by
+// zero...) are printed and exit the process, unless the thread has set a trap: the
+// thread then longjmps back to the trap with the message, in the context it had
+// entered when it set the trap and with the parse and calls started since dropped.
+// Whatever they allocated stays in its context, and classes loaded before the failing
+// one of a source stay loaded. Errors inside a parallel loop, a coroutine or a pool
+// job aren't trapped (their code runs on other stacks) and still exit the process, as
+// do failed allocations and exceeded memory limits (see MemoryLimitHandler).
+typedef struct ErrorTrap {
+	jmp_buf jump;
+	char message[512];         // The error, followed by the first problem reported for it
+	Interpreter* context;      // Set by interpreter_trap_errors
+	ThreadMark mark;
+} ErrorTrap;
+
+// Context functions
+// Create a context whose allocations may total at most `memory_limit` bytes (0 for no limit)
+Interpreter* interpreter_create(size_t memory_limit);
+// Release everything allocated in the context: classes, objects, arrays and whatever
+// the host did not free. No thread may be running in it, and coroutines over its
+// objects must be freed first (their stacks are mapped outside the context).
+void interpreter_destroy(Interpreter* interpreter);
+// Make the context current on this thread (NULL for the default context, which is
+// used when no context was entered); returns the previous one
+Interpreter* interpreter_enter(Interpreter* interpreter);
+Interpreter* interpreter_current();
+// Leave every context and call of this thread after a limit handler longjmp'd out of a call
+void interpreter_recover();
+// Trap the script errors of this thread (NULL for none); returns the previous trap
+ErrorTrap* interpreter_trap_errors(ErrorTrap* trap);
+// Report a script error: trapped, or printed to stderr as "Error: <message>" before exiting
+NORETURN void script_error(const char* format, ...);
+// Report one of several problems that end in a script_error (e.g. each type error of a
+// class): printed to stderr, or kept for the trapped error if it is the first
+void script_report(const char* format, ...);
+void interpreter_set_limit_handler(Interpreter* interpreter, MemoryLimitHandler handler, void* data);
+void interpreter_usage(Interpreter* interpreter, MemoryUsage* usage);
+// Heap of the objects scripts make with `new` in the context (see gc.h), created on first use
+struct GcHeap* interpreter_heap(Interpreter* interpreter);
+
+// Class registry
+// A ClassNode the registry returns comes with a reference for the caller, who drops
+// it with class_release (see reload.h) once it no longer uses the pointer.
+// Parse a class from source text into the context and register it
+ClassNode* interpreter_load_class(Interpreter* interpreter, const char* source_text);
+// Parse every class of a source unit (any number of class declarations, e.g. a bundle)
+// into the context and register them; returns the number of classes
+int interpreter_load_source(Interpreter* interpreter, const char* source_text);
+// Parse a class into the context without registering it: it can't be found by name
+// or used as a base, and several classes of the same name may coexist (see cache.h).
+// The caller holds the class's only reference.
+ClassNode* interpreter_parse_class(Interpreter* interpreter, const char* source_text);
+// Hot reload: parse a new version of classes already loaded in the context (a class
+// that isn't loaded yet is simply loaded) and publish it while other threads keep
+// running. Objects of the old version move to the new one when a host call or field
+// access next enters them with no call running on them: fields the new version
+// declares by the same name keep their values. Calls already running finish on the
+// old version, which is freed once no object or thread can still use it. Classes
+// derived from a reloaded class keep the old base until they are reloaded too.
+// A ClassNode the host still holds from before the reload stays valid, and
+// create_object makes objects of the newest version from it; method slots from
+// before the reload must be looked up again.
+ClassNode* interpreter_reload_class(Interpreter* interpreter, const char* source_text);
+int interpreter_reload_source(Interpreter* interpreter, const char* source_text);
+// Free the replaced versions nothing uses any more (host calls also do it as they return)
+void interpreter_reclaim();
+// A class registered in the context, NULL if there is none by that name (a hash lookup)
+ClassNode* interpreter_find_class(Interpreter* interpreter, const char* class_name);
+// Drop a class from its context's registry (free_class_node does it)
+void interpreter_forget_class(ClassNode* class_node);
+// Head of the context's symbol table (see update_variable)
+SymbolTable** interpreter_symbols(Interpreter* interpreter);
+
+// Name interning: the current context keeps a single copy of every identifier, type
+// and method name it has parsed, so the interpreter compares names by pointer.
+// The copies last as long as the context.
+const char* intern_name(const char* name);
+const char* intern_span(const char* text, size_t length);
+// The permanent String of a string literal: one per distinct text in the context,
+// sharing the context's copy of the text (see text.h)
+struct String* intern_string(const char* text, size_t length);
+
+// Allocation in the current context. Failures and exceeded limits are reported
+// as errors; the memory is zero-filled only by memory_calloc.
+void* memory_alloc(MemoryCategory category, size_t size);
+void* memory_calloc(MemoryCategory category, size_t count, size_t size);
+// Grow or shrink a block from memory_alloc (NULL allocates a new one)
+void* memory_realloc(MemoryCategory category, void* block, size_t size);
+// A block whose address is a multiple of `alignment` (a power of two)
+void* memory_alloc_aligned(MemoryCategory category, size_t size, size_t alignment);
+char* memory_strdup(MemoryCategory category, const char* text);
+// Free a block in whichever context owns it
+void memory_free(void* block);
@@ -0,0 +1,312 @@
+#if defined(__APPLE__)
+#define _XOPEN_SOURCE 700  // ucontext is only declared for XSI on macOS
+#endif
+
+#include "coroutine.h"
+#include "context.h"
+#include "reload.h"
+#include "gc.h"
+#include "text.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <ucontext.h>
+#endif
+
+struct Coroutine {
+	CoroutineState state;
+	Object* obj;
+	const char* method_name;  // Interned in the class's context
+	Value* args;           // Owned copy, already converted to the parameter types
+	int argument_count;
+	long long slice;       // Budget of each resume
+	Value value;           // Yielded value or result; the resumed value on the way in
+	FrameStack frames;     // Interpreter frames of the coroutine's calls
+	GcHeap* heap;          // Heap of the object's context, which scans the frames while suspended
+	GcStack roots;
+	char* stack_limit;     // Lowest C stack address a call may start from (set when the coroutine starts)
+	void* memory;          // C stack followed by the frame slots (POSIX), frame slots (Windows)
+	Coroutine* resumer;    // Coroutine running on the thread when this one was resumed
+#ifdef _WIN32
+	LPVOID fiber;
+	LPVOID caller;         // Fiber to switch back to on yield
+#else
+	ucontext_t context;
+	ucontext_t caller;     // Context to switch back to on yield
+#endif
+};
+
+// Coroutine running on this thread, NULL on the thread's own stack
+static THREAD_LOCAL Coroutine* current_coroutine = NULL;
+
+static size_t frame_bytes() {
+	return sizeof(Value) * COROUTINE_FRAME_SLOTS;
+}
+
+// ---- Stack memory ------------------------------------------------------------
+
+#ifdef _WIN32
+
+static void* allocate_coroutine_memory() {
+	// The fiber owns its C stack; only the frame slots are allocated here (pages are zero-filled on first touch)
+	void* memory = VirtualAlloc(NULL, frame_bytes(), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (memory == NULL) {
+		printf("Error: Memory allocation failed for coroutine frames.\n");
+		exit(1);
+	}
+	return memory;
+}
+
+static void release_coroutine_memory(void* memory) {
+	VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+#else
+
+// Released regions, reused before mapping new ones
+static THREAD_LOCAL void* stack_cache[COROUTINE_STACK_CACHE];
+static THREAD_LOCAL int stack_cache_count = 0;
+
+static void* allocate_coroutine_memory() {
+	if (stack_cache_count > 0) {
+		return stack_cache[--stack_cache_count];
+	}
+	// Reserved without swap backing: the kernel commits pages as the stack and frames touch them.
+	// There is no guard page: every guard would split the mapping, and the process mapping limit
+	// (vm.max_map_count) would cap the number of live coroutines. Calls check the remaining
+	// stack instead (coroutine_stack_exhausted).
+	void* memory = mmap(NULL, COROUTINE_STACK_SIZE + frame_bytes(), PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (memory == MAP_FAILED) {
+		printf("Error: Memory allocation failed for coroutine stack.\n");
+		exit(1);
+	}
+	return memory;
+}
+
+static void release_coroutine_memory(void* memory) {
+	if (stack_cache_count < COROUTINE_STACK_CACHE) {
+		stack_cache[stack_cache_count++] = memory;
+		return;
+	}
+	munmap(memory, COROUTINE_STACK_SIZE + frame_bytes());
+}
+
+#endif
+
+// ---- Switching ---------------------------------------------------------------
+
+// First code on the coroutine's stack: run the method, then switch back for good
+#ifdef _WIN32
+static void WINAPI coroutine_entry(LPVOID argument) {
+#else
+static void coroutine_entry() {
+#endif
+	Coroutine* coroutine = current_coroutine;
+#ifdef _WIN32
+	// The fiber's stack starts about here and grows down COROUTINE_STACK_SIZE bytes
+	volatile char marker;
+	coroutine->stack_limit = (char*)((uintptr_t)&marker - COROUTINE_STACK_SIZE + COROUTINE_STACK_MARGIN);
+#else
+	// The stack is the start of the mapping the coroutine owns
+	coroutine->stack_limit = (char*)coroutine->memory + COROUTINE_STACK_MARGIN;
+#endif
+
+	coroutine->value = call_method(coroutine->obj, coroutine->method_name, coroutine->args, coroutine->argument_count);
+	coroutine->state = COROUTINE_DONE;
+
+#ifdef _WIN32
+	SwitchToFiber(coroutine->caller);
+#else
+	swapcontext(&coroutine->context, &coroutine->caller);
+#endif
+}
+
+Coroutine* coroutine_create(Object* obj, const char* method_name, const Value* args, int argument_count) {
+	// Report a bad call now rather than at the first resume
+	Method* method = find_method(obj->class_type, method_name);
+	if (method == NULL) {
+		printf("Error: Method %s not found in class %s\n", method_name, obj->class_type->class_name);
+		exit(1);
+	}
+	if (argument_count != method->parameter_count) {
+		printf("Error: Method %s expects %d arguments but got %d\n", method_name, method->parameter_count, argument_count);
+		exit(1);
+	}
+	for (int i = 0; i < argument_count; i++) {
+		if (!value_kind_matches(args[i], method->local_types[i])) {
+			script_error("Argument %d of %s must be %s.", i + 1, method_name, value_kind_name(method->local_types[i]));
+		}
+	}
+
+	Interpreter* previous = interpreter_enter(obj->class_type->context);
+	Coroutine* coroutine = (Coroutine*)memory_calloc(MEMORY_RUNTIME, 1, sizeof(Coroutine));
+	coroutine->state = COROUTINE_SUSPENDED;
+	coroutine->obj = obj;
+	coroutine->method_name = intern_name(method_name);
+	coroutine->argument_count = argument_count;
+	coroutine->slice = BUDGET_UNLIMITED;
+	coroutine->value = make_int(0);
+	if (argument_count > 0) {
+		coroutine->args = (Value*)memory_alloc(MEMORY_RUNTIME, sizeof(Value) * argument_count);
+		for (int i = 0; i < argument_count; i++) {
+			string_retain(args[i]);  // Kept until the coroutine is freed
+			coroutine->args[i] = value_convert(args[i], method->local_types[i]);
+		}
+	}
+
+	coroutine->memory = allocate_coroutine_memory();
+#ifdef _WIN32
+	coroutine->frames.slots = (Value*)coroutine->memory;
+	coroutine->fiber = CreateFiberEx(4096, COROUTINE_STACK_SIZE, FIBER_FLAG_FLOAT_SWITCH, coroutine_entry, coroutine);
+	if (coroutine->fiber == NULL) {
+		printf("Error: Failed to create a coroutine fiber.\n");
+		exit(1);
+	}
+#else
+	coroutine->frames.slots = (Value*)((char*)coroutine->memory + COROUTINE_STACK_SIZE);
+	getcontext(&coroutine->context);
+	coroutine->context.uc_stack.ss_sp = coroutine->memory;
+	coroutine->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+	coroutine->context.uc_link = NULL;
+	makecontext(&coroutine->context, coroutine_entry, 0);
+#endif
+	coroutine->frames.capacity = COROUTINE_FRAME_SLOTS;
+	coroutine->frames.top = 0;
+	coroutine->frames.depth = 0;
+	coroutine->frames.max_depth = FRAME_MAX_DEPTH;
+	coroutine->frames.budget = BUDGET_UNLIMITED;
+	coroutine->frames.metered = 0;
+	coroutine->frames.return_value = make_int(0);
+	coroutine->frames.entered = NULL;
+	coroutine->frames.heap = NULL;
+	coroutine->frames.frames = NULL;
+
+	coroutine->heap = interpreter_heap(obj->class_type->context);
+	coroutine->roots.frames = &coroutine->frames;
+	coroutine->roots.receiver = obj;
+	coroutine->roots.args = coroutine->args;
+	coroutine->roots.argument_count = argument_count;
+	gc_register_stack(coroutine->heap, &coroutine->roots);
+	interpreter_enter(previous);
+	return coroutine;
+}
+
+CoroutineState coroutine_resume(Coroutine* coroutine, Value value) {
+	if (coroutine->state == COROUTINE_RUNNING || coroutine->state == COROUTINE_DONE) {
+		printf("Error: Cannot resume a coroutine that is %s.\n", coroutine->state == COROUTINE_RUNNING ? "running" : "done");
+		exit(1);
+	}
+	if (coroutine->state == COROUTINE_SUSPENDED) {
+		coroutine->value = value;
+	}
+	coroutine->state = COROUTINE_RUNNING;
+	coroutine->frames.budget = coroutine->slice;
+
+	// The coroutine's calls use its own frames until it yields or returns
+	coroutine->resumer = current_coroutine;
+	current_coroutine = coroutine;
+	FrameStack* resumer_frames = switch_frame_stack(&coroutine->frames);
+	Interpreter* resumer_context = interpreter_enter(coroutine->obj->class_type->context);
+	ErrorTrap* resumer_trap = interpreter_trap_errors(NULL);  // It can't longjmp off the coroutine's stack
+	// Collections wait while the coroutine runs, which may first run one (see gc_enter)
+	gc_enter(coroutine->heap, &coroutine->frames, NULL, NULL, 0, 1);
+#ifdef _WIN32
+	if (!IsThreadAFiber()) {
+		ConvertThreadToFiber(NULL);
+	}
+	coroutine->caller = GetCurrentFiber();
+	SwitchToFiber(coroutine->fiber);
+#else
+	swapcontext(&coroutine->caller, &coroutine->context);
+#endif
+	if (coroutine->frames.heap != NULL) {
+		gc_leave(&coroutine->frames);  // Suspended: its frames are roots until it resumes
+	}
+	interpreter_trap_errors(resumer_trap);
+	interpreter_enter(resumer_context);
+	switch_frame_stack(resumer_frames);
+	current_coroutine = coroutine->resumer;
+	return coroutine->state;
+}
+
+Value coroutine_yield(Value value) {
+	Coroutine* coroutine = current_coroutine;
+	if (coroutine == NULL) {
+		script_error("yield outside a coroutine.");
+	}
+	coroutine->value = value;
+	coroutine->state = COROUTINE_SUSPENDED;
+#ifdef _WIN32
+	SwitchToFiber(coroutine->caller);
+#else
+	swapcontext(&coroutine->context, &coroutine->caller);
+#endif
+	// Resumed: coroutine_resume left the host's value behind
+	return value_convert(coroutine->value, value.type);
+}
+
+int coroutine_preempt() {
+	Coroutine* coroutine = current_coroutine;
+	if (coroutine == NULL) return 0;
+	coroutine->state = COROUTINE_PREEMPTED;
+#ifdef _WIN32
+	SwitchToFiber(coroutine->caller);
+#else
+	swapcontext(&coroutine->context, &coroutine->caller);
+#endif
+	return 1;
+}
+
+int coroutine_stack_exhausted() {
+	Coroutine* coroutine = current_coroutine;
+	volatile char marker;
+	return coroutine != NULL && (char*)&marker < coroutine->stack_limit;
+}
+
+CoroutineState coroutine_state(Coroutine* coroutine) {
+	return coroutine->state;
+}
+
+void coroutine_set_budget(Coroutine* coroutine, long long slice) {
+	coroutine->slice = slice;
+	coroutine->frames.metered = slice != BUDGET_UNLIMITED;
+}
+
+Value coroutine_value(Coroutine* coroutine) {
+	return coroutine->value;
+}
+
+void coroutine_free(Coroutine* coroutine) {
+	if (coroutine == NULL) return;
+	if (coroutine->state == COROUTINE_RUNNING) {
+		printf("Error: Cannot free a running coroutine.\n");
+		exit(1);
+	}
+	// Abandoned where it yielded: its frames still own their arrays, maps and strings
+	// (their CallFrames live on the coroutine's stack, released below)
+	release_frames(&coroutine->frames, 0, 0);
+	coroutine->frames.frames = NULL;
+	coroutine->frames.top = 0;
+	coroutine->frames.depth = 0;
+	if (coroutine->frames.entered != NULL) {
+		object_leave(&coroutine->frames);  // Abandoned in the middle of its call
+	}
+	gc_unregister_stack(coroutine->heap, &coroutine->roots);
+#ifdef _WIN32
+	DeleteFiber(coroutine->fiber);
+#endif
+	release_coroutine_memory(coroutine->memory);
+	for (int i = 0; i < coroutine->argument_count; i++) {
+		string_release(coroutine->args[i]);
+	}
+	string_release(coroutine->value);  // A string result
+	memory_free(coroutine->args);
+	memory_free(coroutine);
+}
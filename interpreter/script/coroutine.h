@@ -0,0 +1,53 @@
+#pragma once
+#include "parse.h"  // Include parse.h for Object, Value and FrameStack
+
+// Address space reserved for a coroutine's C stack. Pages are only committed
+// when first touched, so a coroutine that doesn't recurse deeply costs a few KB
+// and the stack grows on demand up to this size.
+#define COROUTINE_STACK_SIZE (256 * 1024)
+
+// A call that finds less C stack than this left reports a stack overflow
+#define COROUTINE_STACK_MARGIN (32 * 1024)
+
+// Interpreter frame slots of a coroutine (committed on demand like the C stack)
+#define COROUTINE_FRAME_SLOTS 4096
+
+// Released stacks kept per thread for the next coroutines
+#define COROUTINE_STACK_CACHE 64
+
+typedef enum {
+	COROUTINE_SUSPENDED,  // Not started yet, or stopped at a yield: resume it
+	COROUTINE_PREEMPTED,  // Stopped because its budget slice ran out: resume it to continue
+	COROUTINE_RUNNING,    // Executing on some thread
+	COROUTINE_DONE,       // The method returned; coroutine_value is its result
+} CoroutineState;
+
+// A method invocation with its own C stack and interpreter frames, which can
+// suspend at `yield(value)` anywhere in its call chain without blocking the thread
+typedef struct Coroutine Coroutine;
+
+// Coroutine functions
+// Prepare a call of the method (arguments are copied and converted to the parameter types); nothing runs until the first resume
+Coroutine* coroutine_create(Object* obj, const char* method_name, const Value* args, int argument_count);
+// Run the coroutine until it yields, is preempted or returns. `value`, converted to the yielded
+// type, becomes the result of the yield it was suspended at (ignored on the first resume).
+// A coroutine is resumed on the thread that created it, never on two threads at once.
+CoroutineState coroutine_resume(Coroutine* coroutine, Value value);
+CoroutineState coroutine_state(Coroutine* coroutine);
+// Let every resume run at most `slice` loop iterations and calls before the coroutine
+// is preempted (BUDGET_UNLIMITED, the default, never preempts). A preempted coroutine
+// continues where it stopped on the next resume, whose value is ignored.
+void coroutine_set_budget(Coroutine* coroutine, long long slice);
+// The last yielded value, or the result once done (a string result is borrowed from the coroutine)
+Value coroutine_value(Coroutine* coroutine);
+// Release a coroutine that isn't running. A suspended one is abandoned where it
+// yielded: the arrays, maps and strings of its active methods are freed with it.
+void coroutine_free(Coroutine* coroutine);
+
+// Executor hooks
+// Suspend the running coroutine with `value` and return the value it is resumed with
+Value coroutine_yield(Value value);
+// Suspend the running coroutine as preempted; returns 0 when no coroutine is running
+int coroutine_preempt();
+// Is the running coroutine (if any) close to the end of its C stack?
+int coroutine_stack_exhausted();
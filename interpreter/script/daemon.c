@@ -0,0 +1,766 @@
+#include "daemon.h"
+#include <stdio.h>
+
+#ifdef _WIN32
+
+int daemon_run(const char* socket_path, int worker_count) {
+	printf("Error: The daemon needs Unix domain sockets, which this build doesn't support.\n");
+	return 1;
+}
+
+#else
+#include "context.h"
+#include "map.h"
+#include "pool.h"
+#include "reload.h"
+#include "text.h"
+#include "threads.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Bytes of a growing buffer
+typedef struct Buffer {
+	char* data;
+	size_t length;
+	size_t capacity;
+} Buffer;
+
+// A request waiting for its turn, in arrival order
+typedef struct Request {
+	char* payload;  // NUL-terminated
+	struct Request* next;
+} Request;
+
+typedef struct Daemon Daemon;
+
+// An object handed out to clients. Requests using it hold a claim, so a free
+// arriving meanwhile only marks it and the last claim frees the object.
+typedef struct Handle {
+	Object* object;   // NULL for a free handle
+	int users;        // Requests running on the object
+	int freed;        // Freed by a client, waiting for the users to finish
+} Handle;
+
+typedef struct Connection {
+	int socket;
+	Daemon* daemon;
+	Buffer input;               // Read by the event loop, split into requests as frames complete
+	Mutex lock;                 // Guards everything below (shared by the event loop and the job)
+	Request* first;             // Requests not yet run
+	Request* last;
+	Buffer output;              // Response frames not yet written
+	int scheduled;              // A job is running this connection's requests
+	Future* job;                // That job, released by the event loop once it finished
+	int closing;                // The peer hung up or broke the protocol: drop it once idle
+	struct Connection* next;
+} Connection;
+
+struct Daemon {
+	Interpreter* context;   // Classes and objects of every connection
+	ThreadPool* pool;
+	Mutex lock;             // Guards the class registry and the handles
+	Handle* handles;        // By handle - 1
+	int handle_count;
+	int handle_capacity;
+	int wake[2];            // Self-pipe: jobs write a byte when a connection has output or went idle
+	volatile long stopping;
+};
+
+static void buffer_append(Buffer* buffer, const void* data, size_t length) {
+	if (buffer->length + length > buffer->capacity) {
+		size_t capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+		while (capacity < buffer->length + length) capacity *= 2;
+		char* grown = (char*)realloc(buffer->data, capacity);
+		if (!grown) {
+			printf("Error: Memory allocation failed for a daemon buffer.\n");
+			exit(1);
+		}
+		buffer->data = grown;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->data + buffer->length, data, length);
+	buffer->length += length;
+}
+
+// Drop the first `length` bytes
+static void buffer_consume(Buffer* buffer, size_t length) {
+	memmove(buffer->data, buffer->data + length, buffer->length - length);
+	buffer->length -= length;
+}
+
+static void wake_loop(Daemon* daemon) {
+	char byte = 0;
+	while (write(daemon->wake[1], &byte, 1) < 0 && errno == EINTR) {}
+}
+
+// ---- Requests ----------------------------------------------------------------
+
+// Response text of one request
+typedef struct Response {
+	char text[1024];
+	size_t length;
+	int failed;
+} Response;
+
+static void respond(Response* response, const char* format, ...) {
+	if (response->failed) return;
+	size_t room = sizeof(response->text) - response->length;
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(response->text + response->length, room, format, args);
+	va_end(args);
+	response->length += written < 0 ? 0 : (size_t)written < room ? (size_t)written : room - 1;
+}
+
+static void fail(Response* response, const char* format, ...) {
+	if (response->failed) return;
+	response->failed = 1;
+	response->length = (size_t)snprintf(response->text, sizeof(response->text), "error ");
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(response->text + response->length, sizeof(response->text) - response->length, format, args);
+	va_end(args);
+	response->length += written < 0 ? 0 : (size_t)written;
+	if (response->length >= sizeof(response->text)) response->length = sizeof(response->text) - 1;
+}
+
+// Quoted, with the escapes of script literals
+static void respond_string(Response* response, Value value) {
+	int length;
+	const char* chars = string_chars(&value, &length);
+	respond(response, "\"");
+	for (int i = 0; i < length; i++) {
+		char c = chars[i];
+		if (c == '"' || c == '\\') respond(response, "\\%c", c);
+		else if (c == '\n') respond(response, "\\n");
+		else if (c == '\t') respond(response, "\\t");
+		else respond(response, "%c", c);
+	}
+	respond(response, "\"");
+}
+
+// Floats always carry a point or an exponent, so clients can tell them from ints
+static void respond_value(Response* response, Value value) {
+	if (value.type == VALUE_INT) {
+		respond(response, "%d", value.as.i);
+	}
+	else if (value.type == VALUE_FLOAT) {
+		char number[32];
+		snprintf(number, sizeof(number), "%.9g", value.as.f);
+		respond(response, strpbrk(number, ".einf") != NULL ? "%s" : "%s.0", number);
+	}
+	else if (value.type == VALUE_STRING) {
+		respond_string(response, value);
+	}
+	else if (value.type == VALUE_OBJECT) {
+		respond(response, value.as.o != NULL ? "object" : "null");  // References don't leave the process
+	}
+	else if (is_map_type(value.type)) {
+		Map* map = value.as.m;
+		int first = 1;
+		respond(response, "{");
+		for (int i = 0; map != NULL && i < map->capacity; i++) {
+			if (map->slots[i].distance == 0) continue;
+			respond(response, first ? "%d:" : ",%d:", map->slots[i].key);
+			respond_value(response, map->value_type == VALUE_INT ? make_int(map->slots[i].value.i) : make_float(map->slots[i].value.f));
+			first = 0;
+		}
+		respond(response, "}");
+	}
+	else {
+		Array* array = value.as.a;
+		respond(response, "[");
+		for (int i = 0; array != NULL && i < array->length; i++) {
+			if (i > 0) respond(response, ",");
+			respond_value(response, array->element_type == VALUE_INT ? make_int(((int*)array->data)[i]) : make_float(((float*)array->data)[i]));
+		}
+		respond(response, "]");
+	}
+}
+
+// Next space-separated word of the payload, NULL at the end
+static char* next_word(char** cursor) {
+	char* word = *cursor;
+	while (*word == ' ') word++;
+	if (*word == '\0') return NULL;
+	char* end = word;
+	while (*end != '\0' && *end != ' ') end++;
+	*cursor = *end != '\0' ? end + 1 : end;
+	*end = '\0';
+	return word;
+}
+
+static int parse_argument(const char* word, Value* value) {
+	char* end;
+	if (strpbrk(word, ".eE") != NULL) {
+		*value = make_float(strtof(word, &end));
+	}
+	else {
+		long number = strtol(word, &end, 10);
+		*value = make_int((int)number);
+	}
+	return end != word && *end == '\0';
+}
+
+// Index of the handle a word names in daemon->handles, -1 if the word isn't a handle
+static int handle_index(const char* word) {
+	char* end;
+	long number = strtol(word != NULL ? word : "", &end, 10);
+	if (word == NULL || end == word || *end != '\0' || number < 1 || number > INT_MAX) return -1;
+	return (int)number - 1;
+}
+
+// Claim the object of a handle for one request, NULL if the handle names none.
+// Every claim is given back with release_handle.
+static Object* claim_handle(Daemon* daemon, int index) {
+	Object* obj = NULL;
+	mutex_lock(&daemon->lock);
+	if (index >= 0 && index < daemon->handle_count && !daemon->handles[index].freed) {
+		obj = daemon->handles[index].object;
+		if (obj != NULL) daemon->handles[index].users++;
+	}
+	mutex_unlock(&daemon->lock);
+	return obj;
+}
+
+// Give back a claim, freeing the object if it was freed while claimed
+static void release_handle(Daemon* daemon, int index) {
+	Object* obj = NULL;
+	mutex_lock(&daemon->lock);
+	Handle* handle = &daemon->handles[index];
+	if (--handle->users == 0 && handle->freed) {
+		obj = handle->object;
+		handle->object = NULL;
+		handle->freed = 0;
+	}
+	mutex_unlock(&daemon->lock);
+	if (obj != NULL) free_object(obj);
+}
+
+// Run a request on the object of a handle word, holding a claim on it throughout,
+// script errors included
+static void run_claimed(Daemon* daemon, void (*run)(Object*, char*, Response*), char* cursor, Response* response) {
+	char* handle_word = next_word(&cursor);
+	int index = handle_index(handle_word);
+	Object* obj = claim_handle(daemon, index);
+	if (obj == NULL) {
+		fail(response, "unknown handle %s", handle_word != NULL ? handle_word : "");
+		return;
+	}
+
+	ErrorTrap trap;
+	ErrorTrap* request_trap = interpreter_trap_errors(&trap);
+	if (setjmp(trap.jump) != 0) {
+		interpreter_trap_errors(request_trap);
+		release_handle(daemon, index);
+		script_error("%s", trap.message);
+	}
+	run(obj, cursor, response);
+	interpreter_trap_errors(request_trap);
+	release_handle(daemon, index);
+}
+
+static void run_load(Daemon* daemon, char* source_text, Response* response) {
+	if (*source_text == '\0') {
+		fail(response, "load needs source text");
+		return;
+	}
+	mutex_lock(&daemon->lock);
+	// A source that doesn't parse mustn't leave the registry locked: unlock, then pass the error on
+	ErrorTrap trap;
+	ErrorTrap* request_trap = interpreter_trap_errors(&trap);
+	if (setjmp(trap.jump) != 0) {
+		interpreter_trap_errors(request_trap);
+		mutex_unlock(&daemon->lock);
+		script_error("%s", trap.message);
+	}
+	int count = interpreter_reload_source(daemon->context, source_text);
+	interpreter_trap_errors(request_trap);
+	mutex_unlock(&daemon->lock);
+	respond(response, "ok %d", count);
+}
+
+static void run_new(Daemon* daemon, char* cursor, Response* response) {
+	char* class_name = next_word(&cursor);
+	if (class_name == NULL) {
+		fail(response, "new needs a class name");
+		return;
+	}
+
+	mutex_lock(&daemon->lock);
+	ClassNode* class_node = interpreter_find_class(daemon->context, class_name);
+	if (class_node == NULL) {
+		mutex_unlock(&daemon->lock);
+		fail(response, "class %s is not loaded", class_name);
+		return;
+	}
+	Object* obj = create_object(class_node);
+	class_release(class_node);  // The object holds its own reference
+
+	// The lowest free handle, else a new one
+	int index = 0;
+	while (index < daemon->handle_count && daemon->handles[index].object != NULL) index++;
+	if (index == daemon->handle_capacity) {
+		int capacity = daemon->handle_capacity > 0 ? daemon->handle_capacity * 2 : 64;
+		Handle* handles = (Handle*)realloc(daemon->handles, sizeof(Handle) * capacity);
+		if (!handles) {
+			printf("Error: Memory allocation failed for daemon handles.\n");
+			exit(1);
+		}
+		daemon->handles = handles;
+		daemon->handle_capacity = capacity;
+	}
+	if (index == daemon->handle_count) daemon->handle_count++;
+	daemon->handles[index] = (Handle){ .object = obj, .users = 0, .freed = 0 };
+	mutex_unlock(&daemon->lock);
+	respond(response, "ok %d", index + 1);
+}
+
+static void run_call(Object* obj, char* cursor, Response* response) {
+	char* method_name = next_word(&cursor);
+	if (method_name == NULL) {
+		fail(response, "call needs a method name");
+		return;
+	}
+
+	// Check everything call_method would stop the process over
+	ClassNode* class_node = class_latest(obj->class_type);
+	Method* method = find_method(class_node, method_name);
+	if (method == NULL) {
+		fail(response, "method %s not found in class %s", method_name, class_node->class_name);
+		return;
+	}
+	Value args[16];
+	char* words[16];
+	int argument_count = 0;
+	char* word;
+	while ((word = next_word(&cursor)) != NULL) {
+		if (argument_count == sizeof(args) / sizeof(args[0])) {
+			fail(response, "too many arguments");
+			return;
+		}
+		words[argument_count++] = word;
+	}
+	if (argument_count != method->parameter_count) {
+		fail(response, "method %s expects %d arguments but got %d", method_name, method->parameter_count, argument_count);
+		return;
+	}
+	for (int i = 0; i < argument_count; i++) {
+		ValueType type = method->local_types[i];
+		if (is_array_type(type) || is_map_type(type) || type == VALUE_OBJECT) {
+			fail(response, "method %s takes an %s, which a request can't pass", method_name, is_array_type(type) ? "array" : is_map_type(type) ? "map" : "object");
+			return;
+		}
+		if (type != VALUE_STRING && !parse_argument(words[i], &args[i])) {
+			fail(response, "argument %s is not a number", words[i]);
+			return;
+		}
+	}
+	// Strings are built once the request is known to be valid, so a failure leaks none
+	for (int i = 0; i < argument_count; i++) {
+		if (method->local_types[i] == VALUE_STRING) args[i] = string_from(words[i], (int)strlen(words[i]));
+	}
+
+	Value result = call_method(obj, method_name, args, argument_count);
+	for (int i = 0; i < argument_count; i++) {
+		string_release(args[i]);
+	}
+	respond(response, "ok ");
+	respond_value(response, result);
+	string_release(result);
+}
+
+static void run_get(Object* obj, char* cursor, Response* response) {
+	respond(response, "ok");
+	ClassNode* class_node = class_latest(obj->class_type);
+	char* field_name = next_word(&cursor);
+	if (field_name == NULL) {
+		for (int i = 0; i < class_node->field_count; i++) {
+			const char* name = class_node->field_table[i]->name;
+			respond(response, " %s=", name);
+			respond_value(response, get_object_field(obj, name));
+		}
+	}
+	for (; field_name != NULL; field_name = next_word(&cursor)) {
+		if (find_field(class_node, field_name) < 0) {
+			fail(response, "field %s not found in class %s", field_name, class_node->class_name);
+			return;
+		}
+		respond(response, " %s=", field_name);
+		respond_value(response, get_object_field(obj, field_name));
+	}
+}
+
+static void run_free(Daemon* daemon, char* cursor, Response* response) {
+	char* handle_word = next_word(&cursor);
+	int index = handle_index(handle_word);
+
+	// Look up and mark the handle at once, so only one of two concurrent frees gets the
+	// object. Requests still running on it keep it alive; the last one frees it.
+	int found = 0;
+	Object* obj = NULL;
+	mutex_lock(&daemon->lock);
+	if (index >= 0 && index < daemon->handle_count) {
+		Handle* handle = &daemon->handles[index];
+		found = handle->object != NULL && !handle->freed;
+		if (found && handle->users == 0) {
+			obj = handle->object;
+			handle->object = NULL;
+		}
+		else if (found) {
+			handle->freed = 1;
+		}
+	}
+	mutex_unlock(&daemon->lock);
+	if (!found) {
+		fail(response, "unknown handle %s", handle_word != NULL ? handle_word : "");
+		return;
+	}
+	if (obj != NULL) free_object(obj);
+	respond(response, "ok");
+}
+
+static void run_request(Daemon* daemon, char* payload, Response* response) {
+	char* cursor = payload;
+	char* command = next_word(&cursor);
+	if (command == NULL) {
+		fail(response, "empty request");
+	}
+	else if (strcmp(command, "load") == 0) {
+		run_load(daemon, cursor, response);
+	}
+	else if (strcmp(command, "new") == 0) {
+		run_new(daemon, cursor, response);
+	}
+	else if (strcmp(command, "call") == 0) {
+		run_claimed(daemon, run_call, cursor, response);
+	}
+	else if (strcmp(command, "get") == 0) {
+		run_claimed(daemon, run_get, cursor, response);
+	}
+	else if (strcmp(command, "free") == 0) {
+		run_free(daemon, cursor, response);
+	}
+	else if (strcmp(command, "stop") == 0) {
+		atomic_write(&daemon->stopping, 1);
+		respond(response, "ok");
+	}
+	else {
+		fail(response, "unknown command %s", command);
+	}
+}
+
+// Run a request, answering its script errors (a class that doesn't parse, an index out
+// of bounds...) instead of letting them stop the daemon
+static void run_trapped(Daemon* daemon, char* payload, Response* response) {
+	ErrorTrap trap;
+	ErrorTrap* previous = interpreter_trap_errors(&trap);
+	if (setjmp(trap.jump) == 0) {
+		run_request(daemon, payload, response);
+	}
+	else {
+		response->failed = 0;
+		fail(response, "%s", trap.message);
+	}
+	interpreter_trap_errors(previous);
+}
+
+// Pool job: run the connection's requests in order until none are left
+static void serve_connection(void* argument) {
+	Connection* connection = (Connection*)argument;
+	Daemon* daemon = connection->daemon;
+	Interpreter* previous = interpreter_enter(daemon->context);
+
+	mutex_lock(&connection->lock);
+	while (connection->first != NULL) {
+		Request* request = connection->first;
+		connection->first = request->next;
+		if (connection->first == NULL) connection->last = NULL;
+		mutex_unlock(&connection->lock);
+
+		Response response = { .length = 0, .failed = 0 };
+		run_trapped(daemon, request->payload, &response);
+		free(request->payload);
+		free(request);
+
+		unsigned char header[4] = {
+			(unsigned char)(response.length >> 24), (unsigned char)(response.length >> 16),
+			(unsigned char)(response.length >> 8), (unsigned char)response.length
+		};
+		mutex_lock(&connection->lock);
+		buffer_append(&connection->output, header, sizeof(header));
+		buffer_append(&connection->output, response.text, response.length);
+		wake_loop(daemon);
+	}
+	connection->scheduled = 0;
+	mutex_unlock(&connection->lock);
+
+	interpreter_enter(previous);
+	wake_loop(daemon);
+}
+
+// ---- Event loop --------------------------------------------------------------
+
+static int set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Queue the complete frames of the input; returns 0 when the peer broke the protocol
+static int split_frames(Connection* connection) {
+	Buffer* input = &connection->input;
+	while (input->length >= 4) {
+		const unsigned char* header = (const unsigned char*)input->data;
+		size_t length = ((size_t)header[0] << 24) | ((size_t)header[1] << 16) | ((size_t)header[2] << 8) | header[3];
+		if (length > DAEMON_MAX_FRAME) return 0;
+		if (input->length < 4 + length) break;
+
+		Request* request = (Request*)malloc(sizeof(Request));
+		char* payload = (char*)malloc(length + 1);
+		if (!request || !payload) {
+			printf("Error: Memory allocation failed for a daemon request.\n");
+			exit(1);
+		}
+		memcpy(payload, input->data + 4, length);
+		payload[length] = '\0';
+		request->payload = payload;
+		request->next = NULL;
+		buffer_consume(input, 4 + length);
+
+		mutex_lock(&connection->lock);
+		if (connection->last != NULL) connection->last->next = request;
+		else connection->first = request;
+		connection->last = request;
+		mutex_unlock(&connection->lock);
+	}
+	return 1;
+}
+
+// Start a job for queued requests unless one is running; release the last finished one
+static void schedule(Daemon* daemon, Connection* connection) {
+	mutex_lock(&connection->lock);
+	int idle = !connection->scheduled;
+	int pending = connection->first != NULL;
+	Future* finished = idle ? connection->job : NULL;
+	if (idle) connection->job = NULL;
+	if (idle && pending) connection->scheduled = 1;
+	mutex_unlock(&connection->lock);
+
+	if (finished != NULL) future_free(finished);  // It has returned or is about to
+	if (idle && pending) {
+		Future* job = pool_submit(daemon->pool, serve_connection, connection);
+		mutex_lock(&connection->lock);
+		connection->job = job;
+		mutex_unlock(&connection->lock);
+	}
+}
+
+static void read_connection(Connection* connection) {
+	char chunk[65536];
+	for (;;) {
+		ssize_t received = read(connection->socket, chunk, sizeof(chunk));
+		if (received > 0) {
+			buffer_append(&connection->input, chunk, (size_t)received);
+			continue;
+		}
+		if (received < 0 && errno == EINTR) continue;
+		if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) connection->closing = 1;
+		break;
+	}
+	if (!split_frames(connection)) connection->closing = 1;
+}
+
+static void write_connection(Connection* connection) {
+	mutex_lock(&connection->lock);
+	while (connection->output.length > 0) {
+		ssize_t sent = send(connection->socket, connection->output.data, connection->output.length, MSG_NOSIGNAL);
+		if (sent > 0) {
+			buffer_consume(&connection->output, (size_t)sent);
+			continue;
+		}
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+		connection->closing = 1;  // The peer is gone: drop what it won't read
+		connection->output.length = 0;
+		break;
+	}
+	mutex_unlock(&connection->lock);
+}
+
+static void free_connection(Connection* connection) {
+	close(connection->socket);
+	while (connection->first != NULL) {
+		Request* request = connection->first;
+		connection->first = request->next;
+		free(request->payload);
+		free(request);
+	}
+	free(connection->input.data);
+	free(connection->output.data);
+	mutex_destroy(&connection->lock);
+	free(connection);
+}
+
+static int open_socket(const char* socket_path) {
+	struct sockaddr_un address;
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		printf("Error: Socket path %s is too long.\n", socket_path);
+		return -1;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(socket_path);
+	if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0 || !set_nonblocking(listener)) {
+		printf("Error: Could not listen on %s: %s\n", socket_path, strerror(errno));
+		if (listener >= 0) close(listener);
+		return -1;
+	}
+	return listener;
+}
+
+int daemon_run(const char* socket_path, int worker_count) {
+	trace_tokens = 0;  // Loading a class mustn't dump its tokens into the daemon's output
+	int listener = open_socket(socket_path);
+	if (listener < 0) return 1;
+
+	Daemon daemon;
+	memset(&daemon, 0, sizeof(daemon));
+	if (pipe(daemon.wake) != 0 || !set_nonblocking(daemon.wake[0])) {
+		printf("Error: Could not create the daemon's wake pipe.\n");
+		exit(1);
+	}
+	daemon.context = interpreter_create(0);
+	daemon.pool = pool_create(worker_count);
+	mutex_init(&daemon.lock);
+
+	Connection* connections = NULL;
+	int connection_count = 0;
+	struct pollfd* polls = NULL;
+	int poll_capacity = 0;
+
+	// Once stopping, serve what is queued and flush the responses, then leave
+	for (;;) {
+		int stopping = atomic_read(&daemon.stopping) != 0;
+		int busy = 0;
+		for (Connection* connection = connections; connection != NULL; connection = connection->next) {
+			mutex_lock(&connection->lock);
+			busy |= connection->scheduled || connection->first != NULL || connection->output.length > 0;
+			mutex_unlock(&connection->lock);
+		}
+		if (stopping && !busy) break;
+
+		if (poll_capacity < connection_count + 2) {
+			poll_capacity = (connection_count + 2) * 2;
+			polls = (struct pollfd*)realloc(polls, sizeof(struct pollfd) * poll_capacity);
+			if (!polls) {
+				printf("Error: Memory allocation failed for daemon polls.\n");
+				exit(1);
+			}
+		}
+		polls[0].fd = daemon.wake[0];
+		polls[0].events = POLLIN;
+		polls[1].fd = stopping ? -1 : listener;
+		polls[1].events = POLLIN;
+		int count = 2;
+		for (Connection* connection = connections; connection != NULL; connection = connection->next) {
+			mutex_lock(&connection->lock);
+			// A connection that hung up is only polled for its remaining output
+			int reading = !connection->closing && !stopping;
+			polls[count].fd = reading || connection->output.length > 0 ? connection->socket : -1;
+			polls[count].events = (reading ? POLLIN : 0) | (connection->output.length > 0 ? POLLOUT : 0);
+			mutex_unlock(&connection->lock);
+			count++;
+		}
+
+		if (poll(polls, count, -1) < 0) {
+			if (errno == EINTR) continue;
+			printf("Error: Daemon poll failed: %s\n", strerror(errno));
+			exit(1);
+		}
+
+		if (polls[0].revents & POLLIN) {
+			char drain[256];
+			while (read(daemon.wake[0], drain, sizeof(drain)) > 0) {}
+		}
+
+		int index = 2;
+		for (Connection* connection = connections; connection != NULL; connection = connection->next, index++) {
+			short events = polls[index].revents;
+			if (events & (POLLIN | POLLHUP | POLLERR)) read_connection(connection);
+			if (events & POLLOUT) write_connection(connection);
+		}
+
+		// New connections go first in the list, after the polls above were matched up
+		if (polls[1].revents & POLLIN) {
+			int client;
+			while ((client = accept(listener, NULL, NULL)) >= 0) {
+				Connection* connection = (Connection*)calloc(1, sizeof(Connection));
+				if (!connection) {
+					printf("Error: Memory allocation failed for a daemon connection.\n");
+					exit(1);
+				}
+				set_nonblocking(client);
+				connection->socket = client;
+				connection->daemon = &daemon;
+				mutex_init(&connection->lock);
+				connection->next = connections;
+				connections = connection;
+				connection_count++;
+			}
+		}
+
+		// Run what arrived, flush what is ready and drop idle connections that hung up
+		Connection** link = &connections;
+		while (*link != NULL) {
+			Connection* connection = *link;
+			schedule(&daemon, connection);
+			write_connection(connection);
+			mutex_lock(&connection->lock);
+			int idle = !connection->scheduled && connection->job == NULL && connection->first == NULL;
+			int done = connection->closing && idle && connection->output.length == 0;
+			mutex_unlock(&connection->lock);
+			if (done) {
+				*link = connection->next;
+				free_connection(connection);
+				connection_count--;
+			}
+			else {
+				link = &connection->next;
+			}
+		}
+	}
+
+	while (connections != NULL) {
+		Connection* connection = connections;
+		connections = connection->next;
+		schedule(&daemon, connection);  // Releases the finished job
+		free_connection(connection);
+	}
+	free(polls);
+	close(listener);
+	unlink(socket_path);
+	close(daemon.wake[0]);
+	close(daemon.wake[1]);
+	pool_destroy(daemon.pool);
+
+	for (int i = 0; i < daemon.handle_count; i++) {
+		if (daemon.handles[i].object != NULL) free_object(daemon.handles[i].object);
+	}
+	free(daemon.handles);
+	interpreter_destroy(daemon.context);
+	mutex_destroy(&daemon.lock);
+	return 0;
+}
+
+#endif
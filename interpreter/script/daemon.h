@@ -0,0 +1,32 @@
+#pragma once
+
+// Resident interpreter serving requests over a Unix domain socket, so hosts that
+// run many short jobs pay for process startup and parsing once.
+//
+// A frame is a 4-byte big-endian payload length followed by the payload, whose
+// first word is the command:
+//   load <source>                  load (or hot reload) every class of the source -> ok <classes>
+//   new <class>                    create an object -> ok <handle>
+//   call <handle> <method> [args]  call a method (int, float or one-word string arguments) -> ok <result>
+//   get <handle> [fields]          read fields, all of them by default -> ok name=value ...
+//   free <handle>                  free an object -> ok
+//   stop                           stop the daemon once this response is sent -> ok
+// Strings come back quoted, with the escapes of script literals.
+// Every request gets one response frame, "ok ..." or "error <message>". Clients
+// may pipeline: the requests of a connection run one after another, in order, on
+// the worker pool, and their responses come back in the same order. Requests of
+// different connections run in parallel. Classes and objects are shared by every
+// connection and live until freed or the daemon stops. Freeing a handle that another
+// connection is calling fails the requests that follow, while the running ones finish
+// on the object, which the last of them frees.
+// A script error (a class that doesn't parse, an index out of bounds...) fails its
+// request with "error <message>"; what the request allocated until then stays in the
+// daemon, and classes loaded before the failing one of a source stay loaded. Errors
+// inside parallel loops and failed allocations still stop the daemon (see ErrorTrap).
+
+// Largest payload accepted; a connection sending a larger frame is closed
+#define DAEMON_MAX_FRAME (16 * 1024 * 1024)
+
+// Serve on the socket path (replacing a stale socket file) with `worker_count` workers
+// (<= 0 for one per core) until a stop request. Returns 0, or 1 if the socket can't be opened.
+int daemon_run(const char* socket_path, int worker_count);
@@ -0,0 +1,560 @@
+#include "gc.h"
+#include "context.h"
+#include "reload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- Heap ----------------------------------------------------------------------
+
+// Nursery memory: objects are laid out one after another past the header
+typedef struct GcChunk {
+	struct GcChunk* prev;  // Retained list only
+	struct GcChunk* next;  // Young, retained or free list
+	GcHeap* heap;
+	char* cursor;          // Next free byte
+	char* end;
+	size_t size;           // Bytes after the header
+	long live;             // Promoted objects still alive in the chunk
+} GcChunk;
+
+#define GC_CHUNK_HEADER ((sizeof(GcChunk) + 15) & ~(size_t)15)
+
+typedef enum {
+	GC_IDLE,
+	GC_MARKING,   // Old objects are being marked, GC_MARK_SLICE per step
+	GC_SWEEPING,  // Unmarked old objects are being freed, GC_SWEEP_SLICE per step
+} GcPhase;
+
+// Growable stack of objects (gray objects, the minor collection's work, the remembered set)
+typedef struct ObjectStack {
+	Object** items;
+	int count;
+	int capacity;
+} ObjectStack;
+
+struct GcHeap {
+	Mutex lock;                // Guards everything below; held through every collection step
+	Interpreter* context;      // Chunks and work lists are allocated in it
+	volatile long running;     // Calls holding collections off (see gc_enter), -1 while a step runs
+	volatile long work;        // A collection step is due
+	volatile long young_bytes; // Nursery bytes handed out since the last minor collection
+	long epoch;                // Changes at every minor collection, invalidating the allocation buffers
+	GcChunk* young;            // Chunks handed out since the last minor collection
+	GcChunk* retained;         // Chunks holding old objects
+	GcChunk* free_chunks;      // Empty nursery chunks kept for reuse
+	int free_count;
+	Object* old;               // Old objects (linked through gc_next)
+	size_t major_threshold;    // Old generation bytes that start the next major collection
+	GcPhase phase;
+	volatile long marking;     // phase == GC_MARKING, for the write barrier
+	Object* sweeping;          // Old objects the running sweep hasn't reached yet
+	ObjectStack gray;          // Marked old objects whose fields are still to be traced
+	ObjectStack reached;       // Reached young objects whose fields are still to be traced
+	ObjectStack remembered;    // Old objects holding a young reference
+	Object* roots;             // Host objects (linked through gc_next and gc_prev)
+	const Value* entry_args;   // Arguments of the host call whose gc_enter runs a step
+	int entry_count;
+	GcStack* stacks;           // Frame stacks of the context's coroutines
+	long long step_work;       // Objects the current step traced, promoted or freed
+	GcUsage usage;
+};
+
+volatile long gc_marking_heaps = 0;
+
+// Source of heap epochs: unique across heaps, so a buffer left over from a destroyed
+// heap never matches a new one at the same address
+static volatile long gc_epochs = 0;
+
+// Nursery chunk of the calling thread
+typedef struct GcBuffer {
+	GcHeap* heap;
+	long epoch;
+	GcChunk* chunk;
+} GcBuffer;
+
+static THREAD_LOCAL GcBuffer allocation_buffer;
+
+static void object_stack_push(ObjectStack* stack, Object* obj) {
+	if (stack->count == stack->capacity) {
+		stack->capacity = stack->capacity ? stack->capacity * 2 : 256;
+		stack->items = (Object**)memory_realloc(MEMORY_RUNTIME, stack->items, sizeof(Object*) * stack->capacity);
+	}
+	stack->items[stack->count++] = obj;
+}
+
+GcHeap* gc_create(Interpreter* interpreter) {
+	Interpreter* previous = interpreter_enter(interpreter);
+	GcHeap* heap = (GcHeap*)memory_calloc(MEMORY_RUNTIME, 1, sizeof(GcHeap));
+	interpreter_enter(previous);
+	mutex_init(&heap->lock);
+	heap->context = interpreter;
+	heap->epoch = atomic_increment(&gc_epochs);
+	heap->major_threshold = GC_MAJOR_MINIMUM;
+	return heap;
+}
+
+void gc_destroy(GcHeap* heap) {
+	// Objects, chunks and lists are context memory, released with it
+	if (heap->marking) {
+		atomic_decrement(&gc_marking_heaps);
+	}
+	mutex_destroy(&heap->lock);
+}
+
+// ---- Objects and chunks ----------------------------------------------------------
+
+// Bytes of an object whose fields follow its header, kept 16-byte aligned
+static size_t object_size(int field_count) {
+	return (sizeof(Object) + sizeof(Field) * (size_t)field_count + 15) & ~(size_t)15;
+}
+
+// Release what a dead object owns; its memory goes with its chunk
+static void release_object(Object* obj) {
+	ClassNode* class_node = obj->class_type;
+	free_object_fields(class_node, obj->field_values);
+	if (obj->field_values != NULL && obj->field_values != (Field*)(obj + 1)) {
+		memory_free(obj->field_values);  // Migrated to a reloaded layout
+	}
+	memory_free(obj->field_addresses);
+	class_release(class_node);
+}
+
+static void recycle_chunk(GcHeap* heap, GcChunk* chunk) {
+	if (chunk->size == GC_CHUNK_SIZE && heap->free_count < GC_FREE_CHUNKS) {
+		chunk->next = heap->free_chunks;
+		heap->free_chunks = chunk;
+		heap->free_count++;
+	}
+	else {
+		memory_free(chunk);
+	}
+}
+
+static void retain_chunk(GcHeap* heap, GcChunk* chunk) {
+	chunk->prev = NULL;
+	chunk->next = heap->retained;
+	if (heap->retained != NULL) heap->retained->prev = chunk;
+	heap->retained = chunk;
+}
+
+static void release_chunk(GcHeap* heap, GcChunk* chunk) {
+	if (chunk->prev != NULL) chunk->prev->next = chunk->next;
+	else heap->retained = chunk->next;
+	if (chunk->next != NULL) chunk->next->prev = chunk->prev;
+	recycle_chunk(heap, chunk);
+}
+
+// ---- Tracing ---------------------------------------------------------------------
+
+typedef void (*GcVisit)(GcHeap* heap, Object* obj);
+
+static void visit_young(GcHeap* heap, Object* obj) {
+	if (obj->generation != OBJECT_YOUNG || (obj->gc_flags & GC_REACHED)) return;
+	atomic_write(&obj->gc_flags, obj->gc_flags | GC_REACHED);
+	object_stack_push(&heap->reached, obj);
+}
+
+static void visit_old(GcHeap* heap, Object* obj) {
+	if (obj->generation != OBJECT_OLD || (obj->gc_flags & GC_MARKED)) return;
+	atomic_write(&obj->gc_flags, obj->gc_flags | GC_MARKED);
+	object_stack_push(&heap->gray, obj);
+}
+
+static void visit_value(GcHeap* heap, Value value, GcVisit visit) {
+	if (value.type == VALUE_OBJECT && value.as.o != NULL) visit(heap, value.as.o);
+}
+
+static void visit_fields(GcHeap* heap, Object* obj, GcVisit visit) {
+	if (!obj->class_type->uses_references) return;
+	int count = obj->class_type->field_count;
+	for (int i = 0; i < count; i++) {
+		visit_value(heap, obj->field_values[i].value, visit);
+	}
+	heap->step_work++;
+}
+
+static void visit_frames(GcHeap* heap, FrameStack* frames, GcVisit visit) {
+	for (int i = 0; i < frames->top; i++) {
+		visit_value(heap, frames->slots[i], visit);
+	}
+	visit_value(heap, frames->return_value, visit);
+	if (frames->entered != NULL) visit(heap, frames->entered);
+}
+
+// Host objects, coroutine stacks and the stack (and receiver) of the call collecting
+static void visit_roots(GcHeap* heap, FrameStack* stack, Object* receiver, GcVisit visit) {
+	for (Object* root = heap->roots; root != NULL; root = root->gc_next) {
+		visit_fields(heap, root, visit);
+	}
+	for (GcStack* coroutine = heap->stacks; coroutine != NULL; coroutine = coroutine->next) {
+		visit_frames(heap, coroutine->frames, visit);
+		if (coroutine->receiver != NULL) visit(heap, coroutine->receiver);
+		for (int i = 0; i < coroutine->argument_count; i++) {
+			visit_value(heap, coroutine->args[i], visit);
+		}
+	}
+	if (stack != NULL) visit_frames(heap, stack, visit);
+	if (receiver != NULL) visit(heap, receiver);
+	for (int i = 0; i < heap->entry_count; i++) {
+		visit_value(heap, heap->entry_args[i], visit);
+	}
+}
+
+// ---- Minor collection -----------------------------------------------------------
+
+// Trace the nursery from the roots and the remembered set, promote what was reached
+// in place and free the rest
+static void collect_young(GcHeap* heap, FrameStack* stack, Object* receiver) {
+	visit_roots(heap, stack, receiver, visit_young);
+	for (int i = 0; i < heap->remembered.count; i++) {
+		visit_fields(heap, heap->remembered.items[i], visit_young);
+	}
+	while (heap->reached.count > 0) {
+		visit_fields(heap, heap->reached.items[--heap->reached.count], visit_young);
+	}
+
+	GcChunk* chunk = heap->young;
+	heap->young = NULL;
+	while (chunk != NULL) {
+		GcChunk* next = chunk->next;
+		for (char* cursor = (char*)chunk + GC_CHUNK_HEADER; cursor < chunk->cursor; ) {
+			Object* obj = (Object*)cursor;
+			cursor += obj->gc_size;
+			if (obj->gc_flags & GC_REACHED) {
+				obj->generation = OBJECT_OLD;
+				atomic_write(&obj->gc_flags, obj->gc_flags & ~GC_REACHED);
+				obj->gc_next = heap->old;
+				heap->old = obj;
+				chunk->live++;
+				heap->usage.old_bytes += obj->gc_size;
+				heap->usage.old_objects++;
+				heap->usage.promoted++;
+				if (heap->phase == GC_MARKING) {
+					visit_old(heap, obj);  // Reachable now, so live for the running major collection
+				}
+			}
+			else {
+				release_object(obj);
+				heap->usage.freed++;
+			}
+			heap->step_work++;
+		}
+		if (chunk->live > 0) retain_chunk(heap, chunk);
+		else recycle_chunk(heap, chunk);
+		chunk = next;
+	}
+
+	// Every survivor is old now: nothing points into the nursery
+	for (int i = 0; i < heap->remembered.count; i++) {
+		Object* obj = heap->remembered.items[i];
+		atomic_write(&obj->gc_flags, obj->gc_flags & ~GC_REMEMBERED);
+	}
+	heap->remembered.count = 0;
+	atomic_write(&heap->young_bytes, 0);
+	heap->epoch = atomic_increment(&gc_epochs);
+	heap->usage.minor_collections++;
+}
+
+// ---- Major collection -----------------------------------------------------------
+
+static void start_marking(GcHeap* heap, FrameStack* stack, Object* receiver) {
+	heap->phase = GC_MARKING;
+	atomic_write(&heap->marking, 1);
+	atomic_increment(&gc_marking_heaps);
+	visit_roots(heap, stack, receiver, visit_old);
+}
+
+static void mark_slice(GcHeap* heap, int budget) {
+	while (heap->gray.count > 0 && budget-- > 0) {
+		visit_fields(heap, heap->gray.items[--heap->gray.count], visit_old);
+	}
+}
+
+// Gray objects are all traced: promote the live young objects (marked), trace what the
+// roots point to now, and hand the old generation to the sweep
+static void finish_marking(GcHeap* heap, FrameStack* stack, Object* receiver) {
+	collect_young(heap, stack, receiver);
+	visit_roots(heap, stack, receiver, visit_old);
+	mark_slice(heap, INT_MAX);
+
+	heap->phase = GC_SWEEPING;
+	atomic_write(&heap->marking, 0);
+	atomic_decrement(&gc_marking_heaps);
+	heap->sweeping = heap->old;
+	heap->old = NULL;
+}
+
+static void forget_remembered(GcHeap* heap, Object* obj) {
+	for (int i = 0; i < heap->remembered.count; i++) {
+		if (heap->remembered.items[i] == obj) {
+			heap->remembered.items[i] = heap->remembered.items[--heap->remembered.count];
+			return;
+		}
+	}
+}
+
+static void sweep_slice(GcHeap* heap, int budget) {
+	while (heap->sweeping != NULL && budget-- > 0) {
+		Object* obj = heap->sweeping;
+		heap->sweeping = obj->gc_next;
+		if (obj->gc_flags & GC_MARKED) {
+			atomic_write(&obj->gc_flags, obj->gc_flags & ~GC_MARKED);
+			obj->gc_next = heap->old;
+			heap->old = obj;
+		}
+		else {
+			if (obj->gc_flags & GC_REMEMBERED) forget_remembered(heap, obj);
+			GcChunk* chunk = obj->gc_chunk;
+			heap->usage.old_bytes -= obj->gc_size;
+			heap->usage.old_objects--;
+			heap->usage.freed++;
+			release_object(obj);
+			if (--chunk->live == 0) release_chunk(heap, chunk);
+		}
+		heap->step_work++;
+	}
+	if (heap->sweeping == NULL) {
+		heap->phase = GC_IDLE;
+		heap->major_threshold = heap->usage.old_bytes * 2 > GC_MAJOR_MINIMUM ? heap->usage.old_bytes * 2 : GC_MAJOR_MINIMUM;
+		heap->usage.major_collections++;
+	}
+}
+
+// ---- Safepoints -----------------------------------------------------------------
+
+static int work_due(GcHeap* heap) {
+	return atomic_read(&heap->young_bytes) >= GC_NURSERY_SIZE || heap->phase != GC_IDLE || heap->usage.old_bytes >= heap->major_threshold;
+}
+
+// One bounded piece of work: a minor collection once the nursery is full, otherwise a
+// slice of the major collection. The caller has set running to -1 and holds the lock.
+static void collect_step(GcHeap* heap, FrameStack* stack, Object* receiver) {
+	Interpreter* previous = interpreter_enter(heap->context);
+	heap->step_work = 0;
+	if (atomic_read(&heap->young_bytes) >= GC_NURSERY_SIZE) {
+		collect_young(heap, stack, receiver);
+	}
+	else if (heap->phase == GC_MARKING) {
+		mark_slice(heap, GC_MARK_SLICE);
+		if (heap->gray.count == 0) finish_marking(heap, stack, receiver);
+	}
+	else if (heap->phase == GC_SWEEPING) {
+		sweep_slice(heap, GC_SWEEP_SLICE);
+	}
+	if (heap->phase == GC_IDLE && heap->usage.old_bytes >= heap->major_threshold) {
+		start_marking(heap, stack, receiver);
+	}
+	if (heap->step_work > heap->usage.largest_step) heap->usage.largest_step = heap->step_work;
+	atomic_write(&heap->work, work_due(heap));
+	interpreter_enter(previous);
+}
+
+void gc_enter(GcHeap* heap, FrameStack* stack, Object* receiver, const Value* args, int argument_count, int collect) {
+	if (stack->heap != NULL) return;  // A resumed coroutine's call: the resume holds it
+
+	for (;;) {
+		long running = atomic_read(&heap->running);
+		if (running < 0 || (running > 0 && atomic_read(&heap->young_bytes) >= GC_NURSERY_LIMIT)) {
+			// A step is running, or the nursery has outgrown the calls' own collections:
+			// let the running calls drain so the next one collects
+			thread_yield();
+			continue;
+		}
+		if (running == 0 && collect && atomic_read(&heap->work)) {
+			if (atomic_compare_swap(&heap->running, 0, -1) != 0) continue;
+			mutex_lock(&heap->lock);
+			heap->entry_args = args;
+			heap->entry_count = argument_count;
+			collect_step(heap, stack, receiver);
+			heap->entry_count = 0;
+			mutex_unlock(&heap->lock);
+			atomic_write(&heap->running, 1);
+			break;
+		}
+		if (atomic_compare_swap(&heap->running, running, running + 1) == running) break;
+	}
+	stack->heap = heap;
+}
+
+void gc_leave(FrameStack* stack) {
+	GcHeap* heap = stack->heap;
+	stack->heap = NULL;
+	atomic_decrement(&heap->running);
+}
+
+// Allocation ran out of chunk: collect first when the call is the only one running
+static void collect_in_call(GcHeap* heap) {
+	FrameStack* stack = current_frame_stack();
+	if (stack->heap != heap || atomic_compare_swap(&heap->running, 1, -1) != 1) return;
+	mutex_lock(&heap->lock);
+	collect_step(heap, stack, NULL);
+	mutex_unlock(&heap->lock);
+	atomic_write(&heap->running, 1);
+}
+
+// A chunk with room for `size` bytes: the thread's next nursery chunk, or one of its own for a large object
+static GcChunk* refill_buffer(GcHeap* heap, size_t size) {
+	if (atomic_read(&heap->work)) {
+		collect_in_call(heap);
+	}
+
+	int large = size > GC_LARGE_OBJECT;
+	size_t chunk_size = large ? size : GC_CHUNK_SIZE;
+	mutex_lock(&heap->lock);
+	GcChunk* chunk = NULL;
+	if (!large && heap->free_chunks != NULL) {
+		chunk = heap->free_chunks;
+		heap->free_chunks = chunk->next;
+		heap->free_count--;
+	}
+	mutex_unlock(&heap->lock);
+
+	if (chunk == NULL) {
+		Interpreter* previous = interpreter_enter(heap->context);
+		chunk = (GcChunk*)memory_alloc(MEMORY_OBJECTS, GC_CHUNK_HEADER + chunk_size);
+		interpreter_enter(previous);
+		chunk->heap = heap;
+		chunk->size = chunk_size;
+	}
+	chunk->cursor = (char*)chunk + GC_CHUNK_HEADER;
+	chunk->end = chunk->cursor + chunk_size;
+	chunk->live = 0;
+	chunk->prev = NULL;
+
+	mutex_lock(&heap->lock);
+	chunk->next = heap->young;
+	heap->young = chunk;
+	mutex_unlock(&heap->lock);
+	if (atomic_add(&heap->young_bytes, (long)chunk_size) >= GC_NURSERY_SIZE) {
+		atomic_write(&heap->work, 1);
+	}
+
+	if (!large) {
+		allocation_buffer.heap = heap;
+		allocation_buffer.epoch = heap->epoch;
+		allocation_buffer.chunk = chunk;
+	}
+	return chunk;
+}
+
+Object* gc_new_object(ClassNode* class_node) {
+	class_node = class_latest(class_node);
+	GcHeap* heap = interpreter_heap(class_node->context);
+	size_t size = object_size(class_node->field_count);
+
+	GcChunk* chunk = allocation_buffer.chunk;
+	if (allocation_buffer.heap != heap || allocation_buffer.epoch != heap->epoch || (size_t)(chunk->end - chunk->cursor) < size) {
+		chunk = refill_buffer(heap, size);
+	}
+	Object* obj = (Object*)chunk->cursor;
+	chunk->cursor += size;
+
+	obj->class_type = class_node;
+	obj->field_values = class_node->field_count > 0 ? (Field*)(obj + 1) : NULL;
+	obj->field_addresses = NULL;
+	obj->calls = 0;
+	obj->generation = OBJECT_YOUNG;
+	obj->gc_flags = 0;
+	obj->gc_size = size;
+	obj->gc_chunk = chunk;
+	obj->gc_next = NULL;
+	obj->gc_prev = NULL;
+	Interpreter* previous = interpreter_enter(class_node->context);
+	init_object_fields(class_node, obj->field_values);
+	interpreter_enter(previous);
+	class_retain(class_node);
+	return obj;
+}
+
+// ---- Barrier and roots ------------------------------------------------------------
+
+void gc_barrier_slow(Object* holder, Object* value) {
+	GcHeap* heap = value->gc_chunk->heap;
+	if (value->generation == OBJECT_OLD && !atomic_read(&heap->marking)) return;  // Another heap is marking
+
+	mutex_lock(&heap->lock);
+	Interpreter* previous = interpreter_enter(heap->context);
+	if (value->generation == OBJECT_YOUNG) {
+		if (!(holder->gc_flags & GC_REMEMBERED)) {
+			atomic_write(&holder->gc_flags, holder->gc_flags | GC_REMEMBERED);
+			object_stack_push(&heap->remembered, holder);
+		}
+	}
+	else if (heap->phase == GC_MARKING) {
+		visit_old(heap, value);
+	}
+	interpreter_enter(previous);
+	mutex_unlock(&heap->lock);
+}
+
+void gc_add_root(Object* obj) {
+	GcHeap* heap = interpreter_heap(obj->class_type->context);
+	mutex_lock(&heap->lock);
+	obj->gc_prev = NULL;
+	obj->gc_next = heap->roots;
+	if (heap->roots != NULL) heap->roots->gc_prev = obj;
+	heap->roots = obj;
+	atomic_write(&obj->gc_flags, obj->gc_flags | GC_ROOT);
+	mutex_unlock(&heap->lock);
+}
+
+void gc_remove_root(Object* obj) {
+	GcHeap* heap = interpreter_heap(obj->class_type->context);
+	mutex_lock(&heap->lock);
+	if (obj->gc_prev != NULL) obj->gc_prev->gc_next = obj->gc_next;
+	else heap->roots = obj->gc_next;
+	if (obj->gc_next != NULL) obj->gc_next->gc_prev = obj->gc_prev;
+	atomic_write(&obj->gc_flags, obj->gc_flags & ~GC_ROOT);
+	mutex_unlock(&heap->lock);
+}
+
+void gc_register_stack(GcHeap* heap, GcStack* stack) {
+	mutex_lock(&heap->lock);
+	stack->prev = NULL;
+	stack->next = heap->stacks;
+	if (heap->stacks != NULL) heap->stacks->prev = stack;
+	heap->stacks = stack;
+	mutex_unlock(&heap->lock);
+}
+
+void gc_unregister_stack(GcHeap* heap, GcStack* stack) {
+	mutex_lock(&heap->lock);
+	if (stack->prev != NULL) stack->prev->next = stack->next;
+	else heap->stacks = stack->next;
+	if (stack->next != NULL) stack->next->prev = stack->prev;
+	mutex_unlock(&heap->lock);
+}
+
+// ---- Host control -----------------------------------------------------------------
+
+void gc_collect(Interpreter* interpreter) {
+	GcHeap* heap = interpreter_heap(interpreter);
+	while (atomic_compare_swap(&heap->running, 0, -1) != 0) {
+		thread_yield();
+	}
+	mutex_lock(&heap->lock);
+	Interpreter* previous = interpreter_enter(heap->context);
+	heap->step_work = 0;
+
+	// Finish the cycle in progress, then run a whole one
+	if (heap->phase == GC_SWEEPING) sweep_slice(heap, INT_MAX);
+	if (heap->phase == GC_IDLE) start_marking(heap, NULL, NULL);
+	mark_slice(heap, INT_MAX);
+	finish_marking(heap, NULL, NULL);
+	sweep_slice(heap, INT_MAX);
+
+	if (heap->step_work > heap->usage.largest_step) heap->usage.largest_step = heap->step_work;
+	atomic_write(&heap->work, work_due(heap));
+	interpreter_enter(previous);
+	mutex_unlock(&heap->lock);
+	atomic_write(&heap->running, 0);
+}
+
+void gc_usage(Interpreter* interpreter, GcUsage* usage) {
+	GcHeap* heap = interpreter_heap(interpreter);
+	mutex_lock(&heap->lock);
+	*usage = heap->usage;
+	usage->young_bytes = (size_t)atomic_read(&heap->young_bytes);
+	mutex_unlock(&heap->lock);
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "parse.h"    // Include parse.h for Object, ClassNode and FrameStack
+#include "threads.h"  // Include threads.h for the barrier's atomic reads
+
+// Garbage collection of the objects scripts make with `new`
+//
+// Each context has a heap. `new` bumps a pointer through a nursery chunk owned by
+// the allocating thread, so allocating takes no lock. The collector is precise:
+// references live only in fields and frame slots, whose tags say which values are
+// objects. The roots are the objects made by create_object, the frame stacks of the
+// coroutines of the context and the stack of the call that collects.
+//
+// The heap has two generations. Once the nursery has handed out GC_NURSERY_SIZE bytes,
+// a minor collection traces the young objects reachable from the roots and from the
+// old objects the write barrier remembered (those a young reference was stored into),
+// promotes them and frees the rest, so its pause grows with the survivors rather than
+// with the old generation. Objects never move: a promoted object stays in its chunk,
+// and a chunk is reused once every object in it has died. When the old generation has
+// doubled since the last major collection, the old objects are marked incrementally,
+// GC_MARK_SLICE at a time, between which scripts keep running: while marking, the
+// write barrier shades every old object stored into a field, and the roots are
+// scanned again before marking ends. Unmarked old objects are then swept
+// GC_SWEEP_SLICE at a time.
+//
+// Collection work runs at safepoints: when a host call or coroutine resume enters a
+// context in which no call is running, and when a call allocates while it is the only
+// one running in the context. A reference the host got from a call or a field is only
+// valid until its next call or resume in the context; the references it passes in
+// are rooted for the call. Parallel loops can't make objects, so no collection runs
+// while their chunks do.
+
+#define GC_CHUNK_SIZE (32 * 1024)           // Bytes of a nursery chunk
+#define GC_LARGE_OBJECT (GC_CHUNK_SIZE / 4)  // Bigger objects get a chunk of their own
+#define GC_NURSERY_SIZE (4 * 1024 * 1024)   // Bytes handed out between minor collections
+#define GC_NURSERY_LIMIT (4 * GC_NURSERY_SIZE)  // Past this, entering calls wait for the running ones to collect
+#define GC_MAJOR_MINIMUM (8 * 1024 * 1024)  // Old generation bytes before the first major collection
+#define GC_MARK_SLICE 4096                  // Old objects marked per safepoint
+#define GC_SWEEP_SLICE 8192                 // Old objects swept per safepoint
+#define GC_FREE_CHUNKS 64                   // Empty chunks kept for reuse
+
+// Object::gc_flags
+#define GC_MARKED 1      // Reached by the running major collection
+#define GC_REMEMBERED 2  // Old object in the remembered set
+#define GC_REACHED 4     // Young object reached by the running minor collection
+#define GC_ROOT 8        // Host object in the heap's root list
+
+typedef struct GcHeap GcHeap;
+
+// Frame stack of a coroutine, scanned at every collection of its context
+typedef struct GcStack {
+	FrameStack* frames;
+	Object* receiver;    // Object the coroutine calls its method on
+	Value* args;         // Arguments it starts with
+	int argument_count;
+	struct GcStack* prev;
+	struct GcStack* next;
+} GcStack;
+
+typedef struct GcUsage {
+	size_t young_bytes;          // Nursery bytes handed out since the last minor collection
+	size_t old_bytes;            // Bytes of the old generation
+	long long old_objects;
+	long long minor_collections;
+	long long major_collections;  // Completed mark and sweep cycles
+	long long promoted;           // Objects that survived a minor collection
+	long long freed;              // Objects freed by either collection
+	long long largest_step;       // Most objects a single safepoint traced or swept
+} GcUsage;
+
+// Heap of a context (see interpreter_heap), freed with the context's memory
+GcHeap* gc_create(struct Interpreter* interpreter);
+void gc_destroy(GcHeap* heap);
+
+// An object of the newest version of the class, owned by the collector of its context
+Object* gc_new_object(ClassNode* class_node);
+
+// Host objects whose class uses references are roots from create_object to free_object
+void gc_add_root(Object* obj);
+void gc_remove_root(Object* obj);
+void gc_register_stack(GcHeap* heap, GcStack* stack);
+void gc_unregister_stack(GcHeap* heap, GcStack* stack);
+
+// Start the outermost call of a stack on the context: wait out a running collection
+// step, run one first when `collect` is set and work is due, then hold collections
+// off until gc_leave, apart from the ones the call runs itself when it allocates as
+// the context's only call. The stack, the receiver and the host's arguments are roots
+// of that step.
+void gc_enter(GcHeap* heap, FrameStack* stack, Object* receiver, const Value* args, int argument_count, int collect);
+void gc_leave(FrameStack* stack);
+
+// Write barrier, after storing a reference to `value` into a field of `holder`
+extern volatile long gc_marking_heaps;  // Heaps marking their old generation
+void gc_barrier_slow(Object* holder, Object* value);
+
+static inline void gc_write_barrier(Object* holder, Object* value) {
+	if (value == NULL || value->generation == OBJECT_HOST) return;
+	if (value->generation == OBJECT_YOUNG) {
+		// An old object pointing into the nursery is a root of the next minor collection
+		if (holder->generation == OBJECT_OLD && !(atomic_read(&holder->gc_flags) & GC_REMEMBERED)) gc_barrier_slow(holder, value);
+	}
+	else if (atomic_read(&gc_marking_heaps) > 0 && !(atomic_read(&value->gc_flags) & GC_MARKED)) {
+		gc_barrier_slow(holder, value);
+	}
+}
+
+// Host control
+// Run a full collection: minor, then a complete major one. No call may be running in the context.
+void gc_collect(struct Interpreter* interpreter);
+void gc_usage(struct Interpreter* interpreter, GcUsage* usage);
@@ -1,22 +1,105 @@
 #include "parse.h"
+#include "context.h"
+#include "daemon.h"
+#include "stream.h"
 #include "lexer.h"
+#include "native.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Whole contents of a file, NUL-terminated
+static char* read_file(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "Error: Could not open %s.\n", path);
+		exit(1);
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char* text = (char*)malloc(size + 1);
+	if (!text || fread(text, 1, size, file) != (size_t)size) {
+		fprintf(stderr, "Error: Could not read %s.\n", path);
+		exit(1);
+	}
+	text[size] = '\0';
+	fclose(file);
+	return text;
+}
+
+// --stream <script> <method> [--in a,b] [--out c,d] [--binary] [--header] [input]:
+// run the method of the script's class once per record of the input (stdin by default)
+// and write the output fields of every record to stdout (see stream.h)
+static int run_stream(int argc, char** argv) {
+	StreamOptions options = { STREAM_CSV, NULL, NULL, 0 };
+	const char* input_path = NULL;
+	for (int i = 4; i < argc; i++) {
+		if (strcmp(argv[i], "--in") == 0 && i + 1 < argc) options.input_fields = argv[++i];
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) options.output_fields = argv[++i];
+		else if (strcmp(argv[i], "--binary") == 0) options.format = STREAM_BINARY;
+		else if (strcmp(argv[i], "--header") == 0) options.header = 1;
+		else input_path = argv[i];
+	}
+
+	FILE* input = input_path != NULL ? fopen(input_path, "rb") : stdin;
+	if (!input) {
+		fprintf(stderr, "Error: Could not open %s.\n", input_path);
+		return 1;
+	}
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	_setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+	trace_tokens = 0;  // stdout carries the records
+	char* script = read_file(argv[2]);
+	Interpreter* interpreter = interpreter_create(0);
+	ClassNode* class_node = interpreter_load_class(interpreter, script);
+	long long records = stream_records(class_node, argv[3], input, stdout, &options);
+	fprintf(stderr, "Processed %lld records\n", records);
+
+	if (input != stdin) fclose(input);
+	interpreter_destroy(interpreter);
+	free(script);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 3 && strcmp(argv[1], "--stream") == 0) {
+		return run_stream(argc, argv);
+	}
+	// --daemon <socket> [workers] serves scripts over a Unix domain socket instead (see daemon.h)
+	if (argc > 2 && strcmp(argv[1], "--daemon") == 0) {
+		return daemon_run(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+	}
+
+	// --aot transpiles the class to C and runs the compiled methods natively
+	int aot = argc > 1 && strcmp(argv[1], "--aot") == 0;
 
-int main() {
 	const char* code =
 		"class MyClass {"
 		"  int x;"
+		"  int add(int a, int b) {"
+		"    return a + b;"
+		"  }"
 		"  void myMethod() {"
 		"    if (x < 10) {"
 		"      x = 15;"
 		"    }"
 		"    for (int i = 0; i < 3; i++) {"
-		"      x = x + 1;"
+		"      x = add(x, 1);"
 		"    }"
 		"  }"
 		"}";
 
+	// Keep the full text around: the lexer advances `code` while parsing
+	const char* source_text = code;
+
 	// Point the global source pointer to the source code
 	source = &code;
 
@@ -47,6 +130,10 @@ int main() {
 		method = method->next;
 	}
 
+	if (aot && !compile_class_native(class_node, source_text)) {
+		printf("AOT compilation unavailable, running interpreted.\n");
+	}
+
 	// Create an object of the parsed class
 	Object* my_object = create_object(class_node);
 	printf("Created object of class %s\n", my_object->class_type->class_name);
@@ -58,6 +145,7 @@ int main() {
 	// Cleanup
 	free_object(my_object);
 	free_class_node(class_node);
+	unload_native_modules();
 	clean_up();
 
 	return 0;
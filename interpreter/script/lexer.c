@@ -1,10 +1,11 @@
 #include "lexer.h"
+#include "context.h"
 
 
 
 
 void push(StackNode** top, char value) {
-	StackNode* newNode = (StackNode*)malloc(sizeof(StackNode));
+	StackNode* newNode = (StackNode*)memory_alloc(MEMORY_RUNTIME, sizeof(StackNode));
 	newNode->data = value;
 	newNode->next = *top;
 	*top = newNode;
@@ -15,7 +16,7 @@ char pop(StackNode** top) {
 	StackNode* temp = *top;
 	char popped = temp->data;
 	*top = (*top)->next;
-	free(temp);
+	memory_free(temp);
 	return popped;
 }
 
@@ -92,6 +93,21 @@ Token next_token(const char** src) {
 		token.type = TOKEN_FOR;
 		token.value = "for";
 	}
+	else if (strncmp(*src, "parallel", 8) == 0 && !isalnum((*src)[8]) && (*src)[8] != '_') {
+		*src += 8;
+		token.type = TOKEN_PARALLEL;
+		token.value = "parallel";
+	}
+	else if (strncmp(*src, "memo", 4) == 0 && !isalnum((*src)[4]) && (*src)[4] != '_') {
+		*src += 4;
+		token.type = TOKEN_MEMO;
+		token.value = "memo";
+	}
+	else if (strncmp(*src, "yield", 5) == 0 && !isalnum((*src)[5]) && (*src)[5] != '_') {
+		*src += 5;
+		token.type = TOKEN_YIELD;
+		token.value = "yield";
+	}
 	else if (strncmp(*src, "if", 2) == 0 && !isalnum((*src)[2])) {
 		*src += 2;
 		token.type = TOKEN_IF;
@@ -102,6 +118,21 @@ Token next_token(const char** src) {
 		token.type = TOKEN_ELSE;
 		token.value = "else";
 	}
+	else if (strncmp(*src, "return", 6) == 0 && !isalnum((*src)[6]) && (*src)[6] != '_') {
+		*src += 6;
+		token.type = TOKEN_RETURN;
+		token.value = "return";
+	}
+	else if (strncmp(*src, "new", 3) == 0 && !isalnum((*src)[3]) && (*src)[3] != '_') {
+		*src += 3;
+		token.type = TOKEN_NEW;
+		token.value = "new";
+	}
+	else if (strncmp(*src, "null", 4) == 0 && !isalnum((*src)[4]) && (*src)[4] != '_') {
+		*src += 4;
+		token.type = TOKEN_NULL;
+		token.value = "null";
+	}
 	else if (**src == '{') {
 		(*src)++;
 		token.type = TOKEN_LBRACE;
@@ -117,6 +148,17 @@ Token next_token(const char** src) {
 		token.type = TOKEN_SEMICOLON;
 		token.value = ";";
 	}
+	else if (**src == ':') {
+		(*src)++;
+		token.type = TOKEN_COLON;
+		token.value = ":";
+	}
+	else if (**src == '.') {
+		// Float literals never start with '.', so this is a member access
+		(*src)++;
+		token.type = TOKEN_DOT;
+		token.value = ".";
+	}
 	else if (**src == ',') {
 		(*src)++;
 		token.type = TOKEN_COMMA;
@@ -132,6 +174,16 @@ Token next_token(const char** src) {
 		token.type = TOKEN_RPAREN;
 		token.value = ")";
 	}
+	else if (**src == '[') {
+		(*src)++;
+		token.type = TOKEN_LBRACKET;
+		token.value = "[";
+	}
+	else if (**src == ']') {
+		(*src)++;
+		token.type = TOKEN_RBRACKET;
+		token.value = "]";
+	}
 	// Recognize comparison operators
 	else if (**src == '<') {
 		(*src)++;
@@ -229,30 +281,61 @@ Token next_token(const char** src) {
 	else if (isalpha(**src)) {
 		const char* start = *src;
 		while (isalnum(**src) || **src == '_') (*src)++;
-		size_t length = *src - start;
-		char* value = (char*)malloc(length + 1);
-		strncpy(value, start, length);
-		value[length] = '\0';
 		token.type = TOKEN_IDENTIFIER;
-		token.value = value;
+		token.value = intern_span(start, (size_t)(*src - start));  // Shared by every use of the name
 	}
-	// Recognize integers
+	// Recognize integers and float literals (digits '.' digits)
 	else if (isdigit(**src)) {
 		const char* start = *src;
 		while (isdigit(**src)) (*src)++;
-		size_t length = *src - start;
-		char* value = (char*)malloc(length + 1);
-		strncpy(value, start, length);
-		value[length] = '\0';
 		token.type = TOKEN_INT;
-		token.value = value;
+		if (**src == '.' && isdigit((*src)[1])) {
+			(*src)++;
+			while (isdigit(**src)) (*src)++;
+			token.type = TOKEN_FLOAT_LITERAL;
+		}
+		token.value = intern_span(start, (size_t)(*src - start));  // Never freed, so shared like names
+	}
+	// String literals: the escapes \n, \t, \" and \\ are decoded here
+	else if (**src == '"') {
+		(*src)++;
+		size_t capacity = 16;
+		size_t length = 0;
+		char* text = (char*)memory_alloc(MEMORY_STRINGS, capacity);
+		while (**src != '"') {
+			char c = **src;
+			if (c == '\0' || c == '\n') {
+				script_error("Unterminated string literal.");
+			}
+			if (c == '\\') {
+				(*src)++;
+				switch (**src) {
+				case 'n': c = '\n'; break;
+				case 't': c = '\t'; break;
+				case '"': c = '"'; break;
+				case '\\': c = '\\'; break;
+				default:
+					script_error("Unknown escape \\%c in string literal.", **src);
+				}
+			}
+			if (length + 1 == capacity) {
+				capacity *= 2;
+				text = (char*)memory_realloc(MEMORY_STRINGS, text, capacity);
+			}
+			text[length++] = c;
+			(*src)++;
+		}
+		(*src)++;
+		token.type = TOKEN_STRING_LITERAL;
+		token.value = intern_span(text, length);  // Every use of the same text shares it
+		memory_free(text);
 	}
 	else if (**src == '\0') {
 		token.type = TOKEN_END;
 		token.value = "end";
 	}
 	else {
-		char* unknown_value = (char*)malloc(2);
+		char* unknown_value = (char*)memory_alloc(MEMORY_STRINGS, 2);
 		unknown_value[0] = **src;
 		unknown_value[1] = '\0';
 		token.type = TOKEN_UNKNOWN;
@@ -263,9 +346,9 @@ Token next_token(const char** src) {
 	return token; // Return the token variable
 }
 
-// Free memory for tokens that are dynamically allocated
+// Free memory for tokens that are dynamically allocated (identifiers are interned, never freed)
 void free_token(Token token) {
-	if (token.type == TOKEN_IDENTIFIER || token.type == TOKEN_UNKNOWN) {
-		free((char*)token.value);
+	if (token.type == TOKEN_UNKNOWN) {
+		memory_free((char*)token.value);
 	}
 }
\ No newline at end of file
@@ -34,6 +34,18 @@ typedef enum {
 	TOKEN_GREATER_EQUAL,  // >=
 	TOKEN_EQUAL,          // ==
 	TOKEN_NOT_EQUAL,      // !=
+	TOKEN_RETURN,         // return keyword
+	TOKEN_FLOAT_LITERAL,  // 1.5
+	TOKEN_LBRACKET,       // [
+	TOKEN_RBRACKET,       // ]
+	TOKEN_PARALLEL,       // parallel keyword (parallel for)
+	TOKEN_YIELD,          // yield keyword
+	TOKEN_COLON,          // : (class B : A)
+	TOKEN_NEW,            // new keyword
+	TOKEN_NULL,           // null keyword
+	TOKEN_DOT,            // . (member access)
+	TOKEN_STRING_LITERAL, // "text" (the value is the decoded, interned text)
+	TOKEN_MEMO,           // memo keyword (memoized method)
 	TOKEN_END          // for end of file
 } TokenType;
 
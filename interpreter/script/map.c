@@ -0,0 +1,150 @@
+#include "map.h"
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// Fibonacci hashing: the multiplication spreads consecutive keys over the whole
+// table, and its top bits are the best mixed
+static unsigned int home_slot(const Map* map, int key) {
+	return ((unsigned int)key * 2654435769u) >> map->shift;
+}
+
+static MapSlot* allocate_slots(int capacity) {
+	MapSlot* slots = (MapSlot*)memory_calloc(MEMORY_ARRAYS, (size_t)capacity, sizeof(MapSlot));
+	if (!slots) {
+		printf("Error: Memory allocation failed for map.\n");
+		exit(1);
+	}
+	return slots;
+}
+
+// Place an entry known to be absent, displacing richer entries; returns its slot
+static MapSlot* place_entry(Map* map, MapSlot entry) {
+	unsigned int mask = (unsigned int)map->capacity - 1;
+	unsigned int index = home_slot(map, entry.key);
+	MapSlot* placed = NULL;
+	entry.distance = 1;
+	for (;;) {
+		MapSlot* slot = &map->slots[index];
+		if (slot->distance == 0) {
+			*slot = entry;
+			return placed != NULL ? placed : slot;
+		}
+		if (slot->distance < entry.distance) {
+			// Robin Hood: the entry further from home takes the slot
+			MapSlot displaced = *slot;
+			*slot = entry;
+			entry = displaced;
+			if (placed == NULL) placed = slot;
+		}
+		index = (index + 1) & mask;
+		entry.distance++;
+	}
+}
+
+static void grow(Map* map) {
+	int old_capacity = map->capacity;
+	MapSlot* old_slots = map->slots;
+	map->capacity = old_capacity > 0 ? old_capacity * 2 : MAP_MIN_CAPACITY;
+	map->shift = 32;
+	for (int capacity = map->capacity; capacity > 1; capacity >>= 1) map->shift--;
+	map->slots = allocate_slots(map->capacity);
+	for (int i = 0; i < old_capacity; i++) {
+		if (old_slots[i].distance != 0) place_entry(map, old_slots[i]);
+	}
+	memory_free(old_slots);
+}
+
+static MapSlot* find_slot(const Map* map, int key) {
+	if (map->count == 0) return NULL;
+	unsigned int mask = (unsigned int)map->capacity - 1;
+	unsigned int index = home_slot(map, key);
+	for (unsigned int distance = 1;; distance++) {
+		MapSlot* slot = &map->slots[index];
+		// An entry closer to home means the key would have taken this slot
+		if (slot->distance < distance) return NULL;
+		if (slot->key == key) return slot;
+		index = (index + 1) & mask;
+	}
+}
+
+Map* map_create(ValueType value_type) {
+	Map* map = (Map*)memory_alloc(MEMORY_ARRAYS, sizeof(Map));
+	if (!map) {
+		printf("Error: Memory allocation failed for map.\n");
+		exit(1);
+	}
+	map->value_type = value_type;
+	map->count = 0;
+	map->capacity = 0;
+	map->shift = 32;
+	map->slots = NULL;
+	return map;
+}
+
+void map_free(Map* map) {
+	if (map == NULL) return;
+	memory_free(map->slots);
+	memory_free(map);
+}
+
+void map_clear(Map* map) {
+	if (map->count == 0) return;
+	memset(map->slots, 0, sizeof(MapSlot) * (size_t)map->capacity);
+	map->count = 0;
+}
+
+const MapValue* map_find(const Map* map, int key) {
+	MapSlot* slot = find_slot(map, key);
+	return slot != NULL ? &slot->value : NULL;
+}
+
+MapValue* map_insert(Map* map, int key) {
+	MapSlot* slot = find_slot(map, key);
+	if (slot != NULL) return &slot->value;
+
+	if ((map->count + 1) * 8 > map->capacity * MAP_MAX_LOAD) {
+		grow(map);
+	}
+	MapSlot entry;
+	entry.key = key;
+	entry.value.i = 0;  // All-zero bits are 0 and 0.0f
+	entry.distance = 1;
+	map->count++;
+	return &place_entry(map, entry)->value;
+}
+
+int map_remove(Map* map, int key) {
+	MapSlot* slot = find_slot(map, key);
+	if (slot == NULL) return 0;
+
+	// Backward shift: pull each following entry that isn't at home one slot closer
+	unsigned int mask = (unsigned int)map->capacity - 1;
+	unsigned int index = (unsigned int)(slot - map->slots);
+	for (;;) {
+		unsigned int next = (index + 1) & mask;
+		if (map->slots[next].distance <= 1) break;
+		map->slots[index] = map->slots[next];
+		map->slots[index].distance--;
+		index = next;
+	}
+	map->slots[index].distance = 0;
+	map->count--;
+	return 1;
+}
+
+Value map_get(const Map* map, int key) {
+	const MapValue* value = map_find(map, key);
+	if (map->value_type == VALUE_FLOAT) {
+		return make_float(value != NULL ? value->f : 0.0f);
+	}
+	return make_int(value != NULL ? value->i : 0);
+}
+
+void map_put(Map* map, int key, Value value) {
+	MapValue* slot = map_insert(map, key);
+	if (map->value_type == VALUE_FLOAT) slot->f = value_to_float(value);
+	else slot->i = value_to_int(value);
+}
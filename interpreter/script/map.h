@@ -0,0 +1,52 @@
+#pragma once
+#include "value.h"  // Include value.h for ValueType and Value
+
+// Hash map behind an int[int] or float[int] field or local: int keys to unboxed
+// int or float values. `m[key]` reads a value (0 for a missing key) and
+// `m[key] = value` stores one; contains(m, key), remove(m, key) and len(m) are builtins.
+//
+// The table is a single array of slots probed linearly with Robin Hood hashing:
+// an insertion takes the slot of any entry closer to its home slot than itself, so
+// every entry stays near its home and a lookup stops at the first slot holding an
+// entry closer to home than the probe. A slot keeps the key, the value and that
+// distance together, so a probe reads consecutive slots of one block. Removal
+// shifts the following entries back, leaving no tombstones.
+
+#define MAP_MIN_CAPACITY 8
+#define MAP_MAX_LOAD 7  // Eighths of the slots in use before the table doubles
+
+typedef union MapValue {
+	int i;
+	float f;
+} MapValue;
+
+typedef struct MapSlot {
+	int key;
+	MapValue value;
+	unsigned int distance;  // 0 for a free slot, else 1 + the distance from the key's home slot
+} MapSlot;
+
+typedef struct Map {
+	ValueType value_type;  // VALUE_INT or VALUE_FLOAT
+	int count;             // Entries in use
+	int capacity;          // Power of two, or 0 before the first insertion
+	int shift;             // 32 - log2(capacity): the hash's top bits pick the home slot
+	MapSlot* slots;
+} Map;
+
+// Map functions
+Map* map_create(ValueType value_type);
+void map_free(Map* map);
+// Remove every entry (a re-executed declaration starts empty), keeping the table
+void map_clear(Map* map);
+
+// Value of the key, NULL when it is missing
+const MapValue* map_find(const Map* map, int key);
+// Value of the key, added as zero when it is missing
+MapValue* map_insert(Map* map, int key);
+// Returns 0 if the key wasn't in the map
+int map_remove(Map* map, int key);
+
+// Script access: missing keys read as zero, values are converted to the map's value type
+Value map_get(const Map* map, int key);
+void map_put(Map* map, int key, Value value);
@@ -0,0 +1,257 @@
+#include "memo.h"
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// ---- Purity check ------------------------------------------------------------
+
+typedef struct PurityScan {
+	Method** visited;  // Methods already scanned, or being scanned further up (recursion)
+	int visited_count;
+	int visited_capacity;
+	char reason[256];  // What the first impure method found does
+} PurityScan;
+
+static int scan_method(PurityScan* scan, Method* method);
+
+static int impure(PurityScan* scan, const char* format, const char* name) {
+	snprintf(scan->reason, sizeof(scan->reason), format, name);
+	return 1;
+}
+
+static int scan_expression(PurityScan* scan, ExpressionNode* expr) {
+	if (expr == NULL) return 0;
+	switch (expr->kind) {
+	case EXPR_VARIABLE:
+		if (expr->slot < 0) return impure(scan, "reads field %s", expr->variable);
+		break;
+	case EXPR_ASSIGN:
+		// Elements and members are checked through `left`
+		if (expr->left == EXPR_NONE && expr->slot < 0) return impure(scan, "writes field %s", expr->variable);
+		break;
+	case EXPR_MEMBER:
+	case EXPR_MEMBER_CALL:
+		return impure(scan, "reaches %s through a reference", expr->variable);
+	case EXPR_NEW:
+		return impure(scan, "makes a %s", expr->variable);
+	case EXPR_YIELD:
+		return impure(scan, "%s", "yields");
+	case EXPR_CALL:
+		if (scan_method(scan, expr->callee)) {
+			char callee_reason[sizeof(scan->reason)];
+			memcpy(callee_reason, scan->reason, sizeof(callee_reason));
+			snprintf(scan->reason, sizeof(scan->reason), "calls %.60s, which %.180s", expr->callee->name, callee_reason);
+			return 1;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (scan_expression(scan, ast_node(expr->left)) || scan_expression(scan, ast_node(expr->right)) || scan_expression(scan, ast_node(expr->assigned))) return 1;
+	for (int i = 0; i < expr->argument_count; i++) {
+		if (scan_expression(scan, ast_node(expr->arguments[i]))) return 1;
+	}
+	return 0;
+}
+
+static int scan_block(PurityScan* scan, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			if (scan_expression(scan, current->ifNode->condition) ||
+				scan_block(scan, current->ifNode->trueBlock) ||
+				scan_block(scan, current->ifNode->falseBlock)) return 1;
+			break;
+		case NODE_FOR: {
+			ForNode* for_node = current->forNode;
+			if (for_node->update->slot < 0) return impure(scan, "counts with field %s", for_node->update->variable);
+			if (scan_expression(scan, for_node->initializer) ||
+				scan_expression(scan, for_node->condition) ||
+				scan_block(scan, for_node->body)) return 1;
+			// The guards and the unchecked copy of the body only read what the body does
+			break;
+		}
+		default:
+			if (scan_expression(scan, current->expression)) return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
+// Assumes that the methods already visited are pure: a recursive call is pure when
+// the rest of the method is
+static int scan_method(PurityScan* scan, Method* method) {
+	for (int i = 0; i < scan->visited_count; i++) {
+		if (scan->visited[i] == method) return 0;
+	}
+	if (scan->visited_count == scan->visited_capacity) {
+		scan->visited_capacity = scan->visited_capacity * 2 + 8;
+		scan->visited = (Method**)memory_realloc(MEMORY_RUNTIME, scan->visited, sizeof(Method*) * scan->visited_capacity);
+		if (!scan->visited) {
+			printf("Error: Memory allocation failed while checking memo methods.\n");
+			exit(1);
+		}
+	}
+	scan->visited[scan->visited_count++] = method;
+	return scan_block(scan, method->body);
+}
+
+// Reports why the method can't be memoized; returns 0 if it can
+static int memo_error(Method* method, PurityScan* scan) {
+	if (strcmp(method->return_type, "void") == 0 || (method->result_type != VALUE_INT && method->result_type != VALUE_FLOAT)) {
+		script_report("memo method %s must return an int or a float", method->name);
+		return 1;
+	}
+	if (method->parameter_count > MEMO_MAX_PARAMETERS) {
+		script_report("memo method %s takes more than %d parameters", method->name, MEMO_MAX_PARAMETERS);
+		return 1;
+	}
+	for (int i = 0; i < method->parameter_count; i++) {
+		ValueType type = method->local_types[i];
+		if (type != VALUE_INT && type != VALUE_FLOAT) {
+			script_report("memo method %s can't use its %s parameter as a memo key", method->name, value_type_name(type));
+			return 1;
+		}
+	}
+	scan->visited_count = 0;
+	if (scan_method(scan, method)) {
+		script_report("memo method %s isn't pure: it %s", method->name, scan->reason);
+		return 1;
+	}
+	return 0;
+}
+
+static MemoTable* memo_create(Method* method) {
+	MemoTable* memo = (MemoTable*)memory_alloc(MEMORY_RUNTIME, sizeof(MemoTable));
+	if (!memo) {
+		printf("Error: Memory allocation failed for memo table.\n");
+		exit(1);
+	}
+	memo->argument_count = method->parameter_count;
+	memo->result_type = method->result_type;
+	memo->capacity = MEMO_WAYS;
+	memo->shift = 32;
+	while (memo->capacity < method->memo_capacity) {
+		memo->capacity *= 2;
+		memo->shift--;
+	}
+	memo->hits = 0;
+	memo->misses = 0;
+	memo->entries = (MemoEntry*)memory_calloc(MEMORY_RUNTIME, (size_t)memo->capacity, sizeof(MemoEntry));
+	if (!memo->entries) {
+		printf("Error: Memory allocation failed for memo table.\n");
+		exit(1);
+	}
+	return memo;
+}
+
+void check_memo_methods(ClassNode* class_node) {
+	PurityScan scan;
+	scan.visited = NULL;
+	scan.visited_count = 0;
+	scan.visited_capacity = 0;
+	int error_count = 0;
+
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		if (method->memo_capacity == 0) continue;
+		if (memo_error(method, &scan)) {
+			error_count++;
+		}
+		else {
+			method->memo = memo_create(method);
+		}
+	}
+	memory_free(scan.visited);
+
+	if (error_count > 0) {
+		script_error("%d memo method(s) of class %s can't be memoized", error_count, class_node->class_name);
+	}
+}
+
+void memo_free(MemoTable* memo) {
+	if (memo == NULL) return;
+	memory_free(memo->entries);
+	memory_free(memo);
+}
+
+// ---- Lookups -----------------------------------------------------------------
+
+// Fibonacci hashing of the argument bits, as for map keys (see map.c); the bits
+// hashed so far are folded before each further argument so it mixes with all of them
+static MemoEntry* find_bucket(MemoTable* memo, const MapValue* key) {
+	unsigned int hash = 0;
+	for (int i = 0; i < memo->argument_count; i++) {
+		hash ^= hash >> 16;
+		hash = (hash ^ (unsigned int)key[i].i) * 2654435769u;
+	}
+	return &memo->entries[(memo->shift < 32 ? hash >> memo->shift : 0) * MEMO_WAYS];
+}
+
+static void memo_key(MemoTable* memo, const Value* arguments, MapValue* key) {
+	for (int i = 0; i < memo->argument_count; i++) {
+		key[i].i = arguments[i].as.i;  // The bits of a float argument too
+	}
+}
+
+// Whether the entry holds the key, with its result in `value`. The entry is read,
+// then its sequence number checked again: a writer meanwhile would have changed it.
+static int read_entry(MemoTable* memo, MemoEntry* entry, const MapValue* key, MapValue* value) {
+	long sequence = atomic_read(&entry->sequence);
+	if (sequence == 0 || (sequence & 1) != 0) return 0;
+	*value = entry->result;
+	int found = memcmp(entry->arguments, key, sizeof(MapValue) * memo->argument_count) == 0;
+	atomic_fence();
+	return found && atomic_read(&entry->sequence) == sequence;
+}
+
+int memo_lookup(MemoTable* memo, const Value* arguments, Value* result) {
+	MapValue key[MEMO_MAX_PARAMETERS];
+	memo_key(memo, arguments, key);
+	MemoEntry* bucket = find_bucket(memo, key);
+	for (int way = 0; way < MEMO_WAYS; way++) {
+		MapValue value;
+		if (read_entry(memo, &bucket[way], key, &value)) {
+			*result = memo->result_type == VALUE_FLOAT ? make_float(value.f) : make_int(value.i);
+			atomic_increment(&memo->hits);
+			return 1;
+		}
+	}
+	atomic_increment(&memo->misses);
+	return 0;
+}
+
+void memo_store(MemoTable* memo, const Value* arguments, Value result) {
+	MapValue key[MEMO_MAX_PARAMETERS];
+	memo_key(memo, arguments, key);
+	MemoEntry* bucket = find_bucket(memo, key);
+
+	// A free way, else one picked by the miss count, unless another thread stored the key first
+	MemoEntry* entry = NULL;
+	for (int way = 0; way < MEMO_WAYS; way++) {
+		MapValue value;
+		if (read_entry(memo, &bucket[way], key, &value)) return;
+		if (entry == NULL && atomic_read(&bucket[way].sequence) == 0) entry = &bucket[way];
+	}
+	if (entry == NULL) entry = &bucket[atomic_read(&memo->misses) & (MEMO_WAYS - 1)];
+
+	// Claim the entry; if another thread is writing it, keep its result instead
+	long sequence = atomic_read(&entry->sequence);
+	if ((sequence & 1) != 0 || atomic_compare_swap(&entry->sequence, sequence, sequence + 1) != sequence) return;
+	memcpy(entry->arguments, key, sizeof(MapValue) * memo->argument_count);
+	if (memo->result_type == VALUE_FLOAT) entry->result.f = result.as.f;
+	else entry->result.i = result.as.i;
+	atomic_write(&entry->sequence, sequence + 2);
+}
+
+int method_memo_stats(ClassNode* class_node, const char* method_name, MemoStats* stats) {
+	Method* method = find_method(class_node, method_name);
+	if (method == NULL || method->memo == NULL) return 0;
+	stats->hits = atomic_read(&method->memo->hits);
+	stats->misses = atomic_read(&method->memo->misses);
+	stats->capacity = method->memo->capacity;
+	return 1;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "parse.h"    // Include parse.h for ClassNode and Method
+#include "map.h"      // Include map.h for MapValue
+#include "threads.h"  // Include threads.h for the sequence numbers and counters
+
+// Memoized methods: `memo int score(int a, float b) { ... }` caches results by
+// argument values, for helpers called over and over with a few distinct inputs.
+// `memo(n)` asks for n entries instead of MEMO_DEFAULT_CAPACITY.
+//
+// Only pure methods may be memoized, so that a result depends on the arguments alone.
+// check_memo_methods proves it for every memo method of a class:
+// - it takes at most MEMO_MAX_PARAMETERS ints or floats and returns an int or a float
+// - its body reads and writes no field, reaches no object through a reference,
+//   makes no object and doesn't yield (its own locals, arrays and maps are fine)
+// - every method it calls is pure in turn, recursive calls included
+//
+// The table has a power-of-two number of entries, in buckets of MEMO_WAYS; the
+// arguments hash to a bucket, and a miss stores its result in a free entry of it or
+// in place of one of its calls, so the table never grows. Every thread calling the
+// method shares it without locks: a writer makes the entry's sequence number odd
+// while it fills the entry, and a reader that sees the number change meanwhile
+// treats the entry as holding another call.
+//
+// A hit costs one call of the instruction budget and skips the body. A call the
+// budget aborts stores nothing. A reloaded class starts with empty tables.
+
+#define MEMO_DEFAULT_CAPACITY 1024
+#define MEMO_MAX_CAPACITY (1 << 20)
+#define MEMO_MAX_PARAMETERS 8
+#define MEMO_WAYS 4  // Entries of a bucket, the calls a bucket holds at once
+
+typedef struct MemoEntry {
+	volatile long sequence;  // 0 while empty, odd while a thread writes the entry
+	MapValue result;
+	MapValue arguments[MEMO_MAX_PARAMETERS];  // Compared bitwise, so 0.0 and -0.0 are different calls
+} MemoEntry;
+
+typedef struct MemoTable {
+	int argument_count;
+	ValueType result_type;
+	int shift;               // 32 - log2(capacity / MEMO_WAYS): the hash's top bits pick the bucket
+	int capacity;            // Entries, at least MEMO_WAYS
+	volatile long hits;
+	volatile long misses;
+	MemoEntry* entries;
+} MemoTable;
+
+typedef struct MemoStats {
+	long hits;      // Calls answered from the table
+	long misses;    // Calls that ran the body
+	int capacity;   // Entries of the table
+} MemoStats;
+
+// Check that every memo method of the class is pure and give it its table; run by
+// parse_class after the optimizer (which doesn't inline memo methods). Violations
+// are reported for the whole class before exiting.
+void check_memo_methods(ClassNode* class_node);
+void memo_free(MemoTable* memo);
+
+// Result of a call with these arguments (the method's first slots), if the table holds one
+int memo_lookup(MemoTable* memo, const Value* arguments, Value* result);
+void memo_store(MemoTable* memo, const Value* arguments, Value result);
+
+// Counters of a memo method, 0 if the class has no memo method by that name
+int method_memo_stats(ClassNode* class_node, const char* method_name, MemoStats* stats);
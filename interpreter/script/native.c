@@ -0,0 +1,596 @@
+#ifdef _MSC_VER
+#define strdup _strdup
+#endif
+
+#include "native.h"
+#include "parse.h"
+#include "context.h"
+#include "threads.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#define NATIVE_MODULE_EXT ".dll"
+#define NATIVE_DEFAULT_CC "cl"
+#define NATIVE_COMPILE_COMMAND "%s /nologo /O2 /LD \"%s\" /Fe:\"%s\" /Fo:\"%s/\" >NUL"
+#else
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define NATIVE_MODULE_EXT ".so"
+#define NATIVE_DEFAULT_CC "cc"
+#define NATIVE_COMPILE_COMMAND "%s -O2 -shared -fPIC -o \"%s\" \"%s\""
+#endif
+
+// Growable text buffer, so a method can be discarded if it turns out not to be transpilable
+typedef struct CodeBuffer {
+	char* data;
+	size_t length;
+	size_t capacity;
+} CodeBuffer;
+
+// Methods of the class being transpiled and whether each one can be compiled.
+// A method is only compiled when every method it calls is compiled too.
+typedef struct NativePlan {
+	ClassNode* class_node;
+	Method** methods;
+	int* enabled;
+	int count;
+} NativePlan;
+
+// Handles of every module loaded so far (classes may be compiled on several threads, see cache.h)
+static Mutex module_lock = MUTEX_INITIALIZER;
+static void** loaded_modules = NULL;
+static int loaded_module_count = 0;
+
+static void buffer_append(CodeBuffer* buf, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int needed = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+
+	if (buf->length + needed + 1 > buf->capacity) {
+		size_t new_capacity = buf->capacity ? buf->capacity * 2 : 1024;
+		while (new_capacity < buf->length + needed + 1) new_capacity *= 2;
+		char* data = (char*)realloc(buf->data, new_capacity);
+		if (!data) {
+			printf("Error: Memory allocation failed for native code buffer.\n");
+			exit(1);
+		}
+		buf->data = data;
+		buf->capacity = new_capacity;
+	}
+
+	va_start(args, format);
+	vsnprintf(buf->data + buf->length, needed + 1, format, args);
+	va_end(args);
+	buf->length += needed;
+}
+
+static void buffer_indent(CodeBuffer* buf, int depth) {
+	for (int i = 0; i < depth; i++) {
+		buffer_append(buf, "\t");
+	}
+}
+
+static int method_enabled(NativePlan* plan, Method* method) {
+	for (int i = 0; i < plan->count; i++) {
+		if (plan->methods[i] == method) {
+			return plan->enabled[i];
+		}
+	}
+	return 0;
+}
+
+static Field* find_class_field(ClassNode* class_node, const char* name) {
+	int index = find_field(class_node, name);
+	return index >= 0 ? class_node->field_table[index] : NULL;
+}
+
+// Map an operator stored in ExpressionNode::variable to its C spelling
+static const char* binary_operator(const char* op) {
+	static const char* operators[] = { "<", ">", "<=", ">=", "==", "!=", "+", "-", "*", "/" };
+	for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+		if (strcmp(op, operators[i]) == 0) {
+			return operators[i];
+		}
+	}
+	return NULL;
+}
+
+static const char* c_type_name(ValueType type) {
+	return type == VALUE_FLOAT ? "float" : "int";
+}
+
+// Emit a read or write target: frame slots become C locals, fields go through the field struct
+static int emit_variable(CodeBuffer* buf, NativePlan* plan, const char* name, int slot) {
+	if (slot >= 0) {
+		buffer_append(buf, "l%d", slot);
+		return 1;
+	}
+
+	Field* field = find_class_field(plan->class_node, name);
+	if (field == NULL || is_array_type(field->value.type) || is_map_type(field->value.type) || field->value.type == VALUE_OBJECT || field->value.type == VALUE_STRING) {
+		return 0;  // Unknown names, arrays, maps and references are left to the interpreter
+	}
+	buffer_append(buf, "(*self->f_%s)", name);
+	return 1;
+}
+
+static int emit_expression(CodeBuffer* buf, NativePlan* plan, ExpressionNode* expr) {
+	if (expr == NULL) return 0;
+
+	if (expr->kind == EXPR_CALL) {
+		if (!method_enabled(plan, expr->callee)) return 0;
+		buffer_append(buf, "m_%s(self", expr->variable);
+		for (int i = 0; i < expr->argument_count; i++) {
+			buffer_append(buf, ", ");
+			if (!emit_expression(buf, plan, expr_child(expr, expr->arguments[i]))) return 0;
+		}
+		buffer_append(buf, ")");
+		return 1;
+	}
+
+	switch (expr->kind) {
+	case EXPR_VARIABLE:
+		return emit_variable(buf, plan, expr->variable, expr->slot);
+
+	case EXPR_CONVERT:
+		// C's casts follow the same rules as value_convert
+		buffer_append(buf, "((%s)", c_type_name(expr->value.type));
+		if (!emit_expression(buf, plan, expr_child(expr, expr->left))) return 0;
+		buffer_append(buf, ")");
+		return 1;
+
+	case EXPR_CONSTANT:
+		if (expr->value.type == VALUE_STRING) return 0;
+		if (expr->value.type == VALUE_FLOAT) {
+			if (!isfinite(expr->value.as.f)) return 0;  // Folded to inf/nan: no C literal for it
+			buffer_append(buf, "((float)%.9g)", expr->value.as.f);
+		}
+		else {
+			buffer_append(buf, "%d", expr->value.as.i);
+		}
+		return 1;
+
+	case EXPR_BINARY_INT:
+	case EXPR_BINARY_FLOAT: {
+		const char* op = binary_operator(expr->variable);
+		if (op == NULL || expr->left == EXPR_NONE || expr->right == EXPR_NONE) return 0;
+
+		// check_class gave both operands the same type; only integer division can trap
+		if (expr->kind == EXPR_BINARY_INT && expr->op == OP_DIVIDE) {
+			buffer_append(buf, "vf_div(");
+			if (!emit_expression(buf, plan, expr_child(expr, expr->left))) return 0;
+			buffer_append(buf, ", ");
+			if (!emit_expression(buf, plan, expr_child(expr, expr->right))) return 0;
+			buffer_append(buf, ")");
+			return 1;
+		}
+
+		buffer_append(buf, "(");
+		if (!emit_expression(buf, plan, expr_child(expr, expr->left))) return 0;
+		buffer_append(buf, " %s ", op);
+		if (!emit_expression(buf, plan, expr_child(expr, expr->right))) return 0;
+		buffer_append(buf, ")");
+		return 1;
+	}
+
+	default:
+		return 0;  // Assignments only appear as statements, and every binary node has been checked
+	}
+}
+
+static int emit_block(CodeBuffer* buf, NativePlan* plan, BlockNode* block, int depth);
+
+static int emit_for(CodeBuffer* buf, NativePlan* plan, ForNode* for_node, int depth) {
+	// Parallel loops are split across the worker pool by the interpreter
+	if (for_node->parallel) return 0;
+
+	buffer_indent(buf, depth);
+	buffer_append(buf, "l%d = ", for_node->initializer->slot);
+	if (!emit_expression(buf, plan, expr_child(for_node->initializer, for_node->initializer->assigned))) return 0;
+	buffer_append(buf, ";\n");
+	buffer_indent(buf, depth);
+	buffer_append(buf, "while (");
+	if (!emit_expression(buf, plan, for_node->condition)) return 0;
+	buffer_append(buf, ") {\n");
+
+	if (!emit_block(buf, plan, for_node->body, depth + 1)) return 0;
+
+	buffer_indent(buf, depth + 1);
+	if (!emit_variable(buf, plan, for_node->update->variable, for_node->update->slot)) return 0;
+	buffer_append(buf, " += %d;\n", for_node->update->value.as.i);
+	buffer_indent(buf, depth);
+	buffer_append(buf, "}\n");
+	return 1;
+}
+
+static int emit_block(CodeBuffer* buf, NativePlan* plan, BlockNode* block, int depth) {
+	BlockNode* current = block;
+	while (current != NULL) {
+		switch (current->node_type) {
+		case NODE_ASSIGNMENT:
+			if (current->expression->left != EXPR_NONE) return 0;  // Array elements stay interpreted
+			buffer_indent(buf, depth);
+			if (!emit_variable(buf, plan, current->expression->variable, current->expression->slot)) return 0;
+			buffer_append(buf, " = ");
+			if (!emit_expression(buf, plan, expr_child(current->expression, current->expression->assigned))) return 0;
+			buffer_append(buf, ";\n");
+			break;
+		case NODE_EXPRESSION:
+			buffer_indent(buf, depth);
+			if (!emit_expression(buf, plan, current->expression)) return 0;
+			buffer_append(buf, ";\n");
+			break;
+		case NODE_DECLARATION:
+			// Re-zeroed every time it runs, like the interpreter does
+			buffer_indent(buf, depth);
+			buffer_append(buf, "l%d = ", current->expression->slot);
+			if (current->expression->assigned == EXPR_NONE) {
+				buffer_append(buf, "0");
+			}
+			else if (!emit_expression(buf, plan, expr_child(current->expression, current->expression->assigned))) {
+				return 0;
+			}
+			buffer_append(buf, ";\n");
+			break;
+		case NODE_RETURN:
+			buffer_indent(buf, depth);
+			buffer_append(buf, "return ");
+			if (current->expression == NULL) {
+				buffer_append(buf, "0");
+			}
+			else if (!emit_expression(buf, plan, current->expression)) {
+				return 0;
+			}
+			buffer_append(buf, ";\n");
+			break;
+		case NODE_IF:
+			buffer_indent(buf, depth);
+			buffer_append(buf, "if (");
+			if (!emit_expression(buf, plan, current->ifNode->condition)) return 0;
+			buffer_append(buf, ") {\n");
+			if (!emit_block(buf, plan, current->ifNode->trueBlock, depth + 1)) return 0;
+			buffer_indent(buf, depth);
+			buffer_append(buf, "}\n");
+			if (current->ifNode->falseBlock) {
+				buffer_indent(buf, depth);
+				buffer_append(buf, "else {\n");
+				if (!emit_block(buf, plan, current->ifNode->falseBlock, depth + 1)) return 0;
+				buffer_indent(buf, depth);
+				buffer_append(buf, "}\n");
+			}
+			break;
+		case NODE_FOR:
+			if (!emit_for(buf, plan, current->forNode, depth)) return 0;
+			break;
+		default:
+			return 0;  // Anything else stays interpreted
+		}
+		current = current->next;
+	}
+	return 1;
+}
+
+// Internal methods take the parameters as C arguments, so calls between them are plain C calls
+static void emit_signature(CodeBuffer* buf, NativePlan* plan, Method* method) {
+	buffer_append(buf, "static %s m_%s(vf_%s* self", c_type_name(method->result_type), method->name, plan->class_node->class_name);
+	for (int i = 0; i < method->parameter_count; i++) {
+		buffer_append(buf, ", %s l%d", c_type_name(method->local_types[i]), i);
+	}
+	buffer_append(buf, ")");
+}
+
+static int emit_method(CodeBuffer* buf, NativePlan* plan, Method* method) {
+	// Methods working on arrays stay interpreted, their builtins already run vectorized kernels.
+	// So do methods holding references, whose objects the collector must see in frame slots,
+	// and methods holding strings, whose references the frame releases.
+	if (method->result_type == VALUE_OBJECT || method->result_type == VALUE_STRING) return 0;
+	for (int i = 0; i < method->local_count; i++) {
+		if (is_array_type(method->local_types[i]) || is_map_type(method->local_types[i]) || method->local_types[i] == VALUE_OBJECT || method->local_types[i] == VALUE_STRING) return 0;
+	}
+
+	emit_signature(buf, plan, method);
+	buffer_append(buf, " {\n");
+	buffer_append(buf, "\t(void)self;\n");
+
+	// Every other frame slot becomes a C local of its declared type starting at zero, like invoke_method does
+	for (int i = method->parameter_count; i < method->local_count; i++) {
+		buffer_append(buf, "\t%s l%d = 0;\n", c_type_name(method->local_types[i]), i);
+	}
+
+	if (!emit_block(buf, plan, method->body, 1)) return 0;
+
+	buffer_append(buf, "\treturn 0;\n}\n\n");
+	return 1;
+}
+
+int emit_class_c(ClassNode* class_node, FILE* out) {
+	NativePlan plan;
+	plan.class_node = class_node;
+	plan.count = 0;
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		plan.count++;
+	}
+	plan.methods = (Method**)malloc(sizeof(Method*) * (plan.count + 1));
+	plan.enabled = (int*)malloc(sizeof(int) * (plan.count + 1));
+	if (!plan.methods || !plan.enabled) {
+		printf("Error: Memory allocation failed for native plan.\n");
+		exit(1);
+	}
+	int index = 0;
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		plan.methods[index] = method;
+		plan.enabled[index] = 1;
+		index++;
+	}
+
+	// Drop untranspilable methods until the set is closed under calls
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+		for (int i = 0; i < plan.count; i++) {
+			if (!plan.enabled[i]) continue;
+			CodeBuffer buf = { NULL, 0, 0 };
+			if (!emit_method(&buf, &plan, plan.methods[i])) {
+				printf("AOT: method %s stays interpreted (unsupported construct).\n", plan.methods[i]->name);
+				plan.enabled[i] = 0;
+				changed = 1;
+			}
+			free(buf.data);
+		}
+	}
+
+	fprintf(out, "/* Generated by vfScript from class %s. Do not edit. */\n", class_node->class_name);
+	fprintf(out, "#include <stdio.h>\n#include <stdlib.h>\n\n");
+	fprintf(out, "#ifdef _WIN32\n#define VF_EXPORT __declspec(dllexport)\n#else\n#define VF_EXPORT\n#endif\n\n");
+
+	// Struct for the fields: one pointer per field, in ClassNode::fields order
+	fprintf(out, "typedef struct vf_%s {\n", class_node->class_name);
+	Field* field = class_node->fields;
+	while (field) {
+		int opaque = is_array_type(field->value.type) || is_map_type(field->value.type) || field->value.type == VALUE_OBJECT || field->value.type == VALUE_STRING;
+		fprintf(out, "\t%s* f_%s;\n", opaque ? "void" : c_type_name(field->value.type), field->name);
+		field = field->next;
+	}
+	if (class_node->fields == NULL) {
+		fprintf(out, "\tint unused;\n");
+	}
+	fprintf(out, "} vf_%s;\n\n", class_node->class_name);
+
+	// Same layout as Value, which is what the interpreter's frame slots hold
+	fprintf(out, "typedef struct vf_value {\n\tint type;\n\tunion {\n\t\tint i;\n\t\tfloat f;\n\t\tvoid* a;\n\t} as;\n} vf_value;\n\n");
+
+	// Runtime errors go back to the interpreter, which raises them as script errors (the handler doesn't return)
+	fprintf(out, "static void (*vf_error)(const char* message);\n\n");
+	fprintf(out, "VF_EXPORT void vf_set_error_handler(void (*handler)(const char* message)) {\n\tvf_error = handler;\n}\n\n");
+	fprintf(out, "static int vf_div(int left, int right) {\n");
+	fprintf(out, "\tif (right == 0) {\n\t\tvf_error(\"Division by zero.\");\n\t\treturn 0;\n\t}\n");
+	fprintf(out, "\treturn left / right;\n}\n\n");
+
+	// Prototypes first so methods can call each other in any order (and recurse)
+	CodeBuffer buf = { NULL, 0, 0 };
+	int emitted = 0;
+	for (int i = 0; i < plan.count; i++) {
+		if (!plan.enabled[i]) continue;
+		emit_signature(&buf, &plan, plan.methods[i]);
+		buffer_append(&buf, ";\n");
+		emitted++;
+	}
+	buffer_append(&buf, "\n");
+
+	// One C function per method, plus an exported entry point taking the frame's argument slots
+	for (int i = 0; i < plan.count; i++) {
+		if (!plan.enabled[i]) continue;
+		Method* method = plan.methods[i];
+		emit_method(&buf, &plan, method);
+		// invoke_method has already converted the arguments to the parameter types
+		const char* member = method->result_type == VALUE_FLOAT ? "f" : "i";
+		buffer_append(&buf, "VF_EXPORT vf_value vf_%s_%s(void** fields, vf_value* args) {\n", class_node->class_name, method->name);
+		buffer_append(&buf, "\tvf_value result;\n");
+		buffer_append(&buf, "\t(void)args;\n");
+		buffer_append(&buf, "\tresult.type = %d;\n", (int)method->result_type);
+		buffer_append(&buf, "\tresult.as.%s = m_%s((vf_%s*)fields", member, method->name, class_node->class_name);
+		for (int p = 0; p < method->parameter_count; p++) {
+			buffer_append(&buf, ", args[%d].as.%s", p, method->local_types[p] == VALUE_FLOAT ? "f" : "i");
+		}
+		buffer_append(&buf, ");\n\treturn result;\n}\n\n");
+	}
+	if (buf.length > 0) {
+		fwrite(buf.data, 1, buf.length, out);
+	}
+	free(buf.data);
+
+	free(plan.methods);
+	free(plan.enabled);
+	return emitted;
+}
+
+// 64-bit FNV-1a over the source text and everything that affects the artifact
+static unsigned long long hash_text(unsigned long long hash, const char* text) {
+	for (const unsigned char* p = (const unsigned char*)text; *p; p++) {
+		hash ^= *p;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Key of a class's module: a source unit may hold several classes, and a derived
+// class's module also depends on the bodies it inherits
+static unsigned long long hash_source(ClassNode* class_node, const char* source_text, const char* compiler) {
+	unsigned long long hash = 14695981039346656037ULL;
+	const char* parts[4] = { source_text, class_node->class_name, compiler, NATIVE_COMPILE_COMMAND };
+	for (int i = 0; i < 4; i++) {
+		hash = hash_text(hash, parts[i]);
+	}
+	for (ClassNode* base = class_node->base; base != NULL; base = base->base) {
+		hash = hash_text(hash, base->body_source);
+	}
+	hash ^= NATIVE_ABI_VERSION;
+	hash *= 1099511628211ULL;
+	return hash;
+}
+
+static int file_exists(const char* path) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) return 0;
+	fclose(file);
+	return 1;
+}
+
+static void* open_module(const char* path) {
+#ifdef _WIN32
+	return (void*)LoadLibraryA(path);
+#else
+	return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static void* find_symbol(void* module, const char* name) {
+#ifdef _WIN32
+	return (void*)GetProcAddress((HMODULE)module, name);
+#else
+	return dlsym(module, name);
+#endif
+}
+
+typedef void (*ErrorHandlerSetter)(void (*handler)(const char* message));
+
+// Errors of native code, such as an integer division by zero, raised like the interpreter's
+static void native_error(const char* message) {
+	script_error("%s", message);
+}
+
+static void close_module(void* module) {
+#ifdef _WIN32
+	FreeLibrary((HMODULE)module);
+#else
+	dlclose(module);
+#endif
+}
+
+// Emit and compile the class into module_path. The module is built under a
+// temporary name and renamed, so concurrent processes never load a partial file.
+static int build_module(ClassNode* class_node, const char* cache_dir, const char* compiler, const char* stem, const char* module_path) {
+	char c_path[1024];
+	char tmp_path[1024];
+	char command[4096];
+#ifdef _WIN32
+	int pid = _getpid();
+#else
+	int pid = (int)getpid();
+#endif
+
+	snprintf(c_path, sizeof(c_path), "%s/%s.%d.c", cache_dir, stem, pid);
+	snprintf(tmp_path, sizeof(tmp_path), "%s/%s.%d%s", cache_dir, stem, pid, NATIVE_MODULE_EXT);
+
+	FILE* out = fopen(c_path, "w");
+	if (out == NULL) {
+		printf("Error: Cannot write native source %s\n", c_path);
+		return 0;
+	}
+	int emitted = emit_class_c(class_node, out);
+	fclose(out);
+
+	if (emitted == 0) {
+		remove(c_path);
+		return 0;
+	}
+
+#ifdef _WIN32
+	snprintf(command, sizeof(command), NATIVE_COMPILE_COMMAND, compiler, c_path, tmp_path, cache_dir);
+#else
+	snprintf(command, sizeof(command), NATIVE_COMPILE_COMMAND, compiler, tmp_path, c_path);
+#endif
+	int status = system(command);
+	remove(c_path);
+	if (status != 0) {
+		printf("Error: Native compilation failed: %s\n", command);
+		remove(tmp_path);
+		return 0;
+	}
+
+	if (rename(tmp_path, module_path) != 0) {
+		// Another process published the same artifact first; use theirs
+		remove(tmp_path);
+	}
+	return file_exists(module_path);
+}
+
+int compile_class_native(ClassNode* class_node, const char* source_text) {
+	const char* cache_dir = getenv("VFSCRIPT_CACHE");
+	if (cache_dir == NULL) cache_dir = ".vfscript-cache";
+	const char* compiler = getenv("CC");
+	if (compiler == NULL) compiler = NATIVE_DEFAULT_CC;
+
+#ifdef _WIN32
+	_mkdir(cache_dir);
+#else
+	mkdir(cache_dir, 0755);
+#endif
+
+	char stem[32];
+	char module_path[1024];
+	snprintf(stem, sizeof(stem), "%016llx", hash_source(class_node, source_text, compiler));
+	snprintf(module_path, sizeof(module_path), "%s/%s%s", cache_dir, stem, NATIVE_MODULE_EXT);
+
+	if (file_exists(module_path)) {
+		printf("AOT: using cached module %s\n", module_path);
+	}
+	else if (!build_module(class_node, cache_dir, compiler, stem, module_path)) {
+		return 0;
+	}
+
+	void* module = open_module(module_path);
+	if (module == NULL) {
+		printf("Error: Cannot load native module %s\n", module_path);
+		return 0;
+	}
+	ErrorHandlerSetter set_error_handler = (ErrorHandlerSetter)find_symbol(module, "vf_set_error_handler");
+	if (set_error_handler == NULL) {
+		printf("Error: Native module %s has no error handler entry point\n", module_path);
+		close_module(module);
+		return 0;
+	}
+	set_error_handler(native_error);
+
+	mutex_lock(&module_lock);
+	void** modules = (void**)realloc(loaded_modules, sizeof(void*) * (loaded_module_count + 1));
+	if (!modules) {
+		printf("Error: Memory allocation failed for native module list.\n");
+		exit(1);
+	}
+	loaded_modules = modules;
+	loaded_modules[loaded_module_count++] = module;
+	mutex_unlock(&module_lock);
+
+	// Bind every method that made it into the module
+	Method* method = class_node->methods;
+	while (method) {
+		char symbol[512];
+		snprintf(symbol, sizeof(symbol), "vf_%s_%s", class_node->class_name, method->name);
+		method->native = (NativeMethod)find_symbol(module, symbol);
+		method = method->next;
+	}
+
+	return 1;
+}
+
+void unload_native_modules() {
+	mutex_lock(&module_lock);
+	for (int i = 0; i < loaded_module_count; i++) {
+		close_module(loaded_modules[i]);
+	}
+	free(loaded_modules);
+	loaded_modules = NULL;
+	loaded_module_count = 0;
+	mutex_unlock(&module_lock);
+}
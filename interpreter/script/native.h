@@ -0,0 +1,28 @@
+#pragma once
+#include "parse.h"  // Include parse.h to access ClassNode and Method structures
+
+// Bump this whenever the generated code or the calling convention changes,
+// so stale cached artifacts are never loaded
+#define NATIVE_ABI_VERSION 6
+
+// Signature of a transpiled method: receives the addresses of the object's
+// field payloads, in the same order as ClassNode::fields, and the frame slots
+// holding its arguments (already converted to the parameter types); returns
+// the method's result (int 0 for void methods)
+typedef Value (*NativeMethod)(void** fields, Value* args);
+
+// Ahead-of-time compilation functions
+
+// Transpile the class to C, compile it with the system C compiler (or reuse a
+// cached artifact keyed by the source hash) and bind every transpiled method
+// so execute_method calls it instead of walking the AST.
+// Returns 1 if a module was loaded, 0 if the class keeps running interpreted.
+int compile_class_native(ClassNode* class_node, const char* source_text);
+
+// Write the C translation unit for a class to out. Methods using constructs
+// the transpiler does not support are left out and stay interpreted.
+// Returns the number of methods emitted.
+int emit_class_c(ClassNode* class_node, FILE* out);
+
+// Close every loaded module (call once at shutdown, after the classes are freed)
+void unload_native_modules();
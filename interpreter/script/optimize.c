@@ -0,0 +1,741 @@
+#include "optimize.h"
+#include "parse.h"
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// How a callee body is rewritten while it is copied into a caller
+typedef struct InlineMap {
+	int slot_offset;              // Added to every callee frame slot (statement inlining)
+	uint32_t* arguments;          // Parameter reads are replaced by copies of these (expression inlining)
+	int parameter_count;
+} InlineMap;
+
+static void* allocate_node(size_t size) {
+	return ast_alloc(size);
+}
+
+static int is_constant(ExpressionNode* expr) {
+	return expr->kind == EXPR_CONSTANT;
+}
+
+static int is_variable(ExpressionNode* expr) {
+	return expr->kind == EXPR_VARIABLE;
+}
+
+// Wrap an expression in a conversion to `type` unless it already has that static type
+static ExpressionNode* convert_expression(ExpressionNode* expr, ValueType type) {
+	if (expr->type == type) return expr;
+
+	ExpressionNode* convert = ast_new_expression(EXPR_CONVERT);
+	convert->value = value_zero(type);
+	convert->type = type;
+	convert->slot = -1;
+	convert->field = -1;
+	convert->left = ast_index(expr);
+	return convert;
+}
+
+static int count_expression_nodes(ExpressionNode* expr) {
+	if (expr == NULL) return 0;
+	int count = 1 + count_expression_nodes(ast_node(expr->left)) + count_expression_nodes(ast_node(expr->right)) + count_expression_nodes(ast_node(expr->assigned));
+	for (int i = 0; i < expr->argument_count; i++) {
+		count += count_expression_nodes(ast_node(expr->arguments[i]));
+	}
+	return count;
+}
+
+static int count_block_nodes(BlockNode* block) {
+	int count = 0;
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		count++;
+		switch (current->node_type) {
+		case NODE_IF:
+			count += count_expression_nodes(current->ifNode->condition);
+			count += count_block_nodes(current->ifNode->trueBlock);
+			count += count_block_nodes(current->ifNode->falseBlock);
+			break;
+		case NODE_FOR:
+			count += count_expression_nodes(current->forNode->condition);
+			count += count_block_nodes(current->forNode->body);
+			break;
+		default:
+			count += count_expression_nodes(current->expression);
+			break;
+		}
+	}
+	return count;
+}
+
+static int contains_call(ExpressionNode* expr) {
+	if (expr == NULL) return 0;
+	if (expr->kind == EXPR_CALL || expr->kind == EXPR_YIELD) return 1;  // A yield hands control to the host
+	if (expr->kind == EXPR_MEMBER_CALL || expr->kind == EXPR_NEW) return 1;
+	return contains_call(ast_node(expr->left)) || contains_call(ast_node(expr->right)) || contains_call(ast_node(expr->assigned));
+}
+
+static int contains_return(BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		if (current->node_type == NODE_RETURN) return 1;
+		if (current->node_type == NODE_IF &&
+			(contains_return(current->ifNode->trueBlock) || contains_return(current->ifNode->falseBlock))) return 1;
+		if (current->node_type == NODE_FOR && contains_return(current->forNode->body)) return 1;
+	}
+	return 0;
+}
+
+// Call graph walk: does any call reachable from `block` lead to `target`?
+static int block_reaches(BlockNode* block, Method* target, Method** visited, int* visited_count);
+
+static int expression_reaches(ExpressionNode* expr, Method* target, Method** visited, int* visited_count) {
+	if (expr == NULL) return 0;
+	if (expr->kind == EXPR_CALL) {
+		if (expr->callee == target) return 1;
+		int seen = 0;
+		for (int i = 0; i < *visited_count; i++) {
+			if (visited[i] == expr->callee) seen = 1;
+		}
+		if (!seen && *visited_count < 256) {
+			visited[(*visited_count)++] = expr->callee;
+			if (block_reaches(expr->callee->body, target, visited, visited_count)) return 1;
+		}
+		for (int i = 0; i < expr->argument_count; i++) {
+			if (expression_reaches(ast_node(expr->arguments[i]), target, visited, visited_count)) return 1;
+		}
+		return 0;
+	}
+	return expression_reaches(ast_node(expr->left), target, visited, visited_count) ||
+		expression_reaches(ast_node(expr->right), target, visited, visited_count) ||
+		expression_reaches(ast_node(expr->assigned), target, visited, visited_count);
+}
+
+static int block_reaches(BlockNode* block, Method* target, Method** visited, int* visited_count) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			if (expression_reaches(current->ifNode->condition, target, visited, visited_count) ||
+				block_reaches(current->ifNode->trueBlock, target, visited, visited_count) ||
+				block_reaches(current->ifNode->falseBlock, target, visited, visited_count)) return 1;
+			break;
+		case NODE_FOR:
+			if (expression_reaches(current->forNode->condition, target, visited, visited_count) ||
+				block_reaches(current->forNode->body, target, visited, visited_count)) return 1;
+			break;
+		default:
+			if (expression_reaches(current->expression, target, visited, visited_count)) return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
+static int is_recursive(Method* method) {
+	Method* visited[256];
+	int visited_count = 0;
+	return block_reaches(method->body, method, visited, &visited_count);
+}
+
+// Body of a method that is exactly `return <expression>;`, NULL otherwise
+static ExpressionNode* expression_body(Method* method) {
+	BlockNode* body = method->body;
+	if (body == NULL || body->next != NULL || body->node_type != NODE_RETURN) return NULL;
+	return body->expression;
+}
+
+static ExpressionNode* clone_expression(ExpressionNode* expr, InlineMap* map) {
+	if (expr == NULL) return NULL;
+
+	// A parameter read is replaced by (a copy of) the argument expression
+	if (map != NULL && map->arguments != NULL && is_variable(expr) && expr->slot >= 0 && expr->slot < map->parameter_count) {
+		return clone_expression(ast_node(map->arguments[expr->slot]), NULL);
+	}
+
+	ExpressionNode* copy = ast_new_expression(expr->kind);
+	uint32_t index = copy->index;
+	*copy = *expr;
+	copy->index = index;
+	copy->assigned = ast_index(clone_expression(ast_node(expr->assigned), map));
+	copy->left = ast_index(clone_expression(ast_node(expr->left), map));
+	copy->right = ast_index(clone_expression(ast_node(expr->right), map));
+	if (map != NULL && copy->slot >= 0) {
+		copy->slot += map->slot_offset;
+	}
+	if (expr->argument_count > 0) {
+		copy->arguments = (uint32_t*)allocate_node(sizeof(uint32_t) * expr->argument_count);
+		for (int i = 0; i < expr->argument_count; i++) {
+			copy->arguments[i] = ast_index(clone_expression(ast_node(expr->arguments[i]), map));
+		}
+	}
+	return copy;
+}
+
+static BlockNode* clone_block(BlockNode* block, InlineMap* map) {
+	BlockNode* head = NULL;
+	BlockNode** tail = &head;
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		BlockNode* copy = (BlockNode*)allocate_node(sizeof(BlockNode));
+		*copy = *current;
+		copy->next = NULL;
+		switch (current->node_type) {
+		case NODE_IF:
+			copy->ifNode = (IfNode*)allocate_node(sizeof(IfNode));
+			copy->ifNode->condition = clone_expression(current->ifNode->condition, map);
+			copy->ifNode->trueBlock = clone_block(current->ifNode->trueBlock, map);
+			copy->ifNode->falseBlock = clone_block(current->ifNode->falseBlock, map);
+			break;
+		case NODE_FOR:
+			copy->forNode = (ForNode*)allocate_node(sizeof(ForNode));
+			*copy->forNode = *current->forNode;  // Keeps the parallel flag; check_parallel_loops runs on the final tree
+			copy->forNode->initializer = clone_expression(current->forNode->initializer, map);
+			copy->forNode->condition = clone_expression(current->forNode->condition, map);
+			copy->forNode->update = clone_expression(current->forNode->update, map);
+			copy->forNode->body = clone_block(current->forNode->body, map);
+			copy->forNode->unchecked_body = clone_block(current->forNode->unchecked_body, map);
+			copy->forNode->guard_count = current->forNode->guard_count;
+			copy->forNode->guards = NULL;
+			if (current->forNode->guard_count > 0) {
+				copy->forNode->guards = (ExpressionNode**)allocate_node(sizeof(ExpressionNode*) * current->forNode->guard_count);
+				for (int i = 0; i < current->forNode->guard_count; i++) {
+					copy->forNode->guards[i] = clone_expression(current->forNode->guards[i], map);
+				}
+			}
+			break;
+		default:
+			copy->expression = clone_expression(current->expression, map);
+			break;
+		}
+		*tail = copy;
+		tail = &copy->next;
+	}
+	return head;
+}
+
+// Is the callee small enough, non-recursive, not memoized and within the depth limit?
+static int can_inline(Method* callee, int depth) {
+	if (depth >= INLINE_MAX_DEPTH) return 0;
+	if (callee->memo_capacity > 0) return 0;  // Its calls go through its table
+	if (count_block_nodes(callee->body) > INLINE_BUDGET) return 0;
+	return !is_recursive(callee);
+}
+
+static void inline_block(BlockNode** block, Method* caller, int depth);
+
+// Replace calls to `return <expression>;` methods by the expression itself; returns
+// the node to use in place of expr
+static ExpressionNode* inline_expression(ExpressionNode* expr, Method* caller, int depth) {
+	if (expr == NULL) return NULL;
+
+	expr->assigned = ast_index(inline_expression(ast_node(expr->assigned), caller, depth));
+	expr->left = ast_index(inline_expression(ast_node(expr->left), caller, depth));
+	expr->right = ast_index(inline_expression(ast_node(expr->right), caller, depth));
+	for (int i = 0; i < expr->argument_count; i++) {
+		expr->arguments[i] = ast_index(inline_expression(ast_node(expr->arguments[i]), caller, depth));
+	}
+
+	if (expr->kind != EXPR_CALL) return expr;
+
+	Method* callee = expr->callee;
+	ExpressionNode* body = expression_body(callee);
+	if (body == NULL || !can_inline(callee, depth)) return expr;
+
+	// Arguments are substituted where the parameters are read, so they must be
+	// free of calls (no side effects to reorder, duplicate or drop)
+	for (int i = 0; i < expr->argument_count; i++) {
+		if (contains_call(ast_node(expr->arguments[i]))) return expr;
+	}
+
+	// Arguments take the parameter types and the result the return type, exactly as through a call
+	// (check_class has normally converted both already)
+	for (int i = 0; i < expr->argument_count; i++) {
+		expr->arguments[i] = ast_index(convert_expression(ast_node(expr->arguments[i]), callee->local_types[i]));
+	}
+
+	InlineMap map;
+	map.slot_offset = 0;
+	map.arguments = expr->arguments;
+	map.parameter_count = callee->parameter_count;
+
+	ExpressionNode* inlined = convert_expression(clone_expression(body, &map), callee->result_type);
+	return inline_expression(inlined, caller, depth + 1);
+}
+
+// Replace a call statement by the callee's statements. The parameters and the
+// callee's locals get fresh slots at the end of the caller's frame, and the
+// arguments are assigned to them first, just like invoke_method would.
+static BlockNode* inline_statement(BlockNode* call_statement, Method* caller, int depth) {
+	ExpressionNode* call = call_statement->expression;
+	Method* callee = call->callee;
+	if (callee->body == NULL || contains_return(callee->body) || !can_inline(callee, depth)) return NULL;
+
+	// Array and map parameters would become caller locals, which invoke_method frees on return
+	for (int i = 0; i < callee->parameter_count; i++) {
+		if (is_array_type(callee->local_types[i]) || is_map_type(callee->local_types[i])) return NULL;
+	}
+
+	// The callee's slots keep their declared types in the caller's frame
+	int base = caller->local_count;
+	caller->local_count += callee->local_count;
+	caller->local_types = (ValueType*)memory_realloc(MEMORY_AST, caller->local_types, sizeof(ValueType) * (caller->local_count > 0 ? caller->local_count : 1));
+	if (!caller->local_types) {
+		printf("Error: Memory allocation failed while optimizing.\n");
+		exit(1);
+	}
+	for (int i = 0; i < callee->local_count; i++) {
+		caller->local_types[base + i] = callee->local_types[i];
+	}
+	caller->owns_arrays |= callee->owns_arrays;  // The callee's declared arrays now live in the caller's frame
+	caller->owns_strings |= callee->owns_strings;  // And so do its string parameters and locals
+
+	InlineMap map;
+	map.slot_offset = base;
+	map.arguments = NULL;
+	map.parameter_count = 0;
+
+	BlockNode* head = NULL;
+	BlockNode** tail = &head;
+	ParameterNode* param = callee->parameters;
+	for (int i = 0; i < call->argument_count; i++) {
+		ExpressionNode* assignment = ast_new_expression(EXPR_ASSIGN);
+		assignment->variable = param->name;
+		assignment->slot = base + i;
+		assignment->field = -1;
+		assignment->type = callee->local_types[i];  // A string parameter's previous value is released
+		assignment->assigned = call->arguments[i];
+
+		BlockNode* statement = (BlockNode*)allocate_node(sizeof(BlockNode));
+		statement->node_type = NODE_ASSIGNMENT;
+		statement->expression = assignment;
+		statement->next = NULL;
+		*tail = statement;
+		tail = &statement->next;
+		param = param->next;
+	}
+
+	BlockNode* body = clone_block(callee->body, &map);
+	inline_block(&body, caller, depth + 1);
+	*tail = body;
+
+	return head;  // NULL for an empty callee without arguments: the call is simply kept
+}
+
+static void inline_block(BlockNode** block, Method* caller, int depth) {
+	BlockNode** link = block;
+	while (*link != NULL) {
+		BlockNode* current = *link;
+		switch (current->node_type) {
+		case NODE_IF:
+			current->ifNode->condition = inline_expression(current->ifNode->condition, caller, depth);
+			inline_block(&current->ifNode->trueBlock, caller, depth);
+			inline_block(&current->ifNode->falseBlock, caller, depth);
+			break;
+		case NODE_FOR:
+			current->forNode->condition = inline_expression(current->forNode->condition, caller, depth);
+			// Calls in a parallel loop stay calls: inlined statements would write
+			// caller slots that every iteration shares (see check_parallel_loops)
+			inline_block(&current->forNode->body, caller, current->forNode->parallel ? INLINE_MAX_DEPTH : depth);
+			break;
+		case NODE_EXPRESSION:
+			if (current->expression->kind == EXPR_CALL) {
+				ExpressionNode* call = current->expression;
+				for (int i = 0; i < call->argument_count; i++) {
+					call->arguments[i] = ast_index(inline_expression(ast_node(call->arguments[i]), caller, depth));
+				}
+				BlockNode* inlined = inline_statement(current, caller, depth);
+				if (inlined != NULL) {
+					// Splice the inlined statements in place of the call
+					BlockNode* last = inlined;
+					while (last->next != NULL) last = last->next;
+					last->next = current->next;
+					*link = inlined;
+					link = &last->next;
+					continue;
+				}
+				break;
+			}
+			current->expression = inline_expression(current->expression, caller, depth);
+			break;
+		default:
+			current->expression = inline_expression(current->expression, caller, depth);
+			break;
+		}
+		link = &current->next;
+	}
+}
+
+void inline_calls(ClassNode* class_node) {
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		inline_block(&method->body, method, 0);
+	}
+}
+
+static void fold_expression(ExpressionNode* expr) {
+	if (expr == NULL) return;
+
+	fold_expression(ast_node(expr->assigned));
+	fold_expression(ast_node(expr->left));
+	fold_expression(ast_node(expr->right));
+	for (int i = 0; i < expr->argument_count; i++) {
+		fold_expression(ast_node(expr->arguments[i]));
+	}
+
+	ExpressionNode* left = ast_node(expr->left);
+	ExpressionNode* right = ast_node(expr->right);
+	Value result;
+	if (expr->kind == EXPR_CONVERT && is_constant(left)) {
+		result = value_convert(left->value, expr->value.type);
+	}
+	else if ((expr->kind == EXPR_BINARY_INT || expr->kind == EXPR_BINARY_FLOAT) && is_constant(left) && is_constant(right)) {
+		// Same rules as evaluate_expression; division by zero keeps its runtime error
+		if (!apply_binary_operator(expr->op, left->value, right->value, &result)) return;
+	}
+	else {
+		return;
+	}
+
+	// The operator node becomes a constant (the operands stay in the class's table)
+	expr->kind = EXPR_CONSTANT;
+	expr->variable = NULL;
+	expr->left = EXPR_NONE;
+	expr->right = EXPR_NONE;
+	expr->value = result;
+}
+
+static void fold_block(BlockNode** block) {
+	BlockNode** link = block;
+	while (*link != NULL) {
+		BlockNode* current = *link;
+		switch (current->node_type) {
+		case NODE_IF:
+			fold_expression(current->ifNode->condition);
+			fold_block(&current->ifNode->trueBlock);
+			fold_block(&current->ifNode->falseBlock);
+			if (is_constant(current->ifNode->condition)) {
+				// Replace the if by the branch that is always taken
+				BlockNode* taken = value_is_true(current->ifNode->condition->value) ? current->ifNode->trueBlock : current->ifNode->falseBlock;
+				if (taken == NULL) {
+					*link = current->next;
+				}
+				else {
+					BlockNode* last = taken;
+					while (last->next != NULL) last = last->next;
+					last->next = current->next;
+					*link = taken;
+				}
+				continue;
+			}
+			break;
+		case NODE_FOR:
+			fold_expression(current->forNode->initializer);
+			fold_expression(current->forNode->condition);
+			fold_block(&current->forNode->body);
+			break;
+		default:
+			fold_expression(current->expression);
+			break;
+		}
+		link = &current->next;
+	}
+}
+
+void fold_constants(ClassNode* class_node) {
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		fold_block(&method->body);
+	}
+}
+
+static ExpressionNode* new_typed_node(ExpressionKind kind, ValueType type, const char* variable) {
+	ExpressionNode* node = ast_new_expression(kind);
+	node->type = type;
+	node->value = value_zero(type);
+	node->variable = variable ? intern_name(variable) : NULL;
+	node->slot = -1;
+	node->field = -1;
+	return node;
+}
+
+// Do two variable nodes name the same local or field?
+static int same_variable(ExpressionNode* left, ExpressionNode* right) {
+	if (left->slot >= 0 || right->slot >= 0) return left->slot == right->slot;
+	return left->field == right->field;
+}
+
+// Does any expression in the block (nested statements included) satisfy the predicate?
+typedef int (*ExpressionPredicate)(ExpressionNode* expr, void* context);
+
+static int expression_any(ExpressionNode* expr, ExpressionPredicate predicate, void* context) {
+	if (expr == NULL) return 0;
+	if (predicate(expr, context)) return 1;
+	if (expression_any(ast_node(expr->left), predicate, context) || expression_any(ast_node(expr->right), predicate, context) ||
+		expression_any(ast_node(expr->assigned), predicate, context)) return 1;
+	for (int i = 0; i < expr->argument_count; i++) {
+		if (expression_any(ast_node(expr->arguments[i]), predicate, context)) return 1;
+	}
+	return 0;
+}
+
+static int block_any(BlockNode* block, ExpressionPredicate predicate, void* context) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			if (expression_any(current->ifNode->condition, predicate, context) ||
+				block_any(current->ifNode->trueBlock, predicate, context) ||
+				block_any(current->ifNode->falseBlock, predicate, context)) return 1;
+			break;
+		case NODE_FOR:
+			if (expression_any(current->forNode->initializer, predicate, context) ||
+				expression_any(current->forNode->condition, predicate, context) ||
+				expression_any(current->forNode->update, predicate, context) ||
+				block_any(current->forNode->body, predicate, context)) return 1;
+			break;
+		default:
+			if (expression_any(current->expression, predicate, context)) return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
+// Calls, and yields: the host may change fields or resize arrays before resuming.
+// A store through a reference may reach the object running the method.
+static int is_method_call(ExpressionNode* expr, void* context) {
+	(void)context;
+	if (expr->kind == EXPR_ASSIGN && expr->left != EXPR_NONE && ast_node(expr->left)->kind == EXPR_MEMBER) return 1;
+	return expr->kind == EXPR_CALL || expr->kind == EXPR_YIELD || expr->kind == EXPR_MEMBER_CALL || expr->kind == EXPR_NEW;
+}
+
+// An array of the method whose length the guards rely on
+typedef struct GuardedArray {
+	Method* method;
+	ExpressionNode* array;
+} GuardedArray;
+
+// resize(b, n) and copy(b, c) can change the length of the array when b may be it (see may_alias)
+static int resizes_array(ExpressionNode* expr, void* context) {
+	GuardedArray* guarded = (GuardedArray*)context;
+	return expr->kind == EXPR_BUILTIN && (expr->builtin == BUILTIN_RESIZE || expr->builtin == BUILTIN_COPY) &&
+		may_alias(guarded->method, ast_node(expr->arguments[0]), guarded->array);
+}
+
+static int block_resizes_array(BlockNode* block, Method* method, ExpressionNode* array) {
+	GuardedArray guarded;
+	guarded.method = method;
+	guarded.array = array;
+	return block_any(block, resizes_array, &guarded);
+}
+
+// Assignments, declarations and loop updates of the variable. The targets are
+// EXPR_ASSIGN nodes (and the loop update), which carry the variable and slot.
+static int writes_variable(ExpressionNode* expr, void* context) {
+	ExpressionNode* variable = (ExpressionNode*)context;
+	return (expr->kind == EXPR_ASSIGN && expr->left == EXPR_NONE) && same_variable(expr, variable);
+}
+
+static int block_writes_variable(BlockNode* block, ExpressionNode* variable) {
+	if (block_any(block, writes_variable, variable)) return 1;
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		if (current->node_type == NODE_IF &&
+			(block_writes_variable(current->ifNode->trueBlock, variable) || block_writes_variable(current->ifNode->falseBlock, variable))) return 1;
+		if (current->node_type == NODE_FOR &&
+			(same_variable(current->forNode->update, variable) || block_writes_variable(current->forNode->body, variable))) return 1;
+	}
+	return 0;
+}
+
+// Loop being versioned and the arrays its guards cover
+typedef struct HoistLoop {
+	Method* method;
+	ForNode* for_node;
+	ExpressionNode* loop_variable;  // The condition's `i`
+	ExpressionNode* arrays[16];     // Arrays indexed by exactly `i`
+	int array_count;
+} HoistLoop;
+
+static int is_loop_index(ExpressionNode* expr, HoistLoop* loop) {
+	return (expr->kind == EXPR_INDEX || expr->kind == EXPR_INDEX_UNCHECKED) &&
+		ast_node(expr->right)->kind == EXPR_VARIABLE && ast_node(expr->right)->slot == loop->loop_variable->slot;
+}
+
+// Collect the arrays indexed by the loop variable that keep their length during the loop
+static void collect_indexed_arrays(ExpressionNode* expr, HoistLoop* loop, int* ok) {
+	if (expr == NULL) return;
+	if (is_loop_index(expr, loop)) {
+		ExpressionNode* array = ast_node(expr->left);
+		int known = 0;
+		for (int i = 0; i < loop->array_count; i++) {
+			if (same_variable(loop->arrays[i], array)) known = 1;
+		}
+		if (!known) {
+			if (loop->array_count == (int)(sizeof(loop->arrays) / sizeof(loop->arrays[0])) ||
+				block_resizes_array(loop->for_node->body, loop->method, array) || block_writes_variable(loop->for_node->body, array)) {
+				*ok = 0;  // Some element access would stay checked: keep the loop as it is
+				return;
+			}
+			loop->arrays[loop->array_count++] = array;
+		}
+	}
+	collect_indexed_arrays(ast_node(expr->left), loop, ok);
+	collect_indexed_arrays(ast_node(expr->right), loop, ok);
+	collect_indexed_arrays(ast_node(expr->assigned), loop, ok);
+	for (int i = 0; i < expr->argument_count; i++) {
+		collect_indexed_arrays(ast_node(expr->arguments[i]), loop, ok);
+	}
+}
+
+static void collect_block_arrays(BlockNode* block, HoistLoop* loop, int* ok) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			collect_indexed_arrays(current->ifNode->condition, loop, ok);
+			collect_block_arrays(current->ifNode->trueBlock, loop, ok);
+			collect_block_arrays(current->ifNode->falseBlock, loop, ok);
+			break;
+		case NODE_FOR:
+			collect_indexed_arrays(current->forNode->initializer, loop, ok);
+			collect_indexed_arrays(current->forNode->condition, loop, ok);
+			collect_block_arrays(current->forNode->body, loop, ok);
+			break;
+		default:
+			collect_indexed_arrays(current->expression, loop, ok);
+			break;
+		}
+	}
+}
+
+// Is the loop limit the same on every iteration?
+static int is_loop_invariant(Method* method, ExpressionNode* limit, BlockNode* body) {
+	switch (limit->kind) {
+	case EXPR_CONSTANT:
+		return 1;
+	case EXPR_VARIABLE:
+		return !is_array_type(limit->type) && !block_writes_variable(body, limit);
+	case EXPR_BUILTIN:
+		// The length of a map changes with every new key
+		return limit->builtin == BUILTIN_LEN && is_array_type(ast_node(limit->arguments[0])->type) &&
+			!block_resizes_array(body, method, ast_node(limit->arguments[0]));
+	default:
+		return 0;
+	}
+}
+
+// Turn the element accesses covered by the guards into unchecked ones
+static void mark_unchecked(ExpressionNode* expr, HoistLoop* loop) {
+	if (expr == NULL) return;
+	if (is_loop_index(expr, loop)) {
+		expr->kind = EXPR_INDEX_UNCHECKED;
+	}
+	mark_unchecked(ast_node(expr->left), loop);
+	mark_unchecked(ast_node(expr->right), loop);
+	mark_unchecked(ast_node(expr->assigned), loop);
+	for (int i = 0; i < expr->argument_count; i++) {
+		mark_unchecked(ast_node(expr->arguments[i]), loop);
+	}
+}
+
+static void mark_block_unchecked(BlockNode* block, HoistLoop* loop) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			mark_unchecked(current->ifNode->condition, loop);
+			mark_block_unchecked(current->ifNode->trueBlock, loop);
+			mark_block_unchecked(current->ifNode->falseBlock, loop);
+			break;
+		case NODE_FOR:
+			mark_unchecked(current->forNode->initializer, loop);
+			mark_unchecked(current->forNode->condition, loop);
+			mark_block_unchecked(current->forNode->body, loop);
+			mark_block_unchecked(current->forNode->unchecked_body, loop);
+			for (int i = 0; i < current->forNode->guard_count; i++) {
+				mark_unchecked(current->forNode->guards[i], loop);
+			}
+			break;
+		default:
+			mark_unchecked(current->expression, loop);
+			break;
+		}
+	}
+}
+
+// Version `for (int i = start; i < limit; i++)` loops: when start >= 0 and
+// limit <= len(a) for every array a indexed by i, no a[i] can be out of bounds
+static void hoist_loop(Method* method, ForNode* for_node) {
+	ExpressionNode* condition = for_node->condition;
+	ExpressionNode* update = for_node->update;
+	if (update->slot < 0 || update->slot != for_node->initializer->slot || update->type != VALUE_INT || update->value.as.i != 1) return;
+	if (condition->kind != EXPR_BINARY_INT || condition->op != OP_LESS) return;
+	ExpressionNode* variable = ast_node(condition->left);
+	ExpressionNode* limit = ast_node(condition->right);
+	if (variable->kind != EXPR_VARIABLE || variable->slot != update->slot) return;
+
+	// Calls could change fields or resize arrays passed to them
+	BlockNode* body = for_node->body;
+	if (block_any(body, is_method_call, NULL) || block_writes_variable(body, variable)) return;
+	if (!is_loop_invariant(method, limit, body)) return;
+
+	HoistLoop loop;
+	loop.method = method;
+	loop.for_node = for_node;
+	loop.loop_variable = variable;
+	loop.array_count = 0;
+	int ok = 1;
+	collect_block_arrays(body, &loop, &ok);
+	if (!ok || loop.array_count == 0) return;
+
+	for_node->guard_count = loop.array_count + 1;
+	for_node->guards = (ExpressionNode**)allocate_node(sizeof(ExpressionNode*) * for_node->guard_count);
+
+	// i >= 0 right after the initializer
+	ExpressionNode* start = new_typed_node(EXPR_BINARY_INT, VALUE_INT, ">=");
+	start->op = OP_GREATER_EQUAL;
+	start->left = ast_index(clone_expression(variable, NULL));
+	start->right = ast_index(new_typed_node(EXPR_CONSTANT, VALUE_INT, NULL));
+	for_node->guards[0] = start;
+
+	// limit <= len(a) for every array
+	for (int i = 0; i < loop.array_count; i++) {
+		ExpressionNode* length = new_typed_node(EXPR_BUILTIN, VALUE_INT, "len");
+		length->builtin = BUILTIN_LEN;
+		length->argument_count = 1;
+		length->arguments = (uint32_t*)allocate_node(sizeof(uint32_t));
+		length->arguments[0] = ast_index(clone_expression(loop.arrays[i], NULL));
+
+		ExpressionNode* guard = new_typed_node(EXPR_BINARY_INT, VALUE_INT, "<=");
+		guard->op = OP_LESS_EQUAL;
+		guard->left = ast_index(clone_expression(limit, NULL));
+		guard->right = ast_index(length);
+		for_node->guards[i + 1] = guard;
+	}
+
+	for_node->unchecked_body = clone_block(body, NULL);
+	mark_block_unchecked(for_node->unchecked_body, &loop);
+}
+
+static void hoist_block(Method* method, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			hoist_block(method, current->ifNode->trueBlock);
+			hoist_block(method, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR:
+			hoist_block(method, current->forNode->body);  // Inner loops first, so the outer copy includes their versions
+			hoist_loop(method, current->forNode);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void hoist_bounds_checks(ClassNode* class_node) {
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		hoist_block(method, method->body);
+	}
+}
+
+void optimize_class(ClassNode* class_node) {
+	inline_calls(class_node);
+	fold_constants(class_node);
+	hoist_bounds_checks(class_node);
+}
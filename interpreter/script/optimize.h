@@ -0,0 +1,26 @@
+#pragma once
+#include "parse.h"  // Include parse.h to access the AST structures
+
+// Callees whose body has at most this many AST nodes are inlined
+#define INLINE_BUDGET 32
+
+// Maximum nesting of inlining: calls inside an inlined body are inlined
+// again, at most this many levels deep
+#define INLINE_MAX_DEPTH 3
+
+// Optimization passes, run by parse_class once resolve_class has bound
+// every local to a frame slot and every call to its method
+
+// Run every pass in order: inlining first, so the later passes see through calls
+void optimize_class(ClassNode* class_node);
+
+// Substitute small, non-recursive callee bodies at their call sites
+void inline_calls(ClassNode* class_node);
+
+// Evaluate operators with constant operands and drop branches of constant ifs
+void fold_constants(ClassNode* class_node);
+
+// Version loops over arrays: when guards checked once before the loop prove
+// every a[i] in bounds, run a copy of the body without per-element checks. A loop that
+// resizes or copies into any array that may be a guarded one (see may_alias) keeps its checks
+void hoist_bounds_checks(ClassNode* class_node);
@@ -0,0 +1,701 @@
+#include "parallel.h"
+#include "pool.h"
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+// ---- Race check --------------------------------------------------------------
+
+typedef struct ParallelChecker {
+	ClassNode* class_node;
+	Method* method;
+	int error_count;
+	ForNode* loop;                    // Loop being checked
+	int loop_slot;                    // Frame slot of its variable
+	char* private_slots;              // Non-zero for the slots declared inside its body
+	ExpressionNode** written_arrays;  // Arrays whose elements its iterations write
+	int written_count;
+	int written_capacity;
+} ParallelChecker;
+
+static void parallel_error(ParallelChecker* checker, const char* format, ...) {
+	char message[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	script_report("%s in parallel loop of method %s", message, checker->method->name);
+	checker->error_count++;
+}
+
+static int same_variable(ExpressionNode* left, ExpressionNode* right) {
+	if (left->slot >= 0 || right->slot >= 0) return left->slot == right->slot;
+	return left->field == right->field;
+}
+
+static int is_loop_variable(ParallelChecker* checker, ExpressionNode* expr) {
+	return expr->kind == EXPR_VARIABLE && expr->slot == checker->loop_slot;
+}
+
+static int is_private(ParallelChecker* checker, ExpressionNode* variable) {
+	return variable->slot >= 0 && checker->private_slots[variable->slot];
+}
+
+static int is_mutating_builtin(BuiltinFunction builtin) {
+	return builtin == BUILTIN_RESIZE || builtin == BUILTIN_SCALE || builtin == BUILTIN_FILL || builtin == BUILTIN_COPY || builtin == BUILTIN_REMOVE;
+}
+
+static int reads_variable(ExpressionNode* expr, ExpressionNode* variable) {
+	if (expr == NULL) return 0;
+	if (expr->kind == EXPR_VARIABLE && same_variable(expr, variable)) return 1;
+	if (reads_variable(ast_node(expr->left), variable) || reads_variable(ast_node(expr->right), variable) || reads_variable(ast_node(expr->assigned), variable)) return 1;
+	for (int i = 0; i < expr->argument_count; i++) {
+		if (reads_variable(ast_node(expr->arguments[i]), variable)) return 1;
+	}
+	return 0;
+}
+
+// What a called method does to the object, following its own calls
+typedef struct CalleeScan {
+	const char* field;      // Field whose reads are looked for, NULL to look for writes
+	Method* method;         // Method being scanned
+	Method** visited;
+	int visited_count;
+	int visited_capacity;
+} CalleeScan;
+
+static int scan_method(CalleeScan* scan, Method* method);
+
+// A write through a variable the callee doesn't own: a field, or an array it was passed
+static int is_shared_storage(CalleeScan* scan, ExpressionNode* variable) {
+	return variable->slot < 0 || variable->slot < scan->method->parameter_count;
+}
+
+static int scan_expression(CalleeScan* scan, ExpressionNode* expr) {
+	if (expr == NULL) return 0;
+	if (expr->kind == EXPR_CALL && scan_method(scan, expr->callee)) return 1;
+	// Objects reached through references may be the loop's own, and allocating may collect
+	if (expr->kind == EXPR_MEMBER_CALL || expr->kind == EXPR_NEW) return 1;
+
+	if (scan->field == NULL && expr->kind == EXPR_YIELD) return 1;  // Suspending a chunk would stall the loop
+	if (scan->field != NULL) {
+		if (expr->kind == EXPR_VARIABLE && expr->slot < 0 && expr->variable == scan->field) return 1;
+	}
+	else if (expr->kind == EXPR_ASSIGN) {
+		ExpressionNode* target = ast_node(expr->left);
+		if (target != NULL && target->kind == EXPR_MEMBER) return 1;
+		if (target != NULL ? is_shared_storage(scan, ast_node(target->left)) : expr->slot < 0) return 1;
+	}
+	else if (expr->kind == EXPR_BUILTIN && is_mutating_builtin(expr->builtin)) {
+		if (is_shared_storage(scan, ast_node(expr->arguments[0]))) return 1;
+	}
+
+	if (scan_expression(scan, ast_node(expr->left)) || scan_expression(scan, ast_node(expr->right)) || scan_expression(scan, ast_node(expr->assigned))) return 1;
+	for (int i = 0; i < expr->argument_count; i++) {
+		if (scan_expression(scan, ast_node(expr->arguments[i]))) return 1;
+	}
+	return 0;
+}
+
+static int scan_block(CalleeScan* scan, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			if (scan_expression(scan, current->ifNode->condition) ||
+				scan_block(scan, current->ifNode->trueBlock) ||
+				scan_block(scan, current->ifNode->falseBlock)) return 1;
+			break;
+		case NODE_FOR: {
+			ForNode* for_node = current->forNode;
+			if (scan->field == NULL && for_node->update->slot < 0) return 1;  // Counting with a field
+			if (scan_expression(scan, for_node->initializer) ||
+				scan_expression(scan, for_node->condition) ||
+				scan_expression(scan, for_node->update) ||
+				scan_block(scan, for_node->body)) return 1;
+			break;
+		}
+		default:
+			if (scan_expression(scan, current->expression)) return 1;
+			break;
+		}
+	}
+	return 0;
+}
+
+static int scan_method(CalleeScan* scan, Method* method) {
+	for (int i = 0; i < scan->visited_count; i++) {
+		if (scan->visited[i] == method) return 0;
+	}
+	if (scan->visited_count == scan->visited_capacity) {
+		scan->visited_capacity = scan->visited_capacity * 2 + 8;
+		scan->visited = (Method**)memory_realloc(MEMORY_RUNTIME, scan->visited, sizeof(Method*) * scan->visited_capacity);
+		if (!scan->visited) {
+			printf("Error: Memory allocation failed while checking parallel loops.\n");
+			exit(1);
+		}
+	}
+	scan->visited[scan->visited_count++] = method;
+
+	Method* caller = scan->method;
+	scan->method = method;
+	int found = scan_block(scan, method->body);
+	scan->method = caller;
+	return found;
+}
+
+// Does the method (or anything it calls) write a field or an array it was passed?
+// With `field`, does it read that field instead?
+static int callee_touches(Method* method, const char* field) {
+	CalleeScan scan;
+	scan.field = field;
+	scan.method = method;
+	scan.visited = NULL;
+	scan.visited_count = 0;
+	scan.visited_capacity = 0;
+	int found = scan_method(&scan, method);
+	memory_free(scan.visited);
+	return found;
+}
+
+static void mark_private_slots(ParallelChecker* checker, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_DECLARATION:
+			if (is_array_type(current->expression->type)) {
+				parallel_error(checker, "Array %s must be declared outside the loop", current->expression->variable);
+			}
+			if (is_map_type(current->expression->type)) {
+				parallel_error(checker, "Map %s must be declared outside the loop", current->expression->variable);
+			}
+			if (current->expression->type == VALUE_STRING) {
+				// The chunks' frames copy the parent's slots without taking references
+				parallel_error(checker, "String %s must be declared outside the loop", current->expression->variable);
+			}
+			checker->private_slots[current->expression->slot] = 1;
+			break;
+		case NODE_IF:
+			mark_private_slots(checker, current->ifNode->trueBlock);
+			mark_private_slots(checker, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR:
+			checker->private_slots[current->forNode->initializer->slot] = 1;
+			mark_private_slots(checker, current->forNode->body);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static Reduction* find_reduction(ForNode* loop, ExpressionNode* variable) {
+	for (int i = 0; i < loop->reduction_count; i++) {
+		if (same_variable(loop->reductions[i].target, variable)) return &loop->reductions[i];
+	}
+	return NULL;
+}
+
+// `x = x + e`, `x = x - e` or `x = x * e` where e doesn't read x (and no conversion
+// truncates the accumulator at every step)
+static int is_reduction(ExpressionNode* assignment) {
+	ExpressionNode* value = ast_node(assignment->assigned);
+	if (value->kind != EXPR_BINARY_INT && value->kind != EXPR_BINARY_FLOAT) return 0;
+	if (value->op != OP_ADD && value->op != OP_SUBTRACT && value->op != OP_MULTIPLY) return 0;
+	if (value->type != assignment->type) return 0;
+	ExpressionNode* accumulator = ast_node(value->left);
+	if (accumulator->kind != EXPR_VARIABLE || !same_variable(accumulator, assignment)) return 0;
+	return !reads_variable(ast_node(value->right), assignment);
+}
+
+static void add_reduction(ParallelChecker* checker, ExpressionNode* assignment) {
+	ForNode* loop = checker->loop;
+	BinaryOperator op = ast_node(assignment->assigned)->op == OP_MULTIPLY ? OP_MULTIPLY : OP_ADD;
+	Reduction* reduction = find_reduction(loop, assignment);
+	if (reduction != NULL) {
+		if (reduction->op != op) {
+			parallel_error(checker, "%s is both added to and multiplied", assignment->variable);
+		}
+		return;
+	}
+	loop->reductions = (Reduction*)memory_realloc(MEMORY_AST, loop->reductions, sizeof(Reduction) * (loop->reduction_count + 1));
+	if (!loop->reductions) {
+		printf("Error: Memory allocation failed while checking parallel loops.\n");
+		exit(1);
+	}
+	reduction = &loop->reductions[loop->reduction_count++];
+	reduction->target = assignment;
+	reduction->type = assignment->type;
+	reduction->op = op;
+}
+
+static int is_written_array(ParallelChecker* checker, ExpressionNode* array) {
+	for (int i = 0; i < checker->written_count; i++) {
+		if (same_variable(checker->written_arrays[i], array)) return 1;
+	}
+	return 0;
+}
+
+// A written array the array may be (see may_alias), NULL if there is none
+static ExpressionNode* find_written_alias(ParallelChecker* checker, ExpressionNode* array) {
+	for (int i = 0; i < checker->written_count; i++) {
+		if (may_alias(checker->method, checker->written_arrays[i], array)) return checker->written_arrays[i];
+	}
+	return NULL;
+}
+
+// Whether the field may be a written array: the array itself, or any of its type when a parameter is written
+static int field_may_be_written(ParallelChecker* checker, Field* field) {
+	for (int i = 0; i < checker->written_count; i++) {
+		ExpressionNode* array = checker->written_arrays[i];
+		if (array->slot < 0 ? array->variable == field->name : array->slot < checker->method->parameter_count && array->type == field->value.type) return 1;
+	}
+	return 0;
+}
+
+// Record every write of the body: private locals, own elements, or reductions
+static void collect_writes(ParallelChecker* checker, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		ExpressionNode* expr = current->expression;
+		ExpressionNode* target;
+		switch (current->node_type) {
+		case NODE_ASSIGNMENT:
+			target = ast_node(expr->left);
+			if (target != NULL && target->kind == EXPR_MEMBER) {
+				parallel_error(checker, "Field %s is written through a reference", target->variable);
+			}
+			else if (target != NULL && target->kind == EXPR_MAP_GET) {
+				// Any insertion may move every entry of the table
+				parallel_error(checker, "Map %s is written inside the loop", expr->variable);
+			}
+			else if (target != NULL) {
+				// Element: only the iteration's own one
+				if (!is_loop_variable(checker, ast_node(target->right))) {
+					parallel_error(checker, "%s[...] is written at an index other than the loop variable", expr->variable);
+				}
+				else if (!is_written_array(checker, ast_node(target->left))) {
+					if (checker->written_count == checker->written_capacity) {
+						checker->written_capacity = checker->written_capacity * 2 + 4;
+						checker->written_arrays = (ExpressionNode**)memory_realloc(MEMORY_RUNTIME, checker->written_arrays, sizeof(ExpressionNode*) * checker->written_capacity);
+						if (!checker->written_arrays) {
+							printf("Error: Memory allocation failed while checking parallel loops.\n");
+							exit(1);
+						}
+					}
+					checker->written_arrays[checker->written_count++] = ast_node(target->left);
+				}
+			}
+			else if (expr->slot == checker->loop_slot) {
+				// Private to each iteration, but the iteration space is split up front
+				parallel_error(checker, "The loop variable %s is assigned", expr->variable);
+			}
+			else if (!is_private(checker, expr)) {
+				if (is_reduction(expr)) {
+					add_reduction(checker, expr);
+				}
+				else {
+					parallel_error(checker, "%s is shared by the iterations: only %s = %s + ..., - ... or * ... may write it",
+						expr->variable, expr->variable, expr->variable);
+				}
+			}
+			break;
+		case NODE_RETURN:
+			parallel_error(checker, "return inside the loop");
+			break;
+		case NODE_IF:
+			collect_writes(checker, current->ifNode->trueBlock);
+			collect_writes(checker, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR:
+			if (current->forNode->update->slot == checker->loop_slot) {
+				parallel_error(checker, "The loop variable %s is assigned", current->forNode->update->variable);
+			}
+			else if (!is_private(checker, current->forNode->update)) {
+				parallel_error(checker, "Inner loop counts with %s, declared outside the loop", current->forNode->update->variable);
+			}
+			collect_writes(checker, current->forNode->body);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+// Every read must see data no other iteration writes
+static void check_reads(ParallelChecker* checker, ExpressionNode* expr) {
+	if (expr == NULL) return;
+	ExpressionNode* written;
+	switch (expr->kind) {
+	case EXPR_VARIABLE:
+		if (find_reduction(checker->loop, expr) != NULL) {
+			parallel_error(checker, "%s is read outside its reduction", expr->variable);
+		}
+		else if (is_array_type(expr->type) && (written = find_written_alias(checker, expr)) != NULL) {
+			if (same_variable(written, expr)) {
+				parallel_error(checker, "%s is used whole while the iterations write its elements", expr->variable);
+			}
+			else {
+				parallel_error(checker, "%s is used whole while the iterations write %s, which it may be", expr->variable, written->variable);
+			}
+		}
+		return;
+
+	case EXPR_INDEX:
+	case EXPR_INDEX_UNCHECKED: {
+		ExpressionNode* array = ast_node(expr->left);
+		if (!is_loop_variable(checker, ast_node(expr->right)) && (written = find_written_alias(checker, array)) != NULL) {
+			if (same_variable(written, array)) {
+				parallel_error(checker, "%s[...] is read at an index other than the loop variable while the iterations write it", array->variable);
+			}
+			else {
+				parallel_error(checker, "%s[...] is read at an index other than the loop variable while the iterations write %s, which it may be",
+					array->variable, written->variable);
+			}
+		}
+		check_reads(checker, ast_node(expr->right));
+		return;
+	}
+
+	case EXPR_BUILTIN:
+		if (is_mutating_builtin(expr->builtin)) {
+			parallel_error(checker, "%s() inside the loop", expr->variable);
+			return;
+		}
+		if (expr->builtin == BUILTIN_LEN) return;  // Lengths don't change: resize() is rejected above
+		break;
+
+	case EXPR_YIELD:
+		parallel_error(checker, "yield inside the loop");
+		break;
+
+	case EXPR_NEW:
+		parallel_error(checker, "new %s inside the loop", expr->variable);
+		break;
+
+	case EXPR_MEMBER_CALL:
+		parallel_error(checker, "Call to %s through a reference", expr->variable);
+		break;
+
+	case EXPR_CALL: {
+		Method* callee = expr->callee;
+		if (callee_touches(callee, NULL)) {
+			parallel_error(checker, "Call to %s, which writes fields or arrays or yields", callee->name);
+		}
+		for (int i = 0; i < checker->loop->reduction_count; i++) {
+			ExpressionNode* target = checker->loop->reductions[i].target;
+			if (target->slot < 0 && callee_touches(callee, target->variable)) {
+				parallel_error(checker, "Call to %s, which reads %s", callee->name, target->variable);
+			}
+		}
+		// The callee can only reach a written array through a field
+		for (int i = 0; i < checker->class_node->field_count; i++) {
+			Field* field = checker->class_node->field_table[i];
+			if (is_array_type(field->value.type) && field_may_be_written(checker, field) && callee_touches(callee, field->name)) {
+				parallel_error(checker, "Call to %s, which reads %s", callee->name, field->name);
+			}
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	check_reads(checker, ast_node(expr->left));
+	check_reads(checker, ast_node(expr->right));
+	check_reads(checker, ast_node(expr->assigned));
+	for (int i = 0; i < expr->argument_count; i++) {
+		check_reads(checker, ast_node(expr->arguments[i]));
+	}
+}
+
+static void check_block_reads(ParallelChecker* checker, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		ExpressionNode* expr = current->expression;
+		switch (current->node_type) {
+		case NODE_ASSIGNMENT:
+			if (expr->left != EXPR_NONE) {
+				ExpressionNode* target = ast_node(expr->left);
+				check_reads(checker, ast_node(target->kind == EXPR_MEMBER ? target->left : target->right));
+				check_reads(checker, ast_node(expr->assigned));
+			}
+			else if (find_reduction(checker->loop, expr) != NULL) {
+				check_reads(checker, ast_node(ast_node(expr->assigned)->right));  // The accumulator itself is the reduction's own read
+			}
+			else {
+				check_reads(checker, ast_node(expr->assigned));
+			}
+			break;
+		case NODE_DECLARATION:
+			check_reads(checker, ast_node(expr->assigned));
+			break;
+		case NODE_IF:
+			check_reads(checker, current->ifNode->condition);
+			check_block_reads(checker, current->ifNode->trueBlock);
+			check_block_reads(checker, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR:
+			check_reads(checker, ast_node(current->forNode->initializer->assigned));
+			check_reads(checker, current->forNode->condition);
+			check_block_reads(checker, current->forNode->body);
+			break;
+		default:
+			check_reads(checker, expr);
+			break;
+		}
+	}
+}
+
+static void check_loop(ParallelChecker* checker, ForNode* loop) {
+	ExpressionNode* condition = loop->condition;
+	ExpressionNode* update = loop->update;
+	checker->loop = loop;
+	checker->loop_slot = loop->initializer->slot;
+	checker->written_count = 0;
+	loop->frame_slots = checker->method->local_count;
+	memory_free(loop->reductions);
+	loop->reductions = NULL;
+	loop->reduction_count = 0;
+
+	// The iteration space must be known before the first iteration
+	int step = update->value.as.i;
+	int counts_up = condition->op == OP_LESS || condition->op == OP_LESS_EQUAL;
+	int counts_down = condition->op == OP_GREATER || condition->op == OP_GREATER_EQUAL;
+	if (loop->initializer->type != VALUE_INT || update->slot != checker->loop_slot || condition->kind != EXPR_BINARY_INT ||
+		!is_loop_variable(checker, ast_node(condition->left)) || !((counts_up && step == 1) || (counts_down && step == -1))) {
+		parallel_error(checker, "The loop must count an int with i < n, i <= n (i++) or i > n, i >= n (i--)");
+		return;
+	}
+
+	memset(checker->private_slots, 0, checker->method->local_count);
+	checker->private_slots[checker->loop_slot] = 1;
+	mark_private_slots(checker, loop->body);
+	collect_writes(checker, loop->body);
+	check_block_reads(checker, loop->body);
+
+	// The limit is evaluated once: nothing the iterations write may change it
+	if (reads_variable(ast_node(condition->right), ast_node(condition->left))) {
+		parallel_error(checker, "The loop limit depends on the loop variable");
+	}
+	check_reads(checker, ast_node(condition->right));
+}
+
+static void check_parallel_block(ParallelChecker* checker, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			check_parallel_block(checker, current->ifNode->trueBlock);
+			check_parallel_block(checker, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR:
+			check_parallel_block(checker, current->forNode->body);
+			check_parallel_block(checker, current->forNode->unchecked_body);
+			if (current->forNode->parallel) {
+				check_loop(checker, current->forNode);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void check_parallel_loops(ClassNode* class_node) {
+	ParallelChecker checker;
+	checker.class_node = class_node;
+	checker.error_count = 0;
+	checker.written_arrays = NULL;
+	checker.written_capacity = 0;
+
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		checker.method = method;
+		checker.private_slots = (char*)memory_alloc(MEMORY_RUNTIME, method->local_count > 0 ? method->local_count : 1);
+		check_parallel_block(&checker, method->body);
+		memory_free(checker.private_slots);
+	}
+	memory_free(checker.written_arrays);
+
+	if (checker.error_count > 0) {
+		script_error("%d data race(s) in parallel loops of class %s", checker.error_count, class_node->class_name);
+	}
+}
+
+// ---- Execution ---------------------------------------------------------------
+
+typedef struct ParallelChunk {
+	ForNode* for_node;
+	BlockNode* body;
+	Object* obj;
+	Value* parent_locals;
+	int start;           // Value of the loop variable in iteration 0
+	int step;            // 1 or -1
+	int first;           // Iterations [first, last) of the loop
+	int last;
+	Value* partials;     // Per reduction: the chunk's accumulated value
+} ParallelChunk;
+
+static Value reduction_identity(Reduction* reduction) {
+	if (reduction->type == VALUE_FLOAT) {
+		return make_float(reduction->op == OP_MULTIPLY ? 1.0f : 0.0f);
+	}
+	return make_int(reduction->op == OP_MULTIPLY ? 1 : 0);
+}
+
+static Value combine(Reduction* reduction, Value total, Value partial) {
+	if (reduction->type == VALUE_FLOAT) {
+		return make_float(reduction->op == OP_MULTIPLY ? total.as.f * partial.as.f : total.as.f + partial.as.f);
+	}
+	return make_int(reduction->op == OP_MULTIPLY ? total.as.i * partial.as.i : total.as.i + partial.as.i);
+}
+
+// Shallow copy of the object for a chunk: reduced fields get private
+// accumulators, arrays are shared (each iteration writes its own elements)
+static Object* private_view(Object* obj) {
+	int count = obj->class_type->field_count;
+	Object* view = (Object*)memory_alloc(MEMORY_OBJECTS, sizeof(Object) + sizeof(Field) * count);
+	view->class_type = obj->class_type;
+	view->field_addresses = NULL;
+	view->calls = 0;
+	view->field_values = (Field*)(view + 1);  // Same layout as create_object
+	memcpy(view->field_values, obj->field_values, sizeof(Field) * count);
+	for (int i = 0; i < count; i++) {
+		view->field_values[i].next = i + 1 < count ? &view->field_values[i + 1] : NULL;
+	}
+	return view;
+}
+
+static void free_private_view(Object* view) {
+	memory_free(view->field_addresses);
+	memory_free(view);
+}
+
+static void run_chunk(void* argument) {
+	ParallelChunk* chunk = (ParallelChunk*)argument;
+	ForNode* for_node = chunk->for_node;
+	Interpreter* previous = interpreter_enter(chunk->obj->class_type->context);
+
+	// A private frame on this thread's stack, starting as a copy of the loop's one
+	FrameStack* stack = current_frame_stack();
+	if (stack->top + for_node->frame_slots > stack->capacity) {
+		printf("Error: Stack overflow in parallel loop.\n");
+		exit(1);
+	}
+	Value* locals = stack->slots + stack->top;
+	stack->top += for_node->frame_slots;
+	// Chunks are never preempted (the workers would wait on a suspended one); the caller charges the whole loop
+	long long budget = stack->budget;
+	stack->budget = BUDGET_UNLIMITED;
+	memcpy(locals, chunk->parent_locals, sizeof(Value) * for_node->frame_slots);
+
+	Object* obj = chunk->obj;
+	for (int i = 0; i < for_node->reduction_count; i++) {
+		if (for_node->reductions[i].target->slot < 0 && obj == chunk->obj) {
+			obj = private_view(chunk->obj);
+		}
+	}
+	for (int i = 0; i < for_node->reduction_count; i++) {
+		Reduction* reduction = &for_node->reductions[i];
+		if (reduction->target->slot >= 0) locals[reduction->target->slot] = reduction_identity(reduction);
+		else obj->field_values[reduction->target->field].value = reduction_identity(reduction);
+	}
+
+	int slot = for_node->initializer->slot;
+	for (int iteration = chunk->first; iteration < chunk->last; iteration++) {
+		locals[slot] = make_int(chunk->start + chunk->step * iteration);
+		execute_block(chunk->body, obj, locals);
+	}
+
+	for (int i = 0; i < for_node->reduction_count; i++) {
+		Reduction* reduction = &for_node->reductions[i];
+		chunk->partials[i] = reduction->target->slot >= 0 ? locals[reduction->target->slot] : obj->field_values[reduction->target->field].value;
+	}
+	if (obj != chunk->obj) {
+		free_private_view(obj);
+	}
+	stack->top -= for_node->frame_slots;
+	stack->budget = budget;
+	interpreter_enter(previous);
+}
+
+ExecStatus execute_parallel_for(ForNode* for_node, Object* obj, Value* locals) {
+	int slot = for_node->initializer->slot;
+	int start = evaluate_expression(expr_child(for_node->initializer, for_node->initializer->assigned), obj, locals).as.i;
+	int limit = evaluate_expression(expr_child(for_node->condition, for_node->condition->right), obj, locals).as.i;
+	int step = for_node->update->value.as.i;
+	locals[slot] = make_int(start);
+
+	long long count = 0;
+	switch (for_node->condition->op) {
+	case OP_LESS: count = (long long)limit - start; break;
+	case OP_LESS_EQUAL: count = (long long)limit - start + 1; break;
+	case OP_GREATER: count = (long long)start - limit; break;
+	case OP_GREATER_EQUAL: count = (long long)start - limit + 1; break;
+	default: break;
+	}
+	if (count <= 0) return EXEC_NORMAL;
+
+	// The hoisted guards hold for every iteration or for none
+	BlockNode* body = for_node->body;
+	if (for_node->unchecked_body != NULL) {
+		body = for_node->unchecked_body;
+		for (int i = 0; i < for_node->guard_count; i++) {
+			if (!evaluate_expression(for_node->guards[i], obj, locals).as.i) {
+				body = for_node->body;
+				break;
+			}
+		}
+	}
+
+	ThreadPool* pool = pool_default();
+	long long chunk_count = (long long)pool_worker_count(pool) * PARALLEL_CHUNKS_PER_WORKER;
+	if (chunk_count > count) chunk_count = count;
+
+	ParallelChunk* chunks = (ParallelChunk*)memory_alloc(MEMORY_RUNTIME, sizeof(ParallelChunk) * (size_t)chunk_count);
+	Value* partials = (Value*)memory_alloc(MEMORY_RUNTIME, sizeof(Value) * (size_t)(chunk_count * (for_node->reduction_count > 0 ? for_node->reduction_count : 1)));
+	Future** futures = (Future**)memory_alloc(MEMORY_RUNTIME, sizeof(Future*) * (size_t)chunk_count);
+	for (int c = 0; c < chunk_count; c++) {
+		ParallelChunk* chunk = &chunks[c];
+		chunk->for_node = for_node;
+		chunk->body = body;
+		chunk->obj = obj;
+		chunk->parent_locals = locals;
+		chunk->start = start;
+		chunk->step = step;
+		chunk->first = (int)(count * c / chunk_count);
+		chunk->last = (int)(count * (c + 1) / chunk_count);
+		chunk->partials = partials + (size_t)c * for_node->reduction_count;
+	}
+
+	// This thread runs the first chunk itself while the workers take the others. Its
+	// errors aren't trapped: unwinding it would leave the other chunks running on the loop.
+	ErrorTrap* trap = interpreter_trap_errors(NULL);
+	for (int c = 1; c < chunk_count; c++) {
+		futures[c] = pool_submit(pool, run_chunk, &chunks[c]);
+	}
+	run_chunk(&chunks[0]);
+	for (int c = 1; c < chunk_count; c++) {
+		future_free(futures[c]);
+	}
+	interpreter_trap_errors(trap);
+
+	// Combine in chunk order, so a run gives the same result whichever worker finished first
+	for (int i = 0; i < for_node->reduction_count; i++) {
+		Reduction* reduction = &for_node->reductions[i];
+		ExpressionNode* target = reduction->target;
+		Value total = target->slot >= 0 ? locals[target->slot] : obj->field_values[target->field].value;
+		for (int c = 0; c < chunk_count; c++) {
+			total = combine(reduction, total, chunks[c].partials[i]);
+		}
+		if (target->slot >= 0) locals[target->slot] = total;
+		else obj->field_values[target->field].value = total;
+	}
+
+	memory_free(futures);
+	memory_free(partials);
+	memory_free(chunks);
+
+	// One unit per iteration, like a sequential loop; the next back-edge or call sees an overrun
+	current_frame_stack()->budget -= count;
+	return EXEC_NORMAL;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "parse.h"  // Include parse.h to access the AST structures
+
+// A parallel loop is split into about this many chunks per worker, so that
+// workers finishing early can steal the remaining ones
+#define PARALLEL_CHUNKS_PER_WORKER 4
+
+// Check every `parallel for` of the class, run by parse_class after the optimizer
+// (so the frame sizes are final). A parallel loop must count an int variable with
+// `i < n`, `i <= n` (i++) or `i > n`, `i >= n` (i--), and its iterations may only write:
+// - locals declared in the body
+// - elements a[i] of arrays indexed by the loop variable, which are then read at a[i] only,
+//   as is any array that may be the same one (see may_alias): an array parameter may
+//   have been passed a field or another parameter of its type
+// - reductions `x = x + e`, `x = x - e` or `x = x * e` on variables declared outside
+//   the loop, which are read nowhere else in it
+// Calls must go to methods that write no fields or arrays, and nothing may yield.
+// Violations are reported for the whole class before exiting.
+void check_parallel_loops(ClassNode* class_node);
+
+// Run a checked parallel loop: the iterations are split into chunks on the default
+// pool (see pool_default), each with a private copy of the frame and of the reduced
+// variables. Partial results are combined in chunk order once every chunk is done.
+ExecStatus execute_parallel_for(ForNode* for_node, Object* obj, Value* locals);
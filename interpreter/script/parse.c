@@ -1,16 +1,27 @@
 
 
-#ifdef _MSC_VER
-#define strdup _strdup
-#endif
-
 #include "parse.h"
 #include "lexer.h"
+#include "optimize.h"
+#include "typecheck.h"
+#include "parallel.h"
+#include "pool.h"
+#include "coroutine.h"
+#include "context.h"
+#include "table.h"
+#include "reload.h"
+#include "gc.h"
+#include "map.h"
+#include "text.h"
+#include "memo.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+THREAD_LOCAL Token current_token;
+THREAD_LOCAL const char** source;
+int trace_tokens = 1;
 
 const char* token_type_to_string(TokenType type) {
 	switch (type) {
@@ -43,6 +54,18 @@ const char* token_type_to_string(TokenType type) {
 	case TOKEN_PLUS: return "TOKEN_PLUS";  // --
 	case TOKEN_DIVIDE: return "TOKEN_DIVIDE";  // --
 	case TOKEN_MULTIPLY: return "TOKEN_MULTIPLY";  // --
+	case TOKEN_RETURN: return "TOKEN_RETURN";
+	case TOKEN_FLOAT_LITERAL: return "TOKEN_FLOAT_LITERAL";
+	case TOKEN_STRING_LITERAL: return "TOKEN_STRING_LITERAL";
+	case TOKEN_LBRACKET: return "TOKEN_LBRACKET";
+	case TOKEN_RBRACKET: return "TOKEN_RBRACKET";
+	case TOKEN_PARALLEL: return "TOKEN_PARALLEL";
+	case TOKEN_YIELD: return "TOKEN_YIELD";
+	case TOKEN_COLON: return "TOKEN_COLON";
+	case TOKEN_NEW: return "TOKEN_NEW";
+	case TOKEN_NULL: return "TOKEN_NULL";
+	case TOKEN_DOT: return "TOKEN_DOT";
+	case TOKEN_MEMO: return "TOKEN_MEMO";
 	default: return "UNKNOWN_TOKEN_TYPE";
 	}
 }
@@ -50,7 +73,7 @@ const char* token_type_to_string(TokenType type) {
 
 void next_token_wrapper() {
 	current_token = next_token(source);
-	printf("Token Type: %s, Token Value: %s\n", token_type_to_string(current_token.type), current_token.value);
+	if (trace_tokens) printf("Token Type: %s, Token Value: %s\n", token_type_to_string(current_token.type), current_token.value);
 
 }
 
@@ -58,30 +81,31 @@ void next_token_wrapper() {
 void expect(TokenType type) {
 	if (current_token.type != type) {
 		// Print an error message if the current token is not as expected
-		printf("Error: Expected token type %d but found '%s'\n", type, current_token.value);
-		exit(1);  // Exit the program due to the parsing error
+		script_error("Expected token type %d but found '%s'", type, current_token.value);
 	}
 	next_token_wrapper();  // Move to the next token
 }
 
 // Function to look up a variable in the symbol table
 int lookup_variable(char* variable) {
-	SymbolTable* current = symbol_table;
+	const char* name = intern_name(variable);
+	SymbolTable* current = *interpreter_symbols(interpreter_current());
 	while (current != NULL) {
-		if (strcmp(current->variable_name, variable) == 0) {
+		if (current->variable_name == name) {
 			return current->value;
 		}
 		current = current->next;
 	}
-	printf("Error: Undefined variable %s\n", variable);
-	exit(1);
+	script_error("Undefined variable %s", variable);
 }
 
 // Function to update or add a variable to the symbol table
 void update_variable(char* variable, int value) {
-	SymbolTable* current = symbol_table;
+	const char* name = intern_name(variable);
+	SymbolTable** symbol_table = interpreter_symbols(interpreter_current());
+	SymbolTable* current = *symbol_table;
 	while (current != NULL) {
-		if (strcmp(current->variable_name, variable) == 0) {
+		if (current->variable_name == name) {
 			current->value = value; // Update existing variable
 			return;
 		}
@@ -89,120 +113,588 @@ void update_variable(char* variable, int value) {
 	}
 
 	// If not found, add a new variable to the symbol table
-	SymbolTable* new_variable = (SymbolTable*)malloc(sizeof(SymbolTable));
-	new_variable->variable_name = strdup(variable); // Make a copy of the variable name
+	SymbolTable* new_variable = (SymbolTable*)memory_alloc(MEMORY_RUNTIME, sizeof(SymbolTable));
+	new_variable->variable_name = name;  // Interned, shared with every other use of the name
 	new_variable->value = value;
-	new_variable->next = symbol_table;
-	symbol_table = new_variable;
+	new_variable->next = *symbol_table;
+	*symbol_table = new_variable;
 }
 
 // Function to free the symbol table
 void free_symbol_table() {
-	SymbolTable* current = symbol_table;
+	SymbolTable** symbol_table = interpreter_symbols(interpreter_current());
+	SymbolTable* current = *symbol_table;
 	while (current != NULL) {
 		SymbolTable* temp = current;
 		current = current->next;
-		free(temp->variable_name);
-		free(temp);
+		memory_free(temp);
+	}
+	*symbol_table = NULL;
+}
+
+static void* element_address(ExpressionNode* element, Object* obj, Value* locals);
+static MapValue* map_entry_address(ExpressionNode* entry, Object* obj, Value* locals);
+static Object* evaluate_receiver(ExpressionNode* member, Object* obj, Value* locals);
+static int member_field_index(Object* target, ExpressionNode* member);
+static void push_slot(FrameStack* stack, Value value, const char* name);
+
+// Store a value into a local slot, field, array element or map entry; check_class has already converted it to the declared type
+static void assign_variable(ExpressionNode* target, Value value, Object* obj, Value* locals) {
+	if (target->left != EXPR_NONE && expr_child(target, target->left)->kind == EXPR_MAP_GET) {
+		MapValue* entry = map_entry_address(expr_child(target, target->left), obj, locals);
+		if (target->type == VALUE_FLOAT) {
+			entry->f = value.as.f;
+		}
+		else {
+			entry->i = value.as.i;
+		}
+	}
+	else if (target->left != EXPR_NONE) {
+		// Array element: the payload is stored unboxed
+		void* address = element_address(expr_child(target, target->left), obj, locals);
+		if (target->type == VALUE_FLOAT) {
+			*(float*)address = value.as.f;
+		}
+		else {
+			*(int*)address = value.as.i;
+		}
+	}
+	// Locals were bound to frame slots by resolve_class; anything else is a field.
+	// A string variable drops its reference to the string being replaced.
+	else if (target->slot >= 0) {
+		if (target->type == VALUE_STRING) string_release(locals[target->slot]);
+		locals[target->slot] = value;
+	}
+	else {
+		Value* field = &obj->field_values[target->field].value;
+		if (target->type == VALUE_STRING) string_release(*field);
+		*field = value;
+		if (value.type == VALUE_OBJECT) gc_write_barrier(obj, value.as.o);
+	}
+}
+
+// Store into a field of the object a reference points to: `a.field = value`. The
+// receiver is evaluated first and stays in a frame slot while the value is evaluated.
+static void assign_member(ExpressionNode* expr, Object* obj, Value* locals) {
+	FrameStack* stack = current_frame_stack();
+	ExpressionNode* member = expr_child(expr, expr->left);
+	Object* target = evaluate_receiver(member, obj, locals);
+	push_slot(stack, make_object(target), member->variable);
+	Value value = evaluate_expression(expr_child(expr, expr->assigned), obj, locals);
+	stack->top--;
+	if (target == NULL) {
+		string_release(value);  // An aborted call returned no receiver
+		return;
 	}
-	symbol_table = NULL;
+
+	Field* field = &target->field_values[member_field_index(target, member)];
+	if (member->type == VALUE_STRING) string_release(field->value);
+	field->value = value;
+	if (value.type == VALUE_OBJECT) gc_write_barrier(target, value.as.o);
+}
+
+static Value evaluate_string(ExpressionNode* expr, Object* obj, Value* locals);
+
+// `s = s + e` (marked EXPR_APPEND by check_class): e is evaluated first, then the string
+// leaves its variable while e is appended, so a buffer nobody else holds grows in place
+static void append_string(ExpressionNode* expr, Object* obj, Value* locals) {
+	ExpressionNode* append = expr_child(expr, expr->assigned);
+	Value tail = evaluate_string(expr_child(append, append->right), obj, locals);
+	Value* target = expr->slot >= 0 ? &locals[expr->slot] : &obj->field_values[expr->field].value;
+	Value head = *target;
+	*target = make_empty_string();
+	*target = string_concat(head, tail);
+	string_release(tail);
 }
 
-// Function to execute an expression
-void execute_expression(ExpressionNode* expr, Object* obj, LocalVariable* local_table) {
+// Function to execute an expression statement (assignment or call)
+void execute_expression(ExpressionNode* expr, Object* obj, Value* locals) {
 	if (expr == NULL) {
 		printf("Error: Null expression.\n");
 		return;
 	}
 
 	// Handle assignment operations: variable = value
-	if (expr->variable != NULL && expr->next != NULL) {
+	if (expr->kind == EXPR_ASSIGN && expr->left != EXPR_NONE && expr_child(expr, expr->left)->kind == EXPR_MEMBER) {
+		assign_member(expr, obj, locals);
+	}
+	else if (expr->kind == EXPR_ASSIGN && expr_child(expr, expr->assigned)->kind == EXPR_APPEND) {
+		append_string(expr, obj, locals);
+	}
+	else if (expr->kind == EXPR_ASSIGN) {
 		// This means we have an assignment expression
 		// `expr->variable` is the variable to be assigned
-		// `expr->next` is the value or expression that should be evaluated
-		const char* variable_name = expr->variable;
-		int value = evaluate_expression(expr->next, obj, local_table);  // Evaluate the right-hand side
-
-		// First, check if this variable is in the local scope
-		LocalVariable* local_var = local_table;
-		while (local_var) {
-			if (strcmp(local_var->variable_name, variable_name) == 0) {
-				update_local_variable(&local_table, variable_name, value);
-				return;
-			}
-			local_var = local_var->next;
-		}
+		// `expr->assigned` is the value or expression that should be evaluated
+		Value value = evaluate_expression(expr_child(expr, expr->assigned), obj, locals);  // Evaluate the right-hand side
+		assign_variable(expr, value, obj, locals);
+	}
+	else {
+		// Calls and other expressions are evaluated for their side effects only
+		string_release(evaluate_expression(expr, obj, locals));  // A string result is dropped
+	}
+}
+
+// Node storage of a class: nodes are bump-allocated from blocks that double in size
+// (small classes stay small), so the trees of a method sit in a few contiguous runs
+// of memory instead of one heap block per node
+typedef struct AstBlock {
+	struct AstBlock* next;  // Older block
+	size_t size;            // Bytes of nodes following the header
+} AstBlock;
+
+typedef struct AstArena {
+	AstBlock* blocks;  // Newest first
+	char* cursor;      // Next free byte of the newest block
+	char* end;
+	ExpressionNode** chunks;      // The expression table while the class is parsed, AST_CHUNK_NODES per chunk
+	int chunk_count;
+	uint32_t expression_count;    // Entries of the table, EXPR_NONE's included
+	ExpressionNode* expressions;  // The table once parsed: every expression node of the class, by index
+} AstArena;
+
+#define AST_FIRST_BLOCK 2048
+#define AST_LARGEST_BLOCK (64 * 1024)
+#define AST_ALIGNMENT 16
+#define AST_CHUNK_SHIFT 8
+#define AST_CHUNK_NODES (1 << AST_CHUNK_SHIFT)
+
+// Arena of the class being parsed on this thread
+static THREAD_LOCAL AstArena* current_arena = NULL;
+// Class being parsed on this thread, which the class names of its types are looked up from
+static THREAD_LOCAL ClassNode* parsing_class = NULL;
+// Method being parsed, until parse_members adds it to parsing_class
+static THREAD_LOCAL Method* parsing_method = NULL;
+
+void* ast_alloc(size_t size) {
+	AstArena* arena = current_arena;
+	if (arena == NULL) {
+		printf("Error: Syntax tree node allocated outside parse_class.\n");
+		exit(1);
+	}
+	size = (size + AST_ALIGNMENT - 1) & ~(size_t)(AST_ALIGNMENT - 1);
+	if ((size_t)(arena->end - arena->cursor) < size) {
+		size_t block_size = arena->blocks != NULL ? arena->blocks->size * 2 : AST_FIRST_BLOCK;
+		if (block_size > AST_LARGEST_BLOCK) block_size = AST_LARGEST_BLOCK;
+		if (block_size < size) block_size = size;
+		// The header is 16 bytes, so nodes keep the block's alignment
+		AstBlock* block = (AstBlock*)memory_alloc(MEMORY_AST, sizeof(AstBlock) + block_size);
+		block->next = arena->blocks;
+		block->size = block_size;
+		arena->blocks = block;
+		arena->cursor = (char*)(block + 1);
+		arena->end = arena->cursor + block_size;
+	}
+	void* node = arena->cursor;
+	arena->cursor += size;
+	memset(node, 0, size);
+	return node;
+}
+
+static void free_arena(AstArena* arena) {
+	if (arena == NULL) return;
+	AstBlock* block = arena->blocks;
+	while (block != NULL) {
+		AstBlock* next = block->next;
+		memory_free(block);
+		block = next;
+	}
+	for (int i = 0; i < arena->chunk_count; i++) {
+		memory_free(arena->chunks[i]);
+	}
+	memory_free(arena->chunks);
+	memory_free(arena->expressions);
+	memory_free(arena);
+}
 
-		// If not found in local scope, update it in the object fields
-		update_object_field(obj, variable_name, value);
+ExpressionNode* ast_new_expression(ExpressionKind kind) {
+	AstArena* arena = current_arena;
+	if (arena == NULL) {
+		printf("Error: Syntax tree node allocated outside parse_class.\n");
+		exit(1);
+	}
+	if (arena->expression_count == 0) {
+		arena->expression_count = 1;  // Entry 0 is EXPR_NONE
 	}
-	else if (expr->variable != NULL && expr->next == NULL) {
-		// Simply accessing a variable without assigning
-		// First, try to find the variable in the local table
-		LocalVariable* local_var = local_table;
-		while (local_var) {
-			if (strcmp(local_var->variable_name, expr->variable) == 0) {
-				printf("Variable %s has value: %d\n", expr->variable, local_var->value);
-				return;
+	uint32_t index = arena->expression_count;
+	if ((index & (AST_CHUNK_NODES - 1)) == 0 || arena->chunk_count == 0) {
+		if (index >= UINT32_MAX - AST_CHUNK_NODES) {
+			script_error("Class %s has too many expressions", parsing_class->class_name);
+		}
+		arena->chunks = (ExpressionNode**)memory_realloc(MEMORY_AST, arena->chunks, sizeof(ExpressionNode*) * (arena->chunk_count + 1));
+		arena->chunks[arena->chunk_count++] = (ExpressionNode*)memory_alloc(MEMORY_AST, sizeof(ExpressionNode) * AST_CHUNK_NODES);
+	}
+	arena->expression_count++;
+	ExpressionNode* node = &arena->chunks[index >> AST_CHUNK_SHIFT][index & (AST_CHUNK_NODES - 1)];
+	memset(node, 0, sizeof(ExpressionNode));
+	node->kind = kind;
+	node->index = index;
+	return node;
+}
+
+ExpressionNode* ast_node(uint32_t index) {
+	if (index == EXPR_NONE) return NULL;
+	return &current_arena->chunks[index >> AST_CHUNK_SHIFT][index & (AST_CHUNK_NODES - 1)];
+}
+
+// Statements name the root of each of their expressions by address
+static ExpressionNode* seal_root(AstArena* arena, ExpressionNode* root) {
+	return root != NULL ? &arena->expressions[root->index] : NULL;
+}
+
+static void seal_block(AstArena* arena, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_IF:
+			current->ifNode->condition = seal_root(arena, current->ifNode->condition);
+			seal_block(arena, current->ifNode->trueBlock);
+			seal_block(arena, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR: {
+			ForNode* for_node = current->forNode;
+			for_node->initializer = seal_root(arena, for_node->initializer);
+			for_node->condition = seal_root(arena, for_node->condition);
+			for_node->update = seal_root(arena, for_node->update);
+			for (int i = 0; i < for_node->guard_count; i++) {
+				for_node->guards[i] = seal_root(arena, for_node->guards[i]);
+			}
+			for (int i = 0; i < for_node->reduction_count; i++) {
+				for_node->reductions[i].target = seal_root(arena, for_node->reductions[i].target);
 			}
-			local_var = local_var->next;
+			seal_block(arena, for_node->body);
+			seal_block(arena, for_node->unchecked_body);
+			break;
+		}
+		default:
+			current->expression = seal_root(arena, current->expression);
+			break;
 		}
+	}
+}
+
+// Move the expression table into one array, in index order, once nothing adds nodes
+static void seal_expressions(ClassNode* class_node) {
+	AstArena* arena = class_node->arena;
+	uint32_t count = arena->expression_count > 0 ? arena->expression_count : 1;
+	arena->expressions = (ExpressionNode*)memory_calloc(MEMORY_AST, count, sizeof(ExpressionNode));
+	for (int i = 0; i < arena->chunk_count; i++) {
+		uint32_t first = (uint32_t)i << AST_CHUNK_SHIFT;
+		uint32_t nodes = count - first < AST_CHUNK_NODES ? count - first : AST_CHUNK_NODES;
+		memcpy(&arena->expressions[first], arena->chunks[i], sizeof(ExpressionNode) * nodes);
+	}
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		seal_block(arena, method->body);
+	}
+	for (int i = 0; i < arena->chunk_count; i++) {
+		memory_free(arena->chunks[i]);
+	}
+	memory_free(arena->chunks);
+	arena->chunks = NULL;
+	arena->chunk_count = 0;
+}
+
+// Allocate an expression node with every field in its neutral state
+static ExpressionNode* new_expression_node(ExpressionKind kind) {
+	ExpressionNode* node = ast_new_expression(kind);
+	node->variable = NULL;
+	node->value = make_int(0);
+	node->type = VALUE_INT;
+	node->op = OP_ADD;
+	node->slot = -1;
+	node->field = -1;
+	node->arguments = NULL;
+	node->argument_count = 0;
+	node->callee = NULL;
+	node->builtin = BUILTIN_NONE;
+	node->length = 0;
+	node->class_type = NULL;
+	return node;
+}
 
-		// If not found in the local table, look up in the object fields
-		int value = lookup_object_field(obj, expr->variable);
-		printf("Variable %s has value: %d\n", expr->variable, value);
+// Parse the optional array suffix of a type: `[]` (variable length) or `[16]` (fixed length).
+// Returns the full type name ("float[]", "int[16]"), interned, and stores the fixed length (0 if none).
+static const char* parse_array_suffix(const char* type, int* length) {
+	*length = 0;
+	if (current_token.type != TOKEN_LBRACKET) {
+		return intern_name(type);
+	}
+	next_token_wrapper();  // Move past '['
+
+	if (current_token.type == TOKEN_INT && strcmp(current_token.value, "int") == 0) {
+		// int[int] and float[int] are maps keyed by int (see map.h)
+		next_token_wrapper();  // Move past 'int'
+		expect(TOKEN_RBRACKET);  // Expect ']'
+		char name[64];
+		snprintf(name, sizeof(name), "%s[int]", type);
+		return intern_name(name);
+	}
+	if (current_token.type == TOKEN_INT) {
+		*length = atoi(current_token.value);
+		if (*length <= 0) {
+			script_error("Array length must be positive but found '%s'", current_token.value);
+		}
+		next_token_wrapper();  // Move past the length
 	}
-	else if (expr->variable == NULL) {
-		// For constant expressions
-		printf("Constant value: %d\n", expr->value);
+	expect(TOKEN_RBRACKET);  // Expect ']'
+
+	char name[64];
+	if (*length > 0) {
+		snprintf(name, sizeof(name), "%s[%d]", type, *length);
 	}
 	else {
-		// Unsupported expression type
-		printf("Error: Unsupported expression type.\n");
-		exit(1);
+		snprintf(name, sizeof(name), "%s[]", type);
+	}
+	return intern_name(name);
+}
+
+// Look ahead (without consuming) to tell `int name(` (a method) from `int name;` (a field)
+static int is_method_declaration() {
+	const char* cursor = *source;
+	Token name = next_token(&cursor);
+	Token after = next_token(&cursor);
+	int is_method = name.type == TOKEN_IDENTIFIER && after.type == TOKEN_LPAREN;
+	free_token(name);
+	free_token(after);
+	return is_method;
+}
+
+// Build the member tables of a parsed class: indexed arrays in declaration order
+// and name tables over them, so lookups by name don't walk the lists
+static void index_members(ClassNode* class_node) {
+	class_node->field_table = (Field**)memory_alloc(MEMORY_AST, sizeof(Field*) * (class_node->field_count + 1));
+	class_node->method_table = (Method**)memory_alloc(MEMORY_AST, sizeof(Method*) * (class_node->method_count + 1));
+	class_node->field_names = (NameTable*)memory_alloc(MEMORY_AST, sizeof(NameTable));
+	class_node->method_names = (NameTable*)memory_alloc(MEMORY_AST, sizeof(NameTable));
+	name_table_init(class_node->field_names, MEMORY_AST);
+	name_table_init(class_node->method_names, MEMORY_AST);
+
+	int index = 0;
+	for (Field* field = class_node->fields; field != NULL; field = field->next) {
+		if (!name_table_insert(class_node->field_names, field->name, index)) {
+			script_error("Field %s is declared twice in class %s", field->name, class_node->class_name);
+		}
+		class_node->field_table[index++] = field;
+	}
+	index = 0;
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		if (!name_table_insert(class_node->method_names, method->name, index)) {
+			script_error("Method %s is declared twice in class %s", method->name, class_node->class_name);
+		}
+		class_node->method_table[index++] = method;
+	}
+}
+
+// Where parse_members appends: the ends of the class's field and method lists
+typedef struct MemberTails {
+	Field** field;
+	Method** method;
+	int inherited;  // Methods taken from the base classes, at the front of the list
+} MemberTails;
+
+static void free_method(Method* method) {
+	ParameterNode* param = method->parameters;
+	while (param) {
+		ParameterNode* temp = param;
+		param = param->next;
+		memory_free(temp);
+	}
+	memory_free(method->local_types);
+	memo_free(method->memo);
+	memory_free(method);
+}
+
+// An override must be callable exactly like the method it replaces (type names are interned)
+static int same_signature(Method* left, Method* right) {
+	if (left->return_type != right->return_type) return 0;
+	ParameterNode* left_param = left->parameters;
+	ParameterNode* right_param = right->parameters;
+	while (left_param != NULL && right_param != NULL) {
+		if (left_param->type != right_param->type) return 0;
+		left_param = left_param->next;
+		right_param = right_param->next;
+	}
+	return left_param == NULL && right_param == NULL;
+}
+
+// Append a method, or replace the inherited method of the same name in place so
+// the override takes its vtable slot
+static void add_method(ClassNode* class_node, MemberTails* tails, Method* method) {
+	Method** link = &class_node->methods;
+	for (int i = 0; i < tails->inherited; i++, link = &(*link)->next) {
+		Method* overridden = *link;
+		if (overridden->name != method->name) continue;
+
+		if (!same_signature(overridden, method)) {
+			script_error("Method %s of class %s must have the signature of the method it overrides", method->name, class_node->class_name);
+		}
+		method->next = overridden->next;
+		*link = method;
+		if (tails->method == &overridden->next) {
+			tails->method = &method->next;
+		}
+		free_method(overridden);
+		return;
+	}
+	*tails->method = method;
+	tails->method = &method->next;
+	class_node->method_count++;
+}
+
+// Parse fields and methods up to the closing brace of the body (or the end of the text)
+static void parse_members(ClassNode* class_node, MemberTails* tails) {
+	while (current_token.type != TOKEN_RBRACE && current_token.type != TOKEN_END) {
+		// `memo` or `memo(n)` before a method caches its results (see memo.h)
+		int memo_capacity = 0;
+		if (current_token.type == TOKEN_MEMO) {
+			next_token_wrapper();  // Move past 'memo'
+			memo_capacity = MEMO_DEFAULT_CAPACITY;
+			if (current_token.type == TOKEN_LPAREN) {
+				next_token_wrapper();
+				memo_capacity = current_token.type == TOKEN_INT ? atoi(current_token.value) : 0;
+				if (memo_capacity < 1 || memo_capacity > MEMO_MAX_CAPACITY) {
+					script_error("memo() expects a capacity from 1 to %d but found '%s'", MEMO_MAX_CAPACITY, current_token.value);
+				}
+				next_token_wrapper();
+				expect(TOKEN_RPAREN);
+			}
+		}
+
+		// A member starts with its type: int, float or a class name (void for methods only)
+		int typed = current_token.type == TOKEN_INT || current_token.type == TOKEN_FLOAT || current_token.type == TOKEN_IDENTIFIER;
+		if (current_token.type == TOKEN_VOID || (typed && is_method_declaration())) {
+			// Parse method
+			Method* method = parse_method();
+			method->memo_capacity = memo_capacity;
+			add_method(class_node, tails, method);
+			parsing_method = NULL;  // The class frees it from now on
+		}
+		else if (memo_capacity > 0) {
+			script_error("Expected a method after 'memo' but found '%s'", current_token.value);
+		}
+		else if (typed) {
+			// Parse field
+			Field* field = parse_field();
+			*tails->field = field;
+			tails->field = &field->next;
+			class_node->field_count++;
+		}
+		else {
+			// If an unexpected token is found in the class body, print an error message and exit
+			script_error("Unexpected token in class body: %s", current_token.value);
+		}
 	}
 }
 
+// Parse the members of the base classes into a derived class, outermost base first.
+// Inherited methods are parsed again from the base's body so that they are resolved
+// (and optimized) against the derived class: their calls reach its overrides.
+static void parse_inherited_members(ClassNode* class_node, ClassNode* base, MemberTails* tails) {
+	if (base->base != NULL) {
+		parse_inherited_members(class_node, base->base, tails);
+	}
+	tails->inherited = class_node->method_count;
+
+	const char** saved_source = source;
+	Token saved_token = current_token;
+	const char* code = base->body_source;
+	source = &code;
+	next_token_wrapper();
+	parse_members(class_node, tails);
+	source = saved_source;
+	current_token = saved_token;
+}
 
 ClassNode* parse_class() {
 	expect(TOKEN_CLASS);  // Expect 'class'
 
 	const char* class_name = current_token.value;  // Store class name
 	expect(TOKEN_IDENTIFIER);  // Expect class name
+
+	// `class B : A` derives from a class already loaded in the current context
+	const char* base_name = NULL;
+	if (current_token.type == TOKEN_COLON) {
+		next_token_wrapper();  // Move past ':'
+		base_name = current_token.value;
+		expect(TOKEN_IDENTIFIER);
+	}
+	const char* body_start = *source;  // Just past '{'
 	expect(TOKEN_LBRACE);  // Expect '{'
 
-	ClassNode* class_node = (ClassNode*)malloc(sizeof(ClassNode));
+	// Looked up last, so no error before the class exists can leave the base's reference behind
+	ClassNode* base = NULL;
+	if (base_name != NULL) {
+		base = interpreter_find_class(interpreter_current(), base_name);  // The reference the class holds
+		if (base == NULL) {
+			script_error("Base class %s of class %s is not loaded", base_name, class_name);
+		}
+	}
+
+	ClassNode* class_node = (ClassNode*)memory_alloc(MEMORY_AST, sizeof(ClassNode));
 	if (!class_node) {
 		printf("Error: Memory allocation failed for ClassNode.\n");
 		exit(1);
 	}
 
-	class_node->class_name = strdup(class_name);
+	class_node->class_name = class_name;  // Interned by the lexer
+	class_node->base = base;
+	class_node->body_source = NULL;
 	class_node->fields = NULL;
+	class_node->field_count = 0;
 	class_node->methods = NULL;
+	class_node->method_count = 0;
+	class_node->field_table = NULL;
+	class_node->method_table = NULL;
+	class_node->field_names = NULL;
+	class_node->method_names = NULL;
+	class_node->context = interpreter_current();
+	class_node->replacement = NULL;
+	class_node->references = 1;  // Held by whoever loads it (see reload.h)
+	class_node->referenced = NULL;
+	class_node->referenced_count = 0;
+	class_node->uses_references = 0;
+	class_node->arena = (AstArena*)memory_calloc(MEMORY_AST, 1, sizeof(AstArena));
+
+	// Every node of the class, including the optimizer's, goes to its arena
+	// (a base class's body is parsed again inside a derived class's parse)
+	AstArena* enclosing_arena = current_arena;
+	current_arena = class_node->arena;
+	ClassNode* enclosing_class = parsing_class;
+	parsing_class = class_node;
+
+	// Members are appended so the lists keep declaration order, inherited ones first:
+	// a derived object's fields start with its base's layout, and methods keep their slots
+	MemberTails tails;
+	tails.field = &class_node->fields;
+	tails.method = &class_node->methods;
+	tails.inherited = 0;
+	if (base != NULL) {
+		parse_inherited_members(class_node, base, &tails);
+	}
+	tails.inherited = class_node->method_count;
 
 	// Parse class body (fields and methods)
-	while (current_token.type != TOKEN_END) {
-		if (current_token.type == TOKEN_INT || current_token.type == TOKEN_FLOAT) {
-			// Parse field
-			Field* field = parse_field();
-			field->next = class_node->fields;  // Add field to the front of the list
-			class_node->fields = field;
-		}
-		else if (current_token.type == TOKEN_VOID) {
-			// Parse method
-			Method* method = parse_method();
-			method->next = class_node->methods;  // Add method to the front of the list
-			class_node->methods = method;
-		}
-		else {
-			// If an unexpected token is found in the class body, print an error message and exit
-			printf("Error: Unexpected token in class body: %s\n", current_token.value);
-			free_class_node(class_node);
-			exit(1);
-		}
-	}
+	parse_members(class_node, &tails);
 
+	// Keep the body for the classes that will derive from this one
+	size_t body_length = (size_t)(*source - 1 - body_start);  // Up to the closing '}'
+	char* body_source = (char*)memory_alloc(MEMORY_STRINGS, body_length + 1);
+	memcpy(body_source, body_start, body_length);
+	body_source[body_length] = '\0';
+	class_node->body_source = body_source;
+
+	expect(TOKEN_RBRACE);  // Expect '}' closing the class
+
+	index_members(class_node);
+
+	// Bind locals to frame slots and calls to methods now that every method is known
+	resolve_class(class_node);
+	check_class(class_node);
+	optimize_class(class_node);
+	check_parallel_loops(class_node);
+	check_memo_methods(class_node);
+	seal_expressions(class_node);
+
+	current_arena = enclosing_arena;
+	parsing_class = enclosing_class;
 	return class_node;
 }
 
@@ -212,14 +704,19 @@ Field* parse_field() {
 	const char* type = current_token.value;  // Field type (e.g., 'int')
 	expect(current_token.type);  // Expect data type (int, float, etc.)
 
+	int length;
+	type = parse_array_suffix(type, &length);  // int[16] or float[] for arrays
+
 	const char* name = current_token.value;  // Field name
 	expect(TOKEN_IDENTIFIER);
 
 	expect(TOKEN_SEMICOLON);  // Expect ';'
 
-	Field* field = (Field*)malloc(sizeof(Field));
+	Field* field = (Field*)memory_alloc(MEMORY_AST, sizeof(Field));
 	field->type = type;
 	field->name = name;
+	field->value = value_zero(value_type_from_name(type));  // Default value of new objects
+	field->length = length;
 	field->next = NULL;
 	return field;
 }
@@ -229,22 +726,32 @@ Method* parse_method() {
 	const char* return_type = current_token.value;  // Return type (e.g., "void")
 	expect(current_token.type);  // Expect a valid return type like int, void, etc.
 
-	Method* method = (Method*)malloc(sizeof(Method));
-	method->return_type = return_type;
+	Method* method = (Method*)memory_alloc(MEMORY_AST, sizeof(Method));
+	method->return_type = intern_name(return_type);
+	method->result_type = value_type_from_name(return_type);
+	method->parameter_count = 0;
+	method->local_count = 0;
+	method->local_types = NULL;
+	method->owns_arrays = 0;
+	method->owns_strings = 0;
+	method->native = NULL;
+	method->memo_capacity = 0;
+	method->memo = NULL;
+	method->next = NULL;
+	method->parameters = NULL;
+	parsing_method = method;
 
 	// Expect method name (identifier)
 	if (current_token.type != TOKEN_IDENTIFIER) {
-		printf("Error: Expected method name but found '%s'\n", current_token.value);
-		exit(1);
+		script_error("Expected method name but found '%s'", current_token.value);
 	}
-	method->name = strdup(current_token.value);
+	method->name = current_token.value;  // Identifiers are interned by the lexer
 	next_token_wrapper();  // Move to the next token after method name
 
 	// Expect '(' to start parameter list
 	expect(TOKEN_LPAREN);
 
 	// Parse parameters (if any)
-	method->parameters = NULL;
 	ParameterNode* last_param = NULL;
 
 	// Check if there are parameters or if we directly hit ')'
@@ -252,23 +759,28 @@ Method* parse_method() {
 		while (current_token.type != TOKEN_RPAREN) {
 			const char* param_type = current_token.value;
 
-			// Ensure valid parameter type
-			if (current_token.type != TOKEN_INT && current_token.type != TOKEN_FLOAT) {
-				printf("Error: Expected parameter type but found '%s'\n", current_token.value);
-				exit(1);
+			// Ensure valid parameter type (int, float or a class name)
+			if (current_token.type != TOKEN_INT && current_token.type != TOKEN_FLOAT && current_token.type != TOKEN_IDENTIFIER) {
+				script_error("Expected parameter type but found '%s'", current_token.value);
 			}
 
-			next_token_wrapper();  // Move to parameter name
+			next_token_wrapper();  // Move to parameter name or '['
+
+			// Arrays are passed by reference, whatever their length
+			int length;
+			param_type = parse_array_suffix(param_type, &length);
+			if (length > 0) {
+				script_error("Array parameter types can't have a length");
+			}
 
 			if (current_token.type != TOKEN_IDENTIFIER) {
-				printf("Error: Expected parameter name but found '%s'\n", current_token.value);
-				exit(1);
+				script_error("Expected parameter name but found '%s'", current_token.value);
 			}
 
-			const char* param_name = strdup(current_token.value);
+			const char* param_name = current_token.value;
 			next_token_wrapper();  // Move to ',' or ')'
 
-			ParameterNode* param = (ParameterNode*)malloc(sizeof(ParameterNode));
+			ParameterNode* param = (ParameterNode*)memory_alloc(MEMORY_AST, sizeof(ParameterNode));
 			param->type = param_type;
 			param->name = param_name;
 			param->next = NULL;
@@ -281,14 +793,14 @@ Method* parse_method() {
 				last_param->next = param;
 			}
 			last_param = param;
+			method->parameter_count++;
 
 			// If there's a comma, move to the next parameter
 			if (current_token.type == TOKEN_COMMA) {
 				next_token_wrapper();  // Move to the next parameter
 			}
 			else if (current_token.type != TOKEN_RPAREN) {
-				printf("Error: Expected ',' or ')' but found '%s'\n", current_token.value);
-				exit(1);
+				script_error("Expected ',' or ')' but found '%s'", current_token.value);
 			}
 		}
 	}
@@ -298,105 +810,230 @@ Method* parse_method() {
 
 	// Now we should expect '{' for the method body
 	if (current_token.type != TOKEN_LBRACE) {
-		printf("Error: Expected '{' for method body but found '%s'\n", current_token.value);
-		exit(1);
+		script_error("Expected '{' for method body but found '%s'", current_token.value);
 	}
 
-	method->body = parse_block();  // Parse the method body
-
-	// After parsing the method body, expect the closing '}'
-	expect(TOKEN_RBRACE);
+	method->body = parse_block();  // Parse the method body (including its closing '}')
 
 	return method;
 }
 
-ExpressionNode* parse_expression() {
-	// Allocate memory for the left-hand side of the expression
-	ExpressionNode* left = (ExpressionNode*)malloc(sizeof(ExpressionNode));
-	if (!left) {
-		printf("Error: Memory allocation failed for ExpressionNode.\n");
-		exit(1);
+// Parse the argument list of a call; the method name has already been consumed
+static void parse_call_arguments(ExpressionNode* call) {
+	expect(TOKEN_LPAREN);  // Expect '(' to start the argument list
+
+	// Grown in the arena, so a parse error in some argument leaves nothing to free
+	// (an outgrown buffer stays behind until the arena goes, at most as much again)
+	int capacity = 0;
+	call->kind = EXPR_CALL;
+	while (current_token.type != TOKEN_RPAREN) {
+		if (call->argument_count == capacity) {
+			capacity = capacity ? capacity * 2 : 4;
+			uint32_t* arguments = (uint32_t*)ast_alloc(sizeof(uint32_t) * capacity);
+			if (call->argument_count > 0) memcpy(arguments, call->arguments, sizeof(uint32_t) * call->argument_count);
+			call->arguments = arguments;
+		}
+		call->arguments[call->argument_count++] = ast_index(parse_expression());
+
+		if (current_token.type == TOKEN_COMMA) {
+			next_token_wrapper();  // Move to the next argument
+		}
+		else if (current_token.type != TOKEN_RPAREN) {
+			script_error("Expected ',' or ')' in argument list but found '%s'", current_token.value);
+		}
 	}
 
-	// Parse the initial part of the expression (e.g., identifier or constant)
-	if (current_token.type == TOKEN_IDENTIFIER) {
-		left->variable = strdup(current_token.value);
-		left->value = 0;
-		left->next = NULL;
+	expect(TOKEN_RPAREN);  // Expect ')' to close the argument list
+}
+
+// Parse `[index]` after an array name into an element node
+static ExpressionNode* parse_index(ExpressionNode* array) {
+	expect(TOKEN_LBRACKET);  // Expect '['
+
+	ExpressionNode* element = new_expression_node(EXPR_INDEX);
+	element->left = ast_index(array);
+	element->right = ast_index(parse_expression());
+
+	expect(TOKEN_RBRACKET);  // Expect ']'
+	return element;
+}
+
+// Class named by a type or `new` in the class being parsed; an unknown name is an error
+static ClassNode* parse_class_name(const char* name) {
+	ClassNode* class_node = reference_class(parsing_class, name);
+	if (class_node == NULL) {
+		script_error("Unknown class %s in class %s", name, parsing_class->class_name);
+	}
+	parsing_class->uses_references = 1;
+	return class_node;
+}
+
+// Parse `.field` and `.method(arguments...)` after an operand, left to right
+static ExpressionNode* parse_member_access(ExpressionNode* receiver) {
+	while (current_token.type == TOKEN_DOT) {
+		next_token_wrapper();  // Move past '.'
+		if (current_token.type != TOKEN_IDENTIFIER) {
+			script_error("Expected a member name after '.' but found '%s'", current_token.value);
+		}
+		ExpressionNode* member = new_expression_node(EXPR_MEMBER);
+		member->variable = current_token.value;
+		member->left = ast_index(receiver);
+		next_token_wrapper();  // Move to '(' or past the field name
+
+		if (current_token.type == TOKEN_LPAREN) {
+			parse_call_arguments(member);
+			member->kind = EXPR_MEMBER_CALL;
+		}
+		receiver = member;
+	}
+	return receiver;
+}
+
+// Parse a single operand: parenthesized expression, identifier, method call, array element, yield,
+// `new`, null, member access, integer or float constant
+static ExpressionNode* parse_operand() {
+	if (current_token.type == TOKEN_LPAREN) {
+		next_token_wrapper();  // Move past '('
+		ExpressionNode* inner = parse_expression();
+		expect(TOKEN_RPAREN);  // Expect ')' closing the group
+		return inner;
+	}
+
+	ExpressionNode* operand = new_expression_node(EXPR_CONSTANT);
+
+	if (current_token.type == TOKEN_YIELD) {
+		// `yield(value)` suspends the coroutine; its value is what the host resumes it with
+		operand->kind = EXPR_YIELD;
+		operand->variable = intern_name("yield");
+		next_token_wrapper();  // Move past 'yield'
+		expect(TOKEN_LPAREN);
+		operand->left = ast_index(parse_expression());
+		expect(TOKEN_RPAREN);
+	}
+	else if (current_token.type == TOKEN_IDENTIFIER) {
+		operand->kind = EXPR_VARIABLE;
+		operand->variable = current_token.value;
+		next_token_wrapper();  // Move to the next token
+
+		if (current_token.type == TOKEN_LPAREN) {
+			parse_call_arguments(operand);  // `name(...)` is a method call
+		}
+		else if (current_token.type == TOKEN_LBRACKET) {
+			return parse_index(operand);  // `name[index]` is an array element
+		}
+		return parse_member_access(operand);
+	}
+	else if (current_token.type == TOKEN_NEW) {
+		// `new Name()` makes an object of a class of the context (see gc.h)
+		operand->kind = EXPR_NEW;
+		next_token_wrapper();  // Move past 'new'
+		if (current_token.type != TOKEN_IDENTIFIER) {
+			script_error("Expected a class name after 'new' but found '%s'", current_token.value);
+		}
+		operand->variable = current_token.value;
+		operand->class_type = parse_class_name(current_token.value);
+		next_token_wrapper();  // Move to '('
+		expect(TOKEN_LPAREN);
+		expect(TOKEN_RPAREN);
+		return parse_member_access(operand);
+	}
+	else if (current_token.type == TOKEN_NULL) {
+		operand->value = make_object(NULL);
+		parsing_class->uses_references = 1;
 		next_token_wrapper();  // Move to the next token
 	}
 	else if (current_token.type == TOKEN_INT) {
-		left->variable = NULL;
-		left->value = atoi(current_token.value);
-		left->next = NULL;
+		operand->value = make_int(atoi(current_token.value));
+		next_token_wrapper();  // Move to the next token
+	}
+	else if (current_token.type == TOKEN_FLOAT_LITERAL) {
+		operand->value = make_float((float)atof(current_token.value));
+		next_token_wrapper();  // Move to the next token
+	}
+	else if (current_token.type == TOKEN_STRING_LITERAL) {
+		operand->value = string_literal(current_token.value);  // Interned: the node holds no reference
 		next_token_wrapper();  // Move to the next token
 	}
 	else {
-		printf("Error: Unexpected token in expression: %s\n", current_token.value);
-		free(left);
-		exit(1);
+		script_error("Unexpected token in expression: %s", current_token.value);
 	}
 
-	// Now handle possible comparison and arithmetic operators
-	while (current_token.type == TOKEN_PLUS || current_token.type == TOKEN_MINUS ||
-		current_token.type == TOKEN_MULTIPLY || current_token.type == TOKEN_DIVIDE ||
-		current_token.type == TOKEN_LESS || current_token.type == TOKEN_GREATER ||
-		current_token.type == TOKEN_LESS_EQUAL || current_token.type == TOKEN_GREATER_EQUAL ||
-		current_token.type == TOKEN_EQUAL || current_token.type == TOKEN_NOT_EQUAL) {
+	return operand;
+}
 
-		// Create a new operator node
-		ExpressionNode* operatorNode = (ExpressionNode*)malloc(sizeof(ExpressionNode));
-		if (!operatorNode) {
-			printf("Error: Memory allocation failed for operator ExpressionNode.\n");
-			free(left);
-			exit(1);
-		}
+// Operator of a binary operator token
+static BinaryOperator binary_operator_of(TokenType type) {
+	switch (type) {
+	case TOKEN_MINUS: return OP_SUBTRACT;
+	case TOKEN_MULTIPLY: return OP_MULTIPLY;
+	case TOKEN_DIVIDE: return OP_DIVIDE;
+	case TOKEN_LESS: return OP_LESS;
+	case TOKEN_GREATER: return OP_GREATER;
+	case TOKEN_LESS_EQUAL: return OP_LESS_EQUAL;
+	case TOKEN_GREATER_EQUAL: return OP_GREATER_EQUAL;
+	case TOKEN_EQUAL: return OP_EQUAL;
+	case TOKEN_NOT_EQUAL: return OP_NOT_EQUAL;
+	default: return OP_ADD;
+	}
+}
 
-		operatorNode->variable = strdup(current_token.value);  // Store the operator
-		operatorNode->value = 0;
-		operatorNode->next = left;  // Link the current left-hand side as part of the new operator node
+// Binding strength of a binary operator token, 0 for a token that is not one.
+// Products bind tighter than sums, which bind tighter than comparisons.
+static int binary_precedence(TokenType type) {
+	switch (type) {
+	case TOKEN_MULTIPLY:
+	case TOKEN_DIVIDE:
+		return 3;
+	case TOKEN_PLUS:
+	case TOKEN_MINUS:
+		return 2;
+	case TOKEN_LESS:
+	case TOKEN_GREATER:
+	case TOKEN_LESS_EQUAL:
+	case TOKEN_GREATER_EQUAL:
+	case TOKEN_EQUAL:
+	case TOKEN_NOT_EQUAL:
+		return 1;
+	default:
+		return 0;
+	}
+}
 
-		next_token_wrapper();  // Move past the operator
+// Precedence climbing: extend `left` with every operator binding at least as tightly
+// as `min_precedence`. Operators of one level associate to the left.
+static ExpressionNode* parse_binary(ExpressionNode* left, int min_precedence) {
+	int precedence = binary_precedence(current_token.type);
+	while (precedence != 0 && precedence >= min_precedence) {
+		// Create a new operator node
+		ExpressionNode* operatorNode = new_expression_node(EXPR_BINARY);
+		operatorNode->variable = intern_name(current_token.value);  // Store the operator
+		operatorNode->op = binary_operator_of(current_token.type);
+		operatorNode->left = ast_index(left);  // The expression so far becomes the left-hand operand
 
-		// Parse the right-hand side operand
-		ExpressionNode* right = (ExpressionNode*)malloc(sizeof(ExpressionNode));
-		if (!right) {
-			printf("Error: Memory allocation failed for right-hand side ExpressionNode.\n");
-			free(operatorNode);
-			free(left);
-			exit(1);
-		}
+		next_token_wrapper();  // Move past the operator
 
-		if (current_token.type == TOKEN_IDENTIFIER) {
-			right->variable = strdup(current_token.value);
-			right->value = 0;
-			right->next = NULL;
-			next_token_wrapper();  // Move to the next token after identifier
-		}
-		else if (current_token.type == TOKEN_INT) {
-			right->variable = NULL;
-			right->value = atoi(current_token.value);
-			right->next = NULL;
-			next_token_wrapper();  // Move to the next token after integer
-		}
-		else {
-			printf("Error: Expected an identifier or value after operator but found '%s'\n", current_token.value);
-			free(right);
-			free(operatorNode);
-			free(left);
-			exit(1);
+		// The right-hand side takes every tighter operator that follows it
+		ExpressionNode* right = parse_operand();
+		int next = binary_precedence(current_token.type);
+		while (next > precedence) {
+			right = parse_binary(right, next);
+			next = binary_precedence(current_token.type);
 		}
+		operatorNode->right = ast_index(right);
 
-		// The new operator node becomes the root, with `left` and `right` operands attached
-		operatorNode->next->next = right;  // Link right-hand operand to operator
 		left = operatorNode;  // The operator becomes the new root of this expression
+		precedence = next;
 	}
-
-	return left;  // Return the root of the constructed expression tree
+	return left;
 }
 
+ExpressionNode* parse_expression() {
+	// Parse the initial part of the expression (e.g., identifier, call or constant)
+	ExpressionNode* left = parse_operand();
 
-
+	// Now handle possible comparison and arithmetic operators
+	return parse_binary(left, 1);  // Return the root of the constructed expression tree
+}
 
 
 
@@ -404,7 +1041,7 @@ ExpressionNode* parse_expression() {
 
 // Parsing if statement
 IfNode* parse_if_statement() {
-	IfNode* if_node = (IfNode*)malloc(sizeof(IfNode));
+	IfNode* if_node = (IfNode*)ast_alloc(sizeof(IfNode));
 
 	expect(TOKEN_IF);  // Expect 'if'
 	expect(TOKEN_LPAREN);  // Expect '(' for condition
@@ -427,11 +1064,14 @@ IfNode* parse_if_statement() {
 }
 
 ForNode* parse_for_loop() {
-	ForNode* for_node = (ForNode*)malloc(sizeof(ForNode));
-	if (!for_node) {
-		printf("Error: Memory allocation failed for ForNode.\n");
-		exit(1);
-	}
+	ForNode* for_node = (ForNode*)ast_alloc(sizeof(ForNode));
+	for_node->guards = NULL;
+	for_node->guard_count = 0;
+	for_node->unchecked_body = NULL;
+	for_node->parallel = 0;
+	for_node->frame_slots = 0;
+	for_node->reductions = NULL;
+	for_node->reduction_count = 0;
 
 	expect(TOKEN_FOR);  // Expect 'for' keyword
 	expect(TOKEN_LPAREN);  // Expect '(' to start the for loop components
@@ -443,113 +1083,65 @@ ForNode* parse_for_loop() {
 		next_token_wrapper();  // Move to the variable name
 
 		if (current_token.type != TOKEN_IDENTIFIER) {
-			printf("Error: Expected variable name but found '%s'\n", current_token.value);
-			free(for_node);
-			exit(1);
+			script_error("Expected variable name but found '%s'", current_token.value);
 		}
 
-		const char* variable_name = strdup(current_token.value);
+		const char* variable_name = current_token.value;
 		next_token_wrapper();  // Move to '=' or semicolon
 
 		// Check if it's an assignment
 		if (current_token.type == TOKEN_ASSIGN) {
 			next_token_wrapper();  // Move past the '='
 
-			if (current_token.type != TOKEN_INT && current_token.type != TOKEN_FLOAT) {
-				printf("Error: Expected a value (int or float) but found '%s'\n", current_token.value);
-				free(for_node);
-				exit(1);
-			}
-
-			// Store the initializer value
-			for_node->initializer = (ExpressionNode*)malloc(sizeof(ExpressionNode));
-			if (!for_node->initializer) {
-				printf("Error: Memory allocation failed for initializer ExpressionNode.\n");
-				free(for_node);
-				exit(1);
-			}
-			for_node->initializer->variable = strdup(variable_name);
-			for_node->initializer->value = atoi(current_token.value);
-			for_node->initializer->next = NULL;
-
-			next_token_wrapper();  // Move to the semicolon after initialization
+			// Store the initializer: it declares the loop variable with its type
+			for_node->initializer = new_expression_node(EXPR_ASSIGN);
+			for_node->initializer->variable = variable_name;
+			for_node->initializer->value = value_zero(value_type_from_name(type));
+			for_node->initializer->assigned = ast_index(parse_expression());
 
 			if (current_token.type != TOKEN_SEMICOLON) {
-				printf("Error: Expected ';' after initializer but found '%s'\n", current_token.value);
-				free(for_node->initializer);
-				free(for_node);
-				exit(1);
+				script_error("Expected ';' after initializer but found '%s'", current_token.value);
 			}
 		}
 		else {
-			printf("Error: Expected '=' after variable name but found '%s'\n", current_token.value);
-			free(for_node);
-			exit(1);
+			script_error("Expected '=' after variable name but found '%s'", current_token.value);
 		}
 
 		next_token_wrapper();  // Move past the semicolon after initialization
 	}
 	else {
-		printf("Error: Expected type (int/float) for loop initializer but found '%s'\n", current_token.value);
-		free(for_node);
-		exit(1);
+		script_error("Expected type (int/float) for loop initializer but found '%s'", current_token.value);
 	}
 
 	// Parse condition (e.g., i < 3)
 	for_node->condition = parse_expression();  // Parse the condition expression
 	if (current_token.type != TOKEN_SEMICOLON) {
-		printf("Error: Expected ';' after condition but found '%s'\n", current_token.value);
-		free(for_node->initializer);
-		free(for_node);
-		exit(1);
+		script_error("Expected ';' after condition but found '%s'", current_token.value);
 	}
 	next_token_wrapper();  // Move past the semicolon after condition
 
 	// Parse update expression (e.g., i++, i--)
-	for_node->update = (ExpressionNode*)malloc(sizeof(ExpressionNode));
-	if (!for_node->update) {
-		printf("Error: Memory allocation failed for update ExpressionNode.\n");
-		free(for_node->initializer);
-		free(for_node->condition);
-		free(for_node);
-		exit(1);
-	}
+	for_node->update = new_expression_node(EXPR_VARIABLE);
 	if (current_token.type == TOKEN_IDENTIFIER) {
-		for_node->update->variable = strdup(current_token.value);
+		for_node->update->variable = current_token.value;
 		next_token_wrapper();  // Move to the next token
 
 		// Check for increment (++) or decrement (--)
 		if (current_token.type == TOKEN_INCREMENT || current_token.type == TOKEN_DECREMENT) {
-			for_node->update->value = (current_token.type == TOKEN_INCREMENT) ? 1 : -1;
-			for_node->update->next = NULL;
+			for_node->update->value = make_int((current_token.type == TOKEN_INCREMENT) ? 1 : -1);
 			next_token_wrapper();  // Move past ++ or --
 		}
 		else {
-			printf("Error: Expected '++' or '--' in update expression but found '%s'\n", current_token.value);
-			free(for_node->initializer);
-			free(for_node->condition);
-			free(for_node->update);
-			free(for_node);
-			exit(1);
+			script_error("Expected '++' or '--' in update expression but found '%s'", current_token.value);
 		}
 	}
 	else {
-		printf("Error: Expected identifier in update expression but found '%s'\n", current_token.value);
-		free(for_node->initializer);
-		free(for_node->condition);
-		free(for_node->update);
-		free(for_node);
-		exit(1);
+		script_error("Expected identifier in update expression but found '%s'", current_token.value);
 	}
 
 	// Ensure that the next token is a closing parenthesis
 	if (current_token.type != TOKEN_RPAREN) {
-		printf("Error: Expected ')' after update expression but found '%s'\n", current_token.value);
-		free(for_node->initializer);
-		free(for_node->condition);
-		free(for_node->update);
-		free(for_node);
-		exit(1);
+		script_error("Expected ')' after update expression but found '%s'", current_token.value);
 	}
 	next_token_wrapper();  // Move past ')' to parse the for loop body
 
@@ -562,33 +1154,122 @@ ForNode* parse_for_loop() {
 
 
 
+// Parse a local declaration with an optional initializer (zero otherwise); the type has been consumed
+static void parse_declaration(StatementNode* stmt, const char* type) {
+	int length;
+	type = parse_array_suffix(type, &length);  // int[16] or float[] for arrays
+
+	if (current_token.type != TOKEN_IDENTIFIER) {
+		script_error("Expected variable name but found '%s'", current_token.value);
+	}
+
+	ExpressionNode* declaration = new_expression_node(EXPR_ASSIGN);
+	declaration->variable = current_token.value;
+	declaration->value = value_zero(value_type_from_name(type));
+	declaration->length = length;
+	if (declaration->value.type == VALUE_OBJECT) {
+		declaration->class_type = parse_class_name(type);
+	}
+	next_token_wrapper();  // Move to '=' or ';'
+
+	if (current_token.type == TOKEN_ASSIGN) {
+		next_token_wrapper();  // Move to the initial value
+		declaration->assigned = ast_index(parse_expression());
+	}
+	stmt->node_type = NODE_DECLARATION;
+	stmt->expression = declaration;
+
+	expect(TOKEN_SEMICOLON);  // Expect a semicolon after the declaration
+}
+
 StatementNode* parse_statement() {
-	StatementNode* stmt = (StatementNode*)malloc(sizeof(StatementNode));
+	StatementNode* stmt = (StatementNode*)ast_alloc(sizeof(StatementNode));  // Goes with the class, even if the parse fails
 
 	if (current_token.type == TOKEN_IDENTIFIER) {
 		// Handle assignment statement
-		char* variable_name = strdup(current_token.value);  // Store the variable name
+		const char* variable_name = current_token.value;  // Store the variable name
 		next_token_wrapper();  // Move to next token (should be '=')
 
-		if (current_token.type == TOKEN_ASSIGN) {
+		if (current_token.type == TOKEN_IDENTIFIER) {
+			// `Name variable` declares a reference to an object of class Name
+			parse_declaration(stmt, variable_name);
+		}
+		else if (current_token.type == TOKEN_DOT || current_token.type == TOKEN_LPAREN) {
+			// Handle a call statement, whose return value is discarded, a member call
+			// `a.b.method(...);` or a store `a.b.field = value;` into the object a reference points to
+			ExpressionNode* receiver = new_expression_node(EXPR_VARIABLE);
+			receiver->variable = variable_name;
+			if (current_token.type == TOKEN_LPAREN) {
+				parse_call_arguments(receiver);
+			}
+			ExpressionNode* target = parse_member_access(receiver);
+
+			if (target->kind == EXPR_CALL || target->kind == EXPR_MEMBER_CALL) {
+				stmt->node_type = NODE_EXPRESSION;
+				stmt->expression = target;
+			}
+			else if (current_token.type == TOKEN_ASSIGN) {
+				next_token_wrapper();  // Move to the value being assigned
+				ExpressionNode* assignment_expr = new_expression_node(EXPR_ASSIGN);
+				assignment_expr->variable = target->variable;
+				assignment_expr->left = ast_index(target);
+				assignment_expr->assigned = ast_index(parse_expression());
+				stmt->node_type = NODE_ASSIGNMENT;
+				stmt->expression = assignment_expr;
+			}
+			else {
+				script_error("Expected '=' or a call after member %s but found '%s'", target->variable, current_token.value);
+			}
+
+			expect(TOKEN_SEMICOLON);  // Expect a semicolon after the statement
+		}
+		else if (current_token.type == TOKEN_LBRACKET) {
+			// Handle an element assignment: name[index] = value
+			ExpressionNode* array = new_expression_node(EXPR_VARIABLE);
+			array->variable = variable_name;
+			ExpressionNode* element = parse_index(array);
+			expect(TOKEN_ASSIGN);  // Expect '=' after the element
+
+			ExpressionNode* assignment_expr = new_expression_node(EXPR_ASSIGN);
+			assignment_expr->variable = variable_name;
+			assignment_expr->left = ast_index(element);
+			assignment_expr->assigned = ast_index(parse_expression());
+			stmt->node_type = NODE_ASSIGNMENT;
+			stmt->expression = assignment_expr;
+
+			expect(TOKEN_SEMICOLON);  // Expect a semicolon after the assignment
+		}
+		else if (current_token.type == TOKEN_ASSIGN) {
 			next_token_wrapper();  // Move to the value being assigned
 
 			ExpressionNode* value_expr = parse_expression();  // Parse the assigned value
 			stmt->node_type = NODE_ASSIGNMENT;
 
 			// Create a new expression node for the assignment
-			ExpressionNode* assignment_expr = (ExpressionNode*)malloc(sizeof(ExpressionNode));
+			ExpressionNode* assignment_expr = new_expression_node(EXPR_ASSIGN);
 			assignment_expr->variable = variable_name;
-			assignment_expr->next = value_expr;
+			assignment_expr->assigned = ast_index(value_expr);
 			stmt->expression = assignment_expr;
 
 			expect(TOKEN_SEMICOLON);  // Expect a semicolon after the assignment
 		}
 		else {
-			printf("Error: Expected '=' for assignment after variable name but found '%s'\n", current_token.value);
-			exit(1);
+			script_error("Expected '=' or '(' after name but found '%s'", current_token.value);
 		}
 	}
+	else if (current_token.type == TOKEN_RETURN) {
+		// Handle 'return' with an optional value
+		next_token_wrapper();
+		stmt->node_type = NODE_RETURN;
+		stmt->expression = current_token.type == TOKEN_SEMICOLON ? NULL : parse_expression();
+		expect(TOKEN_SEMICOLON);  // Expect a semicolon after the return
+	}
+	else if (current_token.type == TOKEN_INT || current_token.type == TOKEN_FLOAT) {
+		// Handle a local declaration with an optional initializer (zero otherwise)
+		const char* type = current_token.value;
+		next_token_wrapper();  // Move to the variable name or '['
+		parse_declaration(stmt, type);
+	}
 	else if (current_token.type == TOKEN_IF) {
 		// Handle 'if' statement
 		IfNode* if_node = parse_if_statement();
@@ -601,11 +1282,26 @@ StatementNode* parse_statement() {
 		stmt->node_type = NODE_FOR;
 		stmt->forNode = for_node;
 	}
-	else {
-		// Unsupported statement
-		printf("Error: Unexpected token in statement: %s\n", current_token.value);
-		free(stmt);
-		exit(1);
+	else if (current_token.type == TOKEN_YIELD) {
+		// Handle a `yield(value);` statement, discarding the resumed value
+		stmt->node_type = NODE_EXPRESSION;
+		stmt->expression = parse_expression();
+		expect(TOKEN_SEMICOLON);
+	}
+	else if (current_token.type == TOKEN_PARALLEL) {
+		// Handle 'parallel for': same structure, iterations split across the worker pool
+		next_token_wrapper();  // Move past 'parallel'
+		if (current_token.type != TOKEN_FOR) {
+			script_error("Expected 'for' after 'parallel' but found '%s'", current_token.value);
+		}
+		ForNode* for_node = parse_for_loop();
+		for_node->parallel = 1;
+		stmt->node_type = NODE_FOR;
+		stmt->forNode = for_node;
+	}
+	else {
+		// Unsupported statement
+		script_error("Unexpected token in statement: %s", current_token.value);
 	}
 
 	return stmt;
@@ -614,26 +1310,17 @@ StatementNode* parse_statement() {
 BlockNode* parse_block() {
 	expect(TOKEN_LBRACE);  // Expect '{'
 
-	// Allocate memory for the first block node
-	BlockNode* block = (BlockNode*)malloc(sizeof(BlockNode));
-	if (!block) {
-		printf("Error: Memory allocation failed for BlockNode.\n");
-		exit(1);
-	}
-
-	block->next = NULL;
-	BlockNode* current_block = block;
+	// Statements are linked after a placeholder head
+	BlockNode head;
+	head.next = NULL;
+	BlockNode* current_block = &head;
 
 	// Parse each statement in the block
 	while (current_token.type != TOKEN_RBRACE && current_token.type != TOKEN_END) {
 		StatementNode* stmt = parse_statement();  // Parse the statement
 
 		// Allocate a new block node for the statement
-		BlockNode* new_block = (BlockNode*)malloc(sizeof(BlockNode));
-		if (!new_block) {
-			printf("Error: Memory allocation failed for BlockNode.\n");
-			exit(1);
-		}
+		BlockNode* new_block = (BlockNode*)ast_alloc(sizeof(BlockNode));
 
 		new_block->node_type = stmt->node_type;
 
@@ -651,194 +1338,946 @@ BlockNode* parse_block() {
 		case NODE_ASSIGNMENT:
 			new_block->expression = stmt->expression;  // Assign the assignment expression to the block node
 			break;
+		case NODE_RETURN:
+			new_block->expression = stmt->expression;  // Returned value, NULL for a bare return
+			break;
+		case NODE_DECLARATION:
+			new_block->expression = stmt->expression;  // Declared local and its initial value
+			break;
 		default:
-			printf("Error: Unsupported node type in block.\n");
-			free(new_block);
-			free(stmt);
-			exit(1);
+			script_error("Unsupported node type in block.");
 		}
 
 		// Link the new block node to the list
 		current_block->next = new_block;
 		current_block = new_block;
 		current_block->next = NULL;
-
-		// Free temporary statement node
-		free(stmt);
 	}
 
 	expect(TOKEN_RBRACE);  // Expect '}'
 
-	return block->next;  // Return the parsed block
+	return head.next;  // Return the parsed block
+}
+
+// Names visible while resolving a method body, innermost last
+typedef struct ResolveScope {
+	ClassNode* class_node;
+	Method* method;
+	const char* names[256];
+	int slots[256];
+	ClassNode* classes[256];  // Class of a reference-typed name, NULL otherwise
+	int count;        // Number of visible names
+	int slot_count;   // Frame slots handed out so far
+} ResolveScope;
+
+// Give a newly declared local its own frame slot and record the slot's type (and class, for a reference)
+static int declare_local(ResolveScope* scope, const char* name, ValueType type, ClassNode* class_type) {
+	if (scope->count == (int)(sizeof(scope->names) / sizeof(scope->names[0]))) {
+		script_error("Too many locals in method %s", scope->method->name);
+	}
+	Method* method = scope->method;
+	method->local_types = (ValueType*)memory_realloc(MEMORY_AST, method->local_types, sizeof(ValueType) * (scope->slot_count + 1));
+	if (!method->local_types) {
+		printf("Error: Memory allocation failed for local types.\n");
+		exit(1);
+	}
+	method->local_types[scope->slot_count] = type;
+
+	scope->names[scope->count] = name;
+	scope->classes[scope->count] = class_type;
+	scope->slots[scope->count] = scope->slot_count++;
+	return scope->slots[scope->count++];
+}
+
+// Bind a variable to its frame slot, or to a field of the object (slot -1); locals shadow fields
+static void resolve_name(ResolveScope* scope, ExpressionNode* variable) {
+	const char* name = variable->variable;
+	for (int i = scope->count - 1; i >= 0; i--) {
+		if (scope->names[i] == name) {  // Names are interned
+			variable->slot = scope->slots[i];
+			variable->field = -1;
+			variable->class_type = scope->classes[i];
+			return;
+		}
+	}
+	variable->slot = -1;
+	variable->field = find_field(scope->class_node, name);
+	if (variable->field < 0) {
+		script_error("Undefined variable %s in method %s", name, scope->method->name);
+	}
+}
+
+static void resolve_expression(ResolveScope* scope, ExpressionNode* expr) {
+	if (expr == NULL) return;
+
+	if (expr->kind == EXPR_CALL) {
+		expr->callee = find_method(scope->class_node, expr->variable);
+		if (expr->callee == NULL) {
+			// Not a method of the class: maybe a builtin
+			expr->builtin = find_builtin(expr->variable);
+			if (expr->builtin == BUILTIN_NONE) {
+				script_error("Method %s not found in class %s", expr->variable, scope->class_node->class_name);
+			}
+			expr->kind = EXPR_BUILTIN;
+			if (expr->argument_count != builtin_parameter_count(expr->builtin)) {
+				script_error("Builtin %s expects %d arguments but got %d", expr->variable,
+					builtin_parameter_count(expr->builtin), expr->argument_count);
+			}
+		}
+		else if (expr->argument_count != expr->callee->parameter_count) {
+			script_error("Method %s expects %d arguments but got %d", expr->variable,
+				expr->callee->parameter_count, expr->argument_count);
+		}
+		for (int i = 0; i < expr->argument_count; i++) {
+			resolve_expression(scope, ast_node(expr->arguments[i]));
+		}
+		return;
+	}
+
+	if (expr->kind == EXPR_MEMBER_CALL) {
+		// The method is found in the receiver's class by check_class
+		resolve_expression(scope, ast_node(expr->left));
+		for (int i = 0; i < expr->argument_count; i++) {
+			resolve_expression(scope, ast_node(expr->arguments[i]));
+		}
+		return;
+	}
+
+	if (expr->kind == EXPR_VARIABLE) {
+		resolve_name(scope, expr);
+		return;
+	}
+
+	// Operators, conversions and array elements
+	resolve_expression(scope, ast_node(expr->left));
+	resolve_expression(scope, ast_node(expr->right));
+}
+
+static void resolve_block(ResolveScope* scope, BlockNode* block) {
+	int visible = scope->count;  // Names declared in this block go out of scope at its end
+
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		switch (current->node_type) {
+		case NODE_ASSIGNMENT:
+			if (current->expression->left != EXPR_NONE) {
+				resolve_expression(scope, ast_node(current->expression->left));  // Element of an array or member of an object
+			}
+			else {
+				resolve_name(scope, current->expression);
+			}
+			resolve_expression(scope, ast_node(current->expression->assigned));
+			break;
+		case NODE_EXPRESSION:
+			resolve_expression(scope, current->expression);
+			break;
+		case NODE_DECLARATION:
+			// The initializer is resolved first: it can't see the variable it initializes
+			resolve_expression(scope, ast_node(current->expression->assigned));
+			current->expression->slot = declare_local(scope, current->expression->variable, current->expression->value.type, current->expression->class_type);
+			break;
+		case NODE_IF:
+			resolve_expression(scope, current->ifNode->condition);
+			resolve_block(scope, current->ifNode->trueBlock);
+			resolve_block(scope, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR: {
+			ForNode* for_node = current->forNode;
+			int outer = scope->count;
+			resolve_expression(scope, ast_node(for_node->initializer->assigned));
+			for_node->initializer->slot = declare_local(scope, for_node->initializer->variable, for_node->initializer->value.type, NULL);
+			resolve_expression(scope, for_node->condition);
+			resolve_name(scope, for_node->update);
+			resolve_block(scope, for_node->body);
+			scope->count = outer;  // The loop variable is only visible inside the loop
+			break;
+		}
+		case NODE_RETURN:
+			if (current->expression != NULL && strcmp(scope->method->return_type, "void") == 0) {
+				script_error("void method %s cannot return a value", scope->method->name);
+			}
+			if (current->expression == NULL && strcmp(scope->method->return_type, "void") != 0) {
+				script_error("Method %s must return a value", scope->method->name);
+			}
+			resolve_expression(scope, current->expression);
+			break;
+		default:
+			break;
+		}
+	}
+
+	scope->count = visible;
 }
 
-void execute_block(BlockNode* block, Object* obj, LocalVariable* local_table) {
+// Bind every local (parameters, loop variables, declarations) to a frame slot and every call to its method
+void resolve_class(ClassNode* class_node) {
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		ResolveScope scope;
+		scope.class_node = class_node;
+		scope.method = method;
+		scope.count = 0;
+		scope.slot_count = 0;
+
+		// Parameters take the first slots, in declaration order, where the caller pushes the arguments
+		for (ParameterNode* param = method->parameters; param != NULL; param = param->next) {
+			ValueType type = value_type_from_name(param->type);
+			ClassNode* param_class = NULL;
+			if (type == VALUE_OBJECT) {
+				// An unknown class is reported by check_class
+				param_class = reference_class(class_node, param->type);
+				class_node->uses_references = 1;
+			}
+			declare_local(&scope, param->name, type, param_class);
+		}
+
+		resolve_block(&scope, method->body);
+		method->local_count = scope.slot_count;
+
+		method->owns_arrays = 0;
+		for (int i = method->parameter_count; i < method->local_count; i++) {
+			if (is_array_type(method->local_types[i]) || is_map_type(method->local_types[i])) method->owns_arrays = 1;
+		}
+		method->owns_strings = 0;
+		for (int i = 0; i < method->local_count; i++) {
+			if (method->local_types[i] == VALUE_STRING) method->owns_strings = 1;
+		}
+	}
+}
+
+int may_alias(Method* method, ExpressionNode* left, ExpressionNode* right) {
+	if (left->slot >= 0 ? left->slot == right->slot : right->slot < 0 && left->field == right->field) return 1;
+	// Arrays and maps are never assigned: a local the method declares holds its own one,
+	// and a field holds the same one for the object's life
+	if (left->slot >= method->parameter_count || right->slot >= method->parameter_count) return 0;
+	if (left->slot < 0 && right->slot < 0) return 0;
+	// A parameter may have been passed any array or map of its type
+	return left->type == right->type;
+}
+
+static int evaluate_int(ExpressionNode* expr, Object* obj, Value* locals);
+
+// Set when a bounded call ran out of budget; every statement checks it, so the
+// calls and loops still on the C stack unwind without running anything else
+static THREAD_LOCAL int execution_aborted = 0;
+
+// The budget ran out at a loop back-edge or a call. A coroutine is preempted and
+// continues with a fresh slice once resumed; a bounded host call is aborted.
+// Returns 1 when execution must unwind.
+static int budget_exhausted(FrameStack* stack) {
+	if (execution_aborted) return 1;
+	if (coroutine_preempt()) {
+		stack->budget--;  // The unit that ran out opens the new slice
+		return 0;
+	}
+	execution_aborted = 1;
+	return 1;
+}
+
+ExecStatus execute_block(BlockNode* block, Object* obj, Value* locals) {
 	BlockNode* current = block;
+	ExecStatus status;
 	while (current != NULL) {
+		if (execution_aborted) return EXEC_ABORT;
 		switch (current->node_type) {
 		case NODE_IF:
-			execute_if(current->ifNode, obj, local_table);
+			if ((status = execute_if(current->ifNode, obj, locals)) != EXEC_NORMAL) return status;
 			break;
 		case NODE_FOR:
-			execute_for(current->forNode, obj);  // Pass the object and handle loop variables internally
+			if ((status = execute_for(current->forNode, obj, locals)) != EXEC_NORMAL) return status;
 			break;
 		case NODE_ASSIGNMENT:
-			execute_expression(current->expression, obj, local_table);  // Evaluate the assignment
+			execute_expression(current->expression, obj, locals);  // Evaluate the assignment
 			break;
 		case NODE_EXPRESSION:
-			execute_expression(current->expression, obj, local_table);
+			execute_expression(current->expression, obj, locals);
 			break;
+		case NODE_DECLARATION: {
+			ExpressionNode* declaration = current->expression;
+			if (is_map_type(declaration->type)) {
+				// Like arrays, a map is allocated on first execution and emptied when the declaration runs again
+				Map* map = locals[declaration->slot].as.m;
+				if (map != NULL) {
+					map_clear(map);
+				}
+				else {
+					locals[declaration->slot] = make_map(declaration->type, map_create(map_value_type(declaration->type)));
+				}
+				break;
+			}
+			if (is_array_type(declaration->type)) {
+				// Arrays are allocated on first execution; running the declaration again (in a loop) reuses the storage
+				Array* array = locals[declaration->slot].as.a;
+				if (array != NULL) {
+					array_reset(array);
+				}
+				else {
+					array = array_create(array_element_type(declaration->type), declaration->length, declaration->length > 0);
+					locals[declaration->slot] = make_array(declaration->type, array);
+				}
+				break;
+			}
+			// Without an initializer the variable starts at the declared zero
+			Value value = declaration->assigned != EXPR_NONE ? evaluate_expression(expr_child(declaration, declaration->assigned), obj, locals) : declaration->value;
+			if (declaration->type == VALUE_STRING) string_release(locals[declaration->slot]);  // Left by an earlier iteration
+			locals[declaration->slot] = value;
+			break;
+		}
+		case NODE_RETURN:
+			// Leave the value in the return register and unwind to invoke_method
+			current_frame_stack()->return_value = current->expression ? evaluate_expression(current->expression, obj, locals) : make_int(0);
+			return EXEC_RETURN;
 		default:
-			printf("Error: Unsupported node type in block.\n");
-			exit(1);
+			script_error("Unsupported node type in block.");
 		}
 		current = current->next;
 	}
+	return EXEC_NORMAL;
 }
 
 
 
 // Execute an if statement
-void execute_if(IfNode* if_node, Object* obj, LocalVariable* local_table) {
+ExecStatus execute_if(IfNode* if_node, Object* obj, Value* locals) {
 	if (!if_node) {
 		printf("Error: Null IfNode encountered.\n");
-		return;
+		return EXEC_NORMAL;
 	}
 
-	// Step 1: Evaluate the condition using both the object and the local scope
-	int condition_value = evaluate_expression(if_node->condition, obj, local_table);
+	// Step 1: Evaluate the condition using both the object and the local scope (conditions are ints)
+	int condition_value = evaluate_int(if_node->condition, obj, locals);
 
 	// Step 2: Decide which block to execute based on the condition
 	if (condition_value) {
 		// If the condition is true, execute the true block
-		execute_block(if_node->trueBlock, obj, local_table);
+		return execute_block(if_node->trueBlock, obj, locals);
 	}
 	else if (if_node->falseBlock) {
 		// If the condition is false and there's a false block, execute it
-		execute_block(if_node->falseBlock, obj, local_table);
+		return execute_block(if_node->falseBlock, obj, locals);
 	}
+	return EXEC_NORMAL;
 }
 
 
 
-void execute_for(ForNode* for_node, Object* obj) {
+ExecStatus execute_for(ForNode* for_node, Object* obj, Value* locals) {
 	if (!for_node) {
 		printf("Error: Null ForNode encountered.\n");
-		return;
+		return EXEC_NORMAL;
 	}
 
-	// Create a local variable table for the scope of the for loop
-	LocalVariable* local_table = NULL;
+	// Parallel loops split their iterations across the worker pool
+	if (for_node->parallel && for_node->frame_slots > 0) {
+		return execute_parallel_for(for_node, obj, locals);
+	}
 
-	// Step 1: Execute the initializer (e.g., int i = 0)
-	if (for_node->initializer && for_node->initializer->variable != NULL) {
-		// Add the variable to the local table
-		update_local_variable(&local_table, for_node->initializer->variable, for_node->initializer->value);
+	// Step 1: Execute the initializer (e.g., int i = 0); the loop variable has its own frame slot
+	locals[for_node->initializer->slot] = evaluate_expression(expr_child(for_node->initializer, for_node->initializer->assigned), obj, locals);
+
+	// When the hoisted guards hold, every element the loop touches is in bounds: run the unchecked copy
+	BlockNode* body = for_node->body;
+	if (for_node->unchecked_body != NULL) {
+		body = for_node->unchecked_body;
+		for (int i = 0; i < for_node->guard_count; i++) {
+			if (!evaluate_int(for_node->guards[i], obj, locals)) {
+				body = for_node->body;
+				break;
+			}
+		}
 	}
 
-	// Step 2: Loop while the condition is true
-	while (evaluate_expression(for_node->condition, obj, local_table)) {
+	// Step 2: Loop while the condition is true; every back-edge is charged to the budget
+	FrameStack* stack = current_frame_stack();
+	while (evaluate_int(for_node->condition, obj, locals)) {
 		// Step 3: Execute the body of the loop
-		execute_block(for_node->body, obj, local_table);
+		ExecStatus status = execute_block(body, obj, locals);
+		if (status != EXEC_NORMAL) {
+			return status;
+		}
 
-		// Step 4: Execute the update expression (e.g., i++)
-		if (for_node->update && for_node->update->variable != NULL) {
-			int current_value = lookup_local_variable(local_table, for_node->update->variable);
-			if (for_node->update->value == 1) {  // Increment
-				update_local_variable(&local_table, for_node->update->variable, current_value + 1);
-			}
-			else if (for_node->update->value == -1) {  // Decrement
-				update_local_variable(&local_table, for_node->update->variable, current_value - 1);
-			}
+		// Step 4: Execute the update expression (e.g., i++); the step keeps the variable's type
+		ExpressionNode* update = for_node->update;
+		Value* target = update->slot >= 0 ? &locals[update->slot] : &obj->field_values[update->field].value;
+		if (update->type == VALUE_INT) {
+			target->as.i += update->value.as.i;
+		}
+		else {
+			target->as.f += (float)update->value.as.i;
+		}
+		if (--stack->budget < 0 && budget_exhausted(stack)) {
+			return EXEC_ABORT;
 		}
 	}
+	return EXEC_NORMAL;
 }
 
 
 
-int evaluate_expression(ExpressionNode* expr, Object* obj, LocalVariable* local_table) {
-	if (!expr) {
-		printf("Error: Null expression encountered.\n");
-		exit(1);
+static Value invoke_method(Object* obj, Method* method, FrameStack* stack, int argument_count);
+
+static void push_slot(FrameStack* stack, Value value, const char* name) {
+	if (stack->top >= stack->capacity) {
+		script_error("Stack overflow while calling %s.", name);
 	}
+	stack->slots[stack->top++] = value;
+}
 
-	// If the expression is an operator, handle it as a binary expression
-	if (expr->variable != NULL) {
-		if (strcmp(expr->variable, "<") == 0 || strcmp(expr->variable, ">") == 0 ||
-			strcmp(expr->variable, "<=") == 0 || strcmp(expr->variable, ">=") == 0 ||
-			strcmp(expr->variable, "==") == 0 || strcmp(expr->variable, "!=") == 0 ||
-			strcmp(expr->variable, "+") == 0 || strcmp(expr->variable, "-") == 0 ||
-			strcmp(expr->variable, "*") == 0 || strcmp(expr->variable, "/") == 0) {
+// Evaluate the arguments of a call straight onto the frame stack
+static void push_arguments(ExpressionNode* expr, FrameStack* stack, Object* obj, Value* locals) {
+	for (int i = 0; i < expr->argument_count; i++) {
+		// Nested calls in the argument use the slots above the ones pushed so far
+		push_slot(stack, evaluate_expression(expr_argument(expr, i), obj, locals), expr->variable);
+	}
+}
 
-			// Handle binary operators
-			if (!expr->next || !expr->next->next) {
-				printf("Error: Invalid binary expression. Missing operand.\n");
-				exit(1);
-			}
+// Evaluate the arguments of a call straight onto the frame stack, then invoke the callee
+static Value evaluate_call(ExpressionNode* expr, Object* obj, Value* locals) {
+	FrameStack* stack = current_frame_stack();
+	push_arguments(expr, stack, obj, locals);
+	return invoke_method(obj, expr->callee, stack, expr->argument_count);
+}
 
-			int left_value = evaluate_expression(expr->next, obj, local_table);    // Left operand
-			int right_value = evaluate_expression(expr->next->next, obj, local_table);  // Right operand
+// ---- References ----
 
-			// Perform the operation based on the operator type
-			if (strcmp(expr->variable, "<") == 0) {
-				return left_value < right_value;
-			}
-			else if (strcmp(expr->variable, ">") == 0) {
-				return left_value > right_value;
-			}
-			else if (strcmp(expr->variable, "<=") == 0) {
-				return left_value <= right_value;
-			}
-			else if (strcmp(expr->variable, ">=") == 0) {
-				return left_value >= right_value;
-			}
-			else if (strcmp(expr->variable, "==") == 0) {
-				return left_value == right_value;
-			}
-			else if (strcmp(expr->variable, "!=") == 0) {
-				return left_value != right_value;
-			}
-			else if (strcmp(expr->variable, "+") == 0) {
-				return left_value + right_value;
-			}
-			else if (strcmp(expr->variable, "-") == 0) {
-				return left_value - right_value;
-			}
-			else if (strcmp(expr->variable, "*") == 0) {
-				return left_value * right_value;
-			}
-			else if (strcmp(expr->variable, "/") == 0) {
-				if (right_value == 0) {
-					printf("Error: Division by zero.\n");
-					exit(1);
-				}
-				return left_value / right_value;
-			}
+// Stands in for the field of a receiver that an aborted call didn't return, while the statement unwinds
+static THREAD_LOCAL Field aborted_field;
+
+static Object* evaluate_object(ExpressionNode* expr, Object* obj, Value* locals);
+
+// Object a member access or member call goes through; following null is an error
+static Object* evaluate_receiver(ExpressionNode* member, Object* obj, Value* locals) {
+	Object* target = evaluate_object(expr_child(member, member->left), obj, locals);
+	if (target == NULL && !execution_aborted) {
+		script_error("Null reference reaching %s", member->variable);
+	}
+	return target;
+}
+
+// Index of a member's field in the object a reference reached. Objects of the class the
+// access was checked against, or of a class derived from it, share its layout; another
+// version of the class (after a reload) is looked up by name.
+static int member_field_index(Object* target, ExpressionNode* member) {
+	ClassNode* class_node = target->class_type;
+	ClassNode* checked = expr_child(member, member->left)->class_type;
+	if (class_node == checked || class_derives_from(class_node, checked)) {
+		return member->field;
+	}
+	int index = find_field(class_node, member->variable);
+	if (index < 0 || target->field_values[index].value.type != member->type) {
+		script_error("Class %s has no %s field %s", class_node->class_name, value_type_name(member->type), member->variable);
+	}
+	return index;
+}
+
+static Field* member_field(ExpressionNode* member, Object* obj, Value* locals) {
+	Object* target = evaluate_receiver(member, obj, locals);
+	if (target == NULL) return &aborted_field;
+	return &target->field_values[member_field_index(target, member)];
+}
+
+// Method a member call runs: the override in the receiver's vtable slot, or for another
+// version of the class the method of the same name and signature
+static Method* member_method(Object* target, ExpressionNode* call) {
+	ClassNode* class_node = target->class_type;
+	ClassNode* checked = expr_child(call, call->left)->class_type;
+	if (class_node == checked || class_derives_from(class_node, checked)) {
+		return class_node->method_table[call->field];
+	}
+	Method* method = find_method(class_node, call->variable);
+	int matches = method != NULL && method->parameter_count == call->argument_count && method->result_type == call->type;
+	for (int i = 0; matches && i < call->argument_count; i++) {
+		matches = method->local_types[i] == expr_argument(call, i)->type;
+	}
+	if (!matches) {
+		script_error("Class %s has no method %s taking these arguments", class_node->class_name, call->variable);
+	}
+	return method;
+}
+
+// Call a method on the object a reference points to: `a.method(arguments...)`. The
+// receiver stays in the slot below the arguments while the call runs, so a collection
+// during the call sees it.
+static Value evaluate_member_call(ExpressionNode* expr, Object* obj, Value* locals) {
+	FrameStack* stack = current_frame_stack();
+	Object* target = evaluate_receiver(expr, obj, locals);
+	push_slot(stack, make_object(target), expr->variable);
+	push_arguments(expr, stack, obj, locals);
+	if (target == NULL) {
+		stack->top -= expr->argument_count + 1;
+		return value_zero(expr->type);
+	}
+	Value result = invoke_method(target, member_method(target, expr), stack, expr->argument_count);
+	stack->top--;  // Pop the receiver
+	return result;
+}
+
+// `left == right` or `left != right` on references: whether they point to the same object
+static int compare_objects(ExpressionNode* expr, Object* obj, Value* locals) {
+	Object* left;
+	Object* right;
+	ExpressionKind right_kind = expr_child(expr, expr->right)->kind;
+	if (right_kind == EXPR_CONSTANT || right_kind == EXPR_VARIABLE) {
+		left = evaluate_object(expr_child(expr, expr->left), obj, locals);
+		right = evaluate_object(expr_child(expr, expr->right), obj, locals);
+	}
+	else {
+		// The right operand may allocate: the left one waits in a frame slot
+		FrameStack* stack = current_frame_stack();
+		push_slot(stack, make_object(evaluate_object(expr_child(expr, expr->left), obj, locals)), expr->variable);
+		right = evaluate_object(expr_child(expr, expr->right), obj, locals);
+		left = stack->slots[--stack->top].as.o;
+	}
+	return expr->op == OP_EQUAL ? left == right : left != right;
+}
+
+// Evaluate an expression whose static type is a reference
+static Object* evaluate_object(ExpressionNode* expr, Object* obj, Value* locals) {
+	Value result;
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+		return NULL;  // null
+
+	case EXPR_VARIABLE:
+		if (expr->slot >= 0) {
+			return locals[expr->slot].as.o;
 		}
-		else {
-			// Handle non-operator variables (local variables or fields)
-			// First, try to find the variable in the local table
-			LocalVariable* local_var = local_table;
-			while (local_var) {
-				if (strcmp(local_var->variable_name, expr->variable) == 0) {
-					return local_var->value;
-				}
-				local_var = local_var->next;
+		return obj->field_values[expr->field].value.as.o;
+
+	case EXPR_NEW:
+		return gc_new_object(expr->class_type);
+
+	case EXPR_MEMBER:
+		return member_field(expr, obj, locals)->value.as.o;
+
+	case EXPR_CALL:
+		result = evaluate_call(expr, obj, locals);
+		break;
+
+	case EXPR_MEMBER_CALL:
+		result = evaluate_member_call(expr, obj, locals);
+		break;
+
+	default:
+		script_error("Unsupported object expression.");
+	}
+	// An aborted call returns int 0
+	return result.type == VALUE_OBJECT ? result.as.o : NULL;
+}
+
+static float evaluate_float(ExpressionNode* expr, Object* obj, Value* locals);
+
+// Storage of an array-typed expression (always a variable)
+static Array* evaluate_array(ExpressionNode* expr, Object* obj, Value* locals) {
+	if (expr->slot >= 0) {
+		return locals[expr->slot].as.a;
+	}
+	return obj->field_values[expr->field].value.as.a;
+}
+
+// Storage of a map-typed expression (always a variable)
+static Map* evaluate_map(ExpressionNode* expr, Object* obj, Value* locals) {
+	if (expr->slot >= 0) {
+		return locals[expr->slot].as.m;
+	}
+	return obj->field_values[expr->field].value.as.m;
+}
+
+// Value of a map entry being stored, added when the key is missing
+static MapValue* map_entry_address(ExpressionNode* entry, Object* obj, Value* locals) {
+	Map* map = evaluate_map(expr_child(entry, entry->left), obj, locals);
+	return map_insert(map, evaluate_int(expr_child(entry, entry->right), obj, locals));
+}
+
+// Value of a map entry being read, NULL when the key is missing (which reads as zero)
+static const MapValue* map_entry(ExpressionNode* entry, Object* obj, Value* locals) {
+	Map* map = evaluate_map(expr_child(entry, entry->left), obj, locals);
+	return map_find(map, evaluate_int(expr_child(entry, entry->right), obj, locals));
+}
+
+// Builtins on maps: len, contains and remove
+static Value evaluate_map_builtin(ExpressionNode* expr, Object* obj, Value* locals) {
+	Map* map = evaluate_map(expr_argument(expr, 0), obj, locals);
+	switch (expr->builtin) {
+	case BUILTIN_LEN:
+		return make_int(map->count);
+	case BUILTIN_CONTAINS:
+		return make_int(map_find(map, evaluate_int(expr_argument(expr, 1), obj, locals)) != NULL);
+	case BUILTIN_REMOVE:
+		return make_int(map_remove(map, evaluate_int(expr_argument(expr, 1), obj, locals)));
+	default:
+		return make_int(0);
+	}
+}
+
+// Address of an array element, bounds checked unless a hoisted loop guard has proven the index in range
+static void* element_address(ExpressionNode* element, Object* obj, Value* locals) {
+	Array* array = evaluate_array(expr_child(element, element->left), obj, locals);
+	int index = evaluate_int(expr_child(element, element->right), obj, locals);
+	if (element->kind == EXPR_INDEX && (unsigned)index >= (unsigned)array->length) {
+		script_error("Index %d out of bounds for array %s of length %d", index, expr_child(element, element->left)->variable, array->length);
+	}
+	return (int*)array->data + index;
+}
+
+static Value evaluate_string_builtin(ExpressionNode* expr, Object* obj, Value* locals);
+
+// Builtins run the vectorized array kernels; the void ones return int 0
+static Value evaluate_builtin(ExpressionNode* expr, Object* obj, Value* locals) {
+	if (is_map_type(expr_argument(expr, 0)->type)) {
+		return evaluate_map_builtin(expr, obj, locals);
+	}
+	if (expr_argument(expr, 0)->type == VALUE_STRING) {
+		return evaluate_string_builtin(expr, obj, locals);
+	}
+	Array* array = evaluate_array(expr_argument(expr, 0), obj, locals);
+	switch (expr->builtin) {
+	case BUILTIN_LEN:
+		return make_int(array->length);
+	case BUILTIN_RESIZE:
+		array_resize(array, evaluate_int(expr_argument(expr, 1), obj, locals));
+		break;
+	case BUILTIN_SUM:
+		return array_sum(array);
+	case BUILTIN_MIN:
+		return array_min(array);
+	case BUILTIN_MAX:
+		return array_max(array);
+	case BUILTIN_SCALE:
+		array_scale(array, evaluate_expression(expr_argument(expr, 1), obj, locals));
+		break;
+	case BUILTIN_DOT:
+		return array_dot(array, evaluate_array(expr_argument(expr, 1), obj, locals));
+	case BUILTIN_FILL:
+		array_fill(array, evaluate_expression(expr_argument(expr, 1), obj, locals));
+		break;
+	case BUILTIN_COPY:
+		array_copy(array, evaluate_array(expr_argument(expr, 1), obj, locals));
+		break;
+	default:
+		break;
+	}
+	return make_int(0);
+}
+
+// ---- Strings ----
+
+// Reads nothing can run between: a constant or a variable
+static int is_plain_read(ExpressionNode* expr) {
+	return expr->kind == EXPR_CONSTANT || expr->kind == EXPR_VARIABLE;
+}
+
+// A string operand. When `borrow` is set (nothing evaluated after it can store over the
+// variable), a constant or variable is read without taking a reference and *owned is 0;
+// otherwise the caller owns the result and releases it.
+static Value string_operand(ExpressionNode* expr, int borrow, Object* obj, Value* locals, int* owned) {
+	*owned = 0;
+	if (borrow && expr->kind == EXPR_CONSTANT) {
+		return expr->value;
+	}
+	if (borrow && expr->kind == EXPR_VARIABLE) {
+		return expr->slot >= 0 ? locals[expr->slot] : obj->field_values[expr->field].value;
+	}
+	*owned = 1;
+	return evaluate_string(expr, obj, locals);
+}
+
+// `left + right`: the left string is handed to string_concat, which may extend it in place
+static Value concat_strings(ExpressionNode* left_expr, ExpressionNode* right_expr, Object* obj, Value* locals) {
+	Value left = evaluate_string(left_expr, obj, locals);
+	int owned;
+	Value right = string_operand(right_expr, 1, obj, locals, &owned);
+	Value result = string_concat(left, right);
+	if (owned) string_release(right);
+	return result;
+}
+
+// Comparison of two strings: bytewise, a prefix sorting first
+static int compare_strings(ExpressionNode* expr, Object* obj, Value* locals) {
+	int left_owned;
+	int right_owned;
+	Value left = string_operand(expr_child(expr, expr->left), is_plain_read(expr_child(expr, expr->right)), obj, locals, &left_owned);
+	Value right = string_operand(expr_child(expr, expr->right), 1, obj, locals, &right_owned);
+	int result = 0;
+	if (expr->op == OP_EQUAL || expr->op == OP_NOT_EQUAL) {
+		result = string_equal(left, right) == (expr->op == OP_EQUAL);
+	}
+	else {
+		int order = string_compare(left, right);
+		switch (expr->op) {
+		case OP_LESS: result = order < 0; break;
+		case OP_GREATER: result = order > 0; break;
+		case OP_LESS_EQUAL: result = order <= 0; break;
+		case OP_GREATER_EQUAL: result = order >= 0; break;
+		default: break;
+		}
+	}
+	if (left_owned) string_release(left);
+	if (right_owned) string_release(right);
+	return result;
+}
+
+// Builtins on strings: len, compare and find return ints, concat, substring, lower and upper new strings
+static Value evaluate_string_builtin(ExpressionNode* expr, Object* obj, Value* locals) {
+	if (expr->builtin == BUILTIN_CONCAT) {
+		return concat_strings(expr_argument(expr, 0), expr_argument(expr, 1), obj, locals);
+	}
+	int borrow = 1;
+	for (int i = 1; i < expr->argument_count; i++) {
+		borrow &= is_plain_read(expr_argument(expr, i));
+	}
+	int owned;
+	Value string = string_operand(expr_argument(expr, 0), borrow, obj, locals, &owned);
+	Value result = make_int(0);
+	switch (expr->builtin) {
+	case BUILTIN_LEN:
+		result = make_int(string_length(string));
+		break;
+	case BUILTIN_COMPARE:
+	case BUILTIN_FIND: {
+		int other_owned;
+		Value other = string_operand(expr_argument(expr, 1), 1, obj, locals, &other_owned);
+		result = make_int(expr->builtin == BUILTIN_COMPARE ? string_compare(string, other) : string_find(string, other));
+		if (other_owned) string_release(other);
+		break;
+	}
+	case BUILTIN_SUBSTRING: {
+		int start = evaluate_int(expr_argument(expr, 1), obj, locals);
+		int length = evaluate_int(expr_argument(expr, 2), obj, locals);
+		result = string_substring(string, start, length);
+		break;
+	}
+	case BUILTIN_LOWER:
+		result = string_lower(string);
+		break;
+	case BUILTIN_UPPER:
+		result = string_upper(string);
+		break;
+	default:
+		break;
+	}
+	if (owned) string_release(string);
+	return result;
+}
+
+// Evaluate an expression whose static type is string; the caller owns the reference returned
+static Value evaluate_string(ExpressionNode* expr, Object* obj, Value* locals) {
+	Value result;
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+		return expr->value;  // Short, empty or an interned literal: nothing is counted
+
+	case EXPR_VARIABLE:
+		result = expr->slot >= 0 ? locals[expr->slot] : obj->field_values[expr->field].value;
+		string_retain(result);
+		return result;
+
+	case EXPR_MEMBER:
+		result = member_field(expr, obj, locals)->value;
+		string_retain(result);
+		break;
+
+	case EXPR_CALL:
+		result = evaluate_call(expr, obj, locals);
+		break;
+
+	case EXPR_MEMBER_CALL:
+		result = evaluate_member_call(expr, obj, locals);
+		break;
+
+	case EXPR_BINARY_STRING:
+	case EXPR_APPEND:
+		return concat_strings(expr_child(expr, expr->left), expr_child(expr, expr->right), obj, locals);
+
+	case EXPR_BUILTIN:
+		result = evaluate_builtin(expr, obj, locals);
+		break;
+
+	default:
+		script_error("Unsupported string expression.");
+	}
+	// An aborted call returns int 0
+	return result.type == VALUE_STRING ? result : make_empty_string();
+}
+
+// Evaluate an expression whose static type is int. check_class has made every
+// conversion explicit, so operands are read straight from their payload.
+static int evaluate_int(ExpressionNode* expr, Object* obj, Value* locals) {
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+		return expr->value.as.i;
+
+	case EXPR_VARIABLE:
+		// Locals (parameters, loop variables and declarations) were bound to frame slots by resolve_class
+		if (expr->slot >= 0) {
+			return locals[expr->slot].as.i;
+		}
+
+		// Otherwise it's one of the object fields
+		return obj->field_values[expr->field].value.as.i;
+
+	case EXPR_BINARY_INT: {
+		int left_value = evaluate_int(expr_child(expr, expr->left), obj, locals);    // Left operand
+		int right_value = evaluate_int(expr_child(expr, expr->right), obj, locals);  // Right operand
+		switch (expr->op) {
+		case OP_ADD: return left_value + right_value;
+		case OP_SUBTRACT: return left_value - right_value;
+		case OP_MULTIPLY: return left_value * right_value;
+		case OP_DIVIDE:
+			if (right_value == 0) {
+				script_error("Division by zero.");
 			}
+			return left_value / right_value;
+		case OP_LESS: return left_value < right_value;
+		case OP_GREATER: return left_value > right_value;
+		case OP_LESS_EQUAL: return left_value <= right_value;
+		case OP_GREATER_EQUAL: return left_value >= right_value;
+		case OP_EQUAL: return left_value == right_value;
+		case OP_NOT_EQUAL: return left_value != right_value;
+		}
+		break;
+	}
 
-			// If not found in the local table, look for it in the object fields
-			return lookup_object_field(obj, expr->variable);
+	case EXPR_BINARY_FLOAT: {
+		// Only comparisons of floats produce an int
+		float left_value = evaluate_float(expr_child(expr, expr->left), obj, locals);
+		float right_value = evaluate_float(expr_child(expr, expr->right), obj, locals);
+		switch (expr->op) {
+		case OP_LESS: return left_value < right_value;
+		case OP_GREATER: return left_value > right_value;
+		case OP_LESS_EQUAL: return left_value <= right_value;
+		case OP_GREATER_EQUAL: return left_value >= right_value;
+		case OP_EQUAL: return left_value == right_value;
+		case OP_NOT_EQUAL: return left_value != right_value;
+		default: break;
 		}
+		break;
 	}
 
-	// If the expression is a constant value, simply return the value
-	if (expr->variable == NULL && expr->value != 0) {
-		return expr->value;
+	case EXPR_CONVERT:
+		// Float to int truncates, as in C
+		return (int)evaluate_float(expr_child(expr, expr->left), obj, locals);
+
+	case EXPR_INDEX:
+	case EXPR_INDEX_UNCHECKED:
+		return *(int*)element_address(expr, obj, locals);
+
+	case EXPR_MAP_GET: {
+		const MapValue* entry = map_entry(expr, obj, locals);
+		return entry != NULL ? entry->i : 0;
 	}
 
-	// If we encounter an unexpected structure, print an error
-	printf("Error: Unexpected expression structure.\n");
-	exit(1);
+	case EXPR_CALL:
+		return evaluate_call(expr, obj, locals).as.i;
+
+	case EXPR_MEMBER:
+		return member_field(expr, obj, locals)->value.as.i;
+
+	case EXPR_MEMBER_CALL:
+		return evaluate_member_call(expr, obj, locals).as.i;
+
+	case EXPR_BINARY_OBJECT:
+		return compare_objects(expr, obj, locals);
+
+	case EXPR_BINARY_STRING:
+		return compare_strings(expr, obj, locals);
+
+	case EXPR_BUILTIN:
+		return evaluate_builtin(expr, obj, locals).as.i;
+
+	case EXPR_YIELD:
+		return coroutine_yield(make_int(evaluate_int(expr_child(expr, expr->left), obj, locals))).as.i;
+
+	case EXPR_ASSIGN:
+		execute_expression(expr, obj, locals);
+		return 0;
+
+	default:
+		break;
+	}
+
+	script_error("Unsupported int expression.");
+}
+
+// Evaluate an expression whose static type is float
+static float evaluate_float(ExpressionNode* expr, Object* obj, Value* locals) {
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+		return expr->value.as.f;
+
+	case EXPR_VARIABLE:
+		if (expr->slot >= 0) {
+			return locals[expr->slot].as.f;
+		}
+		return obj->field_values[expr->field].value.as.f;
+
+	case EXPR_BINARY_FLOAT: {
+		float left_value = evaluate_float(expr_child(expr, expr->left), obj, locals);
+		float right_value = evaluate_float(expr_child(expr, expr->right), obj, locals);
+		switch (expr->op) {
+		case OP_ADD: return left_value + right_value;
+		case OP_SUBTRACT: return left_value - right_value;
+		case OP_MULTIPLY: return left_value * right_value;
+		case OP_DIVIDE: return left_value / right_value;
+		default: break;
+		}
+		break;
+	}
+
+	case EXPR_CONVERT:
+		return (float)evaluate_int(expr_child(expr, expr->left), obj, locals);
+
+	case EXPR_INDEX:
+	case EXPR_INDEX_UNCHECKED:
+		return *(float*)element_address(expr, obj, locals);
+
+	case EXPR_MAP_GET: {
+		const MapValue* entry = map_entry(expr, obj, locals);
+		return entry != NULL ? entry->f : 0.0f;
+	}
+
+	case EXPR_CALL:
+		return evaluate_call(expr, obj, locals).as.f;
+
+	case EXPR_MEMBER:
+		return member_field(expr, obj, locals)->value.as.f;
+
+	case EXPR_MEMBER_CALL:
+		return evaluate_member_call(expr, obj, locals).as.f;
+
+	case EXPR_BUILTIN:
+		return evaluate_builtin(expr, obj, locals).as.f;
+
+	case EXPR_YIELD:
+		return coroutine_yield(make_float(evaluate_float(expr_child(expr, expr->left), obj, locals))).as.f;
+
+	default:
+		break;
+	}
+
+	script_error("Unsupported float expression.");
+}
+
+// The static type picks the specialized evaluator; only the result is tagged
+Value evaluate_expression(ExpressionNode* expr, Object* obj, Value* locals) {
+	if (!expr) {
+		script_error("Null expression encountered.");
+	}
+
+	if (expr->type == VALUE_FLOAT) {
+		return make_float(evaluate_float(expr, obj, locals));
+	}
+	if (is_array_type(expr->type)) {
+		return make_array(expr->type, evaluate_array(expr, obj, locals));  // Passed by reference
+	}
+	if (is_map_type(expr->type)) {
+		return make_map(expr->type, evaluate_map(expr, obj, locals));  // Passed by reference
+	}
+	if (expr->type == VALUE_OBJECT) {
+		return make_object(evaluate_object(expr, obj, locals));
+	}
+	if (expr->type == VALUE_STRING) {
+		return evaluate_string(expr, obj, locals);  // A new reference
+	}
+	return make_int(evaluate_int(expr, obj, locals));
 }
 
 
@@ -851,61 +2290,379 @@ void free_class_node(ClassNode* class_node) {
 	while (field) {
 		Field* temp = field;
 		field = field->next;
-		free(temp);
+		memory_free(temp);
 	}
 	// Free methods
 	Method* method = class_node->methods;
 	while (method) {
-		ParameterNode* param = method->parameters;
-		while (param) {
-			ParameterNode* temp = param;
-			param = param->next;
-			free(temp);
-		}
-
 		Method* temp = method;
 		method = method->next;
-		free(temp);
+		free_method(temp);
 	}
-	// Free class node
-	free(class_node);
+	memory_free((char*)class_node->body_source);
+	// Free the member tables
+	if (class_node->field_names != NULL) name_table_free(class_node->field_names);
+	if (class_node->method_names != NULL) name_table_free(class_node->method_names);
+	memory_free(class_node->field_names);
+	memory_free(class_node->method_names);
+	memory_free(class_node->field_table);
+	memory_free(class_node->method_table);
+	// Free every statement and expression node at once
+	free_arena(class_node->arena);
+	// Free class node (a replaced version is no longer in the registry)
+	if (class_node->replacement == NULL) {
+		interpreter_forget_class(class_node);
+	}
+	ClassNode* base = class_node->base;
+	for (int i = 0; i < class_node->referenced_count; i++) {
+		class_release(class_node->referenced[i]);
+	}
+	memory_free(class_node->referenced);
+	memory_free(class_node);
+	class_release(base);
 }
 
 // Create an object from a class definition
+void init_object_fields(ClassNode* class_node, Field* fields) {
+	// In class order, so ExpressionNode::field indexes them
+	int count = class_node->field_count;
+	for (int i = 0; i < count; i++) {
+		Field* class_field = class_node->field_table[i];
+		Field* new_field = &fields[i];
+		new_field->type = class_field->type;
+		new_field->name = class_field->name;
+
+		// The class field holds the tagged zero of its type (0 for int, 0.0 for float)
+		new_field->value = class_field->value;
+		new_field->length = class_field->length;
+		if (is_array_type(class_field->value.type)) {
+			// Every object gets its own array storage: zeroed to its fixed length, or empty
+			new_field->value.as.a = array_create(array_element_type(class_field->value.type), class_field->length, class_field->length > 0);
+		}
+		else if (is_map_type(class_field->value.type)) {
+			new_field->value.as.m = map_create(map_value_type(class_field->value.type));  // Empty
+		}
+		new_field->next = i + 1 < count ? new_field + 1 : NULL;  // Still walkable as a list
+	}
+}
+
+void free_object_fields(ClassNode* class_node, Field* fields) {
+	for (int i = 0; i < class_node->field_count; i++) {
+		if (is_array_type(fields[i].value.type)) {
+			array_free(fields[i].value.as.a);
+		}
+		else if (is_map_type(fields[i].value.type)) {
+			map_free(fields[i].value.as.m);
+		}
+		else if (fields[i].value.type == VALUE_STRING) {
+			string_release(fields[i].value);
+		}
+	}
+}
+
 Object* create_object(ClassNode* class_node) {
-	// Allocate memory for the object
-	Object* obj = (Object*)malloc(sizeof(Object));
+	// A version replaced by a reload creates objects of the newest one
+	class_node = class_latest(class_node);
+
+	// Objects live in the context of their class, whichever context is current
+	Interpreter* previous = interpreter_enter(class_node->context);
+
+	// The object and its fields are one allocation: the fields follow the Object header
+	int count = class_node->field_count;
+	Object* obj = (Object*)memory_alloc(MEMORY_OBJECTS, sizeof(Object) + sizeof(Field) * count);
 	obj->class_type = class_node;
+	obj->field_addresses = NULL;
+	obj->field_values = count > 0 ? (Field*)(obj + 1) : NULL;
+	obj->calls = 0;
+	obj->generation = OBJECT_HOST;
+	obj->gc_flags = 0;
+	obj->gc_size = 0;
+	obj->gc_chunk = NULL;
+	obj->gc_next = NULL;
+	obj->gc_prev = NULL;
+	init_object_fields(class_node, obj->field_values);
+	class_retain(class_node);
+	if (class_node->uses_references) {
+		gc_add_root(obj);  // What its fields point to stays alive (see gc.h)
+	}
+
+	interpreter_enter(previous);
+	return obj; // Return the created object
+}
 
-	// Initialize fields with default values
-	obj->field_values = NULL;
+// Addresses of the object's field payloads in ClassNode::fields order, as transpiled
+// methods expect them
+static void** object_field_addresses(Object* obj) {
+	if (obj->field_addresses == NULL) {
+		int count = obj->class_type->field_count;
+		obj->field_addresses = (void**)memory_alloc(MEMORY_OBJECTS, sizeof(void*) * (count > 0 ? count : 1));
+		if (!obj->field_addresses) {
+			printf("Error: Memory allocation failed for field addresses.\n");
+			exit(1);
+		}
+		for (int i = 0; i < count; i++) {
+			obj->field_addresses[i] = &obj->field_values[i].value.as;
+		}
+	}
+	return obj->field_addresses;
+}
 
-	Field* class_field = class_node->fields;
-	while (class_field != NULL) {
-		Field* new_field = (Field*)malloc(sizeof(Field));
-		new_field->type = class_field->type;
-		new_field->name = class_field->name;
+// Each thread gets its own frame stack, allocated once on first use
+static THREAD_LOCAL FrameStack thread_frame_stack;
+// Stack of the coroutine running on this thread, if any
+static THREAD_LOCAL FrameStack* active_frame_stack = NULL;
 
-		// Initialize field values (0 for int, 0.0 for float)
-		if (strcmp(class_field->type, "int") == 0) {
-			new_field->value = malloc(sizeof(int));  // Allocate memory for an int
-			*((int*)new_field->value) = 0;           // Initialize to zero
+FrameStack* current_frame_stack() {
+	if (active_frame_stack != NULL) {
+		return active_frame_stack;
+	}
+	if (thread_frame_stack.slots == NULL) {
+		thread_frame_stack.slots = (Value*)malloc(sizeof(Value) * FRAME_STACK_SLOTS);
+		if (!thread_frame_stack.slots) {
+			printf("Error: Memory allocation failed for frame stack.\n");
+			exit(1);
+		}
+		thread_frame_stack.capacity = FRAME_STACK_SLOTS;
+		thread_frame_stack.top = 0;
+		thread_frame_stack.depth = 0;
+		thread_frame_stack.max_depth = FRAME_MAX_DEPTH;
+		thread_frame_stack.budget = BUDGET_UNLIMITED;
+		thread_frame_stack.metered = 0;
+		thread_frame_stack.return_value = make_int(0);
+		thread_frame_stack.entered = NULL;
+		thread_frame_stack.heap = NULL;
+		thread_frame_stack.frames = NULL;
+	}
+	return &thread_frame_stack;
+}
+
+FrameStack* switch_frame_stack(FrameStack* stack) {
+	FrameStack* previous = active_frame_stack;
+	active_frame_stack = stack;
+	return previous;
+}
+
+// Release the calling thread's frame stack (the thread must not be executing a method)
+void free_frame_stack() {
+	free(thread_frame_stack.slots);
+	thread_frame_stack.slots = NULL;
+}
+
+void reset_frame_stack() {
+	active_frame_stack = NULL;
+	if (thread_frame_stack.entered != NULL) {
+		object_leave(&thread_frame_stack);
+	}
+	if (thread_frame_stack.heap != NULL) {
+		gc_leave(&thread_frame_stack);
+	}
+	execution_aborted = 0;
+	thread_frame_stack.top = 0;
+	thread_frame_stack.depth = 0;
+	thread_frame_stack.frames = NULL;
+	thread_frame_stack.budget = BUDGET_UNLIMITED;
+	thread_frame_stack.metered = 0;
+}
+
+void mark_thread(ThreadMark* mark) {
+	mark->source = source;
+	mark->token = current_token;
+	mark->arena = current_arena;
+	mark->parsing_class = parsing_class;
+	mark->stack = active_frame_stack;
+	FrameStack* stack = current_frame_stack();
+	mark->top = stack->top;
+	mark->depth = stack->depth;
+	mark->budget = stack->budget;
+	mark->metered = stack->metered;
+}
+
+// Free the arrays and maps declared in the body (parameters belong to the caller) and
+// release the strings of the frame, the arguments included: the caller handed them over
+static void release_locals(Method* method, Value* locals) {
+	if (method->owns_arrays) {
+		for (int i = method->parameter_count; i < method->local_count; i++) {
+			if (is_array_type(method->local_types[i])) {
+				array_free(locals[i].as.a);
+			}
+			else if (is_map_type(method->local_types[i])) {
+				map_free(locals[i].as.m);
+			}
 		}
-		else if (strcmp(class_field->type, "float") == 0) {
-			new_field->value = malloc(sizeof(float)); // Allocate memory for a float
-			*((float*)new_field->value) = 0.0f;       // Initialize to zero
+	}
+	if (method->owns_strings) {
+		for (int i = 0; i < method->local_count; i++) {
+			if (method->local_types[i] == VALUE_STRING) string_release(locals[i]);
 		}
-		else {
-			new_field->value = NULL;  // Default value for other types
+	}
+}
+
+// Arguments pushed for a call that hasn't started hold a reference to their strings
+static void release_arguments(FrameStack* stack, int first, int end) {
+	for (int i = first; i < end; i++) {
+		if (stack->slots[i].type == VALUE_STRING) string_release(stack->slots[i]);
+	}
+}
+
+CallFrame* release_frames(FrameStack* stack, int top, int depth) {
+	CallFrame* frame = stack->frames;
+	int end = stack->top;
+	for (int d = stack->depth; d > depth && frame != NULL; d--) {
+		release_arguments(stack, frame->base + frame->method->local_count, end);
+		release_locals(frame->method, stack->slots + frame->base);
+		end = frame->base;
+		frame = frame->caller;
+	}
+	release_arguments(stack, top, end);
+	return frame;
+}
+
+void unwind_thread(const ThreadMark* mark) {
+	// A class whose parse started since the mark is dropped half-built
+	if (parsing_class != NULL && parsing_class != mark->parsing_class) {
+		ClassNode* class_node = parsing_class;
+		parsing_class = NULL;
+		if (parsing_method != NULL) {
+			free_method(parsing_method);
+			parsing_method = NULL;
 		}
+		free_class_node(class_node);
+	}
+	source = mark->source;
+	current_token = mark->token;
+	current_arena = mark->arena;
+	parsing_class = mark->parsing_class;
+	active_frame_stack = mark->stack;
+	FrameStack* stack = current_frame_stack();
+	// The object and heap are claimed by the outermost call, which is only unwound if the mark was outside it
+	if (mark->depth == 0 && stack->entered != NULL) {
+		object_leave(stack);
+	}
+	if (mark->depth == 0 && stack->heap != NULL) {
+		gc_leave(stack);
+	}
+	execution_aborted = 0;
+	stack->frames = release_frames(stack, mark->top, mark->depth);
+	stack->top = mark->top;
+	stack->depth = mark->depth;
+	stack->budget = mark->budget;
+	stack->metered = mark->metered;
+}
 
-		new_field->next = obj->field_values; // Link to the list of field values
-		obj->field_values = new_field;
+// Run a method whose arguments are the top `argument_count` slots of the frame stack.
+// Those slots become the callee's parameters; the rest of its frame sits right above them.
+static Value run_method(Object* obj, Method* method, FrameStack* stack, int argument_count) {
+	int base = stack->top - argument_count;
+	if (stack->depth >= stack->max_depth || base + method->local_count > stack->capacity || coroutine_stack_exhausted()) {
+		script_error("Stack overflow while calling %s.", method->name);
+	}
+	if (--stack->budget < 0 && budget_exhausted(stack)) {
+		// Aborted: drop the arguments without running the method
+		for (int i = 0; method->owns_strings && i < argument_count; i++) {
+			if (method->local_types[i] == VALUE_STRING) string_release(stack->slots[base + i]);
+		}
+		stack->top = base;
+		return make_int(0);
+	}
 
-		class_field = class_field->next; // Move to the next field
+	// Arguments already have the parameter types (check_class converts them at call sites)
+	Value* locals = stack->slots + base;
+	for (int i = argument_count; i < method->local_count; i++) {
+		locals[i] = value_zero(method->local_types[i]);  // Locals start at zero of their type
+	}
+	stack->top = base + method->local_count;
+	stack->depth++;
+	CallFrame frame = { method, base, stack->frames };
+	stack->frames = &frame;
+
+	Value result = make_int(0);
+	if (method->native != NULL && !stack->metered) {
+		// Transpiled methods run natively on the addresses of the field values
+		result = method->native(object_field_addresses(obj), locals);
+	}
+	else if (execute_block(method->body, obj, locals) == EXEC_RETURN) {
+		result = stack->return_value;  // Already converted to the result type by check_class
 	}
 
-	return obj; // Return the created object
+	release_locals(method, locals);
+
+	// Pop the frame (including the arguments the caller pushed)
+	stack->frames = frame.caller;
+	stack->top = base;
+	stack->depth--;
+	return result;
+}
+
+// Call of a memo method: the result of a table hit, or of running the body (see memo.h)
+static Value invoke_memoized(Object* obj, Method* method, FrameStack* stack, int argument_count) {
+	int base = stack->top - argument_count;
+	Value result;
+	if (memo_lookup(method->memo, stack->slots + base, &result)) {
+		stack->top = base;
+		if (--stack->budget < 0 && budget_exhausted(stack)) return make_int(0);
+		return result;
+	}
+
+	// The body may assign its parameters: keep the key
+	Value arguments[MEMO_MAX_PARAMETERS];
+	memcpy(arguments, stack->slots + base, sizeof(Value) * (size_t)argument_count);
+	result = run_method(obj, method, stack, argument_count);
+	if (!execution_aborted) {
+		memo_store(method->memo, arguments, result);
+	}
+	return result;
+}
+
+static Value invoke_method(Object* obj, Method* method, FrameStack* stack, int argument_count) {
+	if (method->memo != NULL) return invoke_memoized(obj, method, stack, argument_count);
+	return run_method(obj, method, stack, argument_count);
+}
+
+Method* find_method(ClassNode* class_node, const char* method_name) {
+	int index = name_table_find(class_node->method_names, method_name);
+	return index >= 0 ? class_node->method_table[index] : NULL;
+}
+
+int find_method_slot(ClassNode* class_node, const char* method_name) {
+	return name_table_find(class_node->method_names, method_name);
+}
+
+int find_field(ClassNode* class_node, const char* field_name) {
+	return name_table_find(class_node->field_names, field_name);
+}
+
+ClassNode* reference_class(ClassNode* class_node, const char* type_name) {
+	type_name = intern_name(type_name);
+	if (type_name == class_node->class_name) return class_node;
+	for (int i = 0; i < class_node->referenced_count; i++) {
+		if (class_node->referenced[i]->class_name == type_name) return class_node->referenced[i];
+	}
+
+	ClassNode* found = interpreter_find_class(class_node->context, type_name);
+	if (found == NULL) return NULL;
+	// The syntax tree points to the class until class_node is freed, holding the lookup's reference
+	class_node->referenced = (ClassNode**)memory_realloc(MEMORY_AST, class_node->referenced, sizeof(ClassNode*) * (class_node->referenced_count + 1));
+	class_node->referenced[class_node->referenced_count++] = found;
+	return found;
+}
+
+int class_derives_from(ClassNode* derived, ClassNode* base_class) {
+	for (ClassNode* current = derived; current != NULL; current = current->base) {
+		if (current == base_class) return 1;
+	}
+	return 0;
+}
+
+// Claim the object for the outermost call of the stack (see object_enter). When its class
+// uses references, the call also holds off the context's collector, after running a step
+// when `collect` is set; the receiver and the host's arguments are roots of that step.
+static int enter_object(Object* obj, FrameStack* stack, const Value* args, int argument_count, int collect) {
+	if (stack->entered != NULL) return 0;
+	ClassNode* class_node = obj->class_type;
+	if (class_node->uses_references || class_latest(class_node)->uses_references) {
+		gc_enter(interpreter_heap(class_node->context), stack, obj, args, argument_count, collect);
+	}
+	return object_enter(obj, stack);
 }
 
 // Execute a method on an object
@@ -920,118 +2677,191 @@ void execute_method(Object* obj, const char* method_name) {
 		return;
 	}
 
-	// Find the method in the class definition
-	Method* method = obj->class_type->methods;
-	while (method != NULL) {
-		if (strcmp(method->name, method_name) == 0) {
-			printf("Executing method %s on object of class %s\n", method_name, obj->class_type->class_name);
-
-			// Step 1: Create a local variable table for the method
-			LocalVariable* local_table = NULL;
+	// Find the method in the class definition (of the version the object is migrated to)
+	FrameStack* stack = current_frame_stack();
+	int entered = enter_object(obj, stack, NULL, 0, 1);
+	Method* method = find_method(obj->class_type, method_name);
+	if (method == NULL) {
+		printf("Error: Method %s not found in class %s\n", method_name, obj->class_type->class_name);
+		if (entered) object_leave(stack);
+		return;
+	}
 
-			// Step 2: Initialize method parameters in the local variable table
-			ParameterNode* param = method->parameters;
-			while (param != NULL) {
-				// Initialize parameters with a default value (0 for simplicity)
-				update_local_variable(&local_table, param->name, 0);
-				param = param->next;
-			}
+	printf("Executing method %s on object of class %s\n", method_name, obj->class_type->class_name);
 
-			// Step 3: Execute the body of the method
-			execute_block(method->body, obj, local_table);
+	// Parameters are initialized with a default value (0 for simplicity)
+	if (stack->top + method->parameter_count > stack->capacity) {
+		script_error("Stack overflow while calling %s.", method->name);
+	}
+	for (int i = 0; i < method->parameter_count; i++) {
+		stack->slots[stack->top++] = value_zero(method->local_types[i]);
+	}
+	Interpreter* previous = interpreter_enter(obj->class_type->context);
+	string_release(invoke_method(obj, method, stack, method->parameter_count));
+	interpreter_enter(previous);
+	if (entered) object_leave(stack);
+}
 
-			// Step 4: Clean up local variables after method execution
-			LocalVariable* current = local_table;
-			while (current != NULL) {
-				LocalVariable* temp = current;
-				current = current->next;
-				free(temp->variable_name);  // Free the name string
-				free(temp);                 // Free the local variable
-			}
+// Push the host's arguments, converted to the parameter types, and run the method in its class's context
+static Value call_resolved_method(Object* obj, Method* method, const Value* args, int argument_count) {
+	if (argument_count != method->parameter_count) {
+		script_error("Method %s expects %d arguments but got %d", method->name, method->parameter_count, argument_count);
+	}
 
-			return;
+	FrameStack* stack = current_frame_stack();
+	if (stack->top + argument_count > stack->capacity) {
+		script_error("Stack overflow while calling %s.", method->name);
+	}
+	for (int i = 0; i < argument_count; i++) {
+		if (!value_kind_matches(args[i], method->local_types[i])) {
+			script_error("Argument %d of %s must be %s.", i + 1, method->name, value_kind_name(method->local_types[i]));
 		}
-		method = method->next;
+		string_retain(args[i]);  // The call releases its parameters; the host keeps its reference
+		stack->slots[stack->top++] = value_convert(args[i], method->local_types[i]);
 	}
+	// Whatever the method allocates belongs to the context of its class
+	Interpreter* previous = interpreter_enter(obj->class_type->context);
+	Value result = invoke_method(obj, method, stack, argument_count);
+	interpreter_enter(previous);
+	return result;
+}
 
-	// If we reach here, the method was not found
-	printf("Error: Method %s not found in class %s\n", method_name, obj->class_type->class_name);
+// Call a method with arguments from the host and return its result (int 0 for void methods).
+// Arguments are converted to the parameter types.
+// The outermost call on the thread's (or coroutine's) stack claims the object first.
+Value call_method(Object* obj, const char* method_name, const Value* args, int argument_count) {
+	FrameStack* stack = current_frame_stack();
+	int entered = enter_object(obj, stack, args, argument_count, 1);
+	Method* method = find_method(obj->class_type, method_name);
+	if (method == NULL) {
+		script_error("Method %s not found in class %s", method_name, obj->class_type->class_name);
+	}
+	Value result = call_resolved_method(obj, method, args, argument_count);
+	if (entered) object_leave(stack);
+	return result;
+}
+
+Value call_method_slot(Object* obj, int slot, const Value* args, int argument_count) {
+	FrameStack* stack = current_frame_stack();
+	int entered = enter_object(obj, stack, args, argument_count, 1);
+	ClassNode* class_node = obj->class_type;
+	if (slot < 0 || slot >= class_node->method_count) {
+		script_error("Method slot %d not found in class %s", slot, class_node->class_name);
+	}
+	Value result = call_resolved_method(obj, class_node->method_table[slot], args, argument_count);
+	if (entered) object_leave(stack);
+	return result;
+}
+
+int call_method_bounded(Object* obj, const char* method_name, const Value* args, int argument_count, long long budget, Value* result) {
+	FrameStack* stack = current_frame_stack();
+	long long saved_budget = stack->budget;
+	int saved_metered = stack->metered;
+	stack->budget = budget;
+	stack->metered = 1;
+
+	Value value = call_method(obj, method_name, args, argument_count);
+	int completed = !execution_aborted;
+	execution_aborted = 0;
+
+	stack->budget = saved_budget;
+	stack->metered = saved_metered;
+	if (completed && result != NULL) {
+		*result = value;
+	}
+	return completed;
 }
 
 
 // Free memory allocated for an object
 void free_object(Object* obj) {
 	if (obj == NULL) return;
+	if (obj->generation != OBJECT_HOST) {
+		printf("Error: Objects made by new are freed by the collector.\n");
+		return;
+	}
+	if (obj->gc_flags & GC_ROOT) {
+		gc_remove_root(obj);
+	}
 
-	Field* current_field = obj->field_values;
-	while (current_field != NULL) {
-		Field* next_field = current_field->next;
-		if (current_field->value != NULL) {
-			free(current_field->value); // Free field value
-		}
-		free(current_field); // Free field structure
-		current_field = next_field;
+	// Field values are stored inline in the object's block (until a reload migrates
+	// the object to a layout of its own); array storage is separate
+	ClassNode* class_node = obj->class_type;
+	free_object_fields(class_node, obj->field_values);
+	if (obj->field_values != NULL && obj->field_values != (Field*)(obj + 1)) {
+		memory_free(obj->field_values);
 	}
 
-	free(obj); // Free the object itself
+	memory_free(obj->field_addresses);
+	memory_free(obj); // Free the object itself
+	class_release(class_node);
 }
 
-void update_object_field(Object* obj, const char* field_name, int value) {
-	Field* field = obj->field_values;
-	while (field) {
-		if (strcmp(field->name, field_name) == 0) {
-			*((int*)field->value) = value;
-			return;
-		}
-		field = field->next;
-	}
-	printf("Error: Field %s not found in object.\n", field_name);
+// Host field access enters the object like a call (without collecting), so it sees the
+// reloaded layout and no collection step runs while a reference is read or stored
+static Field* find_object_field(Object* obj, const char* field_name) {
+	int index = find_field(obj->class_type, field_name);
+	return index >= 0 ? &obj->field_values[index] : NULL;
 }
 
-int lookup_object_field(Object* obj, const char* field_name) {
-	Field* field = obj->field_values;
-	while (field) {
-		if (strcmp(field->name, field_name) == 0) {
-			return *((int*)field->value);
-		}
-		field = field->next;
+Value get_object_field(Object* obj, const char* field_name) {
+	FrameStack* stack = current_frame_stack();
+	int entered = enter_object(obj, stack, NULL, 0, 0);
+	Field* field = find_object_field(obj, field_name);
+	if (field == NULL) {
+		script_error("Field %s not found in object.", field_name);
 	}
-	printf("Error: Field %s not found in object.\n", field_name);
-	exit(1);
+	Value value = field->value;
+	if (entered) object_leave(stack);
+	return value;
 }
 
-int lookup_local_variable(LocalVariable* local_table, const char* variable_name) {
-	LocalVariable* current = local_table;
-	while (current) {
-		if (strcmp(current->variable_name, variable_name) == 0) {
-			return current->value;
-		}
-		current = current->next;
+// Store a value into a field, converted to the field's declared type
+void set_object_field(Object* obj, const char* field_name, Value value) {
+	FrameStack* stack = current_frame_stack();
+	int entered = enter_object(obj, stack, &value, 1, 0);
+	Field* field = find_object_field(obj, field_name);
+	if (field == NULL) {
+		printf("Error: Field %s not found in object.\n", field_name);
 	}
-	printf("Error: Local variable %s not found.\n", variable_name);
-	exit(1);
+	else if (is_array_type(field->value.type)) {
+		printf("Error: Field %s is an array, fill it through get_object_array.\n", field_name);
+	}
+	else if (is_map_type(field->value.type)) {
+		printf("Error: Field %s is a map.\n", field_name);
+	}
+	else if (!value_kind_matches(value, field->value.type)) {
+		printf("Error: Field %s holds %s.\n", field_name, value_kind_name(field->value.type));
+	}
+	else {
+		string_retain(value);  // A string field takes a reference of its own
+		string_release(field->value);
+		field->value = value_convert(value, field->value.type);
+		if (value.type == VALUE_OBJECT) gc_write_barrier(obj, value.as.o);
+	}
+	if (entered) object_leave(stack);
 }
 
-void update_local_variable(LocalVariable** local_table, const char* variable_name, int value) {
-	LocalVariable* current = *local_table;
-	while (current) {
-		if (strcmp(current->variable_name, variable_name) == 0) {
-			current->value = value; // Update existing variable
-			return;
-		}
-		current = current->next;
-	}
+void update_object_field(Object* obj, const char* field_name, int value) {
+	set_object_field(obj, field_name, make_int(value));
+}
 
-	// If not found, add a new variable to the local symbol table
-	LocalVariable* new_variable = (LocalVariable*)malloc(sizeof(LocalVariable));
-	new_variable->variable_name = strdup(variable_name); // Make a copy of the variable name
-	new_variable->value = value;
-	new_variable->next = *local_table;
-	*local_table = new_variable;
+int lookup_object_field(Object* obj, const char* field_name) {
+	return value_to_int(get_object_field(obj, field_name));
+}
+
+Array* get_object_array(Object* obj, const char* field_name) {
+	Value value = get_object_field(obj, field_name);
+	if (!is_array_type(value.type)) {
+		script_error("Field %s is not an array.", field_name);
+	}
+	return value.as.a;
 }
 
 
 // Free the symbol table when done with interpretation
 void clean_up() {
 	free_symbol_table();
-}
\ No newline at end of file
+	pool_free_default();
+	free_frame_stack();
+}
@@ -1,14 +1,22 @@
 #pragma once
 #include "lexer.h"  // Include lexer.h to access Token structure and functions
+#include "value.h"  // Include value.h for the tagged Value representation
+#include "array.h"  // Include array.h for array storage and builtins
+#include <limits.h>
+#include <stdint.h>
 
 // Field structure representing a class's member variables
 typedef struct Field {
 	const char* type;         // Data type of the field (e.g., int, float)
 	const char* name;         // Name of the field
-	void* value;              // Value of the field
+	Value value;              // Value of the field, stored inline (tag matches the declared type)
+	int length;               // Length of a fixed-length array field (int[16]), 0 otherwise
 	struct Field* next;       // Pointer to the next field (linked list for multiple fields)
 } Field;
 
+struct NameTable;  // Name lookup table (see table.h)
+struct AstArena;   // Storage of a class's syntax tree nodes (see ast_alloc)
+
 // Parameter node for method parameters
 typedef struct ParameterNode {
 	const char* type;            // Type of the parameter
@@ -22,25 +30,68 @@ typedef struct Method {
 	const char* name;         // Name of the method
 	struct ParameterNode* parameters;  // Parameters for the method
 	struct BlockNode* body;   // Body of the method (block of statements)
+	ValueType result_type;    // Tag of the returned value (int for void methods)
+	int parameter_count;      // Number of parameters (they occupy the first frame slots)
+	int local_count;          // Frame slots needed by parameters and locals (set by resolve_class)
+	ValueType* local_types;   // Declared type of every frame slot (set by resolve_class)
+	int owns_arrays;          // Non-zero when the body declares array or map locals, freed on return
+	int owns_strings;         // Non-zero when a parameter or local is a string, released on return
+	Value (*native)(void** fields, Value* args);  // Transpiled implementation (see native.h), NULL when interpreted
+	int memo_capacity;        // Entries asked for by `memo` or `memo(n)`, 0 for a method that isn't memoized
+	struct MemoTable* memo;   // Results by arguments (see memo.h), NULL unless memo_capacity is set
 	struct Method* next;      // Pointer to the next method (linked list for multiple methods)
 } Method;
 
 // Class structure representing a class
 typedef struct ClassNode {
 	const char* class_name;  // Name of the class
-	Field* fields;           // Pointer to the first field in the linked list of fields
-	Method* methods;         // Pointer to the first method in the linked list of methods
+	struct ClassNode* base;  // Class it derives from (class B : A), NULL if none; it must outlive this one (a reference is held)
+	const char* body_source; // Text of the class body, parsed again by derived classes
+	Field* fields;           // Pointer to the first field in the linked list of fields (inherited ones first, then declaration order)
+	int field_count;         // Number of fields in the list
+	Method* methods;         // Pointer to the first method in the linked list of methods (inherited ones first, then declaration order)
+	int method_count;        // Number of methods in the list
+	Field** field_table;     // Fields by index (ExpressionNode::field): a base's fields keep their index in derived classes
+	Method** method_table;   // Vtable: methods by slot. An override takes the slot of the method it replaces,
+	                         // so a slot names the same operation in every class derived from the one declaring it
+	struct NameTable* field_names;   // Field name -> index in field_table
+	struct NameTable* method_names;  // Method name -> index in method_table
+	struct Interpreter* context;  // Context the class was parsed in; its objects and calls use that context's memory
+	struct AstArena* arena;  // Statement nodes of the method bodies and their expression table
+	struct ClassNode* volatile replacement;  // Newer version published by interpreter_reload_class, NULL while current
+	volatile long references;  // Whoever loaded it, live objects, derived classes and the version it replaced (see reload.h)
+	struct ClassNode** referenced;  // Other classes its types and `new` expressions name (a reference is held on each)
+	int referenced_count;
+	int uses_references;     // Some field, local, parameter, result or expression is an object reference (see gc.h)
 } ClassNode;
 
+// Who owns an object's memory
+typedef enum {
+	OBJECT_HOST,   // Made by create_object, freed by free_object
+	OBJECT_YOUNG,  // Made by `new` in a nursery chunk, until it survives a minor collection (see gc.h)
+	OBJECT_OLD,    // Survived a minor collection; freed by a sweep of the old generation
+} ObjectGeneration;
+
+struct GcChunk;
+
 // Object structure representing an instance of a class
 typedef struct Object {
-	ClassNode* class_type;   // Pointer to the class definition
-	Field* field_values;     // Stores the current values of the object's fields
+	ClassNode* volatile class_type;  // Pointer to the class definition (the version the object was last migrated to)
+	Field* field_values;     // Current values of the fields, an array in class order (allocated with the object,
+	                         // separately once the object is migrated to a reloaded class)
+	void** field_addresses;  // Field value addresses in class order, built on the first native call
+	volatile long calls;     // Host calls running on the object, -1 while it is being migrated
+	ObjectGeneration generation;
+	volatile long gc_flags;  // Collector state (GC_MARKED, GC_REMEMBERED, ...; see gc.h)
+	size_t gc_size;          // Bytes the object takes in its chunk
+	struct GcChunk* gc_chunk;  // Chunk holding a collected object, NULL for host objects
+	struct Object* gc_next;  // Next object of the old generation, or next root for host objects
+	struct Object* gc_prev;  // Previous root (host objects only)
 } Object;
 
 // Symbol table for storing variables and their values
 typedef struct SymbolTable {
-	char* variable_name;  // Name of the variable
+	const char* variable_name;  // Name of the variable (interned)
 	int value;            // Value of the variable (only supporting int for simplicity)
 	struct SymbolTable* next;  // Pointer to the next variable
 } SymbolTable;
@@ -54,13 +105,55 @@ typedef enum {
 	NODE_RETURN,      // Represents a return statement
 	NODE_ASSIGNMENT,  // Represents an assignment
 	NODE_EXPRESSION,  // Represents an expression (e.g., x = 5)
+	NODE_DECLARATION, // Represents a local variable declaration (e.g., float y = 1.5;)
 } NodeType;
 
+typedef enum {
+	EXPR_CONSTANT,    // Literal value
+	EXPR_VARIABLE,    // Local variable (frame slot) or field
+	EXPR_BINARY,      // `left <operator> right`, as parsed
+	EXPR_BINARY_INT,  // Binary operator on two int operands (set by check_class)
+	EXPR_BINARY_FLOAT,// Binary operator on two float operands (set by check_class)
+	EXPR_CALL,        // Method call `variable(arguments...)`
+	EXPR_CONVERT,     // Conversion of `left` to value.type
+	EXPR_ASSIGN,      // `variable = assigned` or `left = assigned` for an element (assignments and declarations)
+	EXPR_INDEX,       // Array element `left[right]`, left is the array variable
+	EXPR_INDEX_UNCHECKED, // Element whose bounds a hoisted loop guard has proven (set by the optimizer)
+	EXPR_BUILTIN,     // Builtin call `variable(arguments...)` (set by resolve_class)
+	EXPR_YIELD,       // `yield(left)`: suspend the running coroutine (see coroutine.h)
+	EXPR_NEW,         // `new variable()`: an object of class_type (see gc.h)
+	EXPR_MEMBER,      // `left.variable`: field of the object a reference points to
+	EXPR_MEMBER_CALL, // `left.variable(arguments...)`: method call on the object a reference points to
+	EXPR_BINARY_OBJECT, // `==` or `!=` on two references (set by check_class)
+	EXPR_MAP_GET,     // Map entry `left[right]`, left is the map variable (an EXPR_INDEX retyped by check_class)
+	EXPR_BINARY_STRING, // `+` or a comparison on two strings (set by check_class)
+	EXPR_APPEND,      // `left + right` assigned back to the string variable `left` (set by check_class, see text.h)
+} ExpressionKind;
+
+// Expression nodes of a class live in one table (see ast_new_expression) and name
+// their operands by 32-bit index in it; index 0 (EXPR_NONE) is no node
+#define EXPR_NONE 0
+
 // Expression node for simple expressions (variable or constant values)
 typedef struct ExpressionNode {
-	char* variable;  // Variable name (if it's a variable)
-	int value;       // Constant value (if it's a constant)
-	struct ExpressionNode* next;
+	ExpressionKind kind;
+	uint32_t index;  // Position of the node in its class's table
+	const char* variable;  // Variable name (if it's a variable), operator or called method name; interned
+	Value value;     // Constant value, declared type of a declaration, or conversion target type
+	ValueType type;  // Static type of the result (set by check_class)
+	BinaryOperator op;  // Operator of a binary node
+	uint32_t assigned;  // Assigned value (for an assignment), or initial value (for a declaration)
+	uint32_t left;      // Left operand (for an operator or a conversion)
+	uint32_t right;     // Right operand (for an operator)
+	int slot;        // Frame slot of a local variable, -1 for object fields (set by resolve_class)
+	int field;       // Index of the field when slot is -1, otherwise -1 (set by resolve_class); for a member
+	                 // access, the field's index and for a member call the vtable slot in left's class (set by check_class)
+	uint32_t* arguments;  // Argument expressions of a call
+	int argument_count;   // Number of arguments
+	struct Method* callee;              // Called method (set by resolve_class)
+	BuiltinFunction builtin;            // Called builtin (set by resolve_class)
+	int length;      // Length of a fixed-length array declaration (int[16] a;), 0 otherwise
+	struct ClassNode* class_type;  // Class of a reference-typed result (NULL for null), or the class `new` makes
 } ExpressionNode;
 
 // If statement node
@@ -70,12 +163,28 @@ typedef struct IfNode {
 	struct BlockNode* falseBlock;  // Statements to execute if false
 } IfNode;
 
+// Accumulation `x = x + e`, `x = x - e` or `x = x * e` in a parallel loop: every
+// chunk accumulates into a private copy of x starting at the identity, and the
+// partial results are combined into x in chunk order
+typedef struct Reduction {
+	ExpressionNode* target;  // Accumulated variable (a local slot or a field)
+	ValueType type;          // Its type
+	BinaryOperator op;       // OP_ADD (for + and -) or OP_MULTIPLY
+} Reduction;
+
 // For loop node
 typedef struct ForNode {
-	ExpressionNode* initializer;  // Initialization expression (e.g., int i = 0)
+	ExpressionNode* initializer;  // Initialization expression (e.g., int i = 0), declares the loop variable
 	ExpressionNode* condition;    // Loop condition (e.g., i < 10)
-	ExpressionNode* update;       // Update expression (e.g., i++)
+	ExpressionNode* update;       // Update expression (e.g., i++), `value` holds the step (1 or -1)
 	struct BlockNode* body;       // Body of the loop
+	ExpressionNode** guards;      // Conditions under which unchecked_body is safe (set by the optimizer)
+	int guard_count;
+	struct BlockNode* unchecked_body;  // Copy of body with the array bounds checks hoisted into guards, or NULL
+	int parallel;                 // Declared `parallel for`: iterations are split across the worker pool
+	int frame_slots;              // Slots of the enclosing frame, copied for every chunk (set by check_parallel_loops)
+	struct Reduction* reductions; // Variables the iterations accumulate into (set by check_parallel_loops)
+	int reduction_count;
 } ForNode;
 
 // Method node for representing method definitions
@@ -111,16 +220,55 @@ typedef struct BlockNode {
 	};
 } BlockNode;
 
-typedef struct LocalVariable {
-	char* variable_name;  // Name of the variable
-	int value;            // Value of the variable
-	struct LocalVariable* next;  // Pointer to the next variable in the local scope
-} LocalVariable;
+// Maximum number of nested calls and local slots of a thread's frame stack
+#define FRAME_MAX_DEPTH 1024
+#define FRAME_STACK_SLOTS (64 * 1024)
+
+// Budget of a frame stack that nothing meters
+#define BUDGET_UNLIMITED LLONG_MAX
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// Per-thread call stack: the locals of every active call live contiguously in
+// `slots`, so calling a method never touches the heap. A caller pushes the
+// arguments onto the top of the stack and they become the callee's first slots.
+// A running call, kept in run_method's own C frame so an error can release what
+// the frames it unwinds own (see unwind_thread)
+typedef struct CallFrame {
+	Method* method;
+	int base;                  // First slot of the call's frame
+	struct CallFrame* caller;
+} CallFrame;
 
-// Global variables for token management
-Token current_token;  // Current token being processed
-const char** source;  // Source code being parsed
-static SymbolTable* symbol_table = NULL; // Head of the symbol table linked list
+typedef struct FrameStack {
+	Value* slots;        // Preallocated slot storage
+	int capacity;        // Number of slots
+	int top;             // First free slot
+	int depth;           // Number of active calls
+	int max_depth;       // Calls allowed before reporting a stack overflow
+	long long budget;    // Loop back-edges and calls left before the budget runs out
+	int metered;         // A finite budget is running (compiled methods are interpreted so every loop counts)
+	Value return_value;  // Value of the last executed return statement
+	Object* entered;     // Object claimed by the outermost host call on this stack (see object_enter)
+	struct GcHeap* heap; // Heap whose collector the outermost call holds off (see gc_enter), NULL if none
+	CallFrame* frames;   // Innermost running call, NULL when none is
+} FrameStack;
+
+// Outcome of executing a statement: fall through or unwind to the caller
+typedef enum {
+	EXEC_NORMAL,
+	EXEC_RETURN,
+	EXEC_ABORT,   // The instruction budget ran out: unwind to the host
+} ExecStatus;
+
+// Parser state, per thread so that contexts can load classes concurrently
+extern THREAD_LOCAL Token current_token;  // Current token being processed
+extern THREAD_LOCAL const char** source;  // Source code being parsed
+extern int trace_tokens;  // Print every token as it is read (on by default; hosts writing to stdout turn it off)
 
 // Function declarations for parsing and interpretation
 
@@ -137,16 +285,110 @@ StatementNode* parse_statement();
 void next_token_wrapper();
 void expect(TokenType type);
 
+// Zeroed storage for a statement node of the class being parsed (the optimizer and
+// type checker add theirs while parse_class runs them). Nodes are laid out one after
+// another in large blocks, in parse order, and are only released with the class by
+// free_class_node: they are never freed one by one.
+void* ast_alloc(size_t size);
+
+// A new expression node of the class being parsed, zeroed apart from its index. While
+// the class is parsed its table grows in chunks, so nodes keep their address and
+// ast_node finds one by index. parse_class then moves the table into one array, where
+// expr_child finds an operand from its node's own position without following a pointer.
+ExpressionNode* ast_new_expression(ExpressionKind kind);
+ExpressionNode* ast_node(uint32_t index);  // NULL for EXPR_NONE
+
+#ifdef _MSC_VER
+#define AST_INLINE static __inline
+#else
+#define AST_INLINE static inline
+#endif
+
+// Index of a node to store as an operand, EXPR_NONE for NULL
+AST_INLINE uint32_t ast_index(ExpressionNode* expr) {
+	return expr != NULL ? expr->index : EXPR_NONE;
+}
+
+// Operand `index` (expr->left, expr->right, ...) of a node of a parsed class, NULL for EXPR_NONE
+AST_INLINE ExpressionNode* expr_child(ExpressionNode* expr, uint32_t index) {
+	return index != EXPR_NONE ? expr + ((ptrdiff_t)index - (ptrdiff_t)expr->index) : NULL;
+}
+
+// Argument i of a call node of a parsed class
+AST_INLINE ExpressionNode* expr_argument(ExpressionNode* expr, int i) {
+	return expr_child(expr, expr->arguments[i]);
+}
+
+// Name resolution: binds locals to frame slots and calls to their methods
+void resolve_class(ClassNode* class_node);
+Method* find_method(ClassNode* class_node, const char* method_name);
+// Whether two array or map variables of the method may be the same one: the same
+// variable, or a parameter and another parameter or field of the same type. Two
+// fields, or a local the method declares and anything else, are always distinct.
+int may_alias(Method* method, ExpressionNode* left, ExpressionNode* right);
+// Index of a field in the class's field_table, -1 if there is none by that name
+int find_field(ClassNode* class_node, const char* field_name);
+// Vtable slot of a method, valid for the class and every class derived from it; -1 if there is none
+int find_method_slot(ClassNode* class_node, const char* method_name);
+// Class a type name in class_node's source refers to: class_node itself or a class of its
+// context, which class_node then holds a reference on. NULL if there is no such class.
+ClassNode* reference_class(ClassNode* class_node, const char* type_name);
+// Whether derived is base_class or derives from it
+int class_derives_from(ClassNode* derived, ClassNode* base_class);
+
 // Object functions
+// An object of the newest version of the class (see interpreter_reload_class)
 Object* create_object(ClassNode* class_node);
+// Fill a field array of the class's layout with the zero of every field (arrays get their own storage)
+void init_object_fields(ClassNode* class_node, Field* fields);
+// Free the storage init_object_fields gave a field array (its arrays and maps, and its strings)
+void free_object_fields(ClassNode* class_node, Field* fields);
 void execute_method(Object* obj, const char* method_name);
+// A string result is a reference the host owns and drops with string_release (see text.h)
+Value call_method(Object* obj, const char* method_name, const Value* args, int argument_count);
+// call_method with at most `budget` loop iterations and calls. Returns 1 and stores
+// the result when the method finishes; returns 0 when the budget runs out, in which
+// case the call is unwound (its arrays are freed, fields keep the writes made so far).
+int call_method_bounded(Object* obj, const char* method_name, const Value* args, int argument_count, long long budget, Value* result);
+// call_method through the object's vtable: a slot found once on a base class
+// calls the method (or its override) of whatever derived class the object has
+Value call_method_slot(Object* obj, int slot, const Value* args, int argument_count);
 void free_object(Object* obj);
 
+// Frame stack functions
+FrameStack* current_frame_stack();
+void free_frame_stack();
+// Drop every call of the calling thread, after the host longjmp'd out of the interpreter
+void reset_frame_stack();
+// Where the calling thread's parse and calls stood, to unwind back to (see ErrorTrap)
+typedef struct ThreadMark {
+	const char** source;
+	Token token;
+	struct AstArena* arena;
+	ClassNode* parsing_class;
+	FrameStack* stack;
+	int top;
+	int depth;
+	long long budget;
+	int metered;
+} ThreadMark;
+void mark_thread(ThreadMark* mark);
+// Drop the parse and the calls the thread started since the mark, freeing the class
+// being parsed and the arrays, maps and strings of the dropped frames
+void unwind_thread(const ThreadMark* mark);
+// Release what the frames above `top` own (their arrays, maps and strings, and the
+// strings of arguments pushed for a call), innermost first, down to the first frame
+// at or below `depth`; returns that frame
+CallFrame* release_frames(FrameStack* stack, int top, int depth);
+// Run the calling thread on another frame stack (a coroutine's own), NULL for the
+// thread's default one; returns the stack that was in use
+FrameStack* switch_frame_stack(FrameStack* stack);
+
 // AST Node execution functions
-void execute_if(IfNode* if_node, Object* obj, LocalVariable* local_table);
-void execute_for(ForNode* for_node, Object* obj);
-int evaluate_expression(ExpressionNode* expr, Object* obj, LocalVariable* local_table);
-void execute_block(BlockNode* block, Object* obj, LocalVariable* local_table);
+ExecStatus execute_if(IfNode* if_node, Object* obj, Value* locals);
+ExecStatus execute_for(ForNode* for_node, Object* obj, Value* locals);
+Value evaluate_expression(ExpressionNode* expr, Object* obj, Value* locals);
+ExecStatus execute_block(BlockNode* block, Object* obj, Value* locals);
 
 // Utility functions
 void free_class_node(ClassNode* class_node);
@@ -154,7 +396,11 @@ void update_variable(char* variable, int value);
 int lookup_object_field(Object* obj, const char* field_name);
 // Function to update or add a variable to the symbol table
 void update_object_field(Object* obj, const char* field_name, int value);
+// Typed field access: values are converted to the field's declared type on store.
+// A string read is borrowed from the field; a string stored is copied by reference.
+Value get_object_field(Object* obj, const char* field_name);
+void set_object_field(Object* obj, const char* field_name, Value value);
+// Storage of an array field, for the host to fill or read in bulk
+Array* get_object_array(Object* obj, const char* field_name);
 void free_symbol_table();
-void clean_up();
-int lookup_local_variable(LocalVariable* local_table, const char* variable_name);
-void update_local_variable(LocalVariable** local_table, const char* variable_name, int value);
\ No newline at end of file
+void clean_up();
\ No newline at end of file
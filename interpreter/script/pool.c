@@ -0,0 +1,445 @@
+#ifdef _MSC_VER
+#define strdup _strdup
+#endif
+
+#include "pool.h"
+#include "threads.h"
+#include "text.h"
+#include "context.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- Threads -----------------------------------------------------------------
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+
+static DWORD WINAPI worker_entry(LPVOID argument);
+
+static void thread_start(Thread* thread, void* argument) {
+	*thread = CreateThread(NULL, 0, worker_entry, argument, 0, NULL);
+	if (*thread == NULL) {
+		printf("Error: Failed to start a worker thread.\n");
+		exit(1);
+	}
+}
+
+static void thread_join(Thread thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+#else
+typedef pthread_t Thread;
+
+static void* worker_entry(void* argument);
+
+static void thread_start(Thread* thread, void* argument) {
+	if (pthread_create(thread, NULL, worker_entry, argument) != 0) {
+		printf("Error: Failed to start a worker thread.\n");
+		exit(1);
+	}
+}
+
+static void thread_join(Thread thread) {
+	pthread_join(thread, NULL);
+}
+
+#endif
+
+// ---- Jobs and futures --------------------------------------------------------
+
+typedef enum {
+	JOB_FUNCTION,  // function(argument)
+	JOB_CALL,      // call_method on one object
+	JOB_BATCH,     // batch_call on a batch
+} JobKind;
+
+typedef struct Job {
+	JobKind kind;
+	JobFunction function;
+	void* argument;
+	Object* obj;
+	Batch* batch;
+	char* method_name;   // Owned copy
+	Value* args;         // Owned copy
+	int argument_count;
+	void* results;
+	Future* future;
+} Job;
+
+struct Future {
+	Mutex lock;
+	Condition finished;
+	int done;
+	Value result;
+};
+
+// Jobs of one worker in a ring buffer: the owner pushes and pops at the bottom
+// (newest first, still warm in its cache), thieves take from the top (oldest,
+// usually the largest remaining piece of work)
+typedef struct JobDeque {
+	Mutex lock;
+	Job** jobs;
+	int top;       // Index of the oldest job
+	int count;
+	int capacity;
+} JobDeque;
+
+typedef struct Worker {
+	ThreadPool* pool;
+	int index;
+	Thread thread;
+	JobDeque deque;
+	unsigned int random;  // State for picking steal victims
+} Worker;
+
+struct ThreadPool {
+	Worker* workers;
+	int worker_count;
+	Mutex lock;             // Guards pending, stopping and next_worker
+	Condition work_available;
+	int pending;            // Jobs sitting in any deque
+	int stopping;
+	int next_worker;        // Deque for the next submission from outside the pool
+};
+
+// Worker running on this thread, NULL outside the pool
+static THREAD_LOCAL Worker* current_worker = NULL;
+
+static void deque_init(JobDeque* deque) {
+	mutex_init(&deque->lock);
+	deque->capacity = 64;
+	deque->jobs = (Job**)malloc(sizeof(Job*) * deque->capacity);
+	if (!deque->jobs) {
+		printf("Error: Memory allocation failed for job deque.\n");
+		exit(1);
+	}
+	deque->top = 0;
+	deque->count = 0;
+}
+
+static void deque_destroy(JobDeque* deque) {
+	free(deque->jobs);
+	mutex_destroy(&deque->lock);
+}
+
+static void deque_push_bottom(JobDeque* deque, Job* job) {
+	mutex_lock(&deque->lock);
+	if (deque->count == deque->capacity) {
+		// Unroll the ring into a buffer twice the size
+		Job** jobs = (Job**)malloc(sizeof(Job*) * deque->capacity * 2);
+		if (!jobs) {
+			printf("Error: Memory allocation failed for job deque.\n");
+			exit(1);
+		}
+		for (int i = 0; i < deque->count; i++) {
+			jobs[i] = deque->jobs[(deque->top + i) % deque->capacity];
+		}
+		free(deque->jobs);
+		deque->jobs = jobs;
+		deque->top = 0;
+		deque->capacity *= 2;
+	}
+	deque->jobs[(deque->top + deque->count) % deque->capacity] = job;
+	deque->count++;
+	mutex_unlock(&deque->lock);
+}
+
+static Job* deque_pop_bottom(JobDeque* deque) {
+	Job* job = NULL;
+	mutex_lock(&deque->lock);
+	if (deque->count > 0) {
+		deque->count--;
+		job = deque->jobs[(deque->top + deque->count) % deque->capacity];
+	}
+	mutex_unlock(&deque->lock);
+	return job;
+}
+
+static Job* deque_steal_top(JobDeque* deque) {
+	Job* job = NULL;
+	mutex_lock(&deque->lock);
+	if (deque->count > 0) {
+		job = deque->jobs[deque->top];
+		deque->top = (deque->top + 1) % deque->capacity;
+		deque->count--;
+	}
+	mutex_unlock(&deque->lock);
+	return job;
+}
+
+// Own deque first, then the other workers starting from a random victim
+static Job* find_job(Worker* worker) {
+	ThreadPool* pool = worker->pool;
+	Job* job = deque_pop_bottom(&worker->deque);
+	if (job == NULL && pool->worker_count > 1) {
+		worker->random = worker->random * 1103515245u + 12345u;
+		int start = (int)((worker->random >> 16) % (unsigned int)pool->worker_count);
+		for (int i = 0; i < pool->worker_count && job == NULL; i++) {
+			Worker* victim = &pool->workers[(start + i) % pool->worker_count];
+			if (victim != worker) {
+				job = deque_steal_top(&victim->deque);
+			}
+		}
+	}
+	if (job != NULL) {
+		mutex_lock(&pool->lock);
+		pool->pending--;
+		mutex_unlock(&pool->lock);
+	}
+	return job;
+}
+
+static void run_job(Job* job) {
+	// A job may run inside a wait of the thread's own call, whose trap it must not longjmp to
+	ErrorTrap* trap = interpreter_trap_errors(NULL);
+	Value result = make_int(0);
+	switch (job->kind) {
+	case JOB_FUNCTION:
+		job->function(job->argument);
+		break;
+	case JOB_CALL:
+		result = call_method(job->obj, job->method_name, job->args, job->argument_count);
+		break;
+	case JOB_BATCH:
+		batch_call(job->batch, job->method_name, job->args, job->argument_count, job->results);
+		break;
+	}
+	interpreter_trap_errors(trap);
+
+	Future* future = job->future;
+	mutex_lock(&future->lock);
+	future->result = result;
+	future->done = 1;
+	condition_broadcast(&future->finished);
+	mutex_unlock(&future->lock);
+
+	for (int i = 0; i < job->argument_count; i++) {
+		string_release(job->args[i]);
+	}
+	free(job->method_name);
+	free(job->args);
+	free(job);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_entry(LPVOID argument) {
+#else
+static void* worker_entry(void* argument) {
+#endif
+	Worker* worker = (Worker*)argument;
+	ThreadPool* pool = worker->pool;
+	current_worker = worker;
+
+	while (1) {
+		Job* job = find_job(worker);
+		if (job != NULL) {
+			run_job(job);
+			continue;
+		}
+
+		// Sleep until a job is submitted; queued jobs are drained before stopping
+		mutex_lock(&pool->lock);
+		while (pool->pending == 0 && !pool->stopping) {
+			condition_wait(&pool->work_available, &pool->lock);
+		}
+		int finished = pool->pending == 0 && pool->stopping;
+		mutex_unlock(&pool->lock);
+		if (finished) break;
+	}
+
+	// The worker's interpreter state goes with it
+	free_frame_stack();
+	current_worker = NULL;
+	return 0;
+}
+
+ThreadPool* pool_create(int worker_count) {
+	ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+	if (!pool) {
+		printf("Error: Memory allocation failed for ThreadPool.\n");
+		exit(1);
+	}
+	pool->worker_count = worker_count > 0 ? worker_count : core_count();
+	pool->workers = (Worker*)malloc(sizeof(Worker) * pool->worker_count);
+	if (!pool->workers) {
+		printf("Error: Memory allocation failed for workers.\n");
+		exit(1);
+	}
+	mutex_init(&pool->lock);
+	condition_init(&pool->work_available);
+	pool->pending = 0;
+	pool->stopping = 0;
+	pool->next_worker = 0;
+
+	// Every deque exists before any worker starts stealing
+	for (int i = 0; i < pool->worker_count; i++) {
+		Worker* worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+		worker->random = 2654435761u * (unsigned int)(i + 1);
+		deque_init(&worker->deque);
+	}
+	for (int i = 0; i < pool->worker_count; i++) {
+		thread_start(&pool->workers[i].thread, &pool->workers[i]);
+	}
+	return pool;
+}
+
+void pool_destroy(ThreadPool* pool) {
+	if (pool == NULL) return;
+	mutex_lock(&pool->lock);
+	pool->stopping = 1;
+	condition_broadcast(&pool->work_available);
+	mutex_unlock(&pool->lock);
+
+	for (int i = 0; i < pool->worker_count; i++) {
+		thread_join(pool->workers[i].thread);
+	}
+	for (int i = 0; i < pool->worker_count; i++) {
+		deque_destroy(&pool->workers[i].deque);
+	}
+	condition_destroy(&pool->work_available);
+	mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+int pool_worker_count(ThreadPool* pool) {
+	return pool->worker_count;
+}
+
+static Mutex default_pool_lock = MUTEX_INITIALIZER;
+static ThreadPool* default_pool = NULL;
+
+ThreadPool* pool_default() {
+	mutex_lock(&default_pool_lock);
+	if (default_pool == NULL) {
+		default_pool = pool_create(0);
+	}
+	ThreadPool* pool = default_pool;
+	mutex_unlock(&default_pool_lock);
+	return pool;
+}
+
+void pool_free_default() {
+	mutex_lock(&default_pool_lock);
+	ThreadPool* pool = default_pool;
+	default_pool = NULL;
+	mutex_unlock(&default_pool_lock);
+	pool_destroy(pool);
+}
+
+static Job* new_job(JobKind kind, const char* method_name, const Value* args, int argument_count) {
+	Job* job = (Job*)calloc(1, sizeof(Job));
+	if (!job) {
+		printf("Error: Memory allocation failed for Job.\n");
+		exit(1);
+	}
+	job->kind = kind;
+	job->method_name = method_name ? strdup(method_name) : NULL;
+	job->argument_count = argument_count;
+	if (argument_count > 0) {
+		job->args = (Value*)malloc(sizeof(Value) * argument_count);
+		if (!job->args) {
+			printf("Error: Memory allocation failed for job arguments.\n");
+			exit(1);
+		}
+		memcpy(job->args, args, sizeof(Value) * argument_count);
+		for (int i = 0; i < argument_count; i++) {
+			string_retain(args[i]);  // The job holds its string arguments until it completes
+		}
+	}
+	return job;
+}
+
+// Queue a job and wake a sleeping worker
+static Future* submit_job(ThreadPool* pool, Job* job) {
+	Future* future = (Future*)malloc(sizeof(Future));
+	if (!future) {
+		printf("Error: Memory allocation failed for Future.\n");
+		exit(1);
+	}
+	mutex_init(&future->lock);
+	condition_init(&future->finished);
+	future->done = 0;
+	future->result = make_int(0);
+	job->future = future;
+
+	Worker* worker = current_worker;
+	if (worker == NULL || worker->pool != pool) {
+		// From outside the pool the deques take turns
+		mutex_lock(&pool->lock);
+		worker = &pool->workers[pool->next_worker];
+		pool->next_worker = (pool->next_worker + 1) % pool->worker_count;
+		mutex_unlock(&pool->lock);
+	}
+	deque_push_bottom(&worker->deque, job);
+
+	mutex_lock(&pool->lock);
+	pool->pending++;
+	condition_signal(&pool->work_available);
+	mutex_unlock(&pool->lock);
+	return future;
+}
+
+Future* pool_submit(ThreadPool* pool, JobFunction function, void* argument) {
+	Job* job = new_job(JOB_FUNCTION, NULL, NULL, 0);
+	job->function = function;
+	job->argument = argument;
+	return submit_job(pool, job);
+}
+
+Future* pool_submit_call(ThreadPool* pool, Object* obj, const char* method_name, const Value* args, int argument_count) {
+	Job* job = new_job(JOB_CALL, method_name, args, argument_count);
+	job->obj = obj;
+	return submit_job(pool, job);
+}
+
+Future* pool_submit_batch(ThreadPool* pool, Batch* batch, const char* method_name, const Value* args, int argument_count, void* results) {
+	Job* job = new_job(JOB_BATCH, method_name, args, argument_count);
+	job->batch = batch;
+	job->results = results;
+	return submit_job(pool, job);
+}
+
+int future_done(Future* future) {
+	mutex_lock(&future->lock);
+	int done = future->done;
+	mutex_unlock(&future->lock);
+	return done;
+}
+
+Value future_wait(Future* future) {
+	Worker* worker = current_worker;
+	if (worker != NULL) {
+		// Blocking a worker could starve the job it waits for: keep running jobs instead
+		while (!future_done(future)) {
+			Job* job = find_job(worker);
+			if (job != NULL) {
+				run_job(job);
+			}
+			else {
+				thread_yield();
+			}
+		}
+	}
+
+	mutex_lock(&future->lock);
+	while (!future->done) {
+		condition_wait(&future->finished, &future->lock);
+	}
+	Value result = future->result;
+	mutex_unlock(&future->lock);
+	return result;
+}
+
+void future_free(Future* future) {
+	if (future == NULL) return;
+	string_release(future_wait(future));
+	condition_destroy(&future->finished);
+	mutex_destroy(&future->lock);
+	free(future);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "parse.h"  // Include parse.h for Object and Value
+#include "batch.h"  // Include batch.h for Batch
+
+// Pool of worker threads running script invocations. Every worker owns a deque
+// of jobs: it pops its newest job from the bottom and, when it runs dry, steals
+// the oldest job from the top of another worker's deque.
+//
+// Compiled classes are only read while methods run, so any number of jobs may
+// share one ClassNode. Each worker has its own frame stack (see FrameStack);
+// an Object or Batch must not be used by two jobs at the same time.
+typedef struct ThreadPool ThreadPool;
+
+// Completion of a submitted job
+typedef struct Future Future;
+
+typedef void (*JobFunction)(void* argument);
+
+// Pool functions
+// worker_count <= 0 starts one worker per core
+ThreadPool* pool_create(int worker_count);
+// Run the jobs still queued, then stop the workers
+void pool_destroy(ThreadPool* pool);
+int pool_worker_count(ThreadPool* pool);
+// Process-wide pool with one worker per core, started on first use (parallel for loops run on it)
+ThreadPool* pool_default();
+void pool_free_default();
+
+// Submission: the arguments are copied, the object, batch and results must live until the job completes.
+// A job submitted from a worker goes to that worker's own deque.
+Future* pool_submit(ThreadPool* pool, JobFunction function, void* argument);
+Future* pool_submit_call(ThreadPool* pool, Object* obj, const char* method_name, const Value* args, int argument_count);
+Future* pool_submit_batch(ThreadPool* pool, Batch* batch, const char* method_name, const Value* args, int argument_count, void* results);
+
+// Future functions
+// Block until the job completes and return its result (int 0 for functions, batches and void methods;
+// a string result is borrowed from the future).
+// A worker waiting on a future runs other jobs meanwhile, so jobs may wait on the jobs they submit.
+Value future_wait(Future* future);
+int future_done(Future* future);
+// Wait for the job, then release the future
+void future_free(Future* future);
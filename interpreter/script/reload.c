@@ -0,0 +1,194 @@
+#include "reload.h"
+#include "context.h"
+#include "threads.h"
+#include "gc.h"
+#include "map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- Retired versions ----------------------------------------------------------
+
+typedef struct RetiredClass {
+	ClassNode* class_node;
+	struct RetiredClass* next;
+} RetiredClass;
+
+// Versions whose last reference was dropped, freed at the next quiescent point
+// (a host call returning, a reload or interpreter_reclaim) rather than in the
+// middle of the call that dropped it
+static Mutex retired_lock = MUTEX_INITIALIZER;
+static RetiredClass* retired = NULL;
+static volatile long retired_count = 0;
+
+static void retire_class(ClassNode* class_node) {
+	RetiredClass* entry = (RetiredClass*)malloc(sizeof(RetiredClass));
+	if (!entry) {
+		printf("Error: Memory allocation failed for a retired class.\n");
+		exit(1);
+	}
+	entry->class_node = class_node;
+	mutex_lock(&retired_lock);
+	entry->next = retired;
+	retired = entry;
+	atomic_increment(&retired_count);
+	mutex_unlock(&retired_lock);
+}
+
+void reclaim_classes() {
+	while (atomic_read(&retired_count) > 0) {
+		mutex_lock(&retired_lock);
+		RetiredClass* reclaimed = retired;
+		retired = NULL;
+		atomic_write(&retired_count, 0);
+		mutex_unlock(&retired_lock);
+
+		// Freeing drops references to the next version and the base, which may retire them in turn
+		while (reclaimed != NULL) {
+			RetiredClass* entry = reclaimed;
+			reclaimed = entry->next;
+			ClassNode* replacement = entry->class_node->replacement;
+			free_class_node(entry->class_node);
+			class_release(replacement);
+			free(entry);
+		}
+	}
+}
+
+void forget_retired_classes(struct Interpreter* interpreter) {
+	mutex_lock(&retired_lock);
+	RetiredClass** link = &retired;
+	while (*link != NULL) {
+		RetiredClass* entry = *link;
+		if (entry->class_node->context == interpreter) {
+			*link = entry->next;
+			free(entry);
+			atomic_decrement(&retired_count);
+		}
+		else {
+			link = &entry->next;
+		}
+	}
+	mutex_unlock(&retired_lock);
+}
+
+// ---- References --------------------------------------------------------------
+
+void class_retain(ClassNode* class_node) {
+	atomic_increment(&class_node->references);
+}
+
+void class_release(ClassNode* class_node) {
+	if (class_node == NULL) return;
+	if (atomic_decrement(&class_node->references) == 0) {
+		retire_class(class_node);
+	}
+}
+
+ClassNode* class_latest(ClassNode* class_node) {
+	ClassNode* replacement;
+	while ((replacement = (ClassNode*)atomic_read_pointer((void* volatile*)&class_node->replacement)) != NULL) {
+		class_node = replacement;
+	}
+	return class_node;
+}
+
+// ---- Objects -----------------------------------------------------------------
+
+// Move the object to the newest version of its class: fields keep their value when
+// the new version declares a field of the same name (converted between int and float;
+// an array is kept when its type and length are unchanged, a map or a string when its
+// type is, a reference when its class is), new fields start at zero
+static void migrate_object(Object* obj) {
+	ClassNode* old_class = obj->class_type;
+	ClassNode* new_class = class_latest(old_class);
+	Interpreter* previous = interpreter_enter(new_class->context);
+
+	int count = new_class->field_count;
+	Field* fields = count > 0 ? (Field*)memory_alloc(MEMORY_OBJECTS, sizeof(Field) * count) : NULL;
+	init_object_fields(new_class, fields);
+	for (int i = 0; i < count; i++) {
+		int index = find_field(old_class, fields[i].name);
+		if (index < 0) continue;
+		Field* old_field = &obj->field_values[index];
+		if (is_array_type(fields[i].value.type)) {
+			if (old_field->value.type == fields[i].value.type && old_field->length == fields[i].length) {
+				array_free(fields[i].value.as.a);
+				fields[i].value = old_field->value;
+				old_field->value.as.a = NULL;  // Moved
+			}
+		}
+		else if (is_map_type(fields[i].value.type) || is_map_type(old_field->value.type)) {
+			if (old_field->value.type == fields[i].value.type) {
+				map_free(fields[i].value.as.m);
+				fields[i].value = old_field->value;
+				old_field->value.as.m = NULL;  // Moved
+			}
+		}
+		else if (fields[i].value.type == VALUE_STRING || old_field->value.type == VALUE_STRING) {
+			if (old_field->value.type == fields[i].value.type) {
+				fields[i].value = old_field->value;
+				old_field->value = make_empty_string();  // Moved
+			}
+		}
+		else if (fields[i].value.type == VALUE_OBJECT || old_field->value.type == VALUE_OBJECT) {
+			if (old_field->value.type == fields[i].value.type && strcmp(old_class->field_table[index]->type, new_class->field_table[i]->type) == 0) {
+				fields[i].value = old_field->value;
+			}
+		}
+		else if (!is_array_type(old_field->value.type)) {
+			fields[i].value = value_convert(old_field->value, fields[i].value.type);
+		}
+	}
+
+	// Arrays and maps of dropped or retyped fields go with the old layout
+	free_object_fields(old_class, obj->field_values);
+	if (obj->field_values != NULL && obj->field_values != (Field*)(obj + 1)) {
+		memory_free(obj->field_values);  // The first layout is part of the object's block and goes with it
+	}
+	memory_free(obj->field_addresses);
+	obj->field_addresses = NULL;
+	obj->field_values = fields;
+
+	class_retain(new_class);
+	atomic_write_pointer((void* volatile*)&obj->class_type, new_class);
+	if (new_class->uses_references && obj->generation == OBJECT_HOST && !(obj->gc_flags & GC_ROOT)) {
+		gc_add_root(obj);  // Its new fields may hold the only references to objects of the heap
+	}
+	interpreter_enter(previous);
+	class_release(old_class);
+}
+
+int object_enter(Object* obj, FrameStack* stack) {
+	if (stack->entered != NULL) return 0;
+
+	for (;;) {
+		long calls = atomic_read(&obj->calls);
+		if (calls < 0) {
+			thread_yield();  // Another thread is migrating it
+			continue;
+		}
+		if (atomic_compare_swap(&obj->calls, calls, calls + 1) == calls) break;
+	}
+	// Held, so its version can't be retired under us. Calls already running
+	// keep the version they started with; with none, move to the newest.
+	if (atomic_read_pointer((void* volatile*)&obj->class_type->replacement) != NULL && atomic_compare_swap(&obj->calls, 1, -1) == 1) {
+		migrate_object(obj);
+		atomic_write(&obj->calls, 1);
+	}
+
+	stack->entered = obj;
+	return 1;
+}
+
+void object_leave(FrameStack* stack) {
+	Object* obj = stack->entered;
+	stack->entered = NULL;
+	atomic_decrement(&obj->calls);
+	if (stack->heap != NULL) {
+		gc_leave(stack);  // The call's hold on the collector (see gc_enter)
+	}
+	if (atomic_read(&retired_count) > 0) {
+		reclaim_classes();
+	}
+}
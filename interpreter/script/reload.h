@@ -0,0 +1,35 @@
+#pragma once
+#include "parse.h"  // Include parse.h for ClassNode, Object and FrameStack
+
+// Class versions
+//
+// interpreter_reload_class publishes a new version of a class while other threads
+// keep running. Each version counts its references: one held by the registry (or
+// by whoever parsed it unregistered), one for every ClassNode pointer the registry
+// handed to the host until its class_release, one per live object or batch, one per
+// loaded class deriving from or referring to it and one held by the version it
+// replaced. The reload drops the registry's reference to the old version; the
+// versions between a held one and the newest stay alive through the last of these.
+// free_class_node frees a version outright, whatever its count. Objects move to the newest version
+// when a host call next enters them with no other call running on them, which drops
+// theirs. A call only reads the version of an object it holds, so a version whose
+// count reaches zero is unreachable: it is retired and freed at the next quiescent
+// point (a host call returning, a reload or interpreter_reclaim).
+
+// Start a host call on the object: claim it for the outermost call of the stack,
+// migrating it first when its class was reloaded and no call is running on it.
+// Returns 1 when this call claimed it (release with object_leave), 0 when the stack
+// already holds an object.
+int object_enter(Object* obj, FrameStack* stack);
+void object_leave(FrameStack* stack);
+
+void class_retain(ClassNode* class_node);
+// Drop a reference; the last one retires the version
+void class_release(ClassNode* class_node);
+// Newest version of a class (the class itself unless it was reloaded)
+ClassNode* class_latest(ClassNode* class_node);
+
+// Free the retired versions
+void reclaim_classes();
+// Forget the retired versions of a context that is being destroyed
+void forget_retired_classes(struct Interpreter* interpreter);
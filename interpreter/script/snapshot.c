@@ -0,0 +1,694 @@
+#include "snapshot.h"
+#include "array.h"
+#include "map.h"
+#include "text.h"
+#include "reload.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SNAPSHOT_MAGIC 0x4E534656u  // "VFSN"
+#define SNAPSHOT_HEADER_SIZE ARRAY_ALIGNMENT
+
+// Layout (every number a native 4-byte unsigned int unless noted):
+//   header:  magic, version, section count, zero padding up to SNAPSHOT_HEADER_SIZE
+//   section: object count, field count, end of the section (8 bytes, from the start of the file),
+//            class name length, class name padded to 4 bytes, then per field:
+//            type (ValueType), fixed array length, column offset (8 bytes, from the start of
+//            the file), column length in 4-byte elements, name length, name padded to 4 bytes
+//   columns: at their offsets, each aligned to ARRAY_ALIGNMENT
+
+typedef struct SnapshotField {
+	char* name;
+	ValueType type;
+	int length;          // Fixed array length, 0 for scalars and variable-length arrays
+	const void* column;  // Mapped values: one per object, or the array lengths followed by the elements
+	size_t elements;
+} SnapshotField;
+
+typedef struct SnapshotSection {
+	char* class_name;
+	int count;
+	int field_count;
+	SnapshotField* fields;
+} SnapshotSection;
+
+struct Snapshot {
+	char* base;  // The mapped file (copy-on-write)
+	size_t size;
+#ifdef _WIN32
+	HANDLE mapping;
+#endif
+	int section_count;
+	SnapshotSection* sections;
+};
+
+static size_t align_up(size_t offset, size_t alignment) {
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Column elements holding the bytes of a string of `length` bytes
+static size_t string_words(int length) {
+	return ((size_t)length + 3) / 4;
+}
+
+// ---- Saving ------------------------------------------------------------------
+
+// The objects of one section: a run of objects of one class, or a batch
+typedef struct SectionSource {
+	ClassNode* class_node;
+	Object** objects;  // NULL for a batch
+	Batch* batch;
+	int count;
+	size_t* offsets;   // Column offset of every field
+	size_t* elements;  // Column length of every field
+	size_t end;
+} SectionSource;
+
+typedef struct SnapshotWriter {
+	FILE* file;
+	size_t offset;
+	int failed;
+} SnapshotWriter;
+
+static void write_data(SnapshotWriter* writer, const void* data, size_t size) {
+	if (size > 0 && fwrite(data, 1, size, writer->file) != size) writer->failed = 1;
+	writer->offset += size;
+}
+
+static void write_u32(SnapshotWriter* writer, unsigned int value) {
+	write_data(writer, &value, sizeof(value));
+}
+
+static void write_u64(SnapshotWriter* writer, unsigned long long value) {
+	write_data(writer, &value, sizeof(value));
+}
+
+static void write_padding(SnapshotWriter* writer, size_t offset) {
+	static const char zeros[ARRAY_ALIGNMENT] = { 0 };
+	while (writer->offset < offset) {
+		size_t size = offset - writer->offset < sizeof(zeros) ? offset - writer->offset : sizeof(zeros);
+		write_data(writer, zeros, size);
+	}
+}
+
+static void write_name(SnapshotWriter* writer, const char* name) {
+	size_t length = strlen(name);
+	write_u32(writer, (unsigned int)length);
+	write_data(writer, name, length);
+	write_padding(writer, align_up(writer->offset, 4));
+}
+
+static size_t name_size(const char* name) {
+	return 4 + align_up(strlen(name), 4);
+}
+
+static Field* source_field(SectionSource* source, int object, int field) {
+	return &source->objects[object]->field_values[field];
+}
+
+// Place the section's columns after its header, which starts at `offset`
+static void layout_section(SectionSource* source, size_t offset) {
+	ClassNode* class_node = source->class_node;
+	int field_count = class_node->field_count;
+	source->offsets = (size_t*)malloc(sizeof(size_t) * (field_count + 1));
+	source->elements = (size_t*)malloc(sizeof(size_t) * (field_count + 1));
+	if (!source->offsets || !source->elements) {
+		printf("Error: Memory allocation failed for a snapshot section.\n");
+		exit(1);
+	}
+
+	offset += 16 + name_size(class_node->class_name);
+	for (int i = 0; i < field_count; i++) {
+		offset += 20 + name_size(class_node->field_table[i]->name);
+	}
+	for (int i = 0; i < field_count; i++) {
+		size_t elements = (size_t)source->count;
+		if (is_array_type(class_node->field_table[i]->value.type)) {
+			for (int k = 0; k < source->count; k++) {
+				Array* array = source_field(source, k, i)->value.as.a;
+				elements += array != NULL ? (size_t)array->length : 0;
+			}
+		}
+		else if (is_map_type(class_node->field_table[i]->value.type)) {
+			for (int k = 0; k < source->count; k++) {
+				Map* map = source_field(source, k, i)->value.as.m;
+				elements += map != NULL ? 2 * (size_t)map->count : 0;
+			}
+		}
+		else if (class_node->field_table[i]->value.type == VALUE_STRING) {
+			for (int k = 0; k < source->count; k++) {
+				elements += string_words(string_length(source_field(source, k, i)->value));
+			}
+		}
+		offset = align_up(offset, ARRAY_ALIGNMENT);
+		source->offsets[i] = offset;
+		source->elements[i] = elements;
+		offset += elements * sizeof(int);
+	}
+	source->end = align_up(offset, ARRAY_ALIGNMENT);
+}
+
+static void write_section(SnapshotWriter* writer, SectionSource* source, int* scratch) {
+	ClassNode* class_node = source->class_node;
+	write_u32(writer, (unsigned int)source->count);
+	write_u32(writer, (unsigned int)class_node->field_count);
+	write_u64(writer, source->end);
+	write_name(writer, class_node->class_name);
+	for (int i = 0; i < class_node->field_count; i++) {
+		Field* field = class_node->field_table[i];
+		write_u32(writer, (unsigned int)field->value.type);
+		write_u32(writer, (unsigned int)field->length);
+		write_u64(writer, source->offsets[i]);
+		write_u32(writer, (unsigned int)source->elements[i]);
+		write_name(writer, field->name);
+	}
+
+	for (int i = 0; i < class_node->field_count; i++) {
+		write_padding(writer, source->offsets[i]);
+		if (source->batch != NULL) {
+			write_data(writer, source->batch->columns[i]->data, sizeof(int) * (size_t)source->count);
+			continue;
+		}
+		// Gather the column, then write it at once
+		int array = is_array_type(class_node->field_table[i]->value.type);
+		int map = is_map_type(class_node->field_table[i]->value.type);
+		int reference = class_node->field_table[i]->value.type == VALUE_OBJECT;
+		int string = class_node->field_table[i]->value.type == VALUE_STRING;
+		for (int k = 0; k < source->count; k++) {
+			Value value = source_field(source, k, i)->value;
+			if (array) scratch[k] = value.as.a != NULL ? value.as.a->length : 0;
+			else if (map) scratch[k] = value.as.m != NULL ? value.as.m->count : 0;
+			else if (string) scratch[k] = string_length(value);
+			else if (reference) scratch[k] = 0;  // Saved as null
+			else memcpy(&scratch[k], &value.as, sizeof(int));  // An int or the bits of a float
+		}
+		write_data(writer, scratch, sizeof(int) * (size_t)source->count);
+		for (int k = 0; array && k < source->count; k++) {
+			Array* elements = source_field(source, k, i)->value.as.a;
+			if (elements != NULL) write_data(writer, elements->data, sizeof(int) * (size_t)elements->length);
+		}
+		for (int k = 0; map && k < source->count; k++) {
+			Map* entries = source_field(source, k, i)->value.as.m;
+			for (int slot = 0; entries != NULL && slot < entries->capacity; slot++) {
+				if (entries->slots[slot].distance == 0) continue;
+				write_data(writer, &entries->slots[slot].key, sizeof(int));
+				write_data(writer, &entries->slots[slot].value, sizeof(int));
+			}
+		}
+		for (int k = 0; string && k < source->count; k++) {
+			int length;
+			const char* chars = string_chars(&source_field(source, k, i)->value, &length);
+			write_data(writer, chars, (size_t)length);
+			write_padding(writer, align_up(writer->offset, 4));
+		}
+	}
+	write_padding(writer, source->end);
+}
+
+// Flush the file's data to the disk
+static int sync_file(FILE* file) {
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Move `from` over `to` in one step
+static int replace_file(const char* from, const char* to) {
+#ifdef _WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+static int save_sections(const char* path, SectionSource* sources, int section_count) {
+	size_t offset = SNAPSHOT_HEADER_SIZE;
+	int largest = 1;
+	for (int i = 0; i < section_count; i++) {
+		layout_section(&sources[i], offset);
+		offset = sources[i].end;
+		if (sources[i].count > largest) largest = sources[i].count;
+	}
+
+	// Written next to the file and renamed over it once on disk, so a crash or a full
+	// disk leaves the previous snapshot intact rather than a partial one
+	char* tmp_path = (char*)malloc(strlen(path) + 5);
+	if (!tmp_path) {
+		printf("Error: Memory allocation failed for a snapshot path.\n");
+		exit(1);
+	}
+	sprintf(tmp_path, "%s.tmp", path);
+
+	int saved = 0;
+	FILE* file = fopen(tmp_path, "wb");
+	int* scratch = (int*)malloc(sizeof(int) * (size_t)largest);
+	if (!scratch) {
+		printf("Error: Memory allocation failed for a snapshot column.\n");
+		exit(1);
+	}
+	if (file != NULL) {
+		setvbuf(file, NULL, _IOFBF, 1 << 20);
+		SnapshotWriter writer = { file, 0, 0 };
+		write_u32(&writer, SNAPSHOT_MAGIC);
+		write_u32(&writer, SNAPSHOT_VERSION);
+		write_u32(&writer, (unsigned int)section_count);
+		write_padding(&writer, SNAPSHOT_HEADER_SIZE);
+		for (int i = 0; i < section_count; i++) {
+			write_section(&writer, &sources[i], scratch);
+		}
+		saved = fflush(file) == 0 && sync_file(file) && !writer.failed;
+		saved = fclose(file) == 0 && saved;
+		saved = saved && replace_file(tmp_path, path);
+		if (!saved) remove(tmp_path);
+	}
+
+	free(tmp_path);
+	free(scratch);
+	for (int i = 0; i < section_count; i++) {
+		free(sources[i].offsets);
+		free(sources[i].elements);
+	}
+	return saved;
+}
+
+int snapshot_save_objects(const char* path, Object** objects, int count) {
+	// Sort the objects by class, keeping their order within a class
+	SectionSource* sources = (SectionSource*)calloc(count > 0 ? count : 1, sizeof(SectionSource));
+	Object** sorted = (Object**)malloc(sizeof(Object*) * (count > 0 ? count : 1));
+	if (!sources || !sorted) {
+		printf("Error: Memory allocation failed for a snapshot.\n");
+		exit(1);
+	}
+	int section_count = 0;
+	for (int i = 0; i < count; i++) {
+		int section = 0;
+		while (section < section_count && sources[section].class_node != objects[i]->class_type) section++;
+		if (section == section_count) sources[section_count++].class_node = objects[i]->class_type;
+		sources[section].count++;
+	}
+	int next = 0;
+	for (int section = 0; section < section_count; section++) {
+		sources[section].objects = sorted + next;
+		next += sources[section].count;
+		sources[section].count = 0;
+	}
+	for (int i = 0; i < count; i++) {
+		int section = 0;
+		while (sources[section].class_node != objects[i]->class_type) section++;
+		sources[section].objects[sources[section].count++] = objects[i];
+	}
+
+	int saved = save_sections(path, sources, section_count);
+	free(sorted);
+	free(sources);
+	return saved;
+}
+
+int snapshot_save_batches(const char* path, Batch** batches, int count) {
+	SectionSource* sources = (SectionSource*)calloc(count > 0 ? count : 1, sizeof(SectionSource));
+	if (!sources) {
+		printf("Error: Memory allocation failed for a snapshot.\n");
+		exit(1);
+	}
+	for (int i = 0; i < count; i++) {
+		sources[i].class_node = batches[i]->class_type;
+		sources[i].batch = batches[i];
+		sources[i].count = batches[i]->count;
+	}
+	int saved = save_sections(path, sources, count);
+	free(sources);
+	return saved;
+}
+
+// ---- Loading -----------------------------------------------------------------
+
+typedef struct SnapshotReader {
+	Snapshot* snapshot;
+	const char* path;
+	size_t offset;
+} SnapshotReader;
+
+static void corrupt(SnapshotReader* reader) {
+	script_error("Snapshot %s is corrupt.", reader->path);
+}
+
+static const char* read_data(SnapshotReader* reader, size_t size) {
+	if (size > reader->snapshot->size || reader->offset > reader->snapshot->size - size) corrupt(reader);
+	const char* data = reader->snapshot->base + reader->offset;
+	reader->offset += size;
+	return data;
+}
+
+static unsigned int read_u32(SnapshotReader* reader) {
+	unsigned int value;
+	memcpy(&value, read_data(reader, sizeof(value)), sizeof(value));
+	return value;
+}
+
+static unsigned long long read_u64(SnapshotReader* reader) {
+	unsigned long long value;
+	memcpy(&value, read_data(reader, sizeof(value)), sizeof(value));
+	return value;
+}
+
+static char* read_name(SnapshotReader* reader) {
+	size_t length = read_u32(reader);
+	const char* text = read_data(reader, length);
+	read_data(reader, align_up(length, 4) - length);
+	char* name = (char*)malloc(length + 1);
+	if (!name) {
+		printf("Error: Memory allocation failed for a snapshot name.\n");
+		exit(1);
+	}
+	memcpy(name, text, length);
+	name[length] = '\0';
+	return name;
+}
+
+static void read_section(SnapshotReader* reader, SnapshotSection* section) {
+	section->count = (int)read_u32(reader);
+	section->field_count = (int)read_u32(reader);
+	unsigned long long end = read_u64(reader);
+	section->class_name = read_name(reader);
+	if (section->count < 0 || section->field_count < 0 || end > reader->snapshot->size) corrupt(reader);
+	section->fields = (SnapshotField*)calloc(section->field_count > 0 ? section->field_count : 1, sizeof(SnapshotField));
+	if (!section->fields) {
+		printf("Error: Memory allocation failed for a snapshot section.\n");
+		exit(1);
+	}
+
+	for (int i = 0; i < section->field_count; i++) {
+		SnapshotField* field = &section->fields[i];
+		unsigned int type = read_u32(reader);
+		field->length = (int)read_u32(reader);
+		unsigned long long offset = read_u64(reader);
+		field->elements = read_u32(reader);
+		field->name = read_name(reader);
+		if (type > VALUE_STRING || field->length < 0 || field->elements < (size_t)section->count
+			|| offset % ARRAY_ALIGNMENT != 0 || offset > end || field->elements > (end - offset) / sizeof(int)) {
+			corrupt(reader);
+		}
+		field->type = (ValueType)type;
+		field->column = reader->snapshot->base + offset;
+
+		// An array, map or string column holds exactly the lengths it lists
+		if (is_array_type(field->type) || is_map_type(field->type) || field->type == VALUE_STRING) {
+			const int* lengths = (const int*)field->column;
+			size_t total = (size_t)section->count;
+			for (int k = 0; k < section->count; k++) {
+				if (lengths[k] < 0) corrupt(reader);
+				if (field->type == VALUE_STRING) total += string_words(lengths[k]);
+				else total += (size_t)lengths[k] * (is_map_type(field->type) ? 2 : 1);
+			}
+			if (total != field->elements) corrupt(reader);
+		}
+	}
+	reader->offset = (size_t)end;
+}
+
+static int map_file(Snapshot* snapshot, const char* path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return 0;
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	snapshot->size = (size_t)size.QuadPart;
+	snapshot->mapping = snapshot->size > 0 ? CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL) : NULL;
+	CloseHandle(file);
+	if (snapshot->mapping == NULL) return 0;
+	snapshot->base = (char*)MapViewOfFile(snapshot->mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (snapshot->base == NULL) {
+		CloseHandle(snapshot->mapping);
+		return 0;
+	}
+	return 1;
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) return 0;
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0) {
+		close(file);
+		return 0;
+	}
+	snapshot->size = (size_t)status.st_size;
+	void* base = mmap(NULL, snapshot->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	close(file);
+	if (base == MAP_FAILED) return 0;
+	snapshot->base = (char*)base;
+	return 1;
+#endif
+}
+
+static void unmap_file(Snapshot* snapshot) {
+#ifdef _WIN32
+	UnmapViewOfFile(snapshot->base);
+	CloseHandle(snapshot->mapping);
+#else
+	munmap(snapshot->base, snapshot->size);
+#endif
+}
+
+// Reads the header and the section table of a freshly mapped snapshot
+static void read_sections(Snapshot* snapshot, const char* path) {
+	SnapshotReader reader = { snapshot, path, 0 };
+	if (read_u32(&reader) != SNAPSHOT_MAGIC) corrupt(&reader);
+	unsigned int version = read_u32(&reader);
+	if (version != SNAPSHOT_VERSION) {
+		script_error("Snapshot %s has version %u, this build reads version %d.", path, version, SNAPSHOT_VERSION);
+	}
+	snapshot->section_count = (int)read_u32(&reader);
+	if (snapshot->section_count < 0) corrupt(&reader);
+	reader.offset = SNAPSHOT_HEADER_SIZE;
+	snapshot->sections = (SnapshotSection*)calloc(snapshot->section_count > 0 ? snapshot->section_count : 1, sizeof(SnapshotSection));
+	if (!snapshot->sections) {
+		printf("Error: Memory allocation failed for snapshot sections.\n");
+		exit(1);
+	}
+	for (int i = 0; i < snapshot->section_count; i++) {
+		read_section(&reader, &snapshot->sections[i]);
+	}
+}
+
+Snapshot* snapshot_open(const char* path) {
+	Snapshot* volatile snapshot = (Snapshot*)calloc(1, sizeof(Snapshot)); // Read again after a trapped error
+	if (!snapshot) {
+		printf("Error: Memory allocation failed for a snapshot.\n");
+		exit(1);
+	}
+	if (!map_file(snapshot, path)) {
+		free(snapshot);
+		return NULL;
+	}
+
+	// A file that doesn't read back mustn't leave its mapping behind: close it, then pass the error on
+	ErrorTrap trap;
+	ErrorTrap* caller_trap = interpreter_trap_errors(&trap);
+	if (setjmp(trap.jump) != 0) {
+		interpreter_trap_errors(caller_trap);
+		snapshot_close(snapshot);
+		script_error("%s", trap.message);
+	}
+	read_sections(snapshot, path);
+	interpreter_trap_errors(caller_trap);
+	return snapshot;
+}
+
+void snapshot_close(Snapshot* snapshot) {
+	if (snapshot == NULL) return;
+	for (int i = 0; snapshot->sections != NULL && i < snapshot->section_count; i++) {
+		SnapshotSection* section = &snapshot->sections[i];
+		for (int j = 0; section->fields != NULL && j < section->field_count; j++) free(section->fields[j].name);
+		free(section->fields);
+		free(section->class_name);
+	}
+	free(snapshot->sections);
+	unmap_file(snapshot);
+	free(snapshot);
+}
+
+int snapshot_section_count(Snapshot* snapshot) {
+	return snapshot->section_count;
+}
+
+const char* snapshot_class_name(Snapshot* snapshot, int section) {
+	return snapshot->sections[section].class_name;
+}
+
+int snapshot_object_count(Snapshot* snapshot, int section) {
+	return snapshot->sections[section].count;
+}
+
+// ---- Restoring ---------------------------------------------------------------
+
+static ClassNode* section_class(Interpreter* interpreter, SnapshotSection* section) {
+	ClassNode* class_node = interpreter_find_class(interpreter, section->class_name);
+	if (class_node == NULL) {
+		printf("Error: Class %s of the snapshot is not loaded.\n", section->class_name);
+		exit(1);
+	}
+	// The newest version, held for the restore (the lookup's version holds it meanwhile)
+	ClassNode* latest = class_latest(class_node);
+	class_retain(latest);
+	class_release(class_node);
+	return latest;
+}
+
+// Section field holding each field of the class (-1 for none); returns 1 when the shapes are identical
+static int match_fields(ClassNode* class_node, SnapshotSection* section, int* sources) {
+	int same = class_node->field_count == section->field_count;
+	for (int i = 0; i < class_node->field_count; i++) {
+		Field* field = class_node->field_table[i];
+		sources[i] = -1;
+		for (int j = 0; j < section->field_count; j++) {
+			if (strcmp(section->fields[j].name, field->name) == 0) {
+				sources[i] = j;
+				break;
+			}
+		}
+		SnapshotField* saved = sources[i] >= 0 ? &section->fields[sources[i]] : NULL;
+		if (sources[i] != i || saved->type != field->value.type || saved->length != field->length) same = 0;
+		// A number can't become an array, map or string or the other way around, nor a container change element type
+		if (saved != NULL && saved->type != field->value.type && (is_array_type(saved->type) || is_map_type(saved->type) || saved->type == VALUE_STRING
+			|| is_array_type(field->value.type) || is_map_type(field->value.type) || field->value.type == VALUE_STRING)) {
+			sources[i] = -1;
+		}
+		// References are saved as null, which is what a restored object starts with
+		if (saved != NULL && (saved->type == VALUE_OBJECT || field->value.type == VALUE_OBJECT)) {
+			sources[i] = -1;
+		}
+	}
+	return same;
+}
+
+static Value column_value(const SnapshotField* field, int index) {
+	Value value;
+	value.type = field->type;
+	memcpy(&value.as, (const int*)field->column + index, sizeof(int));
+	return value;
+}
+
+Object** snapshot_restore_objects(Snapshot* snapshot, Interpreter* interpreter, int* count) {
+	int total = 0;
+	for (int i = 0; i < snapshot->section_count; i++) total += snapshot->sections[i].count;
+	Object** objects = (Object**)malloc(sizeof(Object*) * (total > 0 ? total : 1));
+	if (!objects) {
+		printf("Error: Memory allocation failed for restored objects.\n");
+		exit(1);
+	}
+
+	int restored = 0;
+	for (int s = 0; s < snapshot->section_count; s++) {
+		SnapshotSection* section = &snapshot->sections[s];
+		ClassNode* class_node = section_class(interpreter, section);
+		int field_count = class_node->field_count;
+		int* sources = (int*)malloc(sizeof(int) * (field_count + 1));
+		size_t* next_element = (size_t*)calloc(field_count + 1, sizeof(size_t));  // Read position in every array column
+		if (!sources || !next_element) {
+			printf("Error: Memory allocation failed for a restored section.\n");
+			exit(1);
+		}
+		match_fields(class_node, section, sources);
+		for (int i = 0; i < field_count; i++) next_element[i] = (size_t)section->count;
+
+		Interpreter* previous = interpreter_enter(class_node->context);
+		for (int k = 0; k < section->count; k++) {
+			Object* obj = create_object(class_node);
+			for (int i = 0; i < field_count; i++) {
+				if (sources[i] < 0) continue;
+				const SnapshotField* saved = &section->fields[sources[i]];
+				Field* field = &obj->field_values[i];
+				if (is_map_type(field->value.type)) {
+					// Key and value pairs, whose bits are the map's value type
+					int entries = ((const int*)saved->column)[k];
+					const int* pairs = (const int*)saved->column + next_element[i];
+					next_element[i] += 2 * (size_t)entries;
+					for (int e = 0; e < entries; e++) {
+						memcpy(map_insert(field->value.as.m, pairs[2 * e]), &pairs[2 * e + 1], sizeof(int));
+					}
+					continue;
+				}
+				if (field->value.type == VALUE_STRING) {
+					int length = ((const int*)saved->column)[k];
+					const char* chars = (const char*)((const int*)saved->column + next_element[i]);
+					next_element[i] += string_words(length);
+					field->value = string_from(chars, length);  // The field was empty
+					continue;
+				}
+				if (!is_array_type(field->value.type)) {
+					field->value = value_convert(column_value(saved, k), field->value.type);
+					continue;
+				}
+				int length = ((const int*)saved->column)[k];
+				const int* elements = (const int*)saved->column + next_element[i];
+				next_element[i] += (size_t)length;
+				Array* array = field->value.as.a;
+				if (!array->fixed) array_resize(array, length);
+				if (array->length == length) memcpy(array->data, elements, sizeof(int) * (size_t)length);
+			}
+			objects[restored++] = obj;
+		}
+		interpreter_enter(previous);
+		free(next_element);
+		free(sources);
+		class_release(class_node);  // Every object holds its own reference
+	}
+	*count = restored;
+	return objects;
+}
+
+Batch* snapshot_restore_batch(Snapshot* snapshot, Interpreter* interpreter, int section_index, int in_place) {
+	SnapshotSection* section = &snapshot->sections[section_index];
+	ClassNode* class_node = section_class(interpreter, section);
+	int field_count = class_node->field_count;
+	int* sources = (int*)malloc(sizeof(int) * (field_count + 1));
+	if (!sources) {
+		printf("Error: Memory allocation failed for a restored batch.\n");
+		exit(1);
+	}
+	int same = match_fields(class_node, section, sources);
+
+	Interpreter* previous = interpreter_enter(class_node->context);
+	Batch* batch;
+	if (in_place && same) {
+		// The columns are the mapped file
+		batch = batch_create(class_node, 0);
+		batch->count = section->count;
+		for (int i = 0; i < field_count; i++) {
+			array_free(batch->columns[i]);
+			batch->columns[i] = array_wrap(section->fields[i].type, section->count, (void*)section->fields[i].column);
+		}
+	}
+	else {
+		batch = batch_create(class_node, section->count);
+		for (int i = 0; i < field_count; i++) {
+			if (sources[i] < 0) continue;
+			const SnapshotField* saved = &section->fields[sources[i]];
+			Array* column = batch->columns[i];
+			if (saved->type == column->element_type) {
+				memcpy(column->data, saved->column, sizeof(int) * (size_t)section->count);
+				continue;
+			}
+			for (int k = 0; k < section->count; k++) {
+				Value value = value_convert(column_value(saved, k), column->element_type);
+				memcpy((int*)column->data + k, &value.as, sizeof(int));
+			}
+		}
+	}
+	interpreter_enter(previous);
+	free(sources);
+	class_release(class_node);  // The batch holds its own reference
+	return batch;
+}
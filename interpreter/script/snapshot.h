@@ -0,0 +1,52 @@
+#pragma once
+#include "parse.h"    // Include parse.h for ClassNode and Object
+#include "batch.h"    // Include batch.h for Batch
+#include "context.h"  // Include context.h for Interpreter
+
+// Snapshots: object populations written in one sequential pass and read back
+// through a memory mapping, for checkpointing large simulations.
+//
+// A snapshot holds one section per class: its shape (name, then the name, type
+// and array length of every field) followed by the values of its objects column
+// by column, one contiguous run of 4-byte ints or floats per field, each aligned
+// to ARRAY_ALIGNMENT. An array field stores the length of every object's array,
+// then their elements; a map field the entry count of every object's map, then
+// their keys and values in pairs; a string field the byte length of every object's
+// string, then their bytes, each padded to 4 bytes. The format is versioned; a file
+// of another version is rejected.
+//
+// Restoring looks the classes up by name. When a class still has the shape it was
+// saved with, columns map one to one (a batch column is a single memcpy, or the
+// mapped column itself); otherwise fields are matched by name and converted
+// between int and float, as a reload migrates objects, and the others start at zero.
+// References are not followed: they are saved and restored as null.
+
+#define SNAPSHOT_VERSION 1
+
+typedef struct Snapshot Snapshot;
+
+// Saving (no call may be running on the objects or batches meanwhile)
+// Objects are grouped into one section per class, keeping their order within a class.
+// The file is written as <path>.tmp, synced and renamed over <path>, so a failed save
+// leaves the previous snapshot as it was. Returns 1, or 0 if the file can't be written.
+int snapshot_save_objects(const char* path, Object** objects, int count);
+// One section per batch
+int snapshot_save_batches(const char* path, Batch** batches, int count);
+
+// Loading
+// Map a snapshot (NULL if the file can't be opened; a corrupt file or one of another
+// version is a script error)
+Snapshot* snapshot_open(const char* path);
+// Unmap it; batches restored in place must be freed first
+void snapshot_close(Snapshot* snapshot);
+int snapshot_section_count(Snapshot* snapshot);
+const char* snapshot_class_name(Snapshot* snapshot, int section);
+int snapshot_object_count(Snapshot* snapshot, int section);
+// Every object of the snapshot, created in the classes of the same names registered
+// in the context, section by section. The caller frees the objects and the array.
+Object** snapshot_restore_objects(Snapshot* snapshot, Interpreter* interpreter, int* count);
+// The objects of a section as a batch of its class (which must have scalar fields
+// only). In place, the columns of a section whose shape matches are the mapped file
+// itself (copy-on-write, so the file never changes): nothing is copied, the columns
+// can't be resized and the snapshot must stay open while the batch lives.
+Batch* snapshot_restore_batch(Snapshot* snapshot, Interpreter* interpreter, int section, int in_place);
@@ -0,0 +1,400 @@
+#include "stream.h"
+#include "batch.h"
+#include "array.h"
+#include "pool.h"
+#include "threads.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Batches in flight: one per stage, so reading, execution and writing all overlap
+#define STREAM_BUFFERS 3
+
+typedef struct StreamBuffer {
+	Batch* batch;  // Records of the buffer, batch->count of them
+	int end;       // Last buffer of the stream
+} StreamBuffer;
+
+// Buffers handed from one stage to the next, in order
+typedef struct StreamQueue {
+	Mutex lock;
+	Condition changed;
+	StreamBuffer* items[STREAM_BUFFERS];
+	int head;
+	int count;
+} StreamQueue;
+
+typedef struct Stream {
+	const StreamOptions* options;
+	FILE* input;
+	FILE* output;
+	ClassNode* class_node;
+	int* input_columns;   // Field index of every input value
+	int input_count;
+	int* output_columns;  // Field index of every output value
+	int output_count;
+	StreamQueue empty;     // Written (or new) buffers, for the reader
+	StreamQueue parsed;    // For the executor
+	StreamQueue executed;  // For the writer
+	long long records;
+} Stream;
+
+static void queue_init(StreamQueue* queue) {
+	mutex_init(&queue->lock);
+	condition_init(&queue->changed);
+	queue->head = 0;
+	queue->count = 0;
+}
+
+static void queue_destroy(StreamQueue* queue) {
+	condition_destroy(&queue->changed);
+	mutex_destroy(&queue->lock);
+}
+
+// There are only STREAM_BUFFERS buffers, so a queue never overflows
+static void queue_put(StreamQueue* queue, StreamBuffer* buffer) {
+	mutex_lock(&queue->lock);
+	queue->items[(queue->head + queue->count) % STREAM_BUFFERS] = buffer;
+	queue->count++;
+	condition_signal(&queue->changed);
+	mutex_unlock(&queue->lock);
+}
+
+static StreamBuffer* queue_take(StreamQueue* queue) {
+	mutex_lock(&queue->lock);
+	while (queue->count == 0) {
+		condition_wait(&queue->changed, &queue->lock);
+	}
+	StreamBuffer* buffer = queue->items[queue->head];
+	queue->head = (queue->head + 1) % STREAM_BUFFERS;
+	queue->count--;
+	mutex_unlock(&queue->lock);
+	return buffer;
+}
+
+// Field indexes of a comma-separated list (every field for NULL)
+static int* resolve_fields(ClassNode* class_node, const char* names, int* count) {
+	int capacity = class_node->field_count + 1;
+	if (names != NULL) {
+		for (const char* c = names; *c != '\0'; c++) {
+			if (*c == ',') capacity++;
+		}
+	}
+	int* columns = (int*)malloc(sizeof(int) * capacity);
+	if (!columns) {
+		fprintf(stderr, "Error: Memory allocation failed for stream fields.\n");
+		exit(1);
+	}
+
+	*count = 0;
+	if (names == NULL) {
+		for (int i = 0; i < class_node->field_count; i++) columns[(*count)++] = i;
+		return columns;
+	}
+	const char* start = names;
+	for (;;) {
+		const char* end = strchr(start, ',');
+		size_t length = end != NULL ? (size_t)(end - start) : strlen(start);
+		char name[256];
+		if (length == 0 || length >= sizeof(name)) {
+			fprintf(stderr, "Error: Invalid field list \"%s\".\n", names);
+			exit(1);
+		}
+		memcpy(name, start, length);
+		name[length] = '\0';
+		int index = find_field(class_node, name);
+		if (index < 0) {
+			fprintf(stderr, "Error: Field %s not found in class %s\n", name, class_node->class_name);
+			exit(1);
+		}
+		columns[(*count)++] = index;
+		if (end == NULL) break;
+		start = end + 1;
+	}
+	return columns;
+}
+
+// ---- Reader ------------------------------------------------------------------
+
+typedef struct StreamReader {
+	FILE* file;
+	char* data;       // STREAM_CHUNK bytes, plus one for a closing newline
+	size_t length;
+	size_t position;  // Start of the next record
+	int eof;
+} StreamReader;
+
+// Keep the unread bytes and read more after them; returns 0 at the end of the input
+static int refill(StreamReader* reader) {
+	if (reader->eof) return 0;
+	size_t remaining = reader->length - reader->position;
+	if (remaining == STREAM_CHUNK) {
+		fprintf(stderr, "Error: Stream record longer than %d bytes.\n", STREAM_CHUNK);
+		exit(1);
+	}
+	memmove(reader->data, reader->data + reader->position, remaining);
+	reader->length = remaining;
+	reader->position = 0;
+	size_t received = fread(reader->data + remaining, 1, STREAM_CHUNK - remaining, reader->file);
+	reader->length += received;
+	if (received == 0) {
+		reader->eof = 1;
+		return 0;
+	}
+	return 1;
+}
+
+// Next CSV line, without its newline; NULL at the end of the input
+static char* next_line(StreamReader* reader, char** line_end) {
+	for (;;) {
+		char* start = reader->data + reader->position;
+		char* newline = (char*)memchr(start, '\n', reader->length - reader->position);
+		if (newline != NULL) {
+			reader->position = (size_t)(newline - reader->data) + 1;
+			*line_end = newline;
+			return start;
+		}
+		if (!refill(reader)) {
+			if (reader->position == reader->length) return NULL;
+			// A last line without a newline gets one
+			start = reader->data + reader->position;
+			reader->data[reader->length] = '\n';
+			*line_end = reader->data + reader->length;
+			reader->position = reader->length;
+			return start;
+		}
+	}
+}
+
+static void parse_csv_record(Stream* stream, Batch* batch, int record, char* line, char* line_end) {
+	char* cursor = line;
+	for (int i = 0; i < stream->input_count; i++) {
+		if (cursor > line_end) cursor = line_end;  // The line ran out of values
+		while (cursor < line_end && *cursor == ' ') cursor++;
+		Array* column = batch->columns[stream->input_columns[i]];
+		char* value_end = cursor;
+		if (cursor < line_end && *cursor != ',' && *cursor != '\r') {
+			if (column->element_type == VALUE_INT) {
+				long number = strtol(cursor, &value_end, 10);
+				if (*value_end == '.' || *value_end == 'e' || *value_end == 'E') {
+					number = (long)strtof(cursor, &value_end);  // A float in an int column is truncated
+				}
+				((int*)column->data)[record] = (int)number;
+			}
+			else {
+				((float*)column->data)[record] = strtof(cursor, &value_end);
+			}
+		}
+		while (value_end < line_end && (*value_end == ' ' || *value_end == '\r')) value_end++;
+		if (value_end == cursor || (value_end < line_end && *value_end != ',')) {
+			fprintf(stderr, "Error: Invalid value for field %s in record %lld.\n", stream->class_node->field_table[stream->input_columns[i]]->name, stream->records + record + 1);
+			exit(1);
+		}
+		cursor = value_end + 1;  // Columns after the last input value are ignored
+	}
+}
+
+// Fill the batch with up to STREAM_RECORDS records; returns 0 once the input is exhausted
+static int read_batch(Stream* stream, StreamReader* reader, Batch* batch) {
+	int count = 0;
+	if (stream->options->format == STREAM_CSV) {
+		while (count < STREAM_RECORDS) {
+			char* line_end;
+			char* line = next_line(reader, &line_end);
+			if (line == NULL) break;
+			if (line == line_end || (line + 1 == line_end && *line == '\r')) continue;  // Blank line
+			parse_csv_record(stream, batch, count++, line, line_end);
+		}
+	}
+	else {
+		size_t record_size = sizeof(int) * stream->input_count;
+		while (count < STREAM_RECORDS) {
+			if (reader->length - reader->position < record_size && !refill(reader)) {
+				if (reader->position < reader->length) {
+					fprintf(stderr, "Error: Truncated binary record %lld.\n", stream->records + count + 1);
+					exit(1);
+				}
+				break;
+			}
+			if (reader->length - reader->position < record_size) continue;
+			const char* record = reader->data + reader->position;
+			for (int i = 0; i < stream->input_count; i++) {
+				memcpy((char*)batch->columns[stream->input_columns[i]]->data + sizeof(int) * count, record + sizeof(int) * i, sizeof(int));
+			}
+			reader->position += record_size;
+			count++;
+		}
+	}
+	batch->count = count;
+	stream->records += count;
+	return count == STREAM_RECORDS;
+}
+
+static void read_records(void* argument) {
+	Stream* stream = (Stream*)argument;
+	StreamReader reader = { stream->input, (char*)malloc(STREAM_CHUNK + 1), 0, 0, 0 };
+	char* is_input = (char*)calloc(stream->class_node->field_count + 1, 1);
+	if (!reader.data || !is_input) {
+		fprintf(stderr, "Error: Memory allocation failed for the stream reader.\n");
+		exit(1);
+	}
+	for (int i = 0; i < stream->input_count; i++) is_input[stream->input_columns[i]] = 1;
+	if (stream->options->header && stream->options->format == STREAM_CSV) {
+		char* line_end;
+		next_line(&reader, &line_end);
+	}
+
+	for (;;) {
+		StreamBuffer* buffer = queue_take(&stream->empty);
+		Batch* batch = buffer->batch;
+		// The other fields start at zero in every record
+		for (int i = 0; i < stream->class_node->field_count; i++) {
+			if (!is_input[i]) memset(batch->columns[i]->data, 0, sizeof(int) * STREAM_RECORDS);
+		}
+		buffer->end = !read_batch(stream, &reader, batch);
+		queue_put(&stream->parsed, buffer);
+		if (buffer->end) break;
+	}
+	free(is_input);
+	free(reader.data);
+}
+
+// ---- Writer ------------------------------------------------------------------
+
+// Decimal digits of an int, returns the length
+static int format_int(char* text, int value) {
+	char digits[12];
+	unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+	int length = 0;
+	if (value < 0) text[length++] = '-';
+	while (count > 0) text[length++] = digits[--count];
+	return length;
+}
+
+static void write_bytes(FILE* output, const char* data, size_t length) {
+	if (length > 0 && fwrite(data, 1, length, output) != length) {
+		fprintf(stderr, "Error: Failed to write stream output.\n");
+		exit(1);
+	}
+}
+
+static void write_records(void* argument) {
+	Stream* stream = (Stream*)argument;
+	// Every value takes at most 32 bytes, so a record is flushed before it could overflow
+	size_t limit = STREAM_CHUNK - 32 * (size_t)(stream->output_count + 1);
+	char* data = (char*)malloc(STREAM_CHUNK + 32 * (size_t)(stream->output_count + 1));
+	if (!data) {
+		fprintf(stderr, "Error: Memory allocation failed for the stream writer.\n");
+		exit(1);
+	}
+	size_t length = 0;
+	int csv = stream->options->format == STREAM_CSV;
+
+	if (stream->options->header && csv) {
+		for (int i = 0; i < stream->output_count; i++) {
+			const char* name = stream->class_node->field_table[stream->output_columns[i]]->name;
+			if (i > 0) write_bytes(stream->output, ",", 1);
+			write_bytes(stream->output, name, strlen(name));
+		}
+		write_bytes(stream->output, "\n", 1);
+	}
+
+	for (;;) {
+		StreamBuffer* buffer = queue_take(&stream->executed);
+		Batch* batch = buffer->batch;
+		for (int record = 0; record < batch->count; record++) {
+			for (int i = 0; i < stream->output_count; i++) {
+				Array* column = batch->columns[stream->output_columns[i]];
+				if (!csv) {
+					memcpy(data + length, (char*)column->data + sizeof(int) * record, sizeof(int));
+					length += sizeof(int);
+					continue;
+				}
+				if (i > 0) data[length++] = ',';
+				if (column->element_type == VALUE_INT) {
+					length += format_int(data + length, ((int*)column->data)[record]);
+				}
+				else {
+					// Enough digits to read the float back exactly
+					length += snprintf(data + length, 32, "%.9g", ((float*)column->data)[record]);
+				}
+			}
+			if (csv) data[length++] = '\n';
+			if (length >= limit) {
+				write_bytes(stream->output, data, length);
+				length = 0;
+			}
+		}
+		int end = buffer->end;
+		queue_put(&stream->empty, buffer);
+		if (end) break;
+	}
+	write_bytes(stream->output, data, length);
+	fflush(stream->output);
+	free(data);
+}
+
+// ---- Pipeline ----------------------------------------------------------------
+
+long long stream_records(ClassNode* class_node, const char* method_name, FILE* input, FILE* output, const StreamOptions* options) {
+	Method* method = find_method(class_node, method_name);
+	if (method == NULL) {
+		fprintf(stderr, "Error: Method %s not found in class %s\n", method_name, class_node->class_name);
+		exit(1);
+	}
+	if (method->parameter_count != 0) {
+		fprintf(stderr, "Error: Method %s takes parameters, a stream can only run methods without any.\n", method_name);
+		exit(1);
+	}
+
+	Stream stream;
+	stream.options = options;
+	stream.input = input;
+	stream.output = output;
+	stream.class_node = class_node;
+	stream.input_columns = resolve_fields(class_node, options->input_fields, &stream.input_count);
+	stream.output_columns = resolve_fields(class_node, options->output_fields, &stream.output_count);
+	stream.records = 0;
+	queue_init(&stream.empty);
+	queue_init(&stream.parsed);
+	queue_init(&stream.executed);
+
+	StreamBuffer buffers[STREAM_BUFFERS];
+	for (int i = 0; i < STREAM_BUFFERS; i++) {
+		buffers[i].batch = batch_create(class_node, STREAM_RECORDS);
+		buffers[i].end = 0;
+		queue_put(&stream.empty, &buffers[i]);
+	}
+
+	// The reader and the writer get threads of their own; batches execute on this one
+	ThreadPool* pool = pool_create(2);
+	Future* reader = pool_submit(pool, read_records, &stream);
+	Future* writer = pool_submit(pool, write_records, &stream);
+	for (;;) {
+		StreamBuffer* buffer = queue_take(&stream.parsed);
+		if (buffer->batch->count > 0) {
+			batch_call(buffer->batch, method_name, NULL, 0, NULL);
+		}
+		int end = buffer->end;
+		queue_put(&stream.executed, buffer);
+		if (end) break;
+	}
+	future_free(reader);
+	future_free(writer);
+	pool_destroy(pool);
+
+	for (int i = 0; i < STREAM_BUFFERS; i++) {
+		buffers[i].batch->count = STREAM_RECORDS;
+		batch_free(buffers[i].batch);
+	}
+	queue_destroy(&stream.empty);
+	queue_destroy(&stream.parsed);
+	queue_destroy(&stream.executed);
+	free(stream.input_columns);
+	free(stream.output_columns);
+	return stream.records;
+}
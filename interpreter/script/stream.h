@@ -0,0 +1,31 @@
+#pragma once
+#include "parse.h"  // Include parse.h for ClassNode
+#include <stdio.h>
+
+// Records per batch: the input is parsed, executed and written this many records at a time
+#define STREAM_RECORDS 16384
+// Bytes read or written per I/O call
+#define STREAM_CHUNK (1 << 20)
+
+// Record formats, the same for the input and the output
+typedef enum {
+	STREAM_CSV,     // One record per line, values separated by commas
+	STREAM_BINARY,  // Fixed-width records: one native 4-byte int or float per field, in the listed order
+} StreamFormat;
+
+typedef struct StreamOptions {
+	StreamFormat format;
+	const char* input_fields;   // Comma-separated fields the input values bind to, in order (NULL: every field)
+	const char* output_fields;  // Comma-separated fields written per record, in order (NULL: every field)
+	int header;                 // CSV only: skip the input's first line and start the output with the field names
+} StreamOptions;
+
+// Run a method (without parameters) once per input record, for transforming record
+// streams without host code. Every record is an instance of the class whose input
+// fields hold the record's values and whose other fields start at zero; the output
+// fields are written once the method returns. Records run column-wise through
+// batch_call (see batch.h), so the class may only have scalar fields.
+// A reader thread reads and parses batches while the calling thread executes the
+// previous one and a writer thread formats and writes the one before that.
+// Malformed input is reported as an error. Returns the number of records.
+long long stream_records(ClassNode* class_node, const char* method_name, FILE* input, FILE* output, const StreamOptions* options);
@@ -0,0 +1,127 @@
+#include "table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void name_table_init(NameTable* table, MemoryCategory category) {
+	table->entries = NULL;
+	table->capacity = 0;
+	table->count = 0;
+	table->used = 0;
+	table->category = category;
+}
+
+// FNV-1a
+static unsigned int hash_span(const char* text, size_t length) {
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+unsigned int hash_name(const char* name) {
+	return hash_span(name, strlen(name));
+}
+
+// Entry holding the name text[0..length), or NULL. Interned names are found by
+// pointer; other strings are compared character by character.
+static NameEntry* find_entry(const NameTable* table, const char* text, size_t length, unsigned int hash) {
+	if (table->capacity == 0) return NULL;
+	int mask = table->capacity - 1;
+	for (int i = (int)(hash & (unsigned int)mask);; i = (i + 1) & mask) {
+		NameEntry* entry = &table->entries[i];
+		if (entry->name == NULL) return NULL;
+		if (entry->value < 0 || entry->hash != hash) continue;
+		if (entry->name == text || (strncmp(entry->name, text, length) == 0 && entry->name[length] == '\0')) return entry;
+	}
+}
+
+// Rehash the live entries into a table of `capacity` entries (drops removed ones)
+static void resize_table(NameTable* table, int capacity) {
+	NameEntry* old_entries = table->entries;
+	int old_capacity = table->capacity;
+	table->entries = (NameEntry*)memory_calloc(table->category, (size_t)capacity, sizeof(NameEntry));
+	table->capacity = capacity;
+	table->used = table->count;
+
+	int mask = capacity - 1;
+	for (int i = 0; i < old_capacity; i++) {
+		NameEntry* old = &old_entries[i];
+		if (old->name == NULL || old->value < 0) continue;
+		int j = (int)(old->hash & (unsigned int)mask);
+		while (table->entries[j].name != NULL) j = (j + 1) & mask;
+		table->entries[j] = *old;
+	}
+	memory_free(old_entries);
+}
+
+int name_table_find(const NameTable* table, const char* name) {
+	size_t length = strlen(name);
+	NameEntry* entry = find_entry(table, name, length, hash_span(name, length));
+	return entry != NULL ? entry->value : -1;
+}
+
+// Add an entry for a name known to be missing
+static void add_entry(NameTable* table, const char* name, unsigned int hash, int value) {
+	// Keep at most half of the entries in use so probe sequences stay short
+	if ((table->used + 1) * 2 > table->capacity) {
+		int capacity = table->capacity ? table->capacity : 8;
+		while ((table->count + 1) * 2 > capacity) capacity *= 2;
+		resize_table(table, capacity);
+	}
+	int mask = table->capacity - 1;
+	int i = (int)(hash & (unsigned int)mask);
+	while (table->entries[i].name != NULL && table->entries[i].value >= 0) i = (i + 1) & mask;
+	if (table->entries[i].name == NULL) table->used++;
+	table->entries[i].name = name;
+	table->entries[i].hash = hash;
+	table->entries[i].value = value;
+	table->count++;
+}
+
+int name_table_insert(NameTable* table, const char* name, int value) {
+	size_t length = strlen(name);
+	unsigned int hash = hash_span(name, length);
+	if (find_entry(table, name, length, hash) != NULL) return 0;
+	add_entry(table, name, hash, value);
+	return 1;
+}
+
+const char* name_table_intern(NameTable* table, const char* text, size_t length) {
+	unsigned int hash = hash_span(text, length);
+	NameEntry* entry = find_entry(table, text, length, hash);
+	if (entry != NULL) return entry->name;
+
+	char* name = (char*)memory_alloc(table->category, length + 1);
+	memcpy(name, text, length);
+	name[length] = '\0';
+	add_entry(table, name, hash, table->count);
+	return name;
+}
+
+void name_table_update(NameTable* table, const char* name, int value) {
+	NameEntry* entry = find_entry(table, name, strlen(name), hash_name(name));
+	if (entry == NULL) {
+		printf("Error: %s is not in the table.\n", name);
+		exit(1);
+	}
+	entry->value = value;
+}
+
+int name_table_remove(NameTable* table, const char* name) {
+	NameEntry* entry = find_entry(table, name, strlen(name), hash_name(name));
+	if (entry == NULL) return 0;
+	entry->value = -1;
+	table->count--;
+	return 1;
+}
+
+void name_table_free(NameTable* table) {
+	memory_free(table->entries);
+	table->entries = NULL;
+	table->capacity = 0;
+	table->count = 0;
+	table->used = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "context.h"  // Include context.h for MemoryCategory
+
+// Open-addressing hash table from names to non-negative integers (an index into
+// some array). Names are borrowed: they must outlive their entries.
+typedef struct NameEntry {
+	const char* name;   // NULL for a free entry
+	unsigned int hash;
+	int value;          // -1 marks a removed entry (probing continues past it)
+} NameEntry;
+
+typedef struct NameTable {
+	NameEntry* entries;
+	int capacity;       // Power of two, or 0 before the first insertion
+	int count;          // Live entries
+	int used;           // Live and removed entries
+	MemoryCategory category;
+} NameTable;
+
+// Name table functions
+void name_table_init(NameTable* table, MemoryCategory category);
+// Value of the name, -1 if it isn't in the table
+int name_table_find(const NameTable* table, const char* name);
+// Add the name; returns 0 (and changes nothing) if it is already there
+int name_table_insert(NameTable* table, const char* name, int value);
+// Change the value of a name already in the table
+void name_table_update(NameTable* table, const char* name, int value);
+// Returns 0 if the name wasn't in the table
+int name_table_remove(NameTable* table, const char* name);
+// The table's copy of text[0..length), made on first use (its value is the order of
+// first use). Equal names get the same pointer; the copies are never removed.
+const char* name_table_intern(NameTable* table, const char* text, size_t length);
+void name_table_free(NameTable* table);
+unsigned int hash_name(const char* name);
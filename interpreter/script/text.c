@@ -0,0 +1,211 @@
+#include "text.h"
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+static Value make_string(String* string) {
+	Value value;
+	value.type = VALUE_STRING;
+	value.as.s = string;
+	return value;
+}
+
+static Value make_small(const char* text, int length) {
+	Value value;
+	value.type = VALUE_STRING;
+	memset(value.as.small, 0, sizeof(value.as.small));
+	value.as.small[0] = (char)((length << 1) | 1);
+	memcpy(value.as.small + 1, text, (size_t)length);
+	return value;
+}
+
+// A String with a buffer of `capacity` bytes, held by the caller
+static String* allocate_string(int capacity) {
+	String* string = (String*)memory_alloc(MEMORY_STRINGS, sizeof(String) + (size_t)capacity);
+	if (!string) {
+		printf("Error: Memory allocation failed for string.\n");
+		exit(1);
+	}
+	string->references = 1;
+	string->permanent = 0;
+	string->length = 0;
+	string->capacity = capacity;
+	string->chars = (const char*)(string + 1);
+	string->base = NULL;
+	return string;
+}
+
+void string_free(String* string) {
+	if (string->base != NULL) {
+		string_release(make_string(string->base));
+	}
+	memory_free(string);
+}
+
+Value string_from(const char* text, int length) {
+	if (length <= 0) return make_empty_string();
+	if (length <= STRING_SMALL_MAX) return make_small(text, length);
+	String* string = allocate_string(length);
+	memcpy((char*)string->chars, text, (size_t)length);
+	string->length = length;
+	return make_string(string);
+}
+
+Value string_literal(const char* text) {
+	size_t length = strlen(text);
+	if (length <= STRING_SMALL_MAX) return make_small(text, (int)length);
+	return make_string(intern_string(text, length));
+}
+
+Value string_concat(Value left, Value right) {
+	int left_length;
+	int right_length;
+	const char* left_chars = string_chars(&left, &left_length);
+	const char* right_chars = string_chars(&right, &right_length);
+	if (right_length == 0) return left;
+	if (left_length == 0) {
+		string_retain(right);
+		return right;
+	}
+
+	int length = left_length + right_length;
+	if (length < left_length) {
+		script_error("String too long.");
+	}
+	if (length <= STRING_SMALL_MAX) {
+		char text[STRING_SMALL_MAX];
+		memcpy(text, left_chars, (size_t)left_length);
+		memcpy(text + left_length, right_chars, (size_t)right_length);
+		return make_small(text, length);
+	}
+
+	// Nobody else holds the left buffer: append in place. A string holding a reference
+	// to it (a slice of it, or the right side itself) would have raised the count.
+	String* string = string_block(left);
+	if (string != NULL && !string->permanent && string->chars == (const char*)(string + 1) && atomic_read(&string->references) == 1) {
+		if (length > string->capacity) {
+			int capacity = string->capacity * 2 > length ? string->capacity * 2 : length;
+			string = (String*)memory_realloc(MEMORY_STRINGS, string, sizeof(String) + (size_t)capacity);
+			if (!string) {
+				printf("Error: Memory allocation failed for string.\n");
+				exit(1);
+			}
+			string->chars = (const char*)(string + 1);
+			string->capacity = capacity;
+		}
+		memcpy((char*)string->chars + left_length, right_chars, (size_t)right_length);
+		string->length = length;
+		return make_string(string);
+	}
+
+	String* result = allocate_string(length);
+	memcpy((char*)result->chars, left_chars, (size_t)left_length);
+	memcpy((char*)result->chars + left_length, right_chars, (size_t)right_length);
+	result->length = length;
+	string_release(left);
+	return make_string(result);
+}
+
+Value string_substring(Value string, int start, int length) {
+	int string_length;
+	const char* chars = string_chars(&string, &string_length);
+	if (start < 0) start = 0;
+	if (start > string_length) start = string_length;
+	if (length > string_length - start) length = string_length - start;
+	if (length <= STRING_SMALL_MAX) return string_from(chars + start, length);
+	if (length == string_length) {
+		string_retain(string);
+		return string;
+	}
+
+	// A slice of a long string shares the bytes of the string that owns them
+	String* source = string_block(string);
+	String* slice = allocate_string(0);
+	slice->chars = chars + start;
+	slice->length = length;
+	if (!source->permanent) {
+		slice->base = source->base != NULL ? source->base : source;
+		string_retain(make_string(slice->base));
+	}
+	return make_string(slice);
+}
+
+// Copy with every byte mapped, or the string itself when no byte changes
+static Value map_bytes(Value string, int (*map)(int)) {
+	int length;
+	const char* chars = string_chars(&string, &length);
+	int first = 0;
+	while (first < length && map((unsigned char)chars[first]) == (unsigned char)chars[first]) first++;
+	if (first == length) {
+		string_retain(string);
+		return string;
+	}
+
+	char small[STRING_SMALL_MAX];
+	String* result = NULL;
+	char* out = small;
+	if (length > STRING_SMALL_MAX) {
+		result = allocate_string(length);
+		result->length = length;
+		out = (char*)result->chars;
+	}
+	memcpy(out, chars, (size_t)first);
+	for (int i = first; i < length; i++) {
+		out[i] = (char)map((unsigned char)chars[i]);
+	}
+	return result != NULL ? make_string(result) : make_small(small, length);
+}
+
+static int ascii_lower(int c) {
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static int ascii_upper(int c) {
+	return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+Value string_lower(Value string) {
+	return map_bytes(string, ascii_lower);
+}
+
+Value string_upper(Value string) {
+	return map_bytes(string, ascii_upper);
+}
+
+int string_equal(Value left, Value right) {
+	String* left_string = string_block(left);
+	if (left_string != NULL && left_string == string_block(right)) return 1;  // Shared, e.g. the same literal
+	int left_length;
+	int right_length;
+	const char* left_chars = string_chars(&left, &left_length);
+	const char* right_chars = string_chars(&right, &right_length);
+	return left_length == right_length && memcmp(left_chars, right_chars, (size_t)left_length) == 0;
+}
+
+int string_compare(Value left, Value right) {
+	int left_length;
+	int right_length;
+	const char* left_chars = string_chars(&left, &left_length);
+	const char* right_chars = string_chars(&right, &right_length);
+	int order = memcmp(left_chars, right_chars, (size_t)(left_length < right_length ? left_length : right_length));
+	if (order == 0) order = left_length - right_length;
+	return order < 0 ? -1 : order > 0;
+}
+
+int string_find(Value string, Value pattern) {
+	int length;
+	int pattern_length;
+	const char* chars = string_chars(&string, &length);
+	const char* pattern_chars = string_chars(&pattern, &pattern_length);
+	if (pattern_length == 0) return 0;
+	for (int i = 0; i + pattern_length <= length; i++) {
+		// memchr skips to the next candidate first byte
+		const char* candidate = (const char*)memchr(chars + i, pattern_chars[0], (size_t)(length - pattern_length - i + 1));
+		if (candidate == NULL) return -1;
+		i = (int)(candidate - chars);
+		if (memcmp(candidate, pattern_chars, (size_t)pattern_length) == 0) return i;
+	}
+	return -1;
+}
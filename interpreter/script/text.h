@@ -0,0 +1,95 @@
+#pragma once
+#include "value.h"    // Include value.h for Value
+#include "threads.h"  // Include threads.h for the reference counts
+
+// Strings of scripts: immutable byte strings, compared bytewise. `s + t` concatenates
+// and ==, !=, <, <=, > and >= compare; len(s), compare(s, t), concat(s, t),
+// substring(s, start, length), find(s, t), lower(s) and upper(s) are builtins.
+//
+// A string of at most STRING_SMALL_MAX bytes is stored in its Value: the first byte
+// of the payload holds (length << 1) | 1, which the first byte of a pointer never does
+// (Strings are aligned and the targets are little-endian), and the bytes follow. Short
+// strings, the usual tags and keys, cost no allocation at all.
+//
+// A longer string is a String shared by reference counting: a field, frame slot or
+// host copy holding it owns one reference, and storing over it or leaving the frame
+// releases it. Literals are interned: every literal of a context with the same text
+// is one permanent String over the context's copy of the text (see intern_string),
+// never counted nor freed. substring() of a long string is a slice sharing its bytes.
+//
+// Concatenation copies both sides into a new buffer, but appends in place when the
+// left side is a buffer nobody else holds, doubling it when it is full. Chains like
+// `a + b + c` so extend one buffer instead of copying the prefix at every step, and
+// check_class marks `s = s + t` to take s out of its variable before appending, so
+// building a string in a loop is linear rather than quadratic.
+
+#define STRING_SMALL_MAX 7  // Bytes of the payload after the tag byte
+
+typedef struct String {
+	volatile long references;  // Holders of the string (unused for a permanent one)
+	int permanent;             // Interned literal, freed with its context
+	int length;
+	int capacity;              // Bytes of the buffer after the header, 0 for a literal or a slice
+	const char* chars;         // The buffer, the context's copy of a literal, or bytes of `base`
+	struct String* base;       // String a slice shares the bytes of (it holds a reference), NULL otherwise
+} String;
+
+VALUE_INLINE int string_is_small(const Value* value) {
+	return value->as.small[0] & 1;
+}
+
+// The String holding a value's bytes, NULL for a short or empty string
+VALUE_INLINE String* string_block(Value value) {
+	return string_is_small(&value) ? NULL : value.as.s;
+}
+
+VALUE_INLINE const char* string_chars(const Value* value, int* length) {
+	if (string_is_small(value)) {
+		*length = (unsigned char)value->as.small[0] >> 1;
+		return value->as.small + 1;
+	}
+	if (value->as.s == NULL) {
+		*length = 0;
+		return "";
+	}
+	*length = value->as.s->length;
+	return value->as.s->chars;
+}
+
+VALUE_INLINE int string_length(Value value) {
+	int length;
+	string_chars(&value, &length);
+	return length;
+}
+
+void string_free(String* string);
+
+// Take a reference for a new holder of the value (nothing to do for a value of another type)
+VALUE_INLINE void string_retain(Value value) {
+	if (value.type != VALUE_STRING) return;
+	String* string = string_block(value);
+	if (string != NULL && !string->permanent) atomic_increment(&string->references);
+}
+
+// Drop a holder's reference
+VALUE_INLINE void string_release(Value value) {
+	if (value.type != VALUE_STRING) return;
+	String* string = string_block(value);
+	if (string != NULL && !string->permanent && atomic_decrement(&string->references) == 0) string_free(string);
+}
+
+// String functions: the results are new references the caller owns
+// Copy of text[0..length), allocated in the current context when it is long
+Value string_from(const char* text, int length);
+// The string of an interned literal (see intern_string)
+Value string_literal(const char* text);
+// Consumes the caller's reference to `left`, which it may extend in place; `right` is only read
+Value string_concat(Value left, Value right);
+Value string_substring(Value string, int start, int length);
+Value string_lower(Value string);
+Value string_upper(Value string);
+
+// Reading
+int string_equal(Value left, Value right);
+int string_compare(Value left, Value right);  // -1, 0 or 1
+int string_find(Value string, Value pattern);  // -1 if the pattern isn't there
@@ -0,0 +1,82 @@
+#pragma once
+
+// Locks, condition variables and atomics over Win32 or pthreads, shared by the
+// worker pool, the interpreter contexts and class reloading
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef SRWLOCK Mutex;
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+typedef CONDITION_VARIABLE Condition;
+
+static inline void mutex_init(Mutex* mutex) { InitializeSRWLock(mutex); }
+static inline void mutex_destroy(Mutex* mutex) { (void)mutex; }
+static inline void mutex_lock(Mutex* mutex) { AcquireSRWLockExclusive(mutex); }
+static inline void mutex_unlock(Mutex* mutex) { ReleaseSRWLockExclusive(mutex); }
+static inline void condition_init(Condition* condition) { InitializeConditionVariable(condition); }
+static inline void condition_destroy(Condition* condition) { (void)condition; }
+static inline void condition_wait(Condition* condition, Mutex* mutex) { SleepConditionVariableSRW(condition, mutex, INFINITE, 0); }
+static inline void condition_broadcast(Condition* condition) { WakeAllConditionVariable(condition); }
+static inline void condition_signal(Condition* condition) { WakeConditionVariable(condition); }
+static inline void thread_yield() { SwitchToThread(); }
+
+// Sequentially consistent; increment, decrement and add return the new value, compare_swap the previous one
+static inline long atomic_increment(volatile long* target) { return InterlockedIncrement(target); }
+static inline long atomic_decrement(volatile long* target) { return InterlockedDecrement(target); }
+static inline long atomic_add(volatile long* target, long amount) { return InterlockedExchangeAdd(target, amount) + amount; }
+static inline long atomic_compare_swap(volatile long* target, long expected, long desired) { return InterlockedCompareExchange(target, desired, expected); }
+static inline long atomic_read(volatile long* target) { return InterlockedCompareExchange(target, 0, 0); }
+static inline void atomic_write(volatile long* target, long value) { InterlockedExchange(target, value); }
+static inline void* atomic_read_pointer(void* volatile* target) { return InterlockedCompareExchangePointer(target, NULL, NULL); }
+static inline void atomic_write_pointer(void* volatile* target, void* value) { InterlockedExchangePointer(target, value); }
+// Orders the plain loads and stores before it against those after it
+static inline void atomic_fence() { MemoryBarrier(); }
+
+static inline int core_count() {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t Mutex;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+typedef pthread_cond_t Condition;
+
+static inline void mutex_init(Mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+static inline void mutex_destroy(Mutex* mutex) { pthread_mutex_destroy(mutex); }
+static inline void mutex_lock(Mutex* mutex) { pthread_mutex_lock(mutex); }
+static inline void mutex_unlock(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+static inline void condition_init(Condition* condition) { pthread_cond_init(condition, NULL); }
+static inline void condition_destroy(Condition* condition) { pthread_cond_destroy(condition); }
+static inline void condition_wait(Condition* condition, Mutex* mutex) { pthread_cond_wait(condition, mutex); }
+static inline void condition_broadcast(Condition* condition) { pthread_cond_broadcast(condition); }
+static inline void condition_signal(Condition* condition) { pthread_cond_signal(condition); }
+static inline void thread_yield() { sched_yield(); }
+
+// Sequentially consistent; increment, decrement and add return the new value, compare_swap the previous one
+static inline long atomic_increment(volatile long* target) { return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST); }
+static inline long atomic_decrement(volatile long* target) { return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST); }
+static inline long atomic_add(volatile long* target, long amount) { return __atomic_add_fetch(target, amount, __ATOMIC_SEQ_CST); }
+static inline long atomic_compare_swap(volatile long* target, long expected, long desired) {
+	__atomic_compare_exchange_n(target, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return expected;
+}
+static inline long atomic_read(volatile long* target) { return __atomic_load_n(target, __ATOMIC_SEQ_CST); }
+static inline void atomic_write(volatile long* target, long value) { __atomic_store_n(target, value, __ATOMIC_SEQ_CST); }
+static inline void* atomic_read_pointer(void* volatile* target) { return __atomic_load_n(target, __ATOMIC_SEQ_CST); }
+static inline void atomic_write_pointer(void* volatile* target, void* value) { __atomic_store_n(target, value, __ATOMIC_SEQ_CST); }
+// Orders the plain loads and stores before it against those after it
+static inline void atomic_fence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+static inline int core_count() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+#endif
@@ -0,0 +1,577 @@
+#include "typecheck.h"
+#include "parse.h"
+#include "context.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+typedef struct TypeChecker {
+	ClassNode* class_node;
+	Method* method;    // Method being checked, for the types of its frame slots
+	int error_count;
+} TypeChecker;
+
+static void type_error(TypeChecker* checker, const char* format, ...) {
+	char message[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	if (checker->method != NULL) {
+		script_report("%s in method %s", message, checker->method->name);
+	}
+	else {
+		script_report("%s", message);
+	}
+	checker->error_count++;
+}
+
+static ExpressionNode* new_typed_node(ExpressionKind kind, ValueType type) {
+	ExpressionNode* node = ast_new_expression(kind);
+	node->value = value_zero(type);
+	node->type = type;
+	node->slot = -1;
+	node->field = -1;
+	return node;
+}
+
+// Wrap an expression in a conversion when its type differs from `type`
+static ExpressionNode* convert_to(ExpressionNode* expr, ValueType type) {
+	if (expr == NULL || expr->type == type) return expr;
+
+	ExpressionNode* convert = new_typed_node(EXPR_CONVERT, type);
+	convert->left = ast_index(expr);
+	return convert;
+}
+
+// int, float, string, an array of int or float (int[], float[16]), a map to either
+// (int[int]) or a reference to a class of the context
+static int is_known_type(TypeChecker* checker, const char* type_name) {
+	if (strcmp(type_name, "string") == 0) return 1;
+	const char* bracket = strchr(type_name, '[');
+	size_t base_length = bracket ? (size_t)(bracket - type_name) : strlen(type_name);
+	if ((base_length == 3 && strncmp(type_name, "int", 3) == 0) || (base_length == 5 && strncmp(type_name, "float", 5) == 0)) return 1;
+	return bracket == NULL && reference_class(checker->class_node, type_name) != NULL;
+}
+
+// Class of a reference-typed field, parameter or result (NULL for the other types)
+static ClassNode* class_of_type(TypeChecker* checker, ValueType type, const char* type_name) {
+	return type == VALUE_OBJECT ? reference_class(checker->class_node, type_name) : NULL;
+}
+
+static ValueType variable_type(TypeChecker* checker, const char* name, int slot) {
+	if (slot >= 0) {
+		return checker->method->local_types[slot];
+	}
+	int field = find_field(checker->class_node, name);
+	return field >= 0 ? checker->class_node->field_table[field]->value.type : VALUE_INT;  // resolve_class has already rejected unknown names
+}
+
+// Class of a reference variable: locals get theirs from resolve_class, fields from their type
+static ClassNode* variable_class(TypeChecker* checker, ExpressionNode* variable) {
+	if (variable->slot >= 0) return variable->class_type;
+	int field = find_field(checker->class_node, variable->variable);
+	if (field < 0) return NULL;
+	Field* declared = checker->class_node->field_table[field];
+	return class_of_type(checker, declared->value.type, declared->type);
+}
+
+static void check_value(TypeChecker* checker, ExpressionNode* expr);
+static void check_scalar(TypeChecker* checker, ExpressionNode* expr);
+
+// Check a value stored into a variable, field, parameter or result of `type` and convert
+// it. A reference takes null or an object of `class_type` or of a class derived from it.
+static ExpressionNode* check_stored(TypeChecker* checker, ExpressionNode* expr, ValueType type, ClassNode* class_type, const char* target) {
+	if (type == VALUE_STRING) {
+		// Strings and numbers never convert into each other
+		check_value(checker, expr);
+		if (expr->type != VALUE_STRING) {
+			type_error(checker, "%s expects a string but got %s", target, value_type_name(expr->type));
+		}
+		return expr;
+	}
+	if (type != VALUE_OBJECT) {
+		check_scalar(checker, expr);
+		return convert_to(expr, type);
+	}
+	check_value(checker, expr);
+	if (expr->type != VALUE_OBJECT) {
+		type_error(checker, "%s expects an object of class %s but got %s", target, class_type->class_name, value_type_name(expr->type));
+	}
+	else if (expr->class_type != NULL && expr->class_type != class_type && !class_derives_from(expr->class_type, class_type)) {
+		type_error(checker, "%s expects an object of class %s but got one of class %s", target, class_type->class_name, expr->class_type->class_name);
+	}
+	return expr;
+}
+
+// Arguments of a call: arrays must match exactly, references by class, numbers are converted
+static void check_arguments(TypeChecker* checker, ExpressionNode* expr, Method* callee) {
+	ParameterNode* param = callee->parameters;
+	for (int i = 0; i < expr->argument_count; i++, param = param->next) {
+		ValueType parameter_type = callee->local_types[i];
+		ExpressionNode* argument = ast_node(expr->arguments[i]);
+		if (is_array_type(parameter_type) || is_map_type(parameter_type)) {
+			// Arrays and maps are passed by reference: no conversion between int[] and float[]
+			check_value(checker, argument);
+			if (argument->type != parameter_type) {
+				type_error(checker, "Argument %d of %s expects %s but got %s", i + 1, expr->variable,
+					value_type_name(parameter_type), value_type_name(argument->type));
+			}
+			continue;
+		}
+		char target[64];
+		snprintf(target, sizeof(target), "Argument %d of %s", i + 1, expr->variable);
+		expr->arguments[i] = ast_index(check_stored(checker, argument, parameter_type, class_of_type(checker, parameter_type, param->type), target));
+	}
+	expr->type = callee->result_type;
+	expr->class_type = class_of_type(checker, callee->result_type, callee->return_type);
+}
+
+// Receiver of a member access or member call: a reference to an object of a known class
+static ClassNode* check_receiver(TypeChecker* checker, ExpressionNode* expr) {
+	ExpressionNode* receiver = ast_node(expr->left);
+	check_value(checker, receiver);
+	if (receiver->type != VALUE_OBJECT || receiver->class_type == NULL) {
+		type_error(checker, "Member %s of %s, which is not an object", expr->variable, value_type_name(receiver->type));
+		return NULL;
+	}
+	return receiver->class_type;
+}
+
+// Array operand of an element or a builtin: an int[] or float[] variable
+static void check_array(TypeChecker* checker, ExpressionNode* expr, const char* context) {
+	check_value(checker, expr);
+	if (!is_array_type(expr->type)) {
+		type_error(checker, "%s expects an array but got %s", context, value_type_name(expr->type));
+	}
+}
+
+// Builtins on maps: len, contains and remove (see map.h)
+static void check_map_builtin(TypeChecker* checker, ExpressionNode* expr) {
+	uint32_t* arguments = expr->arguments;
+	expr->type = VALUE_INT;
+	if (expr->builtin == BUILTIN_LEN) return;
+	if (expr->builtin != BUILTIN_CONTAINS && expr->builtin != BUILTIN_REMOVE) {
+		type_error(checker, "%s expects an array but got %s", expr->variable, value_type_name(ast_node(arguments[0])->type));
+		return;
+	}
+	check_scalar(checker, ast_node(arguments[1]));
+	if (ast_node(arguments[1])->type != VALUE_INT) {
+		type_error(checker, "%s() expects an int key", expr->variable);
+	}
+}
+
+// Builtins on strings: len, compare, concat, substring, find, lower and upper (see text.h)
+static void check_string_builtin(TypeChecker* checker, ExpressionNode* expr) {
+	uint32_t* arguments = expr->arguments;
+	switch (expr->builtin) {
+	case BUILTIN_LEN:
+		expr->type = VALUE_INT;
+		break;
+	case BUILTIN_COMPARE:
+	case BUILTIN_CONCAT:
+	case BUILTIN_FIND:
+		check_value(checker, ast_node(arguments[1]));
+		if (ast_node(arguments[1])->type != VALUE_STRING) {
+			type_error(checker, "%s() of string and %s", expr->variable, value_type_name(ast_node(arguments[1])->type));
+		}
+		expr->type = expr->builtin == BUILTIN_CONCAT ? VALUE_STRING : VALUE_INT;
+		break;
+	case BUILTIN_SUBSTRING:
+		for (int i = 1; i < 3; i++) {
+			check_scalar(checker, ast_node(arguments[i]));
+			if (ast_node(arguments[i])->type != VALUE_INT) {
+				type_error(checker, "substring() expects an int start and length");
+			}
+		}
+		expr->type = VALUE_STRING;
+		break;
+	case BUILTIN_LOWER:
+	case BUILTIN_UPPER:
+		expr->type = VALUE_STRING;
+		break;
+	default:
+		type_error(checker, "%s expects an array but got string", expr->variable);
+		expr->type = VALUE_INT;
+		break;
+	}
+}
+
+// Builtins: array operations (see array.h), map and string operations
+static void check_builtin(TypeChecker* checker, ExpressionNode* expr) {
+	uint32_t* arguments = expr->arguments;
+	check_value(checker, ast_node(arguments[0]));
+	if (is_map_type(ast_node(arguments[0])->type)) {
+		check_map_builtin(checker, expr);
+		return;
+	}
+	if (ast_node(arguments[0])->type == VALUE_STRING) {
+		check_string_builtin(checker, expr);
+		return;
+	}
+	if (expr->builtin == BUILTIN_CONTAINS || expr->builtin == BUILTIN_REMOVE) {
+		type_error(checker, "%s expects a map but got %s", expr->variable, value_type_name(ast_node(arguments[0])->type));
+		expr->type = VALUE_INT;
+		return;
+	}
+	if (expr->builtin >= BUILTIN_COMPARE) {
+		type_error(checker, "%s expects a string but got %s", expr->variable, value_type_name(ast_node(arguments[0])->type));
+		expr->type = VALUE_INT;
+		return;
+	}
+	check_array(checker, ast_node(arguments[0]), expr->variable);
+	ValueType array_type = ast_node(arguments[0])->type;
+	ValueType element_type = array_element_type(array_type);
+
+	switch (expr->builtin) {
+	case BUILTIN_LEN:
+		expr->type = VALUE_INT;
+		break;
+	case BUILTIN_RESIZE:
+		check_scalar(checker, ast_node(arguments[1]));
+		if (ast_node(arguments[1])->type != VALUE_INT) {
+			type_error(checker, "resize() expects an int length");
+		}
+		expr->type = VALUE_INT;
+		break;
+	case BUILTIN_SCALE:
+	case BUILTIN_FILL:
+		check_scalar(checker, ast_node(arguments[1]));
+		arguments[1] = ast_index(convert_to(ast_node(arguments[1]), element_type));
+		expr->type = VALUE_INT;
+		break;
+	case BUILTIN_DOT:
+	case BUILTIN_COPY:
+		check_array(checker, ast_node(arguments[1]), expr->variable);
+		if (ast_node(arguments[1])->type != array_type) {
+			type_error(checker, "%s() of %s and %s", expr->variable, value_type_name(array_type), value_type_name(ast_node(arguments[1])->type));
+		}
+		expr->type = expr->builtin == BUILTIN_DOT ? element_type : VALUE_INT;
+		break;
+	default:
+		expr->type = element_type;  // sum, min, max
+		break;
+	}
+}
+
+// Builtins that only have a side effect, like void methods
+static int is_void_builtin(BuiltinFunction builtin) {
+	return builtin == BUILTIN_RESIZE || builtin == BUILTIN_SCALE || builtin == BUILTIN_FILL || builtin == BUILTIN_COPY;
+}
+
+static void check_expression(TypeChecker* checker, ExpressionNode* expr) {
+	switch (expr->kind) {
+	case EXPR_CONSTANT:
+		expr->type = expr->value.type;
+		break;
+
+	case EXPR_VARIABLE:
+		expr->type = variable_type(checker, expr->variable, expr->slot);
+		expr->class_type = variable_class(checker, expr);
+		break;
+
+	case EXPR_NEW:
+		expr->type = VALUE_OBJECT;
+		break;
+
+	case EXPR_MEMBER: {
+		// The field index is resolved against the receiver's class (see member_field_index)
+		expr->type = VALUE_INT;
+		ClassNode* receiver_class = check_receiver(checker, expr);
+		if (receiver_class == NULL) break;
+		expr->field = find_field(receiver_class, expr->variable);
+		if (expr->field < 0) {
+			type_error(checker, "Class %s has no field %s", receiver_class->class_name, expr->variable);
+			break;
+		}
+		Field* field = receiver_class->field_table[expr->field];
+		if (is_array_type(field->value.type) || is_map_type(field->value.type)) {
+			type_error(checker, "%s field %s can't be reached through a reference", is_map_type(field->value.type) ? "Map" : "Array", expr->variable);
+		}
+		expr->type = field->value.type;
+		expr->class_type = class_of_type(checker, field->value.type, field->type);
+		break;
+	}
+
+	case EXPR_MEMBER_CALL: {
+		// `field` holds the vtable slot the call dispatches through
+		expr->type = VALUE_INT;
+		ClassNode* receiver_class = check_receiver(checker, expr);
+		if (receiver_class == NULL) break;
+		expr->field = find_method_slot(receiver_class, expr->variable);
+		if (expr->field < 0) {
+			type_error(checker, "Class %s has no method %s", receiver_class->class_name, expr->variable);
+			break;
+		}
+		expr->callee = receiver_class->method_table[expr->field];
+		if (expr->argument_count != expr->callee->parameter_count) {
+			type_error(checker, "Method %s expects %d arguments but got %d", expr->variable, expr->callee->parameter_count, expr->argument_count);
+			break;
+		}
+		check_arguments(checker, expr, expr->callee);
+		break;
+	}
+
+	case EXPR_BINARY_OBJECT:
+	case EXPR_MAP_GET:
+	case EXPR_BINARY_STRING:
+	case EXPR_APPEND:
+		break;  // Already checked
+
+	case EXPR_BINARY:
+	case EXPR_BINARY_INT:
+	case EXPR_BINARY_FLOAT: {
+		ExpressionNode* left = ast_node(expr->left);
+		ExpressionNode* right = ast_node(expr->right);
+		check_value(checker, left);
+		check_value(checker, right);
+		if (left->type == VALUE_OBJECT || right->type == VALUE_OBJECT) {
+			// References only compare for identity
+			if (left->type != right->type || (expr->op != OP_EQUAL && expr->op != OP_NOT_EQUAL)) {
+				type_error(checker, "Operator %s on %s and %s", expr->variable, value_type_name(left->type), value_type_name(right->type));
+			}
+			expr->kind = EXPR_BINARY_OBJECT;
+			expr->type = VALUE_INT;
+			break;
+		}
+		if (left->type == VALUE_STRING || right->type == VALUE_STRING) {
+			// Strings concatenate with + and compare bytewise
+			if (left->type != right->type || (expr->op != OP_ADD && !is_comparison_operator(expr->op))) {
+				type_error(checker, "Operator %s on %s and %s", expr->variable, value_type_name(left->type), value_type_name(right->type));
+			}
+			expr->kind = EXPR_BINARY_STRING;
+			expr->type = expr->op == OP_ADD ? VALUE_STRING : VALUE_INT;
+			break;
+		}
+		check_scalar(checker, left);
+		check_scalar(checker, right);
+
+		// int op int stays int; anything else promotes both operands to float
+		ValueType operand_type = left->type == VALUE_INT && right->type == VALUE_INT ? VALUE_INT : VALUE_FLOAT;
+		expr->left = ast_index(convert_to(left, operand_type));
+		expr->right = ast_index(convert_to(right, operand_type));
+		expr->kind = operand_type == VALUE_INT ? EXPR_BINARY_INT : EXPR_BINARY_FLOAT;
+		expr->type = is_comparison_operator(expr->op) ? VALUE_INT : operand_type;
+		break;
+	}
+
+	case EXPR_CALL:
+		check_arguments(checker, expr, expr->callee);
+		break;
+
+	case EXPR_BUILTIN:
+		check_builtin(checker, expr);
+		break;
+
+	case EXPR_INDEX:
+	case EXPR_INDEX_UNCHECKED: {
+		ExpressionNode* container = ast_node(expr->left);
+		ExpressionNode* key = ast_node(expr->right);
+		check_value(checker, container);
+		if (is_map_type(container->type)) {
+			// m[key] is an entry of the map, zero while the key is missing
+			check_scalar(checker, key);
+			if (key->type != VALUE_INT) {
+				type_error(checker, "Key of map %s must be an int", container->variable);
+			}
+			expr->kind = EXPR_MAP_GET;
+			expr->type = map_value_type(container->type);
+			break;
+		}
+		check_array(checker, container, "Indexing");
+		check_scalar(checker, key);
+		if (key->type != VALUE_INT) {
+			type_error(checker, "Array index of %s must be an int", container->variable);
+		}
+		expr->type = array_element_type(container->type);
+		break;
+	}
+
+	case EXPR_CONVERT:
+		check_scalar(checker, ast_node(expr->left));
+		expr->type = expr->value.type;
+		break;
+
+	case EXPR_ASSIGN:
+		type_error(checker, "Assignment to %s used as a value", expr->variable);
+		break;
+
+	case EXPR_YIELD:
+		// The host resumes with a value of the yielded type
+		check_scalar(checker, ast_node(expr->left));
+		expr->type = ast_node(expr->left)->type;
+		break;
+	}
+}
+
+// Check an expression whose result is used: it must produce a value
+static void check_value(TypeChecker* checker, ExpressionNode* expr) {
+	check_expression(checker, expr);
+	if ((expr->kind == EXPR_CALL || expr->kind == EXPR_MEMBER_CALL) && expr->callee != NULL && strcmp(expr->callee->return_type, "void") == 0) {
+		type_error(checker, "void method %s used as a value", expr->variable);
+	}
+	if (expr->kind == EXPR_BUILTIN && is_void_builtin(expr->builtin)) {
+		type_error(checker, "%s() used as a value", expr->variable);
+	}
+}
+
+// Check an expression used as a number: arrays only appear as elements, builtin and call
+// arguments, references in stores, arguments, results and comparisons
+static void check_scalar(TypeChecker* checker, ExpressionNode* expr) {
+	check_value(checker, expr);
+	if (is_array_type(expr->type)) {
+		type_error(checker, "Array %s used as a number", expr->variable ? expr->variable : "");
+	}
+	if (is_map_type(expr->type)) {
+		type_error(checker, "Map %s used as a number", expr->variable ? expr->variable : "");
+	}
+	if (expr->type == VALUE_OBJECT) {
+		type_error(checker, "Object %s used as a number", expr->variable ? expr->variable : "null");
+	}
+	if (expr->type == VALUE_STRING) {
+		type_error(checker, "String %s used as a number", expr->variable ? expr->variable : "literal");
+	}
+}
+
+// Does evaluating the expression run a call, a yield or an allocation?
+static int contains_call(ExpressionNode* expr) {
+	if (expr == NULL) return 0;
+	if (expr->kind == EXPR_CALL || expr->kind == EXPR_MEMBER_CALL || expr->kind == EXPR_YIELD || expr->kind == EXPR_NEW) return 1;
+	for (int i = 0; i < expr->argument_count; i++) {
+		if (contains_call(ast_node(expr->arguments[i]))) return 1;
+	}
+	return contains_call(ast_node(expr->left)) || contains_call(ast_node(expr->right)) || contains_call(ast_node(expr->assigned));
+}
+
+// `s = s + e` on a string variable becomes an append (see append_string), which reads s
+// after e: only when e can't run anything that would store over s
+static void mark_append(ExpressionNode* assignment) {
+	ExpressionNode* value = ast_node(assignment->assigned);
+	if (value->kind != EXPR_BINARY_STRING || value->op != OP_ADD) return;
+	ExpressionNode* head = ast_node(value->left);
+	if (head->kind != EXPR_VARIABLE || head->slot != assignment->slot || head->field != assignment->field) return;
+	if (contains_call(ast_node(value->right))) return;
+	value->kind = EXPR_APPEND;
+}
+
+// Conditions are ints: a float condition becomes `condition != 0.0`
+static ExpressionNode* check_condition(TypeChecker* checker, ExpressionNode* condition) {
+	check_scalar(checker, condition);
+	if (condition->type == VALUE_INT) return condition;
+
+	ExpressionNode* compare = new_typed_node(EXPR_BINARY_FLOAT, VALUE_INT);
+	compare->variable = intern_name("!=");
+	compare->op = OP_NOT_EQUAL;
+	compare->left = ast_index(condition);
+	compare->right = ast_index(new_typed_node(EXPR_CONSTANT, VALUE_FLOAT));
+	return compare;
+}
+
+static void check_block(TypeChecker* checker, BlockNode* block) {
+	for (BlockNode* current = block; current != NULL; current = current->next) {
+		ExpressionNode* expr = current->expression;
+		switch (current->node_type) {
+		case NODE_ASSIGNMENT:
+			if (expr->left != EXPR_NONE) {
+				// Element of an array or field of an object: the target has its type
+				ExpressionNode* target = ast_node(expr->left);
+				check_expression(checker, target);
+				expr->type = target->type;
+				expr->class_type = target->class_type;
+			}
+			else {
+				expr->type = variable_type(checker, expr->variable, expr->slot);
+				expr->class_type = variable_class(checker, expr);
+				if (is_array_type(expr->type)) {
+					type_error(checker, "Cannot assign to array %s, use copy()", expr->variable);
+				}
+				if (is_map_type(expr->type)) {
+					type_error(checker, "Cannot assign to map %s", expr->variable);
+				}
+			}
+			expr->assigned = ast_index(check_stored(checker, ast_node(expr->assigned), expr->type, expr->class_type, "Assignment"));
+			if (expr->left == EXPR_NONE && expr->type == VALUE_STRING) {
+				mark_append(expr);
+			}
+			break;
+		case NODE_EXPRESSION:
+			check_expression(checker, expr);  // A call statement may discard (or lack) a result
+			break;
+		case NODE_DECLARATION:
+			expr->type = expr->value.type;
+			if (expr->assigned != EXPR_NONE && (is_array_type(expr->type) || is_map_type(expr->type))) {
+				type_error(checker, "%s %s can't have an initializer", is_map_type(expr->type) ? "Map" : "Array", expr->variable);
+			}
+			else if (expr->assigned != EXPR_NONE) {
+				expr->assigned = ast_index(check_stored(checker, ast_node(expr->assigned), expr->type, expr->class_type, expr->variable));
+			}
+			break;
+		case NODE_IF:
+			current->ifNode->condition = check_condition(checker, current->ifNode->condition);
+			check_block(checker, current->ifNode->trueBlock);
+			check_block(checker, current->ifNode->falseBlock);
+			break;
+		case NODE_FOR: {
+			ForNode* for_node = current->forNode;
+			ExpressionNode* initializer = for_node->initializer;
+			initializer->type = initializer->value.type;
+			check_scalar(checker, ast_node(initializer->assigned));
+			initializer->assigned = ast_index(convert_to(ast_node(initializer->assigned), initializer->type));
+			for_node->condition = check_condition(checker, for_node->condition);
+			for_node->update->type = variable_type(checker, for_node->update->variable, for_node->update->slot);
+			if (is_array_type(for_node->update->type) || is_map_type(for_node->update->type) || for_node->update->type == VALUE_OBJECT || for_node->update->type == VALUE_STRING) {
+				type_error(checker, "Cannot increment %s %s", value_type_name(for_node->update->type), for_node->update->variable);
+			}
+			check_block(checker, for_node->body);
+			break;
+		}
+		case NODE_RETURN:
+			if (expr != NULL) {
+				Method* method = checker->method;
+				current->expression = check_stored(checker, expr, method->result_type, class_of_type(checker, method->result_type, method->return_type), "Return");
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void check_class(ClassNode* class_node) {
+	TypeChecker checker;
+	checker.class_node = class_node;
+	checker.method = NULL;
+	checker.error_count = 0;
+
+	for (Field* field = class_node->fields; field != NULL; field = field->next) {
+		if (!is_known_type(&checker, field->type)) {
+			type_error(&checker, "Unknown type %s of field %s", field->type, field->name);
+		}
+		if (field->value.type == VALUE_OBJECT) {
+			class_node->uses_references = 1;
+		}
+	}
+	// Objects of a derived class hold the base class's references too
+	if (class_node->base != NULL && class_node->base->uses_references) {
+		class_node->uses_references = 1;
+	}
+
+	for (Method* method = class_node->methods; method != NULL; method = method->next) {
+		checker.method = method;
+		if (strcmp(method->return_type, "void") != 0 && !is_known_type(&checker, method->return_type)) {
+			type_error(&checker, "Unknown return type %s", method->return_type);
+		}
+		for (ParameterNode* param = method->parameters; param != NULL; param = param->next) {
+			if (!is_known_type(&checker, param->type)) {
+				type_error(&checker, "Unknown type %s of parameter %s", param->type, param->name);
+			}
+		}
+		check_block(&checker, method->body);
+	}
+
+	if (checker.error_count > 0) {
+		script_error("%d type error(s) in class %s", checker.error_count, class_node->class_name);
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "parse.h"  // Include parse.h to access the AST structures
+
+// Static type checking, run by parse_class once resolve_class has bound every
+// local to a frame slot and every call to its method, and before the optimizer
+
+// Annotate every expression with its static type (ExpressionNode::type) and
+// make every implicit conversion explicit, so the executor never tests a tag:
+// - operands of a binary operator are converted to a common type and the node
+//   becomes EXPR_BINARY_INT or EXPR_BINARY_FLOAT
+// - assigned values, initializers, arguments and returned values are converted
+//   to the declared type of their destination
+// - float conditions are compared against 0.0, so every condition is an int
+// Mismatches (such as using the result of a void method) are reported for the
+// whole class before exiting.
+void check_class(ClassNode* class_node);
@@ -0,0 +1,132 @@
+#include "value.h"
+#include "array.h"
+#include "map.h"
+#include "text.h"
+
+#include <stdio.h>
+#include <string.h>
+
+ValueType value_type_from_name(const char* type_name) {
+	if (type_name == NULL) return VALUE_INT;
+	const char* bracket = strchr(type_name, '[');
+	size_t base_length = bracket ? (size_t)(bracket - type_name) : strlen(type_name);
+	ValueType base = base_length == 5 && strncmp(type_name, "float", 5) == 0 ? VALUE_FLOAT : VALUE_INT;
+	if (bracket && strcmp(bracket, "[int]") == 0) return base == VALUE_FLOAT ? VALUE_FLOAT_MAP : VALUE_INT_MAP;
+	if (bracket) return array_type_of(base);
+	if (strcmp(type_name, "string") == 0) return VALUE_STRING;
+	if (base == VALUE_INT && strcmp(type_name, "int") != 0 && strcmp(type_name, "void") != 0) return VALUE_OBJECT;
+	return base;
+}
+
+const char* value_type_name(ValueType type) {
+	switch (type) {
+	case VALUE_FLOAT: return "float";
+	case VALUE_INT_ARRAY: return "int[]";
+	case VALUE_FLOAT_ARRAY: return "float[]";
+	case VALUE_OBJECT: return "object";
+	case VALUE_INT_MAP: return "int[int]";
+	case VALUE_FLOAT_MAP: return "float[int]";
+	case VALUE_STRING: return "string";
+	default: return "int";
+	}
+}
+
+const char* value_kind_name(ValueType type) {
+	if (type == VALUE_OBJECT) return "an object";
+	if (type == VALUE_INT_ARRAY) return "an int[]";
+	if (type == VALUE_FLOAT_ARRAY) return "a float[]";
+	if (type == VALUE_INT_MAP) return "an int[int]";
+	if (type == VALUE_FLOAT_MAP) return "a float[int]";
+	return type == VALUE_STRING ? "a string" : "a number";
+}
+
+int apply_binary_operator(BinaryOperator op, Value left, Value right, Value* result) {
+	if (left.type == VALUE_INT && right.type == VALUE_INT) {
+		int l = left.as.i;
+		int r = right.as.i;
+		switch (op) {
+		case OP_ADD: *result = make_int(l + r); return 1;
+		case OP_SUBTRACT: *result = make_int(l - r); return 1;
+		case OP_MULTIPLY: *result = make_int(l * r); return 1;
+		case OP_DIVIDE:
+			if (r == 0) return 0;
+			*result = make_int(l / r);
+			return 1;
+		case OP_LESS: *result = make_int(l < r); return 1;
+		case OP_GREATER: *result = make_int(l > r); return 1;
+		case OP_LESS_EQUAL: *result = make_int(l <= r); return 1;
+		case OP_GREATER_EQUAL: *result = make_int(l >= r); return 1;
+		case OP_EQUAL: *result = make_int(l == r); return 1;
+		case OP_NOT_EQUAL: *result = make_int(l != r); return 1;
+		}
+		return 0;
+	}
+
+	// Mixed or float operands: promote both sides to float
+	float l = value_to_float(left);
+	float r = value_to_float(right);
+	switch (op) {
+	case OP_ADD: *result = make_float(l + r); return 1;
+	case OP_SUBTRACT: *result = make_float(l - r); return 1;
+	case OP_MULTIPLY: *result = make_float(l * r); return 1;
+	case OP_DIVIDE: *result = make_float(l / r); return 1;
+	case OP_LESS: *result = make_int(l < r); return 1;
+	case OP_GREATER: *result = make_int(l > r); return 1;
+	case OP_LESS_EQUAL: *result = make_int(l <= r); return 1;
+	case OP_GREATER_EQUAL: *result = make_int(l >= r); return 1;
+	case OP_EQUAL: *result = make_int(l == r); return 1;
+	case OP_NOT_EQUAL: *result = make_int(l != r); return 1;
+	}
+	return 0;
+}
+
+int value_is_true(Value value) {
+	if (is_array_type(value.type)) return value.as.a != NULL;
+	if (value.type == VALUE_OBJECT) return value.as.o != NULL;
+	if (is_map_type(value.type)) return value.as.m != NULL;
+	if (value.type == VALUE_STRING) return string_length(value) > 0;
+	return value.type == VALUE_INT ? value.as.i != 0 : value.as.f != 0.0f;
+}
+
+void print_value(Value value) {
+	if (is_array_type(value.type)) {
+		// Arrays print their elements: [1, 2, 3]
+		const Array* array = value.as.a;
+		printf("[");
+		for (int i = 0; array != NULL && i < array->length; i++) {
+			if (i > 0) printf(", ");
+			if (array->element_type == VALUE_FLOAT) printf("%g", ((const float*)array->data)[i]);
+			else printf("%d", ((const int*)array->data)[i]);
+		}
+		printf("]");
+	}
+	else if (is_map_type(value.type)) {
+		// Maps print their entries in table order: {1: 2, 7: 3}
+		const Map* map = value.as.m;
+		printf("{");
+		int first = 1;
+		for (int i = 0; map != NULL && i < map->capacity; i++) {
+			const MapSlot* slot = &map->slots[i];
+			if (slot->distance == 0) continue;
+			printf(first ? "%d: " : ", %d: ", slot->key);
+			if (map->value_type == VALUE_FLOAT) printf("%g", slot->value.f);
+			else printf("%d", slot->value.i);
+			first = 0;
+		}
+		printf("}");
+	}
+	else if (value.type == VALUE_OBJECT) {
+		printf(value.as.o != NULL ? "object" : "null");
+	}
+	else if (value.type == VALUE_STRING) {
+		int length;
+		const char* chars = string_chars(&value, &length);
+		printf("%.*s", length, chars);
+	}
+	else if (value.type == VALUE_FLOAT) {
+		printf("%g", value.as.f);
+	}
+	else {
+		printf("%d", value.as.i);
+	}
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <stddef.h>  // NULL
+
+#ifdef _MSC_VER
+#define VALUE_INLINE static __inline
+#else
+#define VALUE_INLINE static inline
+#endif
+
+// Type tag of a script value
+typedef enum {
+	VALUE_INT,          // 32-bit signed integer
+	VALUE_FLOAT,        // 32-bit float
+	VALUE_INT_ARRAY,    // Reference to an Array of ints (see array.h)
+	VALUE_FLOAT_ARRAY,  // Reference to an Array of floats
+	VALUE_OBJECT,       // Reference to an Object made by `new` (see gc.h), or null
+	VALUE_INT_MAP,      // Reference to a Map from int keys to ints (see map.h)
+	VALUE_FLOAT_MAP,    // Reference to a Map from int keys to floats
+	VALUE_STRING,       // Immutable string, short ones stored inline (see text.h)
+} ValueType;
+
+struct Array;
+struct Object;
+struct Map;
+struct String;
+
+// Unboxed script value: the payload is stored inline next to its tag, so
+// fields, frame slots and expression results never need a heap allocation
+// (arrays, maps, objects and long strings are the exception: the slot holds a reference to them)
+typedef struct Value {
+	ValueType type;
+	union {
+		int i;
+		float f;
+		struct Array* a;
+		struct Object* o;
+		struct Map* m;
+		struct String* s;  // A string longer than fits in `small`, NULL for the empty string
+		char small[8];     // A short string: (length << 1) | 1, then its bytes (see text.h)
+	} as;
+} Value;
+
+// Binary operators, arithmetic first, then comparisons
+typedef enum {
+	OP_ADD,            // +
+	OP_SUBTRACT,       // -
+	OP_MULTIPLY,       // *
+	OP_DIVIDE,         // /
+	OP_LESS,           // <
+	OP_GREATER,        // >
+	OP_LESS_EQUAL,     // <=
+	OP_GREATER_EQUAL,  // >=
+	OP_EQUAL,          // ==
+	OP_NOT_EQUAL,      // !=
+} BinaryOperator;
+
+// Comparisons always yield an int (0 or 1), whatever the operand type
+VALUE_INLINE int is_comparison_operator(BinaryOperator op) {
+	return op >= OP_LESS;
+}
+
+VALUE_INLINE Value make_int(int i) {
+	Value value;
+	value.type = VALUE_INT;
+	value.as.i = i;
+	return value;
+}
+
+VALUE_INLINE Value make_float(float f) {
+	Value value;
+	value.type = VALUE_FLOAT;
+	value.as.f = f;
+	return value;
+}
+
+VALUE_INLINE int is_array_type(ValueType type) {
+	return type == VALUE_INT_ARRAY || type == VALUE_FLOAT_ARRAY;
+}
+
+// Element type of an array type (int[] -> int)
+VALUE_INLINE ValueType array_element_type(ValueType type) {
+	return type == VALUE_FLOAT_ARRAY ? VALUE_FLOAT : VALUE_INT;
+}
+
+VALUE_INLINE ValueType array_type_of(ValueType element_type) {
+	return element_type == VALUE_FLOAT ? VALUE_FLOAT_ARRAY : VALUE_INT_ARRAY;
+}
+
+VALUE_INLINE int is_map_type(ValueType type) {
+	return type == VALUE_INT_MAP || type == VALUE_FLOAT_MAP;
+}
+
+// Value type of a map type (float[int] -> float)
+VALUE_INLINE ValueType map_value_type(ValueType type) {
+	return type == VALUE_FLOAT_MAP ? VALUE_FLOAT : VALUE_INT;
+}
+
+VALUE_INLINE Value make_array(ValueType type, struct Array* array) {
+	Value value;
+	value.type = type;
+	value.as.a = array;
+	return value;
+}
+
+VALUE_INLINE Value make_map(ValueType type, struct Map* map) {
+	Value value;
+	value.type = type;
+	value.as.m = map;
+	return value;
+}
+
+VALUE_INLINE Value make_object(struct Object* obj) {
+	Value value;
+	value.type = VALUE_OBJECT;
+	value.as.o = obj;
+	return value;
+}
+
+// The empty string (text.h makes the others)
+VALUE_INLINE Value make_empty_string() {
+	Value value;
+	value.type = VALUE_STRING;
+	value.as.s = NULL;
+	return value;
+}
+
+VALUE_INLINE int value_to_int(Value value) {
+	return value.type == VALUE_INT ? value.as.i : (int)value.as.f;
+}
+
+VALUE_INLINE float value_to_float(Value value) {
+	return value.type == VALUE_FLOAT ? value.as.f : (float)value.as.i;
+}
+
+// Convert a value to the given type (C conversion rules: float to int truncates).
+// Arrays, maps, references and strings are never converted; check_class rejects such conversions.
+VALUE_INLINE Value value_convert(Value value, ValueType type) {
+	if (value.type == type || is_array_type(type) || is_map_type(type) || type == VALUE_OBJECT || type == VALUE_STRING) return value;
+	return type == VALUE_INT ? make_int(value_to_int(value)) : make_float(value_to_float(value));
+}
+
+// Zero of the given type (a null reference for arrays, maps and objects, the empty string)
+VALUE_INLINE Value value_zero(ValueType type) {
+	if (is_array_type(type)) return make_array(type, NULL);
+	if (is_map_type(type)) return make_map(type, NULL);
+	if (type == VALUE_OBJECT) return make_object(NULL);
+	if (type == VALUE_STRING) return make_empty_string();
+	return type == VALUE_INT ? make_int(0) : make_float(0.0f);
+}
+
+// Can the host pass `value` where a `type` is expected? Numbers convert into each
+// other, but neither into a reference or a string nor the other way around. An array
+// or a map only goes where its own type is expected.
+VALUE_INLINE int value_kind_matches(Value value, ValueType type) {
+	if (is_array_type(value.type) || is_array_type(type)) return value.type == type;
+	if (is_map_type(value.type) || is_map_type(type)) return value.type == type;
+	return (value.type == VALUE_OBJECT) == (type == VALUE_OBJECT) && (value.type == VALUE_STRING) == (type == VALUE_STRING);
+}
+
+// Value functions
+
+// Map a declared type name ("int", "float", "string", "int[]", "float[16]", "int[int]") to its tag;
+// "void" is int and any other name is a class, so a reference (check_class rejects unknown classes)
+ValueType value_type_from_name(const char* type_name);
+const char* value_type_name(ValueType type);
+// "an object", "a string", "an int[]", "a float[int]"... or "a number", for errors about host values (see value_kind_matches)
+const char* value_kind_name(ValueType type);
+
+// Apply a binary operator with C's mixed int/float rules: int op int stays int,
+// otherwise both sides are promoted to float; comparisons always yield int.
+// Returns 0 (leaving result untouched) for an integer division by zero or an unknown operator.
+int apply_binary_operator(BinaryOperator op, Value left, Value right, Value* result);
+
+int value_is_true(Value value);
+void print_value(Value value);
@@ -16,6 +16,9 @@ project "vfScript"
 
    defines { "_CRT_SECURE_NO_WARNINGS" }
 
+   filter "system:linux"
+      links { "dl", "pthread" }  -- dlopen for AOT-compiled classes, threads for the worker pool
+
    filter "configurations:Debug"
       defines { "DEBUG" }
       symbols "On"